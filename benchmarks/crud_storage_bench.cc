@@ -0,0 +1,105 @@
+// Measures POST/GET/PUT/DELETE throughput through crud_handler with the
+// file-per-entity backend versus the log-structured store, and the rate at
+// which the same entities are created by one NDJSON _import request.
+//
+// Usage: ./bin/crud_storage_bench [entities]
+
+#include <chrono>
+#include <cstdlib>
+#include <filesystem>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+#include <boost/beast/http.hpp>
+#include "crud_handler.h"
+#include "file_io.h"
+#include "log_file_io.h"
+#include "logger.h"
+
+namespace http = boost::beast::http;
+
+static http::request<http::string_body> make_request(http::verb method, const std::string& target, const std::string& body) {
+  http::request<http::string_body> request;
+  request.method(method);
+  request.target(target);
+  request.version(11);
+  if (!body.empty()) {
+    request.set(http::field::content_type, "application/json");
+    request.body() = body;
+    request.prepare_payload();
+  }
+  return request;
+}
+
+static double ops_per_second(std::chrono::steady_clock::time_point start, size_t ops) {
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  return ops / seconds;
+}
+
+static void run(const std::string& name, crud_handler& handler, int entities) {
+  std::string body = "{\"name\": \"bench\", \"size\": 10, \"tags\": [\"a\", \"b\", \"c\"]}";
+  std::vector<std::string> ids;
+
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < entities; i++) {
+    auto response = handler.handle_request(make_request(http::verb::post, "/api/bench", body));
+    // Response body is {"id": "<id>"}.
+    ids.push_back(response.body().substr(8, response.body().size() - 10));
+  }
+  double post = ops_per_second(start, entities);
+
+  start = std::chrono::steady_clock::now();
+  for (const auto& id : ids) {
+    handler.handle_request(make_request(http::verb::get, "/api/bench/" + id, ""));
+  }
+  double get = ops_per_second(start, entities);
+
+  start = std::chrono::steady_clock::now();
+  for (const auto& id : ids) {
+    handler.handle_request(make_request(http::verb::put, "/api/bench/" + id, body));
+  }
+  double put = ops_per_second(start, entities);
+
+  start = std::chrono::steady_clock::now();
+  for (const auto& id : ids) {
+    handler.handle_request(make_request(http::verb::delete_, "/api/bench/" + id, ""));
+  }
+  double del = ops_per_second(start, entities);
+
+  std::string ndjson;
+  for (int i = 0; i < entities; i++) {
+    ndjson += body + "\n";
+  }
+  auto request = make_request(http::verb::post, "/api/bulk/_import", ndjson);
+  request.set(http::field::content_type, "application/x-ndjson");
+  start = std::chrono::steady_clock::now();
+  handler.handle_request(request);
+  double import = ops_per_second(start, entities);
+
+  std::cout << name << " ops/s: POST " << post << ", GET " << get << ", PUT " << put << ", DELETE " << del
+            << ", IMPORT " << import << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+  int entities = argc > 1 ? std::atoi(argv[1]) : 20000;
+  // crud_handler logs every request at debug level; keep that out of the timings.
+  Logger::get_global_log();
+  boost::log::core::get()->set_logging_enabled(false);
+  std::filesystem::path root = std::filesystem::temp_directory_path() / "crud_storage_bench";
+  std::filesystem::remove_all(root);
+
+  {
+    crud_handler files((root / "files").string(), std::make_shared<file_io>());
+    run("file-per-entity", files, entities);
+  }
+  {
+    std::string data_path = (root / "log").string();
+    auto store = std::make_shared<log_store>(data_path);
+    crud_handler log(data_path, std::make_shared<log_file_io>(store, data_path));
+    run("log-structured ", log, entities);
+  }
+
+  std::filesystem::remove_all(root);
+  return 0;
+}
@@ -0,0 +1,54 @@
+// Measures json_validator throughput, in GB/s, on entity bodies of typical
+// sizes: a small record, a 2KB record and a 256KB pretty-printed document.
+//
+// Usage: ./bin/json_validate_bench [seconds per case]
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include "json_validator.h"
+
+static std::string record(int i) {
+  return "{\"id\": " + std::to_string(i) + ", \"brand\": \"Nike\", \"model\": \"Air Max " + std::to_string(i) +
+         "\", \"size\": 10.5, \"in_stock\": true, \"tags\": [\"running\", \"men\", \"sale\"], \"discount\": null}";
+}
+
+static std::string document(size_t target, bool pretty) {
+  std::string text = pretty ? "[\n" : "[";
+  for (int i = 0; text.size() < target; i++) {
+    if (i > 0) {
+      text += pretty ? ",\n" : ",";
+    }
+    text += pretty ? "    " + record(i) : record(i);
+  }
+  return text + (pretty ? "\n]" : "]");
+}
+
+static void run(const std::string& name, const std::string& text, double seconds) {
+  std::string minified;
+  for (int minify = 0; minify < 2; minify++) {
+    size_t iterations = 0;
+    bool ok = true;
+    auto start = std::chrono::steady_clock::now();
+    std::chrono::duration<double> elapsed{0};
+    while (elapsed.count() < seconds) {
+      for (int i = 0; i < 64; i++) {
+        ok &= minify ? json_validator::minify(text, minified) : json_validator::validate(text);
+      }
+      iterations += 64;
+      elapsed = std::chrono::steady_clock::now() - start;
+    }
+    double gigabytes = double(iterations) * text.size() / 1e9;
+    std::cout << name << " (" << text.size() << " bytes) " << (minify ? "minify  " : "validate") << ": "
+              << gigabytes / elapsed.count() << " GB/s" << (ok ? "" : " INVALID") << std::endl;
+  }
+}
+
+int main(int argc, char* argv[]) {
+  double seconds = argc > 1 ? std::atof(argv[1]) : 1.0;
+  run("small record ", record(1), seconds);
+  run("2KB record   ", document(2 << 10, false), seconds);
+  run("256KB pretty ", document(256 << 10, true), seconds);
+  return 0;
+}
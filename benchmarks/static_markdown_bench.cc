@@ -0,0 +1,65 @@
+// Measures CPU time spent per GET of a markdown file through static_handler,
+// with the rendered-HTML cache cleared before every request versus warm.
+//
+// Usage: ./bin/static_markdown_bench [iterations]
+
+#include <chrono>
+#include <cstdlib>
+#include <ctime>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <boost/beast/http.hpp>
+#include "static_handler.h"
+#include "markdown_cache.h"
+
+namespace http = boost::beast::http;
+
+static double run(static_handler& handler, int iterations, bool clear_cache) {
+  http::request<http::string_body> request;
+  request.method(http::verb::get);
+  request.target("/bench.md");
+  request.version(11);
+
+  std::clock_t start = std::clock();
+  for (int i = 0; i < iterations; i++) {
+    if (clear_cache) {
+      markdown_cache::get_global_cache()->clear();
+    }
+    http::response<http::string_body> response = handler.handle_request(request);
+    if (response.result() != http::status::ok) {
+      std::cerr << "Unexpected status " << response.result_int() << std::endl;
+      std::exit(1);
+    }
+  }
+  return 1e6 * (std::clock() - start) / CLOCKS_PER_SEC / iterations;
+}
+
+int main(int argc, char* argv[]) {
+  int iterations = argc > 1 ? std::atoi(argv[1]) : 500;
+
+  std::filesystem::path root = std::filesystem::temp_directory_path() / "static_markdown_bench";
+  std::filesystem::create_directories(root);
+  {
+    std::ofstream doc(root / "bench.md");
+    for (int i = 0; i < 2000; i++) {
+      doc << "## Section " << i << "\n\nSome *emphasis*, **bold** text and a [link](https://example.com/" << i << ").\n\n"
+          << "- item one\n- item two\n\n```\ncode block " << i << "\n```\n\n";
+    }
+  }
+
+  static_handler handler(root.string());
+  double uncached = run(handler, iterations, true);
+  size_t renders_before = markdown_cache::get_global_cache()->renders();
+  double cached = run(handler, iterations, false);
+  size_t renders_cached = markdown_cache::get_global_cache()->renders() - renders_before;
+
+  std::cout << "iterations:            " << iterations << "\n"
+            << "uncached cpu/request:  " << uncached << " us\n"
+            << "cached cpu/request:    " << cached << " us\n"
+            << "renders while cached:  " << renders_cached << std::endl;
+
+  std::filesystem::remove_all(root);
+  return 0;
+}
@@ -0,0 +1,70 @@
+#ifndef AGGREGATE_QUERY_H
+#define AGGREGATE_QUERY_H
+
+// Server-side aggregates over the entities of a CRUD entity type, so
+//
+//   GET /api/products/_aggregate?op=sum&field=price&group_by=brand
+//
+// answers with one small object instead of the client downloading every
+// product. crud_handler runs the scan on one of its scan threads, shared by
+// every request, and only the fields the query names are pulled out of
+// each document.
+//
+// count counts entities; sum, min, max and avg fold a numeric top-level
+// field and skip entities where it is missing or not a number. Groups are
+// keyed like field_index values: strings unescaped, numbers, true, false
+// and null as written. Entities without a scalar group_by field are left
+// out.
+
+#include <cstddef>
+#include <functional>
+#include <map>
+#include <string>
+#include <string_view>
+#include <vector>
+
+class aggregate_query {
+public:
+    enum class operation { count, sum, min, max, avg };
+
+    struct group {
+        size_t count = 0;  // entities counted, or numeric values folded
+        double sum = 0;
+        double min = 0;
+        double max = 0;
+        // The aggregate the query asked for.
+        double value(operation op) const;
+    };
+
+    // Reads the entity with the given ID into data, or returns false to
+    // skip it.
+    using reader = std::function<bool(const std::string& id, std::string& data)>;
+
+    // Sets the query from op, field and group_by, or error if they do not
+    // make one.
+    bool parse(const std::string& op, const std::string& field, const std::string& group_by, std::string& error);
+
+    operation op() const { return op_; }
+    const std::string& field() const { return field_; }
+    const std::string& group_by() const { return group_by_; }
+
+    // Folds the entities with the given IDs into groups, keyed by their
+    // group_by value (or "" if the query is not grouped).
+    void run(const std::vector<std::string>& ids, const reader& read, std::map<std::string, group>& groups) const;
+
+    // Adds one entity to groups. Returns false if it was left out.
+    bool add(std::string_view json, std::map<std::string, group>& groups) const;
+
+    // Sets values[i] to the raw text of the top-level field names[i] of the
+    // JSON object json (empty if absent), without parsing anything else.
+    // Returns false if json is not an object.
+    static bool extract(std::string_view json, const std::vector<std::string_view>& names,
+                        std::vector<std::string_view>& values);
+
+private:
+    operation op_ = operation::count;
+    std::string field_;
+    std::string group_by_;
+};
+
+#endif // AGGREGATE_QUERY_H
@@ -0,0 +1,113 @@
+#ifndef ASSET_BUNDLE_H
+#define ASSET_BUNDLE_H
+
+// A packed, read-only archive of static files. A directory is packed once
+// with the asset_bundle tool into a single file holding every file's
+// contents, MIME type, ETag and (when it is smaller) a gzip variant, plus an
+// open-addressing hash index keyed by request path. A static location with
+//
+//   bundle /path/to/site.bundle;
+//
+// maps the archive and serves entries straight out of the mapping, without
+// any per-request open, stat or read.
+//
+// Layout (all integers little-endian, blobs 8-byte aligned):
+//   header | blobs (paths, types, contents, gzip variants) | records | slots
+// Each slot is 0 (empty) or 1 + the index of a record; the slot count is a
+// power of two and lookups probe linearly from hash(path).
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+class mime_types;
+struct HandlerConfig;
+
+// A file in a bundle. All views point into the mapping and stay valid for
+// the lifetime of the bundle.
+struct asset {
+    std::string_view path;
+    std::string_view content_type;
+    std::string_view etag;  // strong ETag, including the quotes
+    std::string_view data;
+    std::string_view gzip;  // empty if no smaller gzip variant was stored
+    std::int64_t mtime = 0;  // nanoseconds since the epoch
+};
+
+class asset_bundle {
+public:
+    asset_bundle() = default;
+    asset_bundle(const asset_bundle&) = delete;
+    asset_bundle& operator=(const asset_bundle&) = delete;
+    ~asset_bundle();
+
+    // Maps the bundle at path and validates its header, index and every
+    // record's bounds, so lookups never read outside the mapping.
+    bool open(const std::string& path);
+
+    // Looks up a request path such as "/static/index.html". O(1) expected.
+    bool find(std::string_view path, asset* found) const;
+
+    size_t size() const;
+    const std::string& path() const;
+
+    // Returns the bundle at path, mapping it on first use. Every handler for
+    // a location shares one mapping. Returns nullptr if it cannot be opened.
+    static std::shared_ptr<const asset_bundle> get_shared(const std::string& path);
+
+    // Maps the bundle of every static_handler location with a bundle
+    // directive. Returns false if one is missing or invalid.
+    static bool load_config(const std::vector<HandlerConfig>& handlers);
+
+    static std::uint64_t hash(std::string_view path);
+
+private:
+    friend class asset_bundle_writer;
+    struct record;
+
+    const record* records() const;
+    const std::uint32_t* slots() const;
+    std::string_view view(std::uint64_t offset, std::uint64_t length) const;
+
+    std::string path_;
+    const char* base_ = nullptr;
+    size_t length_ = 0;
+    std::uint32_t count_ = 0;
+    std::uint32_t slot_mask_ = 0;
+    std::uint64_t records_offset_ = 0;
+    std::uint64_t slots_offset_ = 0;
+};
+
+// Builds a bundle. Paths are request paths: "/" followed by the file's path
+// relative to the location's root.
+class asset_bundle_writer {
+public:
+    // Adds a file. A gzip variant is stored when it saves at least an eighth
+    // of the original size.
+    void add(const std::string& path, const std::string& content_type, std::string data, std::int64_t mtime);
+
+    // Adds every regular file under root, typed with types.
+    bool add_directory(const std::string& root, const mime_types& types);
+
+    // Writes the bundle to a temporary file and renames it over path.
+    bool write(const std::string& path) const;
+
+    size_t size() const;
+
+private:
+    struct entry {
+        std::string path;
+        std::string content_type;
+        std::string etag;
+        std::string data;
+        std::string gzip;
+        std::int64_t mtime;
+    };
+
+    std::vector<entry> entries_;
+};
+
+#endif // ASSET_BUNDLE_H
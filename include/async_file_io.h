@@ -0,0 +1,73 @@
+#ifndef ASYNC_FILE_IO_H
+#define ASYNC_FILE_IO_H
+
+// Non-blocking file operations for handlers that answer through
+// handle_request_async. Each operation returns at once and its completion
+// is posted to an io_context, so a handler waiting on the disk does not
+// hold an io thread.
+//
+// Two backends implement it: uring_file_io submits the operations to an
+// io_uring, batching everything queued since the last submission into one
+// system call, and pooled_file_io runs the blocking calls on a small thread
+// pool. create() picks io_uring when the kernel offers every operation it
+// needs and falls back to the pool otherwise.
+//
+// Writes replace a file atomically: the data goes to a hidden temporary
+// file in the same directory that is renamed over the target, so readers,
+// which take no entity locks, never see a half written file. Listings skip
+// those temporary files.
+
+#include <boost/asio/io_context.hpp>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+struct HandlerConfig;
+
+class async_file_io {
+public:
+    using completion = std::function<void(bool ok)>;
+    using read_completion = std::function<void(bool ok, std::string content)>;
+    using list_completion = std::function<void(bool ok, std::vector<std::string> names)>;
+
+    virtual ~async_file_io() = default;
+
+    // Reads the whole file.
+    virtual void read(const std::string& path, read_completion done) = 0;
+    // Replaces the file with data, creating it if needed. The parent
+    // directory must exist.
+    virtual void write(const std::string& path, std::string data, completion done) = 0;
+    // Flushes the file's data to the disk.
+    virtual void fsync(const std::string& path, completion done) = 0;
+    // Deletes the file; fails if there is none.
+    virtual void unlink(const std::string& path, completion done) = 0;
+    // Creates the directory and any missing parents. Succeeds if it exists.
+    virtual void mkdir(const std::string& path, completion done) = 0;
+    // Names of the regular files in the directory.
+    virtual void list(const std::string& path, list_completion done) = 0;
+
+    // "io_uring" or "threads".
+    virtual const char* backend() const = 0;
+
+    // An io_uring backend if the kernel supports it, otherwise a pool of
+    // threads; force_threads skips the io_uring attempt.
+    static std::shared_ptr<async_file_io> create(boost::asio::io_context& io, size_t threads = 4, bool force_threads = false);
+
+    // Checks the `async_io on|off;` directives and, if a location turns it
+    // on, creates the instance those locations share. Returns false if a
+    // value is unknown or async_io is combined with compress or file_cache,
+    // which it would bypass.
+    static bool load_config(const std::vector<HandlerConfig>& handlers, boost::asio::io_context& io);
+    // The shared instance, or nullptr if no location uses async_io.
+    static std::shared_ptr<async_file_io> get_shared();
+    // Replaces the shared instance; the server drops it on shutdown.
+    static void set_shared(std::shared_ptr<async_file_io> files);
+
+protected:
+    // "<dir>/.<name>.tmp-<n>", unique within the process.
+    static std::string temporary_path(const std::string& path);
+    static bool is_temporary(const std::string& name);
+};
+
+#endif // ASYNC_FILE_IO_H
@@ -0,0 +1,32 @@
+#ifndef BOUNDED_POOL_H
+#define BOUNDED_POOL_H
+
+// A few worker threads for requests too slow to answer on an io thread,
+// such as the pages of a replication snapshot. At most max_pending tasks
+// are queued or running at once; past that, post refuses the task so the
+// handler can answer 503 instead of piling up work.
+
+#include <boost/asio/thread_pool.hpp>
+#include <atomic>
+#include <cstddef>
+#include <functional>
+
+class bounded_pool {
+public:
+    bounded_pool(size_t threads, size_t max_pending);
+    // Finishes the tasks already posted.
+    ~bounded_pool();
+
+    // Runs task on a pool thread. Returns false, without running it, if
+    // max_pending tasks are already queued or running.
+    bool post(std::function<void()> task);
+    // Tasks queued or running.
+    size_t pending() const { return pending_; }
+
+private:
+    boost::asio::thread_pool pool_;
+    size_t max_pending_;
+    std::atomic<size_t> pending_{0};
+};
+
+#endif // BOUNDED_POOL_H
@@ -0,0 +1,100 @@
+#ifndef CACHINGFILEIO_H
+#define CACHINGFILEIO_H
+
+#include "i_file_io.h"
+#include <atomic>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+struct HandlerConfig;
+
+// Read-through cache on top of another backend, selected with
+// `file_cache <size>;` in a crud_handler or markdown_handler location. File
+// contents and directory listings are kept in memory, least recently used
+// first out, within the size budget. open() for reading loads the file into
+// the cache, so the read() that follows does not touch the disk again.
+//
+// The cache is kept coherent by the writes and deletes made through it,
+// which drop the file and its directory listing. Changes made to the files
+// behind its back (by another process, or by hand) are not seen until the
+// entry is evicted.
+class caching_file_io : public i_file_io {
+public:
+    // The cached contents of a location, shared by all of its handlers.
+    class cache {
+    public:
+        explicit cache(size_t budget);
+
+        std::shared_ptr<const std::string> file(const std::string& path);
+        std::shared_ptr<const std::vector<std::string>> listing(const std::string& path);
+        // Increases on every invalidate. Loads compare it before and after
+        // reading the backend and only cache what no change could have raced.
+        std::uint64_t generation();
+        void put_file(const std::string& path, std::shared_ptr<const std::string> content, std::uint64_t generation);
+        void put_listing(const std::string& path, std::shared_ptr<const std::vector<std::string>> names,
+                         std::uint64_t generation);
+        // Drops the file at path and the listing of its directory.
+        void invalidate(const std::string& path);
+
+        size_t budget() const;
+        size_t used();
+        size_t size();
+        size_t hits() const;
+        size_t misses() const;
+
+    private:
+        struct entry {
+            std::shared_ptr<const std::string> content;
+            std::shared_ptr<const std::vector<std::string>> names;
+            size_t bytes;
+            std::list<std::string>::iterator lru;
+        };
+
+        void put(const std::string& key, entry value, std::uint64_t generation);
+        void erase(const std::string& key);
+
+        std::mutex mutex_;
+        std::unordered_map<std::string, entry> entries_;
+        std::list<std::string> lru_;  // most recently used at the front
+        size_t budget_;
+        size_t used_ = 0;
+        std::uint64_t generation_ = 0;
+        std::atomic<size_t> hits_{0};
+        std::atomic<size_t> misses_{0};
+    };
+
+    caching_file_io(std::shared_ptr<i_file_io> inner, std::shared_ptr<cache> files);
+    virtual ~caching_file_io() = default;
+    bool open(const std::string& filename, std::ios_base::openmode mode) override;
+    bool write(const std::string& data) override;
+    bool close() override;
+    bool read(const std::string& filepath, std::string& content) override;
+    bool delete_file(const std::string& filepath) override;
+    bool create_directories(const std::string& path) override;
+    bool list_directories(const std::string& path, std::vector<std::string>& directories) override;
+    bool exists(const std::string& filepath) override;
+    bool version(const std::string& filepath, std::string& tag) override;
+    void write_batch(const std::vector<batch_op>& ops, std::vector<bool>& results) override;
+
+    // Wraps storage if the location has `file_cache <size>;`.
+    static std::shared_ptr<i_file_io> wrap(const HandlerConfig& config, std::shared_ptr<i_file_io> storage);
+    // Returns false if a file_cache directive is not a size or `off`.
+    static bool load_config(const std::vector<HandlerConfig>& handlers);
+    // Returns the cache for a root, created with budget on first use.
+    static std::shared_ptr<cache> get_shared(const std::string& root, size_t budget);
+
+private:
+    // Loads filepath into the cache if it is not there.
+    std::shared_ptr<const std::string> load(const std::string& filepath);
+
+    std::shared_ptr<i_file_io> inner_;
+    std::shared_ptr<cache> cache_;
+    std::string writing_;  // the file open for writing
+};
+
+#endif /* CACHINGFILEIO_H */
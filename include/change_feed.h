@@ -0,0 +1,95 @@
+#ifndef CHANGE_FEED_H
+#define CHANGE_FEED_H
+
+// An in-memory, sequenced log of the changes to each entity directory, so
+// clients can ask for what changed since the last sequence they saw instead
+// of re-listing the directory. crud_handler records every create, update
+// and delete. Watchers register a callback that runs once the directory has
+// a change past their sequence, or once their deadline passes. The writer
+// that records the change wakes them, and a background thread handles
+// deadlines, so no io thread is held while a client waits.
+//
+// Sequences are shared by every directory of a feed and start at the
+// process start time in microseconds, so they keep increasing across
+// restarts. Each directory keeps its most recent changes; a client whose
+// sequence is older than that history must list the directory again.
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+class change_feed {
+public:
+    struct change {
+        std::uint64_t sequence;
+        std::string id;
+        bool deleted;
+    };
+
+    // Keeps up to history changes per directory and up to max_watchers
+    // waiting callbacks in all.
+    explicit change_feed(size_t history = 10000, size_t max_watchers = 1024);
+    ~change_feed();
+
+    // Records a change to directory/id and wakes its watchers.
+    void record(const std::string& directory, const std::string& id, bool deleted);
+
+    // Appends up to limit changes after since to changes, oldest first, and
+    // sets next to the sequence to ask for changes after next time: the
+    // last change returned if more remain, else the newest of the feed.
+    // Returns false if changes after since have been dropped from the
+    // history.
+    bool since(const std::string& directory, std::uint64_t since, size_t limit,
+               std::vector<change>& changes, std::uint64_t& next);
+
+    // Runs notify once the directory has a change after since or at
+    // deadline, on the recording thread or the deadline thread. Runs it
+    // right away if there already is such a change. Returns false without
+    // registering if max_watchers are already waiting.
+    bool watch(const std::string& directory, std::uint64_t since,
+               std::chrono::steady_clock::time_point deadline, std::function<void()> notify);
+
+    size_t watchers();
+
+    // Returns the feed for a CRUD root, shared by every handler for it.
+    static std::shared_ptr<change_feed> get_shared(const std::string& root);
+
+private:
+    struct log {
+        std::deque<change> changes;
+        std::uint64_t start;  // changes after this are all retained
+    };
+    struct watcher {
+        std::string directory;
+        std::uint64_t since;
+        std::chrono::steady_clock::time_point deadline;
+        std::function<void()> notify;
+    };
+
+    log& log_for(const std::string& directory);
+    void deadline_loop();
+
+    size_t history_;
+    size_t max_watchers_;
+
+    std::mutex mutex_;
+    std::map<std::string, log> logs_;
+    std::uint64_t first_sequence_;
+    std::uint64_t next_sequence_;
+    std::list<watcher> watchers_;
+
+    std::condition_variable wake_;
+    bool stopping_ = false;
+    std::thread deadlines_;  // started with the first watcher
+};
+
+#endif // CHANGE_FEED_H
@@ -0,0 +1,74 @@
+#ifndef COMPRESSEDFILEIO_H
+#define COMPRESSEDFILEIO_H
+
+#include "i_file_io.h"
+#include <filesystem>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+struct HandlerConfig;
+
+// Compresses files at rest on top of another backend, selected with
+// `compress on;` in a crud_handler or markdown_handler location. Every
+// write is deflated at the fastest level and reads inflate transparently,
+// so handlers, indexes and replays see the plain file.
+//
+// Files are stored as gzip, which read_stored hands back untouched so
+// clients that accept gzip get the stored bytes without recompression.
+// With `compress_dictionary <entity>:<file> ...;` an entity directory is
+// instead compressed against a preset dictionary (small documents that
+// share keys compress much better), stored as a 0x1f 0x9e marker and a
+// zlib stream naming the dictionary by its Adler-32 ID; those are always
+// inflated on the server, as browsers cannot. Files written before
+// compression was turned on are read as they are.
+class compressed_file_io : public i_file_io {
+public:
+    // Dictionary contents by entity directory, relative to the root.
+    using dictionaries = std::map<std::string, std::string>;
+
+    explicit compressed_file_io(std::shared_ptr<i_file_io> inner, const std::string& root = "",
+                                std::shared_ptr<const dictionaries> entity_dictionaries = nullptr);
+    virtual ~compressed_file_io() = default;
+    bool open(const std::string& filename, std::ios_base::openmode mode) override;
+    bool write(const std::string& data) override;
+    bool close() override;
+    bool read(const std::string& filepath, std::string& content) override;
+    bool read_stored(const std::string& filepath, std::string& content, std::string& encoding) override;
+    bool delete_file(const std::string& filepath) override;
+    bool create_directories(const std::string& path) override;
+    bool list_directories(const std::string& path, std::vector<std::string>& directories) override;
+    bool exists(const std::string& filepath) override;
+    bool version(const std::string& filepath, std::string& tag) override;
+    // Compresses every op, then hands the batch to the inner backend.
+    void write_batch(const std::vector<batch_op>& ops, std::vector<bool>& results) override;
+
+    // Gzip of data, or with a dictionary the marked zlib stream.
+    static std::string compress(const std::string& data, const std::string* dictionary = nullptr);
+    // Decodes a stored file: any run of gzip members and dictionary
+    // streams, or plain bytes as they are. Returns false if a stream is
+    // corrupt or its dictionary is not in known.
+    static bool decompress(const std::string& stored, const dictionaries* known, std::string& data);
+    // Builds a dictionary of up to size bytes from sample files: the runs
+    // of bytes most of them share, the most valuable last.
+    static std::string train(const std::vector<std::string>& samples, size_t size = 32768);
+
+    // Wraps storage if the location has `compress on;`.
+    static std::shared_ptr<i_file_io> wrap(const HandlerConfig& config, std::shared_ptr<i_file_io> storage);
+    // Loads the dictionaries of every location with `compress on;`. Returns
+    // false if a compress directive is unknown or a dictionary unreadable.
+    static bool load_config(const std::vector<HandlerConfig>& handlers);
+
+private:
+    const std::string* dictionary_for(const std::string& path) const;
+    // The dictionaries of a location, loaded once and shared.
+    static std::shared_ptr<const dictionaries> get_dictionaries(const HandlerConfig& config);
+
+    std::shared_ptr<i_file_io> inner_;
+    std::filesystem::path root_;
+    std::shared_ptr<const dictionaries> dictionaries_;
+    std::string writing_;  // the file open for writing
+};
+
+#endif /* COMPRESSEDFILEIO_H */
@@ -3,7 +3,10 @@
 
 // An nginx config file parser.
 
+#include <chrono>
+#include <cstddef>
 #include <iostream>
+#include <map>
 #include <memory>
 #include <string>
 #include <vector>
@@ -14,6 +17,9 @@ struct HandlerConfig {
   std::string name;
   std::string path;
   std::string root;
+  // Every directive in the location block, keyed by name, e.g.
+  // "preload" -> {"64m"} for `preload 64m;`.
+  std::map<std::string, std::vector<std::string>> directives;
 };
 
 // The parsed representation of a single config statement.
@@ -35,6 +41,12 @@ class NginxConfig {
   std::string GetRoot();
 };
 
+// Parse nginx-style values such as "30s", "500ms", "5m" or "1h" (a bare
+// number is seconds) and "512", "64k", "16m" or "1g" (bytes). Return false
+// if the value is malformed.
+bool ParseConfigDuration(const std::string& value, std::chrono::milliseconds* duration);
+bool ParseConfigSize(const std::string& value, size_t* size);
+
 // The driver that parses a config file and generates an NginxConfig.
 class NginxConfigParser {
  public:
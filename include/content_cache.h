@@ -0,0 +1,60 @@
+#ifndef CONTENT_CACHE_H
+#define CONTENT_CACHE_H
+
+// Process-wide cache of static file contents with precomputed ETags, bounded
+// by a byte budget. It is used by static locations that have a `preload`
+// directive: warm-up fills it at startup and requests read through it.
+
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+struct cached_content {
+    std::shared_ptr<const std::string> data;
+    std::int64_t mtime;
+    std::uintmax_t size;
+    std::string etag;  // strong ETag, including the quotes
+};
+
+class content_cache {
+public:
+    explicit content_cache(size_t budget = 0);
+
+    // Returns the entry for path if it was cached with the same mtime and
+    // size, otherwise nullptr.
+    std::shared_ptr<const cached_content> get(const std::string& path, std::int64_t mtime, std::uintmax_t size);
+
+    // Caches content for path, evicting least recently used entries to stay
+    // within the budget, and returns the new entry. Content larger than the
+    // whole budget is returned without being cached.
+    std::shared_ptr<const cached_content> put(const std::string& path, std::int64_t mtime, std::string content);
+
+    void set_budget(size_t bytes);
+    size_t budget();
+    size_t used();
+    void clear();
+
+    // Strong ETag derived from the content (64-bit FNV-1a, hex).
+    static std::string make_etag(const std::string& content);
+
+    static content_cache* get_global_cache();
+
+private:
+    struct entry {
+        std::shared_ptr<const cached_content> content;
+        std::list<std::string>::iterator lru;
+    };
+
+    void erase(std::unordered_map<std::string, entry>::iterator it);
+
+    std::mutex mutex_;
+    std::unordered_map<std::string, entry> entries_;
+    std::list<std::string> lru_;  // most recently used at the front
+    size_t budget_;
+    size_t used_ = 0;
+};
+
+#endif // CONTENT_CACHE_H
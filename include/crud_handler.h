@@ -3,32 +3,139 @@
 
 #include "request_handler.h"
 #include "i_file_io.h"
+#include "replication_log.h"
 #include <string>
 #include <vector>
 #include <memory>
 #include <filesystem>
+#include <functional>
+#include <map>
+
+class entity_index;
+class field_index;
+class change_feed;
+class expiry_wheel;
+class shard_router;
+class replication_follower;
 
 class crud_handler: public request_handler {
 public:
-    static std::unique_ptr<request_handler> init(std::string data_path);
+    static std::unique_ptr<request_handler> init(const HandlerConfig& config);
+    // Checks the `ttl` directives and starts reaping expired entities of
+    // every CRUD location, handing off entities of sharded locations and
+    // following the leaders of followers. Returns false if a ttl is not a
+    // whole number.
+    static bool load_config(const std::vector<HandlerConfig>& handlers);
+    // Most IDs a listing page may request with ?limit=.
+    static const size_t max_page_size = 10000;
+    // Most operations of a _bulk or _import request written to storage at once.
+    static const size_t max_batch_size = 1000;
+    // Longest a _changes request may wait for a change with ?wait=.
+    static const unsigned max_wait_seconds = 60;
+    // Threads answering snapshot pages and aggregates, and most of them
+    // queued or in progress at once before more are refused with 503.
+    static const size_t scan_threads = 4;
+    static const size_t max_pending_scans = 16;
+    // A snapshot page ends at the first entity past this many bytes.
+    static const size_t snapshot_page_bytes = 8 * 1024 * 1024;
+
     crud_handler(std::string data_path, std::shared_ptr<i_file_io> file_io_ptr);
+    crud_handler(std::string data_path, std::shared_ptr<i_file_io> file_io_ptr, std::shared_ptr<entity_index> index, bool minify_json = false,
+                 std::shared_ptr<field_index> fields = nullptr, std::shared_ptr<change_feed> feed = nullptr,
+                 std::shared_ptr<expiry_wheel> expiry = nullptr, unsigned default_ttl = 0,
+                 std::shared_ptr<shard_router> shard = nullptr, std::shared_ptr<replication_log> replication = nullptr,
+                 std::shared_ptr<replication_follower> follower = nullptr);
     http::response<http::string_body> handle_request(http::request<http::string_body> request) override;
+    // Long polls of GET .../_changes?since=<seq>&wait=<seconds> and of a
+    // leader's GET /api/_replication?since=<seq>&wait=<seconds>, scans (pages
+    // of its GET /api/_replication?snapshot, GET .../_aggregate), and with a
+    // shard router, requests for entities another node owns
+    bool handle_request_async(const http::request<http::string_body>& request, response_callback respond) override;
+    // Deletes the entity at path if expiry still has it as expired. Run by
+    // the expiry wheel's reaper thread.
+    void expire_entity(const std::string& path, expiry_wheel& expiry);
+    // Stores or deletes an entity as its leader did. Run by the replication
+    // follower's thread.
+    bool apply_replicated(const replication_log::entry& written);
 
 private:
     std::string data_path_;
     std::shared_ptr<i_file_io> file_io_;
+    std::shared_ptr<entity_index> index_;
+    std::shared_ptr<field_index> fields_;
+    std::shared_ptr<change_feed> feed_;
+    std::shared_ptr<expiry_wheel> expiry_;  // null if entities never expire
+    std::shared_ptr<shard_router> shard_;   // null unless the location is sharded
+    std::shared_ptr<replication_log> replication_;  // null unless the location is a replication leader
+    std::shared_ptr<replication_follower> follower_;  // null unless the location is a follower
+    unsigned default_ttl_;
+    bool minify_json_;
     std::string generate_id();
     // handle_request delegates to specific HTTP method
     http::response<http::string_body> handle_post_request(const http::request<http::string_body>& request);
     http::response<http::string_body> handle_get_request(const http::request<http::string_body>& request);
     http::response<http::string_body> handle_put_request(const http::request<http::string_body>& request);
     http::response<http::string_body> handle_delete_request(const http::request<http::string_body>& request);
+    http::response<http::string_body> handle_patch_request(const http::request<http::string_body>& request);
+    // bulk endpoints: POST .../_bulk, POST .../_import and GET ...?ids=
+    struct bulk_item;
+    http::response<http::string_body> handle_bulk_request(const http::request<http::string_body>& request, const std::string& entity_dir, bool import);
+    http::response<http::string_body> handle_multi_get(const std::filesystem::path& entity_path, const std::string& ids);
+    // GET ...?<field>=<value> answered from the field index
+    bool find_filtered(const std::filesystem::path& entity_path, const std::map<std::string, std::string>& filters,
+                       std::vector<std::string>& ids, std::string& error);
+    // aggregate endpoint: GET .../_aggregate?op=<op>&field=<field>&group_by=<field>
+    http::response<http::string_body> handle_aggregate_request(const std::filesystem::path& entity_path, const std::string& query);
+    // Answers with scan on the scan threads, or 503 if too many are waiting.
+    static void post_scan(std::function<http::response<http::string_body>()> scan, response_callback respond);
+    // change feed endpoint: GET .../_changes
+    struct changes_query;
+    bool parse_changes_query(const std::string& query, changes_query& changes, std::string& error);
+    static http::response<http::string_body> changes_response(change_feed& feed, const std::string& directory, const changes_query& changes);
+    // cluster mode: forwards, gathers listings from every node, and moves
+    // entities between owners
+    bool route_to_shard(const http::request<http::string_body>& request, response_callback respond);
+    void gather_listing(const http::request<http::string_body>& request, response_callback respond);
+    void take_over(const std::string& key, const std::string& previous);
+    bool hand_off(const std::string& key, const std::string& owner);
+    // replication endpoint: GET /api/_replication?since=<seq> or
+    // ?snapshot&cursor=<key> on a leader, the follower's state on a follower;
+    // follower reads report their lag and writes are refused
+    http::response<http::string_body> handle_replication_request(const std::string& query);
+    http::response<http::string_body> handle_follower_request(const http::request<http::string_body>& request);
+    static http::response<http::string_body> replication_response(replication_log& log, std::uint64_t since, size_t limit);
+    // A page of up to limit entities after cursor, in key order, ending
+    // early past snapshot_page_bytes. X-Replication-Cursor, percent-encoded,
+    // addresses the next page.
+    static http::response<http::string_body> snapshot_response(const std::string& root, i_file_io& files, expiry_wheel* expiry,
+                                                               replication_log& log, const std::string& cursor, size_t limit);
+    // Records a successful write in the field index, change feed and
+    // expiry wheel. A ttl of 0 means the entity does not expire.
+    void entity_written(const std::filesystem::path& path, const std::string& entity_data, unsigned ttl);
+    void entity_deleted(const std::filesystem::path& path);
+    // Seconds a write should live, from the X-TTL header or the location's ttl.
+    bool entity_ttl(const http::request<http::string_body>& request, unsigned& ttl, std::string& error);
+    // True if the entity has expired but has not been reaped yet.
+    bool entity_expired(const std::filesystem::path& path);
+    // Whole seconds, rounded up, until the entity expires, or 0 if it never
+    // does. Entities moving between shards take this as their X-TTL.
+    unsigned remaining_ttl(const std::filesystem::path& path);
+    // Quoted ETag of the entity's current version, or empty if the storage
+    // backend cannot tell.
+    std::string entity_etag(const std::filesystem::path& path);
+    // Checks If-Match and If-None-Match of a PUT or DELETE against the entity.
+    bool preconditions_met(const http::request<http::string_body>& request, const std::filesystem::path& path, bool exists);
+    // Validates (and with minify_json, minifies) a POST/PUT body in place.
+    bool prepare_entity(std::string& entity_data, std::string& error);
+    void reject_invalid_entity(bulk_item& item);
+    void commit_bulk_items(const std::filesystem::path& entity_path, std::vector<bulk_item>& items, unsigned ttl);
     // helper functions
     bool create_or_update_entity(const std::filesystem::path& path, const std::string& entity_data);
+    std::map<std::string, std::string> parse_query(const std::string& query);
     std::string remove_prefix_dir(boost::beast::string_view prefix, boost::beast::string_view uri_view);
     int count_path_segments(const std::filesystem::path& path);
     bool has_json_content_type(const http::request<http::string_body>& req);
-    http::response<http::string_body> create_response(http::status status, const std::string& content_type, const std::string& body);
+    static http::response<http::string_body> create_response(http::status status, const std::string& content_type, const std::string& body);
 };
 
 #endif
@@ -0,0 +1,55 @@
+#ifndef DURABLEFILEIO_H
+#define DURABLEFILEIO_H
+
+#include "file_io.h"
+#include "write_ahead_log.h"
+#include <memory>
+#include <string>
+#include <vector>
+
+struct HandlerConfig;
+
+// File-per-entity storage with crash-safe writes, selected with
+// `durable on;` in a crud_handler location. Every write or delete is first
+// committed to a write-ahead log under <root>/.wal (group-committed with
+// concurrent requests, so the caller returns only once it is durable) and
+// then applied: files are replaced by writing a temporary file and renaming
+// it over the entity, so readers never see a partial write. Checkpoints
+// sync the filesystem and empty the log; on startup the log is replayed.
+class durable_file_io : public i_file_io {
+public:
+    durable_file_io(std::shared_ptr<write_ahead_log> wal, std::string root);
+    virtual ~durable_file_io() = default;
+    bool open(const std::string& filename, std::ios_base::openmode mode) override;
+    bool write(const std::string& data) override;
+    bool close() override;
+    bool read(const std::string& filepath, std::string& content) override;
+    bool delete_file(const std::string& filepath) override;
+    bool create_directories(const std::string& path) override;
+    bool list_directories(const std::string& path, std::vector<std::string>& directories) override;
+    bool exists(const std::string& filepath) override;
+    bool version(const std::string& filepath, std::string& tag) override;
+    // Commits the whole batch as one log record, so it costs one fsync.
+    void write_batch(const std::vector<batch_op>& ops, std::vector<bool>& results) override;
+
+    // Returns the log for root, replaying and checkpointing it on first use.
+    // Returns nullptr if it cannot be opened.
+    static std::shared_ptr<write_ahead_log> get_shared_log(const std::string& root);
+
+    // Opens the log of every crud_handler location with `durable on;`.
+    // Returns false if a durable directive is malformed or a log cannot be opened.
+    static bool load_config(const std::vector<HandlerConfig>& handlers);
+
+private:
+    static bool apply(const std::string& root, const std::string& payload);
+    static bool replace_file(const std::string& root, const std::string& path, const std::string& data);
+
+    std::shared_ptr<write_ahead_log> wal_;
+    std::string root_;
+    file_io files_;
+    std::string current_path_;
+    std::string pending_;  // contents written since open(out)
+    bool writing_ = false;
+};
+
+#endif /* DURABLEFILEIO_H */
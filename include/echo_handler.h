@@ -9,7 +9,7 @@
 
 class echo_handler : public request_handler {
 public:
-    static std::unique_ptr<request_handler> init(std::string root);
+    static std::unique_ptr<request_handler> init(const HandlerConfig& config);
 
     // Constructor
     echo_handler();
@@ -0,0 +1,67 @@
+#ifndef ENTITY_INDEX_H
+#define ENTITY_INDEX_H
+
+// A sorted in-memory index of the IDs in each entity directory, so a
+// collection can be listed a page at a time. An entity's IDs are read from
+// storage the first time it is listed; after that crud_handler keeps them
+// current as entities are created and deleted, and a page costs
+// O(log n + page) no matter how large the collection is.
+//
+// Pages are addressed by cursor: the last ID of the previous page. Cursors
+// stay valid while entities are added and removed, since a page always
+// starts at the first ID after the cursor.
+//
+// Files created, renamed or deleted behind the handlers' backs (by hand, or
+// by another process) are picked up too: each loaded directory is watched
+// with inotify, and a background thread applies the events to its IDs. If
+// a directory is removed or the event queue overflows, the affected
+// entities are dropped and listed from storage again on next use.
+
+#include "i_file_io.h"
+#include <map>
+#include <memory>
+#include <set>
+#include <shared_mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+class entity_index {
+public:
+    // watch_files turns off the inotify watches, for storage that keeps no
+    // entity directories on disk.
+    explicit entity_index(bool watch_files = true);
+    ~entity_index();
+
+    // Appends up to limit IDs after cursor (from the start if cursor is
+    // empty; every remaining ID if limit is 0) to ids, loading the entity
+    // from files on first use. Sets more if IDs remain past the page.
+    // Returns false if the entity directory cannot be listed.
+    bool page(i_file_io& files, const std::string& directory, const std::string& cursor,
+              size_t limit, std::vector<std::string>& ids, bool& more);
+
+    // Record a created or deleted entity. No-ops until the directory has
+    // been loaded, since the first listing will read it from storage.
+    void add(const std::string& directory, const std::string& id);
+    void remove(const std::string& directory, const std::string& id);
+
+    // Returns the index for a CRUD root, shared by every handler for it.
+    static std::shared_ptr<entity_index> get_shared(const std::string& root);
+
+private:
+    // Watches directory for the entity key name. Called with mutex_ held.
+    void watch(const std::string& name, const std::string& directory);
+    void watch_loop();
+
+    std::shared_mutex mutex_;
+    std::map<std::string, std::set<std::string>> entities_;
+
+    bool watch_files_;
+    int inotify_fd_ = -1;
+    int stop_fd_ = -1;
+    std::unordered_map<int, std::string> watches_;  // entity key by watch descriptor
+    std::thread watching_;
+};
+
+#endif // ENTITY_INDEX_H
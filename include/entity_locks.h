@@ -0,0 +1,47 @@
+#ifndef ENTITY_LOCKS_H
+#define ENTITY_LOCKS_H
+
+// Striped reader/writer locks keyed by entity path. Handlers take a shared
+// lock on an entity's stripe to read it and an exclusive lock to create,
+// replace or delete it, so concurrent writes to one id never interleave
+// while readers of the same (or any other) entity proceed in parallel.
+// Paths hash onto a fixed set of stripes, so memory stays bounded no matter
+// how many entities exist; two entities that share a stripe only contend
+// when one of them is being written.
+
+#include <cstddef>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <vector>
+
+class entity_locks {
+public:
+    // stripes is rounded up to a power of two.
+    explicit entity_locks(size_t stripes = 256);
+
+    // The lock guarding path. Equivalent spellings of a path
+    // ("a//b", "a/./b") map to the same stripe.
+    std::shared_mutex& for_path(const std::filesystem::path& path);
+
+    // Exclusive locks on the stripes of every path, each taken once and in
+    // address order, so batches that overlap cannot deadlock.
+    std::vector<std::unique_lock<std::shared_mutex>> lock_all(const std::vector<std::filesystem::path>& paths);
+
+    size_t stripe_count() const;
+
+    // The locks shared by every crud and markdown handler in the process.
+    static entity_locks& get_global_locks();
+
+private:
+    // Padded to a cache line so neighbouring stripes do not false-share.
+    struct alignas(64) stripe {
+        std::shared_mutex mutex;
+    };
+
+    std::unique_ptr<stripe[]> stripes_;
+    size_t mask_;
+};
+
+#endif // ENTITY_LOCKS_H
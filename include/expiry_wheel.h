@@ -0,0 +1,99 @@
+#ifndef EXPIRY_WHEEL_H
+#define EXPIRY_WHEEL_H
+
+// Expiry deadlines of CRUD entities, kept in a hashed timer wheel: one slot
+// per tick, with a deadline filed in the slot of its tick modulo the wheel
+// size. Setting, clearing or checking a deadline is O(1), and a tick only
+// looks at one slot, so the cost of finding expired entities does not grow
+// with the number of live ones. Deadlines further out than one turn of the
+// wheel stay in their slot until the turn they fall in.
+//
+// A background thread reaps expired entities a batch at a time, pausing
+// between batches, so a burst of expiries is spread out instead of holding
+// entity locks and the disk all at once. The reaper takes the entity lock
+// and calls claim(), which only succeeds if the deadline is still due, so an
+// entity rewritten while queued is kept.
+//
+// Deadlines are appended to a journal (deadline path records, the latest
+// for a path wins), fsynced once per tick and replayed on startup, so they
+// survive restarts. The journal is rewritten once most of it is stale.
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+class expiry_wheel {
+public:
+    using clock = std::chrono::system_clock;
+    // Deletes the entity at path, if wheel.claim(path) agrees it expired.
+    using reaper = std::function<void(const std::string& path, expiry_wheel& wheel)>;
+
+    // Replays the journal at journal_path, if there is one; an empty path
+    // keeps deadlines in memory only. Expired entities are reaped up to
+    // batch at a time.
+    explicit expiry_wheel(const std::string& journal_path, std::chrono::milliseconds tick = std::chrono::seconds(1),
+                          size_t slots = 512, size_t batch = 64);
+    ~expiry_wheel();
+
+    // Starts reaping with reap. Only the first call has any effect.
+    void start(reaper reap);
+
+    // Expires path at deadline, replacing any earlier deadline. Paths are
+    // compared as given, so an entity must be spelled the same way each time.
+    void set(const std::string& path, clock::time_point deadline);
+    // Keeps path from expiring.
+    void clear(const std::string& path);
+    // True if path has a deadline at or before now.
+    bool expired(const std::string& path, clock::time_point now = clock::now());
+    // Sets at to the deadline of path. Returns false if it has none.
+    bool deadline(const std::string& path, clock::time_point& at);
+    // Forgets path and returns true if it has expired; false if it has no
+    // deadline or a later one.
+    bool claim(const std::string& path);
+
+    size_t size();
+
+    // Returns the wheel for a CRUD root, journaled under <root>/.ttl.
+    static std::shared_ptr<expiry_wheel> get_shared(const std::string& root);
+
+private:
+    struct entry {
+        std::string path;
+        std::int64_t deadline;  // ms since the epoch
+    };
+
+    bool current(const entry& queued) const;
+    void file(const std::string& path, std::int64_t deadline);
+    void journal(const std::string& path, std::int64_t deadline);
+    void replay();
+    void rewrite_journal();
+    void reap_loop();
+
+    std::string journal_path_;
+    std::int64_t tick_ms_;
+    size_t batch_;
+
+    std::mutex mutex_;
+    std::unordered_map<std::string, std::int64_t> deadlines_;
+    std::vector<std::vector<entry>> slots_;
+    std::int64_t last_tick_;     // every slot up to this tick has been swept
+    std::deque<std::string> due_;  // swept, waiting to be reaped
+    int journal_fd_ = -1;
+    size_t journal_records_ = 0;
+    bool journal_dirty_ = false;
+
+    reaper reap_;
+    std::condition_variable wake_;
+    bool stopping_ = false;
+    std::thread reaping_;
+};
+
+#endif // EXPIRY_WHEEL_H
@@ -0,0 +1,75 @@
+#ifndef FIELD_INDEX_H
+#define FIELD_INDEX_H
+
+// Secondary indexes on top-level fields of CRUD entities, so a filtered
+// listing such as GET /api/books?author=X is answered from memory instead of
+// reading every entity. Indexes are opt-in per entity type:
+//
+//   index books:author books:year;
+//
+// indexes author and year of the entities under <root>/books (a bare field
+// name indexes it on every entity type). An entity directory is read from
+// storage the first time it is queried; after that crud_handler keeps the
+// index current as entities are written and deleted.
+//
+// String values are indexed unescaped, numbers, true, false and null as
+// written, so ?year=1990 matches "year": 1990 and "year": "1990". Fields
+// holding objects or arrays are not indexed.
+
+#include "i_file_io.h"
+#include <map>
+#include <memory>
+#include <set>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+class field_index {
+public:
+    // declarations are the arguments of the index directive.
+    field_index(const std::string& root, const std::vector<std::string>& declarations);
+
+    bool indexed(const std::string& directory, const std::string& field) const;
+
+    // Appends the IDs whose field equals value to ids, sorted, loading the
+    // directory from files on first use. Returns false if the field is not
+    // indexed or the directory cannot be listed.
+    bool find(i_file_io& files, const std::string& directory, const std::string& field,
+              const std::string& value, std::vector<std::string>& ids);
+
+    // Record an entity written with data, or deleted. No-ops until the
+    // directory has been loaded, since the first query reads it from storage.
+    void update(const std::string& directory, const std::string& id, std::string_view data);
+    void remove(const std::string& directory, const std::string& id);
+
+    // Sets values to the indexable top-level fields of a JSON object.
+    // Returns false if json is not an object.
+    static bool extract(std::string_view json, std::map<std::string, std::string>& values);
+
+    // Returns the index for a CRUD root, shared by every handler for it and
+    // built from the declarations the first time the root is seen.
+    static std::shared_ptr<field_index> get_shared(const std::string& root, const std::vector<std::string>& declarations);
+
+private:
+    struct entity {
+        // field -> value -> IDs, with every indexed field present
+        std::map<std::string, std::unordered_map<std::string, std::set<std::string>>> fields;
+        // ID -> the indexed values it was last written with
+        std::unordered_map<std::string, std::map<std::string, std::string>> values;
+    };
+
+    std::set<std::string> fields_of(const std::string& directory) const;
+    void insert(entity& found, const std::string& id, const std::map<std::string, std::string>& values);
+    void erase(entity& found, const std::string& id);
+
+    std::string root_;
+    std::map<std::string, std::set<std::string>> declared_;  // entity type -> fields
+    std::set<std::string> everywhere_;                       // fields indexed on every type
+
+    std::shared_mutex mutex_;
+    std::map<std::string, entity> entities_;
+};
+
+#endif // FIELD_INDEX_H
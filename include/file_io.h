@@ -13,12 +13,15 @@ public:
     virtual ~file_io() = default;
     bool open(const std::string& filename, std::ios_base::openmode mode) override;
     bool write(const std::string& data) override;
-    void close() override;
+    bool close() override;
     bool read(const std::string& filepath, std::string& content) override;
     bool delete_file(const std::string& filepath) override;
     bool create_directories(const std::string& path) override;
     bool list_directories(const std::string& path,std::vector<std::string>& directories) override;
     bool exists(const std::string& filepath) override;
+    // Device, inode, size and modification time of the file, and how many
+    // times this process has opened it for writing.
+    bool version(const std::string& filepath, std::string& tag) override;
 private:
     std::fstream file_;
 };
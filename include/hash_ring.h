@@ -0,0 +1,41 @@
+#ifndef HASH_RING_H
+#define HASH_RING_H
+
+// Consistent-hash ring that maps keys (such as "Books/<id>") to the node
+// that owns them. Each node is placed on the ring at many points, and a key
+// belongs to the first point at or after its own hash, so keys spread
+// evenly and adding or removing a node only moves the keys of the ranges
+// next to its points. The hash is fixed (FNV-1a, mixed), so every process
+// given the same nodes builds the same ring.
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <set>
+#include <string>
+#include <string_view>
+
+class hash_ring {
+public:
+    explicit hash_ring(size_t points_per_node = 128);
+
+    void add(const std::string& node);
+    void remove(const std::string& node);
+
+    // The node owning key, or empty if the ring has no nodes.
+    std::string owner(std::string_view key) const;
+    // The node that would own key if node were not on the ring: the one key
+    // moves from when node joins. Empty if node is the only one.
+    std::string owner_without(std::string_view key, const std::string& node) const;
+
+    const std::set<std::string>& nodes() const { return nodes_; }
+
+    static std::uint64_t hash(std::string_view text);
+
+private:
+    size_t points_per_node_;
+    std::map<std::uint64_t, std::string> points_;
+    std::set<std::string> nodes_;
+};
+
+#endif // HASH_RING_H
@@ -7,12 +7,18 @@
 
 class health_handler : public request_handler {
 public:
-    static std::unique_ptr<request_handler> init(std::string root);
+    static std::unique_ptr<request_handler> init(const HandlerConfig& config);
 
     // Constructor
     health_handler();
 
+    // Returns 200 OK once ready, or 503 while any startup warm-up is running.
     http::response<http::string_body> handle_request(http::request<http::string_body> request) override;
+
+    // Startup warm-ups (e.g. static preload) bracket their work with these.
+    static void begin_warmup();
+    static void end_warmup();
+    static bool ready();
 };
 
 #endif
@@ -0,0 +1,12 @@
+#ifndef HTTP_UTIL_H
+#define HTTP_UTIL_H
+
+// Request header helpers shared by the handlers.
+
+#include <boost/beast/http.hpp>
+namespace http = boost::beast::http;
+
+// True if Accept-Encoding lists gzip (or *) without q=0.
+bool accepts_gzip(const http::request<http::string_body>& request);
+
+#endif // HTTP_UTIL_H
@@ -4,18 +4,64 @@
 #include <string>
 #include <vector>
 #include <ios>
+#include <filesystem>
 
 class i_file_io {
 public:
     virtual ~i_file_io() = default;
     virtual bool open(const std::string& filename, std::ios_base::openmode mode) = 0;
     virtual bool write(const std::string& data) = 0;
-    virtual void close() = 0;
+    // Returns false if what was written since open could not be stored;
+    // backends that store on close report their failures here.
+    virtual bool close() = 0;
     virtual bool read(const std::string& filepath, std::string& content) = 0;
     virtual bool delete_file(const std::string& filepath) = 0;
     virtual bool create_directories(const std::string& path) = 0;
     virtual bool list_directories(const std::string& path,std::vector<std::string>& directories) = 0;
     virtual bool exists(const std::string& filepath) = 0;
+
+    // Sets tag to a token that changes whenever the file is written, taken
+    // from storage metadata rather than the contents. Returns false if the
+    // file does not exist or the backend keeps no such metadata.
+    virtual bool version(const std::string& filepath, std::string& tag) {
+        return false;
+    }
+
+    // Reads the file as stored. Backends that keep it compressed may hand
+    // back the compressed bytes and set encoding to their Content-Encoding
+    // (such as "gzip"); otherwise content is the file and encoding is empty.
+    virtual bool read_stored(const std::string& filepath, std::string& content, std::string& encoding) {
+        encoding.clear();
+        return read(filepath, content);
+    }
+
+    // One file replaced or deleted by write_batch.
+    struct batch_op {
+        std::string path;
+        std::string data;
+        bool remove = false;
+    };
+
+    // Applies ops in order and sets results[i] to whether op i succeeded (a
+    // delete fails if the file does not exist). Backends that can commit
+    // many changes with one storage write override this; by default each
+    // op is applied on its own.
+    virtual void write_batch(const std::vector<batch_op>& ops, std::vector<bool>& results) {
+        results.assign(ops.size(), false);
+        for (size_t i = 0; i < ops.size(); i++) {
+            if (ops[i].remove) {
+                results[i] = delete_file(ops[i].path);
+                continue;
+            }
+            try {
+                create_directories(std::filesystem::path(ops[i].path).parent_path().string());
+            } catch (const std::exception&) {
+                continue;
+            }
+            results[i] = open(ops[i].path, std::ios::out | std::ios::trunc) && write(ops[i].data);
+            results[i] = close() && results[i];
+        }
+    }
 };
 
 #endif /* IFILEIO_H */
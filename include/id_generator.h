@@ -0,0 +1,38 @@
+#ifndef ID_GENERATOR_H
+#define ID_GENERATOR_H
+
+// Time-ordered entity IDs in the UUIDv7 layout (RFC 9562):
+//
+//   48-bit Unix milliseconds | version 7 | 12-bit counter | variant | 62 random bits
+//
+// IDs from one generator strictly increase, and IDs from different threads
+// are ordered to the millisecond, so sorting IDs as strings sorts entities
+// by creation time. Each thread owns its generator (see generate()), so
+// creating an ID takes no lock and no atomic operation.
+
+#include <cstdint>
+#include <string>
+
+class id_generator {
+public:
+    static const size_t id_length = 36;
+
+    // Seeds the random bits from std::random_device.
+    id_generator();
+
+    // Writes the next ID as 36 lowercase hex characters and dashes.
+    void next(char* out);
+    std::string next();
+
+    // The next ID from the calling thread's generator.
+    static std::string generate();
+
+private:
+    std::uint64_t random();
+
+    std::uint64_t state_;
+    std::uint64_t last_ms_ = 0;
+    std::uint32_t counter_ = 0;
+};
+
+#endif // ID_GENERATOR_H
@@ -0,0 +1,22 @@
+#ifndef JSON_MERGE_PATCH_H
+#define JSON_MERGE_PATCH_H
+
+// RFC 7396 JSON Merge Patch, used by crud_handler to apply PATCH requests
+// server-side. A patch object replaces the members it names, removes the
+// ones it sets to null and leaves the rest alone; any other patch value
+// replaces the target. Only objects are parsed into members; arrays and
+// scalars are carried over as written, so the cost is proportional to the
+// object structure rather than the size of the values in it.
+
+#include <string>
+#include <string_view>
+
+class json_merge_patch {
+public:
+    // Writes target with patch applied to out. Objects in out are written
+    // without insignificant whitespace. Both inputs must be valid JSON
+    // (see json_validator); returns false if either cannot be parsed.
+    static bool apply(std::string_view target, std::string_view patch, std::string& out);
+};
+
+#endif // JSON_MERGE_PATCH_H
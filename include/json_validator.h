@@ -0,0 +1,44 @@
+#ifndef JSON_VALIDATOR_H
+#define JSON_VALIDATOR_H
+
+// Single-pass RFC 8259 JSON validation, used to reject malformed entity
+// bodies before they reach storage. Runs of string characters and
+// whitespace are scanned 16 bytes at a time with SSE2 where available, and
+// nothing is allocated while validating. Strings must be valid UTF-8, and
+// nesting is limited to max_depth. bin/json_validate_bench reports the
+// throughput.
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+class json_validator {
+public:
+    static const size_t max_depth = 512;
+
+    // Returns true if text is exactly one JSON value, optionally surrounded
+    // by whitespace. On failure, sets error (if given) to a message with
+    // the byte offset of the problem.
+    static bool validate(std::string_view text, std::string* error = nullptr);
+
+    // Validates text and writes it to out without insignificant whitespace.
+    // out is unspecified on failure.
+    static bool minify(std::string_view text, std::string& out, std::string* error = nullptr);
+
+    // Appends the value of the JSON string text (quotes included) to out,
+    // decoding escapes and joining surrogate pairs. Returns false if text is
+    // not a string literal.
+    static bool unescape(std::string_view text, std::string& out);
+
+    // Scanners for picking fields out of a document without parsing the
+    // rest, 16 bytes at a time with SSE2 where available. Each moves i past
+    // what it steps over; neither validates it.
+    //
+    // Steps over the whitespace at json[i].
+    static void skip_space(std::string_view json, size_t& i);
+    // Steps over the string whose opening quote is at json[i]. Sets escaped
+    // if it holds a backslash. Returns false if the string is not closed.
+    static bool skip_string(std::string_view json, size_t& i, bool& escaped);
+};
+
+#endif // JSON_VALIDATOR_H
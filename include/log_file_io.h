@@ -0,0 +1,48 @@
+#ifndef LOGFILEIO_H
+#define LOGFILEIO_H
+
+#include "i_file_io.h"
+#include "log_store.h"
+#include <memory>
+#include <string>
+#include <vector>
+
+struct HandlerConfig;
+
+// Adapts a log_store to the file interface crud_handler uses, so the same
+// handler code can keep entities in the log instead of one file per entity.
+// Paths are mapped to keys relative to the store's root ("<entity>/<id>");
+// directories exist implicitly. Selected with `storage log;` in a
+// crud_handler location.
+class log_file_io : public i_file_io {
+public:
+    log_file_io(std::shared_ptr<log_store> store, std::string root);
+    virtual ~log_file_io() = default;
+    bool open(const std::string& filename, std::ios_base::openmode mode) override;
+    bool write(const std::string& data) override;
+    bool close() override;
+    bool read(const std::string& filepath, std::string& content) override;
+    bool delete_file(const std::string& filepath) override;
+    bool create_directories(const std::string& path) override;
+    bool list_directories(const std::string& path, std::vector<std::string>& directories) override;
+    bool exists(const std::string& filepath) override;
+    // The sequence number of the key's latest record.
+    bool version(const std::string& filepath, std::string& tag) override;
+    // Appends the whole batch to the log with one write.
+    void write_batch(const std::vector<batch_op>& ops, std::vector<bool>& results) override;
+
+    // Opens the store of every crud_handler location with `storage log;`.
+    // Returns false if a storage directive is unknown or a store cannot be opened.
+    static bool load_config(const std::vector<HandlerConfig>& handlers);
+
+private:
+    bool to_key(const std::string& path, std::string& key) const;
+
+    std::shared_ptr<log_store> store_;
+    std::string root_;
+    std::string current_key_;
+    std::string pending_;  // contents written since open(out), stored on close()
+    bool writing_ = false;
+};
+
+#endif /* LOGFILEIO_H */
@@ -0,0 +1,129 @@
+#ifndef LOG_STORE_H
+#define LOG_STORE_H
+
+// An embedded log-structured key/value store. Values are appended to
+// numbered segment files (segment-<n>.log) in a directory and located
+// through an in-memory hash index, so a write is one append and a read is
+// one pread regardless of how many keys there are. Deletes append a
+// tombstone. A background thread compacts sealed segments once enough of
+// their bytes are dead, and opening a store replays the segments to rebuild
+// the index, truncating a torn record at the tail of the log.
+//
+// Record layout: crc32 | sequence | key length | value length | type | key | value
+// The crc covers everything after itself. Every record carries a global
+// sequence number so recovery keeps the newest record of each key no matter
+// which segment compaction moved it to.
+
+#include <condition_variable>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <shared_mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+class log_store {
+public:
+    struct options {
+        size_t segment_size = 64 << 20;  // roll to a new segment past this size
+        double compaction_ratio = 0.5;   // compact when this fraction of sealed bytes is dead
+        bool background_compaction = true;
+    };
+
+    // Opens (creating if needed) the store in directory and recovers its index.
+    // Throws std::runtime_error if the directory or a segment cannot be opened.
+    explicit log_store(const std::string& directory);
+    log_store(const std::string& directory, options opts);
+    ~log_store();
+
+    bool put(const std::string& key, const std::string& value);
+    bool get(const std::string& key, std::string& value);
+    // Returns false if the key did not exist.
+    bool remove(const std::string& key);
+    bool contains(const std::string& key);
+    // Sets sequence to that of the key's latest record, which compaction
+    // preserves. Returns false if the key does not exist.
+    bool version(const std::string& key, std::uint64_t& sequence);
+
+    struct write_op {
+        std::string key;
+        std::string value;
+        bool remove = false;
+    };
+
+    // Appends every op with a single write under one lock and sets
+    // results[i] to whether op i applied (removing a missing key fails).
+    // Returns false, applying nothing, if the write fails.
+    bool write_batch(const std::vector<write_op>& ops, std::vector<bool>& results);
+
+    // Names of the keys directly under prefix + "/", like a directory listing.
+    // Returns false if nothing has ever been stored under prefix.
+    bool list(const std::string& prefix, std::vector<std::string>& names);
+
+    // Flushes appended records to stable storage.
+    bool sync();
+
+    // Rewrites the live records of all sealed segments into a new segment and
+    // deletes the old ones. Runs in the background when enabled.
+    bool compact();
+
+    size_t size();
+    std::uint64_t total_bytes();
+    std::uint64_t live_bytes();
+    size_t segment_count();
+
+    // Returns the store for directory, opening it on first use, so every
+    // handler for a location shares one index. Returns nullptr on failure.
+    static std::shared_ptr<log_store> get_shared(const std::string& directory);
+
+private:
+    struct segment {
+        segment(std::uint32_t id, int fd, std::string path);
+        ~segment();
+        std::uint32_t id;
+        int fd;
+        std::string path;
+        std::uint64_t size = 0;
+    };
+    struct location {
+        std::shared_ptr<segment> seg;
+        std::uint64_t offset;  // of the value
+        std::uint32_t length;
+        std::uint64_t sequence;
+    };
+
+    void recover();
+    std::shared_ptr<segment> open_segment(std::uint32_t id, bool create);
+    // Caller holds mutex_ exclusively.
+    bool append(const std::string& key, const std::string& value, bool tombstone, location* written);
+    void roll();
+    void index(const std::string& key, const location& loc, bool tombstone);
+    bool needs_compaction();
+    bool compaction_due();
+    void compaction_loop();
+
+    std::string directory_;
+    options options_;
+
+    std::shared_mutex mutex_;
+    std::unordered_map<std::string, location> index_;
+    std::unordered_map<std::string, std::set<std::string>> children_;
+    std::map<std::uint32_t, std::shared_ptr<segment>> segments_;
+    std::shared_ptr<segment> active_;
+    std::uint32_t next_segment_ = 1;
+    std::uint64_t next_sequence_ = 1;
+    std::uint64_t total_bytes_ = 0;
+    std::uint64_t live_bytes_ = 0;
+
+    std::mutex compaction_mutex_;  // one compaction at a time
+    std::mutex wake_mutex_;
+    std::condition_variable wake_;
+    bool stopping_ = false;
+    std::thread compactor_;
+};
+
+#endif // LOG_STORE_H
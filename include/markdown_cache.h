@@ -0,0 +1,59 @@
+#ifndef MARKDOWN_CACHE_H
+#define MARKDOWN_CACHE_H
+
+// Process-wide cache of rendered markdown. Entries are keyed by the source
+// path and are only reused while the file's mtime and size are unchanged.
+// The rendered HTML held is bounded in bytes; past the bound the least
+// recently used documents are dropped.
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+class markdown_cache {
+public:
+    explicit markdown_cache(size_t max_bytes = 64 << 20);
+
+    // Returns the rendered HTML for path. If no entry matches mtime and size,
+    // render() is called once; concurrent callers for the same document wait
+    // for that render instead of starting their own.
+    std::shared_ptr<const std::string> get(const std::string& path, std::int64_t mtime, std::uintmax_t size,
+                                           const std::function<std::string()>& render);
+
+    void clear();
+    size_t hits() const;
+    size_t renders() const;
+    // Bytes of rendered HTML (and their paths) held.
+    size_t used();
+
+    static markdown_cache* get_global_cache();
+
+private:
+    using html_future = std::shared_future<std::shared_ptr<const std::string>>;
+    struct entry {
+        std::int64_t mtime;
+        std::uintmax_t size;
+        html_future html;
+        size_t bytes;  // 0 until the render finishes
+        std::list<std::string>::iterator lru;
+    };
+
+    // Drops least recently used entries until used_ fits in max_bytes_.
+    void evict();
+
+    size_t max_bytes_;
+    std::mutex mutex_;
+    std::unordered_map<std::string, entry> entries_;
+    std::list<std::string> lru_;  // most recently used at the front
+    size_t used_ = 0;
+    std::atomic<size_t> hits_{0};
+    std::atomic<size_t> renders_{0};
+};
+
+#endif // MARKDOWN_CACHE_H
@@ -3,6 +3,8 @@
 
 #include "request_handler.h"
 #include "i_file_io.h"
+#include "async_file_io.h"
+#include "entity_index.h"
 #include <string>
 #include <vector>
 #include <memory>
@@ -10,26 +12,38 @@
 
 class markdown_handler: public request_handler {
 public:
-    static std::unique_ptr<request_handler> init(std::string data_path);
-    markdown_handler(std::string data_path, std::shared_ptr<i_file_io> file_io_ptr);
+    static std::unique_ptr<request_handler> init(const HandlerConfig& config);
+    // With async_io_ptr, requests are answered through handle_request_async
+    // and its non-blocking file operations. Listings are served from index_ptr,
+    // or from an index of the handler's own if none is given.
+    markdown_handler(std::string data_path, std::shared_ptr<i_file_io> file_io_ptr, std::shared_ptr<async_file_io> async_io_ptr = nullptr,
+                     std::shared_ptr<entity_index> index_ptr = nullptr);
     http::response<http::string_body> handle_request(http::request<http::string_body> request) override;
+    bool handle_request_async(const http::request<http::string_body>& request, response_callback respond) override;
 
 private:
     std::string data_path_;
     std::shared_ptr<i_file_io> file_io_;
+    std::shared_ptr<async_file_io> async_io_;
+    std::shared_ptr<entity_index> index_;
     std::string generate_id();
     // handle_request delegates to specific HTTP method
     http::response<http::string_body> create_markdown_file(const http::request<http::string_body>& request);
     http::response<http::string_body> get_markdown_file(const http::request<http::string_body>& request);
     http::response<http::string_body> update_markdown_file(const http::request<http::string_body>& request);
     http::response<http::string_body> delete_markdown_file(const http::request<http::string_body>& request);
+    bool get_markdown_file_async(const http::request<http::string_body>& request, response_callback respond);
+    bool write_markdown_file_async(const http::request<http::string_body>& request, response_callback respond);
+    bool delete_markdown_file_async(const http::request<http::string_body>& request, response_callback respond);
     
     // helper functions
     bool create_or_update_entity(const std::filesystem::path& path, const std::string& entity_data);
     std::string remove_prefix_dir(boost::beast::string_view prefix, boost::beast::string_view uri_view);
     int count_path_segments(const std::filesystem::path& path);
     bool has_markdown_content_type(const http::request<http::string_body>& req);
-    http::response<http::string_body> create_response(http::status status, const std::string& content_type, const std::string& body);
+    static http::response<http::string_body> create_response(http::status status, const std::string& content_type, const std::string& body);
+    static http::response<http::string_body> list_response(std::vector<std::string> ids);
+    static http::response<http::string_body> document_response(const std::string& entity_data, bool convert_to_html);
 };
 
 #endif // MARKDOWN_HANDLER_H
@@ -0,0 +1,64 @@
+#ifndef MIME_TYPES_H
+#define MIME_TYPES_H
+
+// Maps file extensions to MIME types. The table starts from a built-in
+// default list and can be extended or replaced from a `types {}` config
+// block or a mime.types file. Entries are stored in an open-addressing hash
+// table so lookups are constant time and never allocate.
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+class NginxConfig;
+
+class mime_types {
+public:
+    // Builds the table from the built-in defaults.
+    mime_types();
+
+    // Returns the type registered for extension (without the leading dot),
+    // compared case-insensitively, or default_type() if there is none.
+    std::string_view lookup(std::string_view extension) const;
+
+    // Registers (or overrides) the type for extension.
+    void add(std::string_view type, std::string_view extension);
+    void clear();
+    size_t size() const;
+
+    const std::string& default_type() const;
+    void set_default_type(std::string_view type);
+
+    // Applies a top-level `types {}` block, `types_file` and `default_type`
+    // from config. A types block or file replaces the built-in defaults, as
+    // in nginx. Returns false if a types_file cannot be read.
+    bool load_config(NginxConfig& config);
+
+    // Reads a mime.types file in either nginx format (`types { ... }`) or
+    // the Apache/Debian format of "type ext ext ..." lines.
+    bool load_file(const std::string& path);
+
+    // Number of entries in the built-in default table.
+    static size_t builtin_size();
+
+    static mime_types* get_global_table();
+
+private:
+    struct slot {
+        std::string extension;
+        std::string type;
+    };
+
+    static std::uint64_t hash(std::string_view extension);
+    static bool equals(std::string_view lowercase, std::string_view extension);
+    void load_builtin();
+    void rehash(size_t capacity);
+
+    std::vector<slot> slots_;
+    size_t size_ = 0;
+    std::string default_type_ = "application/octet-stream";
+};
+
+#endif // MIME_TYPES_H
@@ -7,7 +7,7 @@
 
 class notfound_handler : public request_handler {
 public:
-    static std::unique_ptr<request_handler> init(std::string root);
+    static std::unique_ptr<request_handler> init(const HandlerConfig& config);
 
     // Constructor
     notfound_handler();
@@ -0,0 +1,89 @@
+#ifndef OPEN_FILE_CACHE_H
+#define OPEN_FILE_CACHE_H
+
+// An nginx-style cache of open file descriptors and stat results, shared by
+// all static handlers. Configured from the top level of the config:
+//
+//   open_file_cache max=1000 inactive=20s;
+//   open_file_cache_valid 30s;
+//   open_file_cache_errors on;
+//
+// With the cache off (the default) every lookup opens and stats the file.
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+class NginxConfig;
+
+// A file looked up through the cache. Negative lookups are represented by
+// exists == false, with error set to the errno of the failed open.
+struct open_file {
+    open_file() = default;
+    open_file(const open_file&) = delete;
+    open_file& operator=(const open_file&) = delete;
+    ~open_file();
+
+    int fd = -1;
+    bool exists = false;
+    bool is_directory = false;
+    int error = 0;
+    std::uintmax_t size = 0;
+    std::int64_t mtime = 0;  // nanoseconds since the epoch
+    std::uint64_t device = 0;
+    std::uint64_t inode = 0;
+
+    // Reads the whole file with pread, so the descriptor can be shared
+    // between threads. Returns false on a short or failed read.
+    bool read(std::string& content) const;
+};
+
+class open_file_cache {
+public:
+    open_file_cache();
+
+    // Returns the (possibly cached) open file for path. Never null.
+    std::shared_ptr<const open_file> open(const std::string& path);
+
+    // max == 0 turns the cache off.
+    void configure(size_t max, std::chrono::milliseconds inactive, std::chrono::milliseconds valid, bool cache_errors);
+
+    // Applies the open_file_cache* directives. Returns false if one is malformed.
+    bool load_config(NginxConfig& config);
+
+    void clear();
+    size_t size();
+    size_t hits() const;
+    size_t misses() const;
+
+    static open_file_cache* get_global_cache();
+
+private:
+    using clock = std::chrono::steady_clock;
+    struct entry {
+        std::shared_ptr<const open_file> file;
+        clock::time_point validated;
+        clock::time_point last_used;
+        std::list<std::string>::iterator lru;
+    };
+
+    static std::shared_ptr<const open_file> open_uncached(const std::string& path);
+    void evict(clock::time_point now);
+
+    std::mutex mutex_;
+    std::unordered_map<std::string, entry> entries_;
+    std::list<std::string> lru_;  // most recently used at the front
+    size_t max_ = 0;
+    std::chrono::milliseconds inactive_{std::chrono::seconds(60)};
+    std::chrono::milliseconds valid_{std::chrono::seconds(60)};
+    bool cache_errors_ = true;
+    std::atomic<size_t> hits_{0};
+    std::atomic<size_t> misses_{0};
+};
+
+#endif // OPEN_FILE_CACHE_H
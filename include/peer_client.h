@@ -0,0 +1,52 @@
+#ifndef PEER_CLIENT_H
+#define PEER_CLIENT_H
+
+// HTTP client for requests between server instances: a shard router
+// forwarding to the node that owns an entity, a follower polling its
+// leader. Idle keep-alive connections are pooled per node. Each connection
+// has an io_context of its own, run by whichever thread is exchanging on
+// it, so a blocked exchange times out without involving the server's io
+// threads.
+
+#include "request_handler.h"
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+class peer_client {
+public:
+    // timeout bounds connecting, sending a request and receiving its
+    // response; a response with a body over body_limit bytes fails. At most
+    // max_idle connections per node are kept open.
+    peer_client(std::chrono::seconds timeout, std::uint64_t body_limit, size_t max_idle);
+    ~peer_client();
+
+    // Sends request to node (host:port) as a keep-alive request and waits
+    // for its response. A request that fails on an idle connection the node
+    // had already closed is sent again on a new one, so only idempotent
+    // requests may be exchanged. Returns false if the node cannot be reached
+    // or its response is too large.
+    bool exchange(const std::string& node, http::request<http::string_body> request, http::response<http::string_body>& response);
+
+    // Splits node into host and port. Returns false if it is not host:port.
+    static bool split_node(const std::string& node, std::string& host, std::string& port);
+
+private:
+    struct connection;
+
+    // An idle connection to node, or a new one. Sets reused for an idle one.
+    std::unique_ptr<connection> checkout(const std::string& node, bool& reused);
+    void checkin(const std::string& node, std::unique_ptr<connection> idle);
+
+    std::chrono::seconds timeout_;
+    std::uint64_t body_limit_;
+    size_t max_idle_;
+    std::mutex idle_mutex_;
+    std::map<std::string, std::vector<std::unique_ptr<connection>>> idle_;
+};
+
+#endif // PEER_CLIENT_H
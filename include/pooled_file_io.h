@@ -0,0 +1,29 @@
+#ifndef POOLED_FILE_IO_H
+#define POOLED_FILE_IO_H
+
+#include "async_file_io.h"
+#include <boost/asio/thread_pool.hpp>
+
+// async_file_io that runs the blocking system calls on a thread pool. It is
+// the fallback where io_uring is unavailable, and uring_file_io hands it the
+// operations io_uring has no opcode for (listing a directory).
+class pooled_file_io : public async_file_io {
+public:
+    pooled_file_io(boost::asio::io_context& io, size_t threads);
+    // Waits for the operations in progress.
+    ~pooled_file_io() override;
+
+    void read(const std::string& path, read_completion done) override;
+    void write(const std::string& path, std::string data, completion done) override;
+    void fsync(const std::string& path, completion done) override;
+    void unlink(const std::string& path, completion done) override;
+    void mkdir(const std::string& path, completion done) override;
+    void list(const std::string& path, list_completion done) override;
+    const char* backend() const override;
+
+private:
+    boost::asio::io_context& io_;
+    boost::asio::thread_pool pool_;
+};
+
+#endif // POOLED_FILE_IO_H
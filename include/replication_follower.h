@@ -0,0 +1,111 @@
+#ifndef REPLICATION_FOLLOWER_H
+#define REPLICATION_FOLLOWER_H
+
+// Follower mode for a CRUD location: a read-only copy of another server's
+// location, kept current from its replication log.
+//
+//   On the leader:      replication leader;
+//   On each follower:   replication follower 127.0.0.1:8080;
+//                       replication_max_lag 5;
+//
+// A background thread first copies every entity of the leader, a page at a
+// time (GET /api/_replication?snapshot&cursor=), then long-polls its log for the writes
+// made since and applies them through crud_handler, so the follower's own
+// indexes and change feed stay current. The follower answers GETs and
+// refuses writes; each answer reports its lag, and once the lag passes
+// replication_max_lag (10 seconds by default) GETs are refused as well
+// until it catches up.
+//
+// The lag is how long ago the follower last had every write the leader
+// had. An idle follower polls once a second, so it reads up to about a
+// second even when nothing is missing.
+
+#include "peer_client.h"
+#include "replication_log.h"
+#include "request_handler.h"
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+class replication_follower {
+public:
+    static constexpr const char* lag_header = "X-Replication-Lag";
+    static const unsigned default_max_lag = 10;
+    // Longest a poll of the leader waits for a write.
+    static constexpr std::chrono::seconds poll_wait{1};
+    // Longest the leader has to connect, or to take a request or send a response.
+    static constexpr std::chrono::seconds leader_timeout{30};
+    // Largest response body taken from the leader. A poll returns at most
+    // the leader's whole replication log (64 MB).
+    static const std::uint64_t max_response_size = 128 * 1024 * 1024;
+    // Entries asked for at once.
+    static const size_t batch_size = 1000;
+
+    // Applies one write or delete of the leader's. Returns false if it
+    // should be tried again later.
+    using apply = std::function<bool(const replication_log::entry& written)>;
+
+    // root is the location's root, walked after a copy to delete what the
+    // leader no longer has.
+    replication_follower(const std::string& leader, const std::string& root, std::chrono::seconds max_lag);
+    // Stops following.
+    ~replication_follower();
+
+    const std::string& leader() const { return leader_; }
+    std::chrono::seconds max_lag() const { return max_lag_; }
+    // Sequence of the leader's last write applied here.
+    std::uint64_t sequence();
+    // How long ago the follower last had every write the leader had, or
+    // std::chrono::milliseconds::max() if it has not caught up yet.
+    std::chrono::milliseconds lag();
+    // True if the lag is within max_lag.
+    bool current();
+
+    // Starts following the leader, applying its writes with write. Only the
+    // first call has any effect.
+    void start(apply write);
+
+    // Checks the replication directives of every CRUD location and creates
+    // the followers. Returns false if a role is not `leader` or
+    // `follower <host:port>`, replication_max_lag is not a whole, positive
+    // number of seconds, or the location uses `storage log;`.
+    static bool load_config(const std::vector<HandlerConfig>& handlers);
+    // The follower of a CRUD root, or nullptr if the location is not one.
+    static std::shared_ptr<replication_follower> get_shared(const std::string& root);
+
+private:
+    void follow_loop();
+    // Copies every entity of the leader. Returns false if it has to be
+    // tried again.
+    bool copy();
+    // Asks for the writes after sequence_. Returns false if it has to be
+    // tried again, and clears synced_ if the leader no longer has them.
+    bool poll();
+    bool fetch(const std::string& target, http::response<http::string_body>& response);
+    // Waits for period, returning false if the follower is stopping.
+    bool pause(std::chrono::milliseconds period);
+
+    std::string leader_;
+    std::string root_;
+    std::chrono::seconds max_lag_;
+    apply write_;
+    peer_client client_;  // used by the following thread only
+
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    bool stopping_ = false;
+    bool synced_ = false;
+    std::uint64_t sequence_ = 0;
+    bool caught_up_ = false;
+    std::chrono::steady_clock::time_point caught_up_at_;
+    std::thread following_;
+};
+
+#endif // REPLICATION_FOLLOWER_H
@@ -0,0 +1,90 @@
+#ifndef REPLICATION_LOG_H
+#define REPLICATION_LOG_H
+
+// The write log a replication leader keeps for its followers: every
+// create, update and delete of the location's entities, with the entity's
+// new contents, in the order they were made. crud_handler records each
+// write under the entity's lock, so the log agrees with storage. Followers
+// long-poll GET /api/_replication?since=<seq> and apply what they get.
+//
+// Like the change feed, the log lives in memory and its sequences start at
+// the process start time in microseconds. It keeps the most recent writes
+// up to a size; a follower whose sequence is older than that, or from
+// before the leader restarted, copies the whole location again.
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+class replication_log {
+public:
+    struct entry {
+        std::uint64_t sequence;
+        std::string key;   // "<entity>/<id>", relative to the location's root
+        std::string data;  // the entity's new contents, empty for a delete
+        bool deleted;
+    };
+
+    // Keeps the most recent writes up to max_bytes of keys and contents in
+    // all, and up to max_watchers waiting callbacks.
+    explicit replication_log(size_t max_bytes = 64 * 1024 * 1024, size_t max_watchers = 64);
+    ~replication_log();
+
+    // Appends a write and wakes the watchers.
+    void record(const std::string& key, const std::string& data, bool deleted);
+
+    // Appends up to limit entries after since to entries, oldest first, and
+    // sets next to the sequence to ask for next time and more if entries
+    // past it remain. Returns false if entries after since have been
+    // dropped.
+    bool since(std::uint64_t since, size_t limit, std::vector<entry>& entries, std::uint64_t& next, bool& more);
+    // The sequence of the newest write, or the log's start if there is none.
+    std::uint64_t last_sequence();
+
+    // Runs notify once there is a write after since or at deadline, on the
+    // recording thread or the deadline thread; right away if there already
+    // is one. Returns false without registering if max_watchers wait.
+    bool watch(std::uint64_t since, std::chrono::steady_clock::time_point deadline, std::function<void()> notify);
+
+    // Writes entries as a _replication response body and reads them back.
+    // Each entry is a line "<seq> <length> <key>", or "<seq> - <key>" for a
+    // delete, followed by length bytes of contents.
+    static void serialize(const entry& written, std::string& body);
+    static bool parse(const std::string& body, std::vector<entry>& entries);
+
+    // Returns the log for a CRUD root, shared by every handler for it.
+    static std::shared_ptr<replication_log> get_shared(const std::string& root);
+
+private:
+    struct watcher {
+        std::uint64_t since;
+        std::chrono::steady_clock::time_point deadline;
+        std::function<void()> notify;
+    };
+
+    void deadline_loop();
+
+    size_t max_bytes_;
+    size_t max_watchers_;
+
+    std::mutex mutex_;
+    std::deque<entry> entries_;
+    size_t bytes_ = 0;
+    std::uint64_t start_;  // entries after this are all retained
+    std::uint64_t next_sequence_;
+    std::list<watcher> watchers_;
+
+    std::condition_variable wake_;
+    bool stopping_ = false;
+    std::thread deadlines_;  // started with the first watcher
+};
+
+#endif // REPLICATION_LOG_H
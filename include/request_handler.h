@@ -5,16 +5,35 @@
 #include <string>
 #include <functional>
 #include <boost/beast/http.hpp>
+#include "config_parser.h"
 namespace http = boost::beast::http;
 
+// Called with the response to a request answered asynchronously.
+using response_callback = std::function<void(http::response<http::string_body>)>;
+
 class request_handler {
 public:
+    virtual ~request_handler() = default;
+
+    // A response carrying this header, naming a file, is sent with that
+    // file as its body, streamed from disk rather than held in memory. The
+    // session removes the file once it has opened it.
+    static constexpr const char* spooled_body_header = "X-Spooled-Body";
+
     // Takes an HTTP request and returns and HTTP response.
     virtual http::response<http::string_body> handle_request(http::request<http::string_body> request) = 0;
+
+    // Handlers that may have to wait for a response (such as a long poll)
+    // override this to take the request and call respond later, from any
+    // thread, instead of holding an io thread. Returns false if the request
+    // should be answered by handle_request instead.
+    virtual bool handle_request_async(const http::request<http::string_body>& request, response_callback respond) {
+        return false;
+    }
 };
 
-// Function that creates a request handler given a root string.
-using request_handler_factory = std::function<std::unique_ptr<request_handler>(std::string)>;
+// Function that creates a request handler given its location's config.
+using request_handler_factory = std::function<std::unique_ptr<request_handler>(const HandlerConfig&)>;
 
 
 #endif // REQUEST_HANDLER_H
@@ -21,6 +21,9 @@ public:
 private:
   void do_read();
   void write_response(const boost::system::error_code& error, std::string response);
+  // Streams a response whose body is the file named by its spooled body header.
+  void write_spooled_response(http::response<http::string_body> response);
+  std::string respond(http::request<http::string_body>& parsed, request_handler* handler, const std::string& log_handler_name);
   void read_request(const boost::system::error_code& error);
   tcp::socket socket_;
   enum { max_length = 1024 };
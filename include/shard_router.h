@@ -0,0 +1,121 @@
+#ifndef SHARD_ROUTER_H
+#define SHARD_ROUTER_H
+
+// Cluster mode for a CRUD location: several server instances each own a
+// shard of the entity key space, placed on a consistent-hash ring.
+//
+//   shard_nodes 127.0.0.1:8080 127.0.0.1:8081 127.0.0.1:8082;
+//   shard_self 127.0.0.1:8080;
+//
+// lists every node of the cluster (the same list on each of them) and says
+// which one this is. crud_handler forwards a request for an entity another
+// node owns to that node through a peer_client, on a few forwarding threads
+// so no io thread waits on a peer. Forwarded
+// requests carry X-Shard-Forwarded and are always answered locally.
+//
+// When a node joins, every node is restarted with the longer list, and a
+// background pass on each one hands the entities it no longer owns to
+// their new owner, a batch at a time. Until an entity has moved, its new
+// owner fetches it from the previous owner the first time it is asked for
+// it. That take-over window closes once every node reports (GET
+// /api/_shard) that its pass is done, or after takeover_window at most;
+// from then on an entity missing from its owner is simply missing.
+
+#include "hash_ring.h"
+#include "peer_client.h"
+#include "request_handler.h"
+#include <boost/asio/thread_pool.hpp>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+class shard_router {
+public:
+    static constexpr const char* forwarded_header = "X-Shard-Forwarded";
+    // Idle connections kept open per node.
+    static const size_t max_idle_connections = 16;
+    // Longest a peer has to connect, or to take a request or send a response.
+    static constexpr std::chrono::seconds peer_timeout{5};
+    // Largest response body taken from a peer, well above an entity or a
+    // listing page.
+    static const std::uint64_t max_response_size = 64 * 1024 * 1024;
+    // Where each node reports its rebalancing state.
+    static constexpr const char* status_target = "/api/_shard";
+    // Longest the take-over window stays open after rebalancing starts.
+    static constexpr std::chrono::minutes takeover_window{10};
+
+    // Moves the entity stored under key (such as "Books/<id>") to owner.
+    // Returns false if it should be tried again later.
+    using handoff = std::function<bool(const std::string& key, const std::string& owner)>;
+
+    // root is the location's root, whose entities the rebalancing pass walks.
+    shard_router(const std::string& self, const std::vector<std::string>& nodes, const std::string& root, size_t threads = 8);
+    // Stops rebalancing and finishes the forwards already queued.
+    ~shard_router();
+
+    const std::string& self() const { return self_; }
+    // Every node but this one.
+    std::vector<std::string> peers() const;
+    std::string owner(const std::string& key) const;
+    // The node that owned key before this one joined, or empty if this is
+    // the only node.
+    std::string previous_owner(const std::string& key) const;
+    // True once this node has handed off every entity it no longer owns.
+    bool handed_off() const { return handed_off_; }
+    // True while entities may still be waiting on their previous owner:
+    // until every node has handed off, or the window has run out.
+    bool taking_over() const { return taking_over_; }
+
+    // Sends request to node, marked as forwarded, and waits for its
+    // response. Returns false if the node cannot be reached.
+    bool exchange(const std::string& node, http::request<http::string_body> request, http::response<http::string_body>& response);
+    // Runs task on the forwarding threads.
+    void post(std::function<void()> task);
+    // Exchanges request with node on the forwarding threads and answers with
+    // its response, or 502 Bad Gateway if the node cannot be reached.
+    void forward(const std::string& node, http::request<http::string_body> request, response_callback respond);
+
+    // Starts walking root for entities owned by other nodes and handing
+    // them off with move. Only the first call has any effect.
+    void start(handoff move);
+
+    // Checks the shard directives of every CRUD location and creates their
+    // routers. Returns false if a node is not host:port, shard_self is not
+    // one of shard_nodes, or the location uses `storage log;`.
+    static bool load_config(const std::vector<HandlerConfig>& handlers);
+    // The router of a CRUD root, or nullptr if the location is not sharded.
+    static std::shared_ptr<shard_router> get_shared(const std::string& root);
+
+private:
+    void rebalance_loop();
+    // Hands off every entity other nodes own. Returns false if stopping.
+    bool hand_off_all();
+    // True if every peer reports it has handed off.
+    bool peers_handed_off();
+
+    std::string self_;
+    std::string root_;
+    hash_ring ring_;
+
+    peer_client peers_;
+    boost::asio::thread_pool forwarding_;
+
+    std::atomic<bool> handed_off_;
+    std::atomic<bool> taking_over_;
+
+    std::mutex rebalance_mutex_;
+    std::condition_variable rebalance_wake_;
+    bool stopping_ = false;
+    handoff move_;
+    std::thread rebalancing_;
+};
+
+#endif // SHARD_ROUTER_H
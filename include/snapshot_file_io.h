@@ -0,0 +1,131 @@
+#ifndef SNAPSHOTFILEIO_H
+#define SNAPSHOTFILEIO_H
+
+#include "i_file_io.h"
+#include "request_handler.h"
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Copy-on-write for point-in-time backups, selected with `backup on;` in a
+// crud_handler or markdown_handler location, which then answers
+// GET <prefix>/_backup with a tar archive of every file under its root.
+//
+// A backup does not stop writers. While one is open, the first write or
+// delete of each file through this decorator saves what the file held
+// before (or that it did not exist), and the archive takes that saved copy
+// instead of the file. Files the archive has already read are not saved
+// again, so a backup costs at most one extra copy of each file written
+// during it. Saved copies are held in memory up to a limit and spilled to
+// files under <root>/.backup past it. The archive itself is written there
+// too and streamed from disk, so neither grows with the size of the data
+// set in memory. Hidden files and directories (the write-ahead log, expiry
+// journal, writes in progress and .backup) are left out.
+//
+// `restore_from <archive>;` unpacks an archive into the location at
+// startup if its root is empty, through the same storage (so with
+// `compress on;` the restored files are compressed).
+class snapshot_file_io : public i_file_io {
+public:
+    // The backup state of a location, shared by all of its handlers.
+    class snapshot {
+    public:
+        // Saved copies past memory_limit bytes in total go to files.
+        explicit snapshot(const std::string& root, size_t memory_limit = default_memory_limit);
+        // Waits for a running backup to finish.
+        ~snapshot();
+
+        // Opens a snapshot of the location as it is now. Returns false if a
+        // backup is already open.
+        bool begin();
+        // Reads every file of the open snapshot through files into a tar
+        // archive written to tar_path, then closes the snapshot. Sets count to
+        // the files archived. Returns false, removing tar_path, if a file
+        // could not be read or the archive could not be written.
+        bool archive(i_file_io& files, const std::string& tar_path, size_t& count);
+        // Runs job, which should call archive, on the backup thread.
+        void run(std::function<void()> job);
+
+        // Called before path is written or deleted through inner: saves its
+        // contents if a snapshot is open and still needs them.
+        void preserve(i_file_io& inner, const std::string& path);
+        // Files saved by writers during the open or last snapshot.
+        size_t preserved();
+        // Of those, the ones spilled to files.
+        size_t spilled();
+        // Where archives and spilled copies are kept: <root>/.backup.
+        std::string directory() const;
+
+        static const size_t default_memory_limit = 64 << 20;
+
+    private:
+        // What a file held when the snapshot opened.
+        struct saved_copy {
+            bool existed = false;
+            std::string content;  // unless spilled
+            std::string spill;    // file holding the content, if spilled
+        };
+
+        // Drops the saved copies and their spill files.
+        void clear_saved();
+        static bool load(const saved_copy& saved, std::string& content);
+
+        std::string root_;
+        size_t memory_limit_;
+
+        std::mutex mutex_;
+        bool open_ = false;
+        std::uint64_t generation_ = 0;  // bumped by begin()
+        std::map<std::string, saved_copy> before_;
+        std::set<std::string> taken_;   // read by the archive, no longer needed
+        size_t memory_ = 0;             // bytes of saved copies held in memory
+        size_t next_spill_ = 0;         // names the next spill file
+        size_t preserved_ = 0;
+        size_t spilled_ = 0;
+        std::thread backup_;
+    };
+
+    snapshot_file_io(std::shared_ptr<i_file_io> inner, std::shared_ptr<snapshot> state);
+    virtual ~snapshot_file_io() = default;
+    bool open(const std::string& filename, std::ios_base::openmode mode) override;
+    bool write(const std::string& data) override;
+    bool close() override;
+    bool read(const std::string& filepath, std::string& content) override;
+    bool read_stored(const std::string& filepath, std::string& content, std::string& encoding) override;
+    bool delete_file(const std::string& filepath) override;
+    bool create_directories(const std::string& path) override;
+    bool list_directories(const std::string& path, std::vector<std::string>& directories) override;
+    bool exists(const std::string& filepath) override;
+    bool version(const std::string& filepath, std::string& tag) override;
+    void write_batch(const std::vector<batch_op>& ops, std::vector<bool>& results) override;
+
+    // Wraps storage if the location has `backup on;`.
+    static std::shared_ptr<i_file_io> wrap(const HandlerConfig& config, std::shared_ptr<i_file_io> storage);
+    // Checks the backup and restore_from directives and restores the
+    // locations that name an archive and are empty. Returns false if backup
+    // is not on or off, is combined with `storage log;` or `async_io on;`,
+    // or an archive cannot be read or unpacked.
+    static bool load_config(const std::vector<HandlerConfig>& handlers);
+    // Unpacks the tar archive at archive_path into root through storage.
+    static bool restore(const std::string& archive_path, const std::string& root, i_file_io& storage, size_t& count);
+    // The backup state of a location with `backup on;`, or nullptr.
+    static std::shared_ptr<snapshot> get_shared(const std::string& root);
+    // Answers GET <prefix>/_backup for the location at root: opens a
+    // snapshot and responds with its archive, read through files on the
+    // backup thread and spooled to a file the session streams (see
+    // request_handler::spooled_body_header), or 409 Conflict if a backup is
+    // already running. Returns false if the location does not have `backup on;`.
+    static bool answer_backup(const std::string& root, std::shared_ptr<i_file_io> files, response_callback respond);
+
+private:
+    std::shared_ptr<i_file_io> inner_;
+    std::shared_ptr<snapshot> state_;
+};
+
+#endif /* SNAPSHOTFILEIO_H */
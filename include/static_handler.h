@@ -2,20 +2,35 @@
 #define STATIC_HANDLER_H
 
 #include <string>
+#include <memory>
 #include "request_handler.h"
 
+struct open_file;
+struct cached_content;
+class asset_bundle;
+
 class static_handler: public request_handler {
 public:
-    static std::unique_ptr<request_handler> init(std::string root);
+    static std::unique_ptr<request_handler> init(const HandlerConfig& config);
+
+    // Constructor. With use_content_cache, file contents are served from
+    // (and added to) the shared content cache, with ETags.
+    static_handler(std::string root, bool use_content_cache = false);
 
-    // Constructor.
-    static_handler(std::string root);
+    // Constructor for a location served from a packed asset bundle.
+    explicit static_handler(std::shared_ptr<const asset_bundle> bundle);
 
     // Takes in an HTTP request for a static file and returns it if it exists.
     http::response<http::string_body> handle_request(http::request<http::string_body> request) override;
 
 private:
     std::string root_;
+    bool use_content_cache_;
+    std::shared_ptr<const asset_bundle> bundle_;
+    http::response<http::string_body> handle_bundle_request(const http::request<http::string_body>& request,
+                                                            const std::string& filepath, const std::string& parameter);
+    std::shared_ptr<const std::string> render_markdown(const std::string& path, std::shared_ptr<const open_file> file,
+                                                       std::shared_ptr<const cached_content> cached);
 };
 
 #endif
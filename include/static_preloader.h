@@ -0,0 +1,45 @@
+#ifndef STATIC_PRELOADER_H
+#define STATIC_PRELOADER_H
+
+// Warms the caches behind a static location at startup. Every file under the
+// root is opened through open_file_cache, read into content_cache (which
+// computes its ETag) until the location's budget is used, and markdown is
+// pre-rendered into markdown_cache. Enabled per location with
+//
+//   preload [budget];   # default budget 64m
+
+#include <atomic>
+#include <cstddef>
+#include <string>
+#include <vector>
+#include "config_parser.h"
+
+class static_preloader {
+public:
+    static_preloader(std::string root, size_t budget, size_t threads);
+
+    // Walks the root and loads files on a pool of worker threads. Blocks until done.
+    void run();
+
+    size_t files_loaded() const;
+    size_t bytes_loaded() const;
+    size_t markdown_rendered() const;
+
+    // Starts a background warm-up for every static_handler location with a
+    // preload directive and sizes the content cache to the sum of their
+    // budgets. health_handler reports 503 until every warm-up has finished.
+    // Returns false (and starts nothing) if a preload directive is malformed.
+    static bool start(const std::vector<HandlerConfig>& handlers);
+
+private:
+    void load(const std::string& path);
+
+    std::string root_;
+    size_t budget_;
+    size_t threads_;
+    std::atomic<size_t> files_{0};
+    std::atomic<size_t> bytes_{0};
+    std::atomic<size_t> rendered_{0};
+};
+
+#endif // STATIC_PRELOADER_H
@@ -0,0 +1,34 @@
+#ifndef TAR_ARCHIVE_H
+#define TAR_ARCHIVE_H
+
+// Writes and reads the POSIX ustar archives backups are made of, so a
+// backup can also be listed and unpacked with tar(1). Only regular files
+// are written; names are relative paths of up to 255 bytes, split between
+// the header's prefix and name fields.
+
+#include <cstdint>
+#include <functional>
+#include <string>
+
+class tar_archive {
+public:
+    // Called for each regular file of an archive. Returns false to stop.
+    using file_visitor = std::function<bool(const std::string& name, const std::string& content)>;
+
+    // Appends a regular file to archive. Returns false, appending nothing,
+    // if name is too long, empty, absolute or has a ".." part.
+    static bool append(const std::string& name, const std::string& content, std::uint64_t mtime, std::string& archive);
+    // Appends the two zero blocks that end an archive.
+    static void finish(std::string& archive);
+
+    // Calls visit for every regular file of archive, in order, and skips
+    // directories and other entries. Returns false if the archive is
+    // malformed, a name is unsafe to extract, or visit returns false.
+    static bool extract(const std::string& archive, const file_visitor& visit);
+
+    // True if name is relative, has no ".." part, and so stays below the
+    // directory it is extracted to.
+    static bool safe_name(const std::string& name);
+};
+
+#endif // TAR_ARCHIVE_H
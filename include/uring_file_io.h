@@ -0,0 +1,91 @@
+#ifndef URING_FILE_IO_H
+#define URING_FILE_IO_H
+
+#include "async_file_io.h"
+#include "pooled_file_io.h"
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+struct io_uring_sqe;
+struct io_uring_cqe;
+
+// async_file_io on an io_uring, driven through the raw system calls. A ring
+// thread turns each queued operation into a chain of submissions (open,
+// read or write, close, rename...), one step at a time, and every step
+// queued since the last io_uring_enter goes to the kernel in one call. New
+// operations wake the thread through an eventfd the ring itself reads.
+//
+// io_uring has no opcode for reading a directory, so listings run on a
+// small thread pool.
+class uring_file_io : public async_file_io {
+public:
+    // Returns nullptr if the kernel has no io_uring, or lacks an opcode.
+    static std::shared_ptr<uring_file_io> open(boost::asio::io_context& io, unsigned entries = 256);
+    // Finishes the operations already queued.
+    ~uring_file_io() override;
+
+    void read(const std::string& path, read_completion done) override;
+    void write(const std::string& path, std::string data, completion done) override;
+    void fsync(const std::string& path, completion done) override;
+    void unlink(const std::string& path, completion done) override;
+    void mkdir(const std::string& path, completion done) override;
+    void list(const std::string& path, list_completion done) override;
+    const char* backend() const override;
+
+    // Calls to io_uring_enter that submitted something, and the steps they
+    // submitted between them.
+    size_t submit_calls() const;
+    size_t submitted() const;
+
+private:
+    struct operation;
+
+    explicit uring_file_io(boost::asio::io_context& io);
+    bool setup(unsigned entries);
+    void enqueue(operation* op);
+    void loop();
+    // Queues the next step of op, or of the eventfd read if op is null.
+    io_uring_sqe* prepare(operation* op, std::uint8_t opcode);
+    void arm_wakeup();
+    void advance(operation* op, int result);
+    void finish(operation* op, bool ok);
+
+    boost::asio::io_context& io_;
+    pooled_file_io lister_;
+
+    int ring_fd_ = -1;
+    int event_fd_ = -1;
+    std::uint64_t event_count_ = 0;  // the eventfd read lands here
+    void* sq_ring_ = nullptr;
+    void* cq_ring_ = nullptr;
+    size_t sq_ring_size_ = 0;
+    size_t cq_ring_size_ = 0;
+    io_uring_sqe* sqes_ = nullptr;
+    size_t sqes_size_ = 0;
+    unsigned* sq_head_ = nullptr;
+    unsigned* sq_tail_ = nullptr;
+    unsigned* sq_mask_ = nullptr;
+    unsigned* sq_array_ = nullptr;
+    unsigned* cq_head_ = nullptr;
+    unsigned* cq_tail_ = nullptr;
+    unsigned* cq_mask_ = nullptr;
+    io_uring_cqe* cqes_ = nullptr;
+    unsigned entries_ = 0;
+
+    // Owned by the ring thread.
+    unsigned to_submit_ = 0;
+    size_t active_ = 0;  // operations with a step in the ring
+
+    std::mutex mutex_;
+    std::deque<operation*> queued_;
+    bool stopping_ = false;
+    std::thread thread_;
+
+    std::atomic<size_t> submit_calls_{0};
+    std::atomic<size_t> submitted_{0};
+};
+
+#endif // URING_FILE_IO_H
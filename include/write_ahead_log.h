@@ -0,0 +1,113 @@
+#ifndef WRITE_AHEAD_LOG_H
+#define WRITE_AHEAD_LOG_H
+
+// An append-only redo log with group commit. Concurrent commit() calls are
+// batched: whichever caller finds no flush in progress becomes the leader,
+// writes every pending record with one write() and one fdatasync(), and
+// wakes the callers whose records were in the batch. A commit returns only
+// once its record is on stable storage, so N concurrent writers cost about
+// one fsync instead of N.
+//
+// Record layout: crc32 | length | payload, with the crc over the payload.
+// A torn record at the tail (from a crash mid-write) ends replay.
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <thread>
+
+// Power-of-two bucketed histogram, safe to record into from any thread.
+class log2_histogram {
+public:
+    void record(std::uint64_t value);
+    std::uint64_t count() const;
+    // Upper bound of the bucket holding the given percentile (0-100).
+    std::uint64_t percentile(double p) const;
+    std::uint64_t max() const;
+    // "count=N p50=X p90=X p99=X max=X"
+    std::string summary() const;
+
+private:
+    static const int buckets = 64;
+    std::atomic<std::uint64_t> counts_[buckets] = {};
+    std::atomic<std::uint64_t> max_{0};
+};
+
+class write_ahead_log {
+public:
+    // Opens or creates the log at path. Throws std::runtime_error on failure.
+    explicit write_ahead_log(const std::string& path);
+    ~write_ahead_log();
+
+    // Calls apply(payload) for every intact record, oldest first. Returns
+    // false if the log cannot be read.
+    bool replay(const std::function<void(const std::string&)>& apply);
+
+    // Makes payload durable, then runs apply() (which updates the data the
+    // record describes) before any checkpoint can discard the record.
+    // Returns false if the log write or apply() failed. After an fsync
+    // failure the log refuses further commits, since the kernel may have
+    // dropped the dirty pages.
+    bool commit(const std::string& payload, const std::function<bool()>& apply);
+
+    // Waits for in-flight commits to finish applying, calls flush() to make
+    // the applied data durable, and empties the log. Returns false (keeping
+    // the log) if flush() fails.
+    bool checkpoint(const std::function<bool()>& flush);
+
+    // Log size past which commit() triggers a checkpoint with flush.
+    void set_checkpoint(std::uint64_t bytes, std::function<bool()> flush);
+
+    std::uint64_t size();
+    std::uint64_t commits() const;
+    std::uint64_t fsyncs() const;
+    const log2_histogram& batch_sizes() const;
+    const log2_histogram& commit_latency_us() const;
+
+    // Logs "[WalMetrics]" lines with the batch size and latency histograms.
+    // Called at each checkpoint.
+    void log_metrics() const;
+    // Also logs them every interval, from a thread of this log, whenever
+    // there have been commits since the last time, so they show up on a
+    // server that writes too little to reach a checkpoint.
+    void report_metrics(std::chrono::milliseconds interval);
+
+private:
+    std::string path_;
+    int fd_ = -1;
+
+    // Guards the pending batch and flush state.
+    std::mutex mutex_;
+    std::condition_variable flushed_;
+    std::string pending_;
+    size_t pending_records_ = 0;
+    std::uint64_t open_batch_ = 1;     // batch new records join
+    std::uint64_t durable_batch_ = 0;  // every batch up to this one is on disk
+    bool flushing_ = false;
+    bool failed_ = false;
+    std::uint64_t size_ = 0;
+
+    // Commits hold it shared from before their record is written until it is
+    // applied; checkpoint() holds it exclusively while truncating.
+    std::shared_mutex checkpoint_mutex_;
+    std::uint64_t checkpoint_bytes_ = 0;
+    std::function<bool()> checkpoint_flush_;
+    std::atomic<bool> checkpointing_{false};
+
+    std::atomic<std::uint64_t> commits_{0};
+    std::atomic<std::uint64_t> fsyncs_{0};
+    log2_histogram batch_sizes_;
+    log2_histogram commit_latency_us_;
+
+    std::mutex reporter_mutex_;
+    std::condition_variable reporter_wake_;
+    bool stopping_ = false;
+    std::thread reporter_;
+};
+
+#endif // WRITE_AHEAD_LOG_H
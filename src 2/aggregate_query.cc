@@ -0,0 +1,187 @@
+#include "aggregate_query.h"
+#include "json_validator.h"
+#include <algorithm>
+#include <charconv>
+#include <limits>
+
+namespace {
+
+bool is_space(char c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+// Steps over the value at json[i], whatever it is.
+bool skip_value(std::string_view json, size_t& i) {
+    bool escaped = false;
+    if (i >= json.size()) {
+        return false;
+    }
+    if (json[i] == '"') {
+        return json_validator::skip_string(json, i, escaped);
+    }
+    if (json[i] != '{' && json[i] != '[') {
+        size_t start = i;
+        while (i < json.size() && json[i] != ',' && json[i] != '}' && json[i] != ']' && !is_space(json[i])) {
+            i++;
+        }
+        return i > start;
+    }
+    size_t depth = 0;
+    while (i < json.size()) {
+        char c = json[i];
+        if (c == '"') {
+            if (!json_validator::skip_string(json, i, escaped)) {
+                return false;
+            }
+            continue;
+        }
+        i++;
+        if (c == '{' || c == '[') {
+            depth++;
+        } else if ((c == '}' || c == ']') && --depth == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool parse_number(std::string_view raw, double& number) {
+    if (raw.empty() || (raw[0] != '-' && (raw[0] < '0' || raw[0] > '9'))) {
+        return false;
+    }
+    auto parsed = std::from_chars(raw.data(), raw.data() + raw.size(), number);
+    return parsed.ec == std::errc() && parsed.ptr == raw.data() + raw.size();
+}
+
+}
+
+double aggregate_query::group::value(operation op) const {
+    switch (op) {
+        case operation::count:
+            return static_cast<double>(count);
+        case operation::sum:
+            return sum;
+        case operation::min:
+            return min;
+        case operation::max:
+            return max;
+        case operation::avg:
+            return count > 0 ? sum / count : std::numeric_limits<double>::quiet_NaN();
+    }
+    return 0;
+}
+
+bool aggregate_query::parse(const std::string& op, const std::string& field, const std::string& group_by, std::string& error) {
+    static const std::map<std::string, operation> operations = {
+        {"count", operation::count}, {"sum", operation::sum}, {"min", operation::min},
+        {"max", operation::max}, {"avg", operation::avg}};
+    auto found = operations.find(op);
+    if (found == operations.end()) {
+        error = "op must be one of count, sum, min, max or avg";
+        return false;
+    }
+    if (found->second != operation::count && field.empty()) {
+        error = "op=" + op + " needs a field";
+        return false;
+    }
+    op_ = found->second;
+    field_ = op_ == operation::count ? "" : field;
+    group_by_ = group_by;
+    return true;
+}
+
+bool aggregate_query::extract(std::string_view json, const std::vector<std::string_view>& names,
+                              std::vector<std::string_view>& values) {
+    values.assign(names.size(), std::string_view());
+    size_t i = 0;
+    json_validator::skip_space(json, i);
+    if (i >= json.size() || json[i] != '{') {
+        return false;
+    }
+    i++;
+    json_validator::skip_space(json, i);
+    if (i < json.size() && json[i] == '}') {
+        return true;
+    }
+    std::string unescaped;
+    while (i < json.size() && json[i] == '"') {
+        size_t key_start = i;
+        bool escaped = false;
+        if (!json_validator::skip_string(json, i, escaped)) {
+            return false;
+        }
+        std::string_view key = json.substr(key_start + 1, i - key_start - 2);
+        if (escaped) {
+            unescaped.clear();
+            if (!json_validator::unescape(json.substr(key_start, i - key_start), unescaped)) {
+                return false;
+            }
+            key = unescaped;
+        }
+        json_validator::skip_space(json, i);
+        if (i >= json.size() || json[i] != ':') {
+            return false;
+        }
+        i++;
+        json_validator::skip_space(json, i);
+        size_t value_start = i;
+        if (!skip_value(json, i)) {
+            return false;
+        }
+        // A repeated key takes its last value, as most parsers do.
+        for (size_t n = 0; n < names.size(); n++) {
+            if (!names[n].empty() && names[n] == key) {
+                values[n] = json.substr(value_start, i - value_start);
+            }
+        }
+        json_validator::skip_space(json, i);
+        if (i < json.size() && json[i] == ',') {
+            i++;
+            json_validator::skip_space(json, i);
+            continue;
+        }
+        return i < json.size() && json[i] == '}';
+    }
+    return false;
+}
+
+bool aggregate_query::add(std::string_view json, std::map<std::string, group>& groups) const {
+    std::vector<std::string_view> values;
+    if (!extract(json, {field_, group_by_}, values)) {
+        return false;
+    }
+
+    double number = 0;
+    if (op_ != operation::count && !parse_number(values[0], number)) {
+        return false;
+    }
+
+    std::string key;
+    if (!group_by_.empty()) {
+        std::string_view raw = values[1];
+        if (raw.empty() || raw[0] == '{' || raw[0] == '[') {
+            return false;
+        }
+        if (raw[0] != '"') {
+            key = raw;
+        } else if (!json_validator::unescape(raw, key)) {
+            return false;
+        }
+    }
+
+    group& into = groups[key];
+    into.min = into.count == 0 ? number : std::min(into.min, number);
+    into.max = into.count == 0 ? number : std::max(into.max, number);
+    into.count++;
+    into.sum += number;
+    return true;
+}
+
+void aggregate_query::run(const std::vector<std::string>& ids, const reader& read, std::map<std::string, group>& groups) const {
+    std::string data;
+    for (const auto& id : ids) {
+        if (read(id, data)) {
+            add(data, groups);
+        }
+    }
+}
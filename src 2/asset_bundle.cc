@@ -0,0 +1,333 @@
+#include "asset_bundle.h"
+#include "config_parser.h"
+#include "content_cache.h"
+#include "mime_types.h"
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <zlib.h>
+
+namespace {
+
+const char bundle_magic[8] = {'A', 'S', 'S', 'E', 'T', 'B', 'N', 'D'};
+const std::uint32_t bundle_version = 1;
+
+struct bundle_header {
+    char magic[8];
+    std::uint32_t version;
+    std::uint32_t count;
+    std::uint64_t records_offset;
+    std::uint64_t slots_offset;
+    std::uint32_t slot_count;
+    std::uint32_t reserved;
+};
+static_assert(sizeof(bundle_header) == 40, "bundle header layout changed");
+
+std::uint64_t align8(std::uint64_t offset) {
+    return (offset + 7) & ~std::uint64_t(7);
+}
+
+// Range check that cannot overflow.
+bool within(std::uint64_t offset, std::uint64_t length, std::uint64_t limit) {
+    return offset <= limit && length <= limit - offset;
+}
+
+std::string gzip(const std::string& data) {
+    z_stream stream;
+    std::memset(&stream, 0, sizeof(stream));
+    // 15 + 16 selects a gzip wrapper rather than zlib's.
+    if (deflateInit2(&stream, Z_BEST_COMPRESSION, Z_DEFLATED, 15 + 16, 9, Z_DEFAULT_STRATEGY) != Z_OK) {
+        return "";
+    }
+    std::string out(deflateBound(&stream, data.size()), '\0');
+    stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data.data()));
+    stream.avail_in = data.size();
+    stream.next_out = reinterpret_cast<Bytef*>(&out[0]);
+    stream.avail_out = out.size();
+    int result = deflate(&stream, Z_FINISH);
+    out.resize(stream.total_out);
+    deflateEnd(&stream);
+    return result == Z_STREAM_END ? out : "";
+}
+
+std::int64_t mtime_of(const std::string& path) {
+    struct stat st;
+    if (::stat(path.c_str(), &st) != 0) {
+        return 0;
+    }
+    return static_cast<std::int64_t>(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+}
+
+}
+
+struct asset_bundle::record {
+    std::uint64_t hash;
+    std::uint64_t path_offset;
+    std::uint32_t path_length;
+    std::uint32_t type_length;
+    std::uint64_t type_offset;
+    std::uint64_t data_offset;
+    std::uint64_t data_length;
+    std::uint64_t gzip_offset;
+    std::uint64_t gzip_length;
+    std::int64_t mtime;
+    char etag[24];  // NUL padded
+};
+
+asset_bundle::~asset_bundle() {
+    if (base_ != nullptr) {
+        ::munmap(const_cast<char*>(base_), length_);
+    }
+}
+
+std::uint64_t asset_bundle::hash(std::string_view path) {
+    std::uint64_t hash = 14695981039346656037ULL;
+    for (unsigned char c : path) {
+        hash ^= c;
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+bool asset_bundle::open(const std::string& path) {
+    static_assert(sizeof(record) == 96, "bundle record layout changed");
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat st;
+    if (::fstat(fd, &st) != 0 || st.st_size < static_cast<off_t>(sizeof(bundle_header))) {
+        ::close(fd);
+        return false;
+    }
+    void* mapping = ::mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (mapping == MAP_FAILED) {
+        return false;
+    }
+    base_ = static_cast<const char*>(mapping);
+    length_ = st.st_size;
+    path_ = path;
+
+    bundle_header header;
+    std::memcpy(&header, base_, sizeof(header));
+    bool valid = std::memcmp(header.magic, bundle_magic, sizeof(bundle_magic)) == 0 &&
+                 header.version == bundle_version &&
+                 header.records_offset % 8 == 0 && header.slots_offset % 4 == 0 &&
+                 within(header.records_offset, std::uint64_t(header.count) * sizeof(record), length_) &&
+                 header.slot_count > header.count && (header.slot_count & (header.slot_count - 1)) == 0 &&
+                 within(header.slots_offset, std::uint64_t(header.slot_count) * sizeof(std::uint32_t), length_);
+    if (valid) {
+        count_ = header.count;
+        slot_mask_ = header.slot_count - 1;
+        records_offset_ = header.records_offset;
+        slots_offset_ = header.slots_offset;
+        for (std::uint32_t i = 0; valid && i < count_; i++) {
+            const record& r = records()[i];
+            valid = within(r.path_offset, r.path_length, length_) && within(r.type_offset, r.type_length, length_) &&
+                    within(r.data_offset, r.data_length, length_) && within(r.gzip_offset, r.gzip_length, length_);
+        }
+        for (std::uint32_t i = 0; valid && i <= slot_mask_; i++) {
+            valid = slots()[i] <= count_;
+        }
+    }
+    if (!valid) {
+        ::munmap(const_cast<char*>(base_), length_);
+        base_ = nullptr;
+        length_ = 0;
+        count_ = 0;
+        return false;
+    }
+    return true;
+}
+
+const asset_bundle::record* asset_bundle::records() const {
+    return reinterpret_cast<const record*>(base_ + records_offset_);
+}
+
+const std::uint32_t* asset_bundle::slots() const {
+    return reinterpret_cast<const std::uint32_t*>(base_ + slots_offset_);
+}
+
+std::string_view asset_bundle::view(std::uint64_t offset, std::uint64_t length) const {
+    return std::string_view(base_ + offset, length);
+}
+
+bool asset_bundle::find(std::string_view path, asset* found) const {
+    if (count_ == 0) {
+        return false;
+    }
+    std::uint64_t h = hash(path);
+    for (std::uint32_t i = h & slot_mask_, probes = 0; probes <= slot_mask_; i = (i + 1) & slot_mask_, probes++) {
+        std::uint32_t slot = slots()[i];
+        if (slot == 0) {
+            return false;
+        }
+        const record& r = records()[slot - 1];
+        if (r.hash != h || view(r.path_offset, r.path_length) != path) {
+            continue;
+        }
+        found->path = view(r.path_offset, r.path_length);
+        found->content_type = view(r.type_offset, r.type_length);
+        found->etag = std::string_view(r.etag, strnlen(r.etag, sizeof(r.etag)));
+        found->data = view(r.data_offset, r.data_length);
+        found->gzip = view(r.gzip_offset, r.gzip_length);
+        found->mtime = r.mtime;
+        return true;
+    }
+    return false;
+}
+
+size_t asset_bundle::size() const {
+    return count_;
+}
+
+const std::string& asset_bundle::path() const {
+    return path_;
+}
+
+std::shared_ptr<const asset_bundle> asset_bundle::get_shared(const std::string& path) {
+    static std::mutex mutex;
+    static std::map<std::string, std::shared_ptr<const asset_bundle>> bundles;
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = bundles.find(path);
+    if (it != bundles.end()) {
+        return it->second;
+    }
+    auto bundle = std::make_shared<asset_bundle>();
+    if (!bundle->open(path)) {
+        return nullptr;
+    }
+    bundles[path] = bundle;
+    return bundle;
+}
+
+bool asset_bundle::load_config(const std::vector<HandlerConfig>& handlers) {
+    for (const auto& handler : handlers) {
+        auto directive = handler.directives.find("bundle");
+        if (handler.name != "static_handler" || directive == handler.directives.end()) {
+            continue;
+        }
+        if (directive->second.size() != 1 || get_shared(directive->second[0]) == nullptr) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void asset_bundle_writer::add(const std::string& path, const std::string& content_type, std::string data, std::int64_t mtime) {
+    entry e;
+    e.path = path;
+    e.content_type = content_type;
+    e.etag = content_cache::make_etag(data);
+    e.gzip = gzip(data);
+    if (e.gzip.empty() || e.gzip.size() > data.size() - data.size() / 8) {
+        e.gzip.clear();
+    }
+    e.data = std::move(data);
+    e.mtime = mtime;
+    entries_.push_back(std::move(e));
+}
+
+bool asset_bundle_writer::add_directory(const std::string& root, const mime_types& types) {
+    std::error_code ec;
+    for (auto it = std::filesystem::recursive_directory_iterator(root, ec);
+         !ec && it != std::filesystem::recursive_directory_iterator(); it.increment(ec)) {
+        if (!it->is_regular_file(ec)) {
+            continue;
+        }
+        std::ifstream file(it->path(), std::ios::binary);
+        if (!file) {
+            return false;
+        }
+        std::stringstream content;
+        content << file.rdbuf();
+        std::string extension = it->path().extension().string();
+        if (!extension.empty()) {
+            extension = extension.substr(1);
+        }
+        add("/" + it->path().lexically_relative(root).generic_string(), std::string(types.lookup(extension)),
+            content.str(), mtime_of(it->path().string()));
+    }
+    return !ec;
+}
+
+bool asset_bundle_writer::write(const std::string& path) const {
+    std::uint32_t slot_count = 1;
+    while (slot_count < entries_.size() * 2 + 1) {
+        slot_count <<= 1;
+    }
+
+    // Lay out blobs after the header, then the records and the slot table.
+    std::string blobs;
+    std::vector<asset_bundle::record> records(entries_.size());
+    auto append = [&blobs](const std::string& blob) {
+        std::uint64_t offset = sizeof(bundle_header) + blobs.size();
+        blobs += blob;
+        blobs.resize(align8(blobs.size()), '\0');
+        return offset;
+    };
+    std::vector<std::uint32_t> slots(slot_count, 0);
+    for (size_t i = 0; i < entries_.size(); i++) {
+        const entry& e = entries_[i];
+        asset_bundle::record& r = records[i];
+        std::memset(&r, 0, sizeof(r));
+        r.hash = asset_bundle::hash(e.path);
+        r.path_offset = append(e.path);
+        r.path_length = e.path.size();
+        r.type_offset = append(e.content_type);
+        r.type_length = e.content_type.size();
+        r.data_offset = append(e.data);
+        r.data_length = e.data.size();
+        r.gzip_offset = e.gzip.empty() ? 0 : append(e.gzip);
+        r.gzip_length = e.gzip.size();
+        r.mtime = e.mtime;
+        std::strncpy(r.etag, e.etag.c_str(), sizeof(r.etag));
+
+        std::uint32_t slot = r.hash & (slot_count - 1);
+        while (slots[slot] != 0) {
+            if (records[slots[slot] - 1].hash == r.hash && entries_[slots[slot] - 1].path == e.path) {
+                return false;  // duplicate path
+            }
+            slot = (slot + 1) & (slot_count - 1);
+        }
+        slots[slot] = i + 1;
+    }
+
+    bundle_header header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, bundle_magic, sizeof(bundle_magic));
+    header.version = bundle_version;
+    header.count = entries_.size();
+    header.records_offset = sizeof(bundle_header) + blobs.size();
+    header.slots_offset = header.records_offset + records.size() * sizeof(asset_bundle::record);
+    header.slot_count = slot_count;
+
+    std::string temp = path + ".tmp";
+    {
+        std::ofstream out(temp, std::ios::binary | std::ios::trunc);
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        out.write(blobs.data(), blobs.size());
+        out.write(reinterpret_cast<const char*>(records.data()), records.size() * sizeof(asset_bundle::record));
+        out.write(reinterpret_cast<const char*>(slots.data()), slots.size() * sizeof(std::uint32_t));
+        if (!out.flush()) {
+            std::remove(temp.c_str());
+            return false;
+        }
+    }
+    return std::rename(temp.c_str(), path.c_str()) == 0;
+}
+
+size_t asset_bundle_writer::size() const {
+    return entries_.size();
+}
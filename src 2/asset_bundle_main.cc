@@ -0,0 +1,33 @@
+// Packs a static root into an asset bundle.
+//
+// Usage: ./asset_bundle <root directory> <output bundle> [mime.types file]
+
+#include <iostream>
+#include <string>
+#include "asset_bundle.h"
+#include "mime_types.h"
+
+int main(int argc, char* argv[]) {
+  if (argc != 3 && argc != 4) {
+    std::cerr << "Usage: ./asset_bundle <root directory> <output bundle> [mime.types file]\n";
+    return 1;
+  }
+
+  mime_types types;
+  if (argc == 4 && !types.load_file(argv[3])) {
+    std::cerr << "Unable to read " << argv[3] << std::endl;
+    return 1;
+  }
+
+  asset_bundle_writer writer;
+  if (!writer.add_directory(argv[1], types)) {
+    std::cerr << "Unable to read " << argv[1] << std::endl;
+    return 1;
+  }
+  if (!writer.write(argv[2])) {
+    std::cerr << "Unable to write " << argv[2] << std::endl;
+    return 1;
+  }
+  std::cout << "Packed " << writer.size() << " files into " << argv[2] << std::endl;
+  return 0;
+}
@@ -0,0 +1,80 @@
+#include "async_file_io.h"
+#include "config_parser.h"
+#include "logger.h"
+#include "pooled_file_io.h"
+#include "uring_file_io.h"
+#include <atomic>
+#include <filesystem>
+#include <mutex>
+#include <unistd.h>
+
+namespace {
+
+std::mutex shared_mutex;
+std::shared_ptr<async_file_io> shared_files;
+
+const char temporary_marker[] = ".tmp-";
+
+}
+
+std::shared_ptr<async_file_io> async_file_io::create(boost::asio::io_context& io, size_t threads, bool force_threads) {
+    if (!force_threads) {
+        std::shared_ptr<async_file_io> ring = uring_file_io::open(io);
+        if (ring) {
+            return ring;
+        }
+    }
+    return std::make_shared<pooled_file_io>(io, threads);
+}
+
+bool async_file_io::load_config(const std::vector<HandlerConfig>& handlers, boost::asio::io_context& io) {
+    bool used = false;
+    for (const auto& handler : handlers) {
+        auto directive = handler.directives.find("async_io");
+        if (handler.name != "markdown_handler" || directive == handler.directives.end()) {
+            continue;
+        }
+        if (directive->second == std::vector<std::string>{"off"}) {
+            continue;
+        }
+        // Async operations go straight to the files, around any decorator.
+        if (directive->second != std::vector<std::string>{"on"} || handler.directives.count("compress") > 0 ||
+            handler.directives.count("file_cache") > 0) {
+            return false;
+        }
+        used = true;
+    }
+    if (used && !get_shared()) {
+        std::shared_ptr<async_file_io> files = create(io);
+        Logger::get_global_log()->logInfo(std::string("Asynchronous file I/O using ") + files->backend());
+        set_shared(files);
+    }
+    return true;
+}
+
+std::shared_ptr<async_file_io> async_file_io::get_shared() {
+    std::lock_guard<std::mutex> lock(shared_mutex);
+    return shared_files;
+}
+
+void async_file_io::set_shared(std::shared_ptr<async_file_io> files) {
+    std::shared_ptr<async_file_io> previous;
+    {
+        std::lock_guard<std::mutex> lock(shared_mutex);
+        previous.swap(shared_files);
+        shared_files = files;
+    }
+    // The previous instance finishes its operations outside the lock.
+}
+
+std::string async_file_io::temporary_path(const std::string& path) {
+    static std::atomic<unsigned long> counter{0};
+    std::filesystem::path target(path);
+    std::string name = "." + target.filename().string() + temporary_marker + std::to_string(::getpid()) + "-" +
+                       std::to_string(counter++);
+    return (target.parent_path() / name).string();
+}
+
+bool async_file_io::is_temporary(const std::string& name) {
+    return !name.empty() && name[0] == '.' && name.find(temporary_marker) != std::string::npos;
+}
@@ -0,0 +1,24 @@
+#include "bounded_pool.h"
+#include <boost/asio/post.hpp>
+#include <algorithm>
+
+bounded_pool::bounded_pool(size_t threads, size_t max_pending)
+    : pool_(std::max<size_t>(threads, 1)), max_pending_(std::max<size_t>(max_pending, 1)) {}
+
+bounded_pool::~bounded_pool() {
+    pool_.join();
+}
+
+bool bounded_pool::post(std::function<void()> task) {
+    size_t pending = pending_.load();
+    do {
+        if (pending >= max_pending_) {
+            return false;
+        }
+    } while (!pending_.compare_exchange_weak(pending, pending + 1));
+    boost::asio::post(pool_, [this, task = std::move(task)]() {
+        task();
+        pending_--;
+    });
+    return true;
+}
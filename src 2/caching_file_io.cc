@@ -0,0 +1,265 @@
+#include "caching_file_io.h"
+#include "config_parser.h"
+#include <filesystem>
+#include <map>
+
+namespace {
+
+// The same file spelled differently ("./root/a", "root/b/../a") is one entry.
+std::filesystem::path normal(const std::string& path) {
+    std::filesystem::path normalized = std::filesystem::path(path).lexically_normal();
+    // Directories are listed with or without a trailing slash.
+    return normalized.has_filename() || !normalized.has_relative_path() ? normalized : normalized.parent_path();
+}
+
+// Files and directories share the cache, told apart by their key prefix.
+std::string file_key(const std::string& path) {
+    return "f " + normal(path).string();
+}
+
+std::string listing_key(const std::string& path) {
+    return "d " + normal(path).string();
+}
+
+std::string parent_listing_key(const std::string& path) {
+    return "d " + normal(path).parent_path().string();
+}
+
+}
+
+caching_file_io::cache::cache(size_t budget): budget_(budget) {}
+
+std::shared_ptr<const std::string> caching_file_io::cache::file(const std::string& path) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = entries_.find(file_key(path));
+    if (it == entries_.end()) {
+        misses_++;
+        return nullptr;
+    }
+    lru_.splice(lru_.begin(), lru_, it->second.lru);
+    hits_++;
+    return it->second.content;
+}
+
+std::shared_ptr<const std::vector<std::string>> caching_file_io::cache::listing(const std::string& path) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = entries_.find(listing_key(path));
+    if (it == entries_.end()) {
+        misses_++;
+        return nullptr;
+    }
+    lru_.splice(lru_.begin(), lru_, it->second.lru);
+    hits_++;
+    return it->second.names;
+}
+
+std::uint64_t caching_file_io::cache::generation() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return generation_;
+}
+
+void caching_file_io::cache::put_file(const std::string& path, std::shared_ptr<const std::string> content,
+                                      std::uint64_t generation) {
+    std::string key = file_key(path);
+    size_t bytes = key.size() + content->size();
+    put(key, entry{content, nullptr, bytes, {}}, generation);
+}
+
+void caching_file_io::cache::put_listing(const std::string& path, std::shared_ptr<const std::vector<std::string>> names,
+                                         std::uint64_t generation) {
+    std::string key = listing_key(path);
+    size_t bytes = key.size();
+    for (const auto& name : *names) {
+        bytes += name.size();
+    }
+    put(key, entry{nullptr, names, bytes, {}}, generation);
+}
+
+void caching_file_io::cache::put(const std::string& key, entry value, std::uint64_t generation) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    // Something was written or deleted while this was being read, so it may
+    // already be stale.
+    if (generation != generation_ || value.bytes > budget_) {
+        return;
+    }
+    erase(key);
+    while (used_ + value.bytes > budget_ && !lru_.empty()) {
+        erase(lru_.back());
+    }
+    lru_.push_front(key);
+    value.lru = lru_.begin();
+    used_ += value.bytes;
+    entries_.emplace(key, std::move(value));
+}
+
+void caching_file_io::cache::invalidate(const std::string& path) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    generation_++;
+    erase(file_key(path));
+    erase(parent_listing_key(path));
+}
+
+void caching_file_io::cache::erase(const std::string& key) {
+    auto it = entries_.find(key);
+    if (it == entries_.end()) {
+        return;
+    }
+    used_ -= it->second.bytes;
+    lru_.erase(it->second.lru);
+    entries_.erase(it);
+}
+
+size_t caching_file_io::cache::budget() const {
+    return budget_;
+}
+
+size_t caching_file_io::cache::used() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return used_;
+}
+
+size_t caching_file_io::cache::size() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return entries_.size();
+}
+
+size_t caching_file_io::cache::hits() const {
+    return hits_;
+}
+
+size_t caching_file_io::cache::misses() const {
+    return misses_;
+}
+
+caching_file_io::caching_file_io(std::shared_ptr<i_file_io> inner, std::shared_ptr<cache> files)
+    : inner_(inner), cache_(files) {}
+
+bool caching_file_io::open(const std::string& filename, std::ios_base::openmode mode) {
+    if (!(mode & std::ios::out)) {
+        // Reading: the file is loaded (or already cached) here, and read()
+        // is served from memory.
+        return load(filename) != nullptr;
+    }
+    writing_ = filename;
+    cache_->invalidate(filename);
+    return inner_->open(filename, mode);
+}
+
+bool caching_file_io::write(const std::string& data) {
+    bool written = inner_->write(data);
+    cache_->invalidate(writing_);
+    return written;
+}
+
+bool caching_file_io::close() {
+    bool closed = inner_->close();
+    if (!writing_.empty()) {
+        // Drops anything read while the file was half written.
+        cache_->invalidate(writing_);
+        writing_.clear();
+    }
+    return closed;
+}
+
+bool caching_file_io::read(const std::string& filepath, std::string& content) {
+    std::shared_ptr<const std::string> cached = load(filepath);
+    if (!cached) {
+        return false;
+    }
+    content = *cached;
+    return true;
+}
+
+bool caching_file_io::delete_file(const std::string& filepath) {
+    cache_->invalidate(filepath);
+    bool deleted = inner_->delete_file(filepath);
+    cache_->invalidate(filepath);
+    return deleted;
+}
+
+bool caching_file_io::create_directories(const std::string& path) {
+    return inner_->create_directories(path);
+}
+
+bool caching_file_io::list_directories(const std::string& path, std::vector<std::string>& directories) {
+    std::shared_ptr<const std::vector<std::string>> names = cache_->listing(path);
+    if (!names) {
+        std::uint64_t generation = cache_->generation();
+        auto listed = std::make_shared<std::vector<std::string>>();
+        if (!inner_->list_directories(path, *listed)) {
+            return false;
+        }
+        cache_->put_listing(path, listed, generation);
+        names = listed;
+    }
+    directories.insert(directories.end(), names->begin(), names->end());
+    return true;
+}
+
+bool caching_file_io::exists(const std::string& filepath) {
+    return cache_->file(filepath) != nullptr || inner_->exists(filepath);
+}
+
+bool caching_file_io::version(const std::string& filepath, std::string& tag) {
+    return inner_->version(filepath, tag);
+}
+
+void caching_file_io::write_batch(const std::vector<batch_op>& ops, std::vector<bool>& results) {
+    for (const auto& op : ops) {
+        cache_->invalidate(op.path);
+    }
+    inner_->write_batch(ops, results);
+    for (const auto& op : ops) {
+        cache_->invalidate(op.path);
+    }
+}
+
+std::shared_ptr<const std::string> caching_file_io::load(const std::string& filepath) {
+    std::shared_ptr<const std::string> cached = cache_->file(filepath);
+    if (cached) {
+        return cached;
+    }
+    std::uint64_t generation = cache_->generation();
+    auto content = std::make_shared<std::string>();
+    if (!inner_->read(filepath, *content)) {
+        return nullptr;
+    }
+    cache_->put_file(filepath, content, generation);
+    return content;
+}
+
+std::shared_ptr<i_file_io> caching_file_io::wrap(const HandlerConfig& config, std::shared_ptr<i_file_io> storage) {
+    auto directive = config.directives.find("file_cache");
+    size_t budget;
+    if (directive == config.directives.end() || directive->second.size() != 1 ||
+        !ParseConfigSize(directive->second[0], &budget) || budget == 0) {
+        return storage;
+    }
+    return std::make_shared<caching_file_io>(storage, get_shared(config.root, budget));
+}
+
+bool caching_file_io::load_config(const std::vector<HandlerConfig>& handlers) {
+    for (const auto& handler : handlers) {
+        auto directive = handler.directives.find("file_cache");
+        if ((handler.name != "crud_handler" && handler.name != "markdown_handler") || directive == handler.directives.end()) {
+            continue;
+        }
+        size_t budget;
+        if (directive->second.size() != 1 ||
+            (directive->second[0] != "off" && !ParseConfigSize(directive->second[0], &budget))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+std::shared_ptr<caching_file_io::cache> caching_file_io::get_shared(const std::string& root, size_t budget) {
+    static std::mutex mutex;
+    static std::map<std::string, std::shared_ptr<cache>> caches;
+    std::lock_guard<std::mutex> lock(mutex);
+    std::shared_ptr<cache>& files = caches[root];
+    if (!files) {
+        files = std::make_shared<cache>(budget);
+    }
+    return files;
+}
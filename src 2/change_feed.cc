@@ -0,0 +1,168 @@
+#include "change_feed.h"
+#include <algorithm>
+#include <filesystem>
+
+namespace {
+
+// "root/Shoes", "root/Shoes/" and "root/./Shoes" are one entity.
+std::string key(const std::string& directory) {
+    std::filesystem::path normal = std::filesystem::path(directory).lexically_normal();
+    if (!normal.has_filename() && normal.has_parent_path()) {
+        normal = normal.parent_path();
+    }
+    return normal.string();
+}
+
+}
+
+change_feed::change_feed(size_t history, size_t max_watchers)
+    : history_(std::max<size_t>(history, 1)), max_watchers_(max_watchers) {
+    first_sequence_ = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+    next_sequence_ = first_sequence_ + 1;
+}
+
+change_feed::~change_feed() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    wake_.notify_all();
+    if (deadlines_.joinable()) {
+        deadlines_.join();
+    }
+}
+
+change_feed::log& change_feed::log_for(const std::string& directory) {
+    auto found = logs_.find(directory);
+    if (found == logs_.end()) {
+        // Nothing has changed in the directory since the feed began.
+        found = logs_.emplace(directory, log{{}, first_sequence_}).first;
+    }
+    return found->second;
+}
+
+void change_feed::record(const std::string& directory, const std::string& id, bool deleted) {
+    std::string name = key(directory);
+    std::list<watcher> woken;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        std::uint64_t sequence = next_sequence_++;
+        log& entries = log_for(name);
+        if (entries.changes.size() == history_) {
+            entries.start = entries.changes.front().sequence;
+            entries.changes.pop_front();
+        }
+        entries.changes.push_back(change{sequence, id, deleted});
+        for (auto it = watchers_.begin(); it != watchers_.end();) {
+            auto next = std::next(it);
+            if (it->directory == name && it->since < sequence) {
+                woken.splice(woken.end(), watchers_, it);
+            }
+            it = next;
+        }
+    }
+    for (auto& woke : woken) {
+        woke.notify();
+    }
+}
+
+bool change_feed::since(const std::string& directory, std::uint64_t since, size_t limit,
+                        std::vector<change>& changes, std::uint64_t& next) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    next = next_sequence_ - 1;
+    auto found = logs_.find(key(directory));
+    std::uint64_t start = found == logs_.end() ? first_sequence_ : found->second.start;
+    if (since < start) {
+        return false;
+    }
+    if (found == logs_.end()) {
+        return true;
+    }
+    const std::deque<change>& entries = found->second.changes;
+    auto it = std::upper_bound(entries.begin(), entries.end(), since,
+                               [](std::uint64_t sequence, const change& entry) { return sequence < entry.sequence; });
+    for (size_t taken = 0; it != entries.end() && (limit == 0 || taken < limit); ++it, ++taken) {
+        changes.push_back(*it);
+    }
+    if (it != entries.end()) {
+        next = changes.back().sequence;
+    }
+    return true;
+}
+
+bool change_feed::watch(const std::string& directory, std::uint64_t since,
+                        std::chrono::steady_clock::time_point deadline, std::function<void()> notify) {
+    std::string name = key(directory);
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (stopping_) {
+            return false;
+        }
+        // Checked under the lock record() takes, so no change can slip in
+        // between this check and registering the watcher.
+        auto found = logs_.find(name);
+        std::uint64_t start = found == logs_.end() ? first_sequence_ : found->second.start;
+        bool changed = found != logs_.end() && !found->second.changes.empty() &&
+                       found->second.changes.back().sequence > since;
+        if (!changed && since >= start) {
+            if (watchers_.size() >= max_watchers_) {
+                return false;
+            }
+            watchers_.push_back(watcher{name, since, deadline, std::move(notify)});
+            if (!deadlines_.joinable()) {
+                deadlines_ = std::thread(&change_feed::deadline_loop, this);
+            }
+            wake_.notify_one();
+            return true;
+        }
+    }
+    notify();
+    return true;
+}
+
+size_t change_feed::watchers() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return watchers_.size();
+}
+
+void change_feed::deadline_loop() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (!stopping_) {
+        if (watchers_.empty()) {
+            wake_.wait(lock);
+            continue;
+        }
+        // Copied, since the watcher may be woken and freed while we wait.
+        auto earliest = std::min_element(watchers_.begin(), watchers_.end(),
+                                         [](const watcher& a, const watcher& b) { return a.deadline < b.deadline; })->deadline;
+        if (wake_.wait_until(lock, earliest) != std::cv_status::timeout) {
+            continue;  // a watcher came or went; look again
+        }
+        std::list<watcher> expired;
+        auto now = std::chrono::steady_clock::now();
+        for (auto it = watchers_.begin(); it != watchers_.end();) {
+            auto next = std::next(it);
+            if (it->deadline <= now) {
+                expired.splice(expired.end(), watchers_, it);
+            }
+            it = next;
+        }
+        lock.unlock();
+        for (auto& timed_out : expired) {
+            timed_out.notify();
+        }
+        lock.lock();
+    }
+}
+
+std::shared_ptr<change_feed> change_feed::get_shared(const std::string& root) {
+    static std::mutex mutex;
+    static std::map<std::string, std::shared_ptr<change_feed>> feeds;
+    std::lock_guard<std::mutex> lock(mutex);
+    std::shared_ptr<change_feed>& feed = feeds[root];
+    if (!feed) {
+        feed = std::make_shared<change_feed>();
+    }
+    return feed;
+}
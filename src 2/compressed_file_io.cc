@@ -0,0 +1,301 @@
+#include "compressed_file_io.h"
+#include "config_parser.h"
+#include <algorithm>
+#include <fstream>
+#include <mutex>
+#include <set>
+#include <sstream>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+#include <zlib.h>
+
+namespace {
+
+const char dictionary_marker[] = "\x1f\x9e";
+
+bool is_gzip(std::string_view data) {
+    return data.size() >= 2 && data[0] == '\x1f' && data[1] == '\x8b';
+}
+
+bool is_dictionary_stream(std::string_view data) {
+    return data.size() >= 2 && data[0] == dictionary_marker[0] && data[1] == dictionary_marker[1];
+}
+
+// Inflates one gzip member or zlib stream from the front of input and
+// appends it to data, leaving input at what follows it.
+bool inflate_stream(std::string_view& input, bool gzip, const compressed_file_io::dictionaries* known, std::string& data) {
+    z_stream stream{};
+    // 15 + 16 expects a gzip wrapper, 15 a zlib one.
+    if (inflateInit2(&stream, gzip ? 15 + 16 : 15) != Z_OK) {
+        return false;
+    }
+    stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(input.data()));
+    stream.avail_in = input.size();
+    char buffer[16384];
+    int result;
+    do {
+        stream.next_out = reinterpret_cast<Bytef*>(buffer);
+        stream.avail_out = sizeof(buffer);
+        result = inflate(&stream, Z_NO_FLUSH);
+        if (result == Z_NEED_DICT) {
+            // stream.adler holds the ID of the dictionary the writer used.
+            result = Z_DATA_ERROR;
+            if (known) {
+                for (const auto& dictionary : *known) {
+                    const Bytef* bytes = reinterpret_cast<const Bytef*>(dictionary.second.data());
+                    if (adler32(adler32(0, nullptr, 0), bytes, dictionary.second.size()) == stream.adler) {
+                        result = inflateSetDictionary(&stream, bytes, dictionary.second.size());
+                        break;
+                    }
+                }
+            }
+        }
+        data.append(buffer, sizeof(buffer) - stream.avail_out);
+    } while (result == Z_OK);
+    input.remove_prefix(input.size() - stream.avail_in);
+    inflateEnd(&stream);
+    return result == Z_STREAM_END;
+}
+
+}
+
+compressed_file_io::compressed_file_io(std::shared_ptr<i_file_io> inner, const std::string& root,
+                                       std::shared_ptr<const dictionaries> entity_dictionaries)
+    : inner_(inner), root_(std::filesystem::path(root).lexically_normal()), dictionaries_(entity_dictionaries) {}
+
+bool compressed_file_io::open(const std::string& filename, std::ios_base::openmode mode) {
+    writing_ = (mode & std::ios::out) ? filename : "";
+    return inner_->open(filename, mode);
+}
+
+bool compressed_file_io::write(const std::string& data) {
+    // Each write is its own gzip member (or dictionary stream); a file
+    // written in several pieces reads back as their concatenation.
+    std::string compressed = compress(data, dictionary_for(writing_));
+    return !compressed.empty() && inner_->write(compressed);
+}
+
+bool compressed_file_io::close() {
+    writing_.clear();
+    return inner_->close();
+}
+
+bool compressed_file_io::read(const std::string& filepath, std::string& content) {
+    std::string stored;
+    return inner_->read(filepath, stored) && decompress(stored, dictionaries_.get(), content);
+}
+
+bool compressed_file_io::read_stored(const std::string& filepath, std::string& content, std::string& encoding) {
+    std::string stored;
+    if (!inner_->read(filepath, stored)) {
+        return false;
+    }
+    // Each write replaces the whole file, so a file that starts as gzip is
+    // all gzip members: a valid gzip body as it stands.
+    if (is_gzip(stored)) {
+        content.swap(stored);
+        encoding = "gzip";
+        return true;
+    }
+    encoding.clear();
+    return decompress(stored, dictionaries_.get(), content);
+}
+
+bool compressed_file_io::delete_file(const std::string& filepath) {
+    return inner_->delete_file(filepath);
+}
+
+bool compressed_file_io::create_directories(const std::string& path) {
+    return inner_->create_directories(path);
+}
+
+bool compressed_file_io::list_directories(const std::string& path, std::vector<std::string>& directories) {
+    return inner_->list_directories(path, directories);
+}
+
+bool compressed_file_io::exists(const std::string& filepath) {
+    return inner_->exists(filepath);
+}
+
+bool compressed_file_io::version(const std::string& filepath, std::string& tag) {
+    return inner_->version(filepath, tag);
+}
+
+void compressed_file_io::write_batch(const std::vector<batch_op>& ops, std::vector<bool>& results) {
+    std::vector<batch_op> compressed = ops;
+    for (auto& op : compressed) {
+        if (!op.remove) {
+            op.data = compress(op.data, dictionary_for(op.path));
+        }
+    }
+    inner_->write_batch(compressed, results);
+}
+
+const std::string* compressed_file_io::dictionary_for(const std::string& path) const {
+    if (!dictionaries_ || dictionaries_->empty() || path.empty()) {
+        return nullptr;
+    }
+    std::string entity = std::filesystem::path(path).lexically_normal().parent_path().lexically_relative(root_).string();
+    auto found = dictionaries_->find(entity);
+    return found == dictionaries_->end() ? nullptr : &found->second;
+}
+
+std::string compressed_file_io::compress(const std::string& data, const std::string* dictionary) {
+    z_stream stream{};
+    // Level 1: disk time is what we are saving, so spend little CPU on it.
+    if (deflateInit2(&stream, Z_BEST_SPEED, Z_DEFLATED, dictionary ? 15 : 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+        return "";
+    }
+    if (dictionary && deflateSetDictionary(&stream, reinterpret_cast<const Bytef*>(dictionary->data()), dictionary->size()) != Z_OK) {
+        deflateEnd(&stream);
+        return "";
+    }
+    std::string out = dictionary ? std::string(dictionary_marker, 2) : std::string();
+    size_t header = out.size();
+    out.resize(header + deflateBound(&stream, data.size()));
+    stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data.data()));
+    stream.avail_in = data.size();
+    stream.next_out = reinterpret_cast<Bytef*>(&out[header]);
+    stream.avail_out = out.size() - header;
+    int result = deflate(&stream, Z_FINISH);
+    out.resize(header + stream.total_out);
+    deflateEnd(&stream);
+    return result == Z_STREAM_END ? out : "";
+}
+
+bool compressed_file_io::decompress(const std::string& stored, const dictionaries* known, std::string& data) {
+    data.clear();
+    std::string_view rest(stored);
+    if (!is_gzip(rest) && !is_dictionary_stream(rest)) {
+        data = stored;
+        return true;
+    }
+    while (!rest.empty()) {
+        bool gzip = is_gzip(rest);
+        if (!gzip && !is_dictionary_stream(rest)) {
+            return false;
+        }
+        if (!gzip) {
+            rest.remove_prefix(2);
+        }
+        if (!inflate_stream(rest, gzip, known, data)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+std::string compressed_file_io::train(const std::vector<std::string>& samples, size_t size) {
+    // How many samples each k-byte string appears in.
+    const size_t k = 8;
+    std::unordered_map<std::string_view, size_t> seen_in;
+    for (const auto& sample : samples) {
+        std::unordered_set<std::string_view> here;
+        for (size_t i = 0; i + k <= sample.size(); i++) {
+            here.insert(std::string_view(sample).substr(i, k));
+        }
+        for (const auto& piece : here) {
+            seen_in[piece]++;
+        }
+    }
+
+    // Runs of shared strings, and how many samples have each run.
+    size_t common = std::max<size_t>(2, samples.size() / 4);
+    std::map<std::string, size_t> runs;
+    for (const auto& sample : samples) {
+        std::set<std::string> here;
+        size_t start = std::string::npos;
+        for (size_t i = 0; i + k <= sample.size() + 1; i++) {
+            bool shared = i + k <= sample.size() && seen_in[std::string_view(sample).substr(i, k)] >= common;
+            if (shared && start == std::string::npos) {
+                start = i;
+            } else if (!shared && start != std::string::npos) {
+                here.insert(sample.substr(start, i - 1 + k - start));
+                start = std::string::npos;
+            }
+        }
+        for (const auto& run : here) {
+            runs[run]++;
+        }
+    }
+
+    // Keep the runs that save the most bytes. Deflate reaches the end of a
+    // dictionary with the shortest distances, so those go last.
+    std::vector<std::pair<size_t, const std::string*>> ranked;
+    for (const auto& run : runs) {
+        if (run.second >= common) {
+            ranked.emplace_back(run.second * run.first.size(), &run.first);
+        }
+    }
+    std::sort(ranked.begin(), ranked.end(), [](const auto& a, const auto& b) { return a.first > b.first; });
+    std::vector<const std::string*> chosen;
+    size_t total = 0;
+    for (const auto& run : ranked) {
+        if (total + run.second->size() <= size) {
+            chosen.push_back(run.second);
+            total += run.second->size();
+        }
+    }
+    std::string dictionary;
+    dictionary.reserve(total);
+    for (auto run = chosen.rbegin(); run != chosen.rend(); ++run) {
+        dictionary += **run;
+    }
+    return dictionary;
+}
+
+std::shared_ptr<i_file_io> compressed_file_io::wrap(const HandlerConfig& config, std::shared_ptr<i_file_io> storage) {
+    auto compress = config.directives.find("compress");
+    if (compress == config.directives.end() || compress->second != std::vector<std::string>{"on"}) {
+        return storage;
+    }
+    return std::make_shared<compressed_file_io>(storage, config.root, get_dictionaries(config));
+}
+
+bool compressed_file_io::load_config(const std::vector<HandlerConfig>& handlers) {
+    for (const auto& handler : handlers) {
+        auto compress = handler.directives.find("compress");
+        if ((handler.name != "crud_handler" && handler.name != "markdown_handler") || compress == handler.directives.end()) {
+            continue;
+        }
+        if (compress->second == std::vector<std::string>{"off"}) {
+            continue;
+        }
+        if (compress->second != std::vector<std::string>{"on"} || get_dictionaries(handler) == nullptr) {
+            return false;
+        }
+    }
+    return true;
+}
+
+std::shared_ptr<const compressed_file_io::dictionaries> compressed_file_io::get_dictionaries(const HandlerConfig& config) {
+    static std::mutex mutex;
+    static std::map<std::string, std::shared_ptr<const dictionaries>> loaded;
+    std::lock_guard<std::mutex> lock(mutex);
+    auto found = loaded.find(config.root);
+    if (found != loaded.end()) {
+        return found->second;
+    }
+    // `compress_dictionary books:./dict/books shoes:./dict/shoes;`
+    auto entity_dictionaries = std::make_shared<dictionaries>();
+    auto declarations = config.directives.find("compress_dictionary");
+    if (declarations != config.directives.end()) {
+        for (const auto& declaration : declarations->second) {
+            size_t colon = declaration.find(':');
+            if (colon == std::string::npos || colon == 0 || colon + 1 == declaration.size()) {
+                return nullptr;
+            }
+            std::ifstream file(declaration.substr(colon + 1), std::ios::binary);
+            std::stringstream contents;
+            contents << file.rdbuf();
+            if (!file || contents.str().empty()) {
+                return nullptr;
+            }
+            std::string entity = std::filesystem::path(declaration.substr(0, colon)).lexically_normal().string();
+            (*entity_dictionaries)[entity] = contents.str();
+        }
+    }
+    loaded[config.root] = entity_dictionaries;
+    return entity_dictionaries;
+}
@@ -0,0 +1,62 @@
+// Trains a compression dictionary from the entities already stored in an
+// entity directory, for `compress_dictionary <entity>:<file>;`.
+//
+// Usage: ./compression_dictionary <entity directory> <output file> [size]
+
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "compressed_file_io.h"
+
+int main(int argc, char* argv[]) {
+  if (argc != 3 && argc != 4) {
+    std::cerr << "Usage: ./compression_dictionary <entity directory> <output file> [size]\n";
+    return 1;
+  }
+  size_t size = 32768;
+  if (argc == 4) {
+    try {
+      size = std::stoul(argv[3]);
+    } catch (const std::exception&) {
+      std::cerr << "Invalid size " << argv[3] << std::endl;
+      return 1;
+    }
+  }
+
+  std::vector<std::string> samples;
+  try {
+    for (const auto& entry : std::filesystem::directory_iterator(argv[1])) {
+      if (!entry.is_regular_file()) {
+        continue;
+      }
+      std::ifstream file(entry.path(), std::ios::binary);
+      std::stringstream contents;
+      contents << file.rdbuf();
+      // Entities already compressed against a dictionary cannot be read
+      // without it and are left out.
+      std::string sample;
+      if (compressed_file_io::decompress(contents.str(), nullptr, sample)) {
+        samples.push_back(sample);
+      }
+    }
+  } catch (const std::exception&) {
+    std::cerr << "Unable to read " << argv[1] << std::endl;
+    return 1;
+  }
+
+  std::string dictionary = compressed_file_io::train(samples, size);
+  if (dictionary.empty()) {
+    std::cerr << "Not enough shared content in " << samples.size() << " files to build a dictionary" << std::endl;
+    return 1;
+  }
+  std::ofstream out(argv[2], std::ios::binary);
+  if (!out.write(dictionary.data(), dictionary.size())) {
+    std::cerr << "Unable to write " << argv[2] << std::endl;
+    return 1;
+  }
+  std::cout << "Built a " << dictionary.size() << " byte dictionary from " << samples.size() << " files into " << argv[2] << std::endl;
+  return 0;
+}
@@ -7,6 +7,7 @@
 // How Nginx does it:
 //   http://lxr.nginx.org/source/src/core/ngx_conf_file.c
 
+#include <cctype>
 #include <cstdio>
 #include <fstream>
 #include <filesystem>
@@ -58,6 +59,12 @@ std::vector<HandlerConfig> NginxConfig::GetRequestHandlers() {
       handlerConfig.path = statement->tokens_[1];
       handlerConfig.name = statement->tokens_[2];
       handlerConfig.root = statement->child_block_->GetRoot();
+      for (const auto& directive : statement->child_block_->statements_) {
+        if (!directive->tokens_.empty()) {
+          handlerConfig.directives[directive->tokens_[0]] =
+              std::vector<std::string>(directive->tokens_.begin() + 1, directive->tokens_.end());
+        }
+      }
       for (const auto& rh : requestHandlers) {
         if (statement->tokens_[1] == rh.path) {
           std::cerr << "Please ensure serving locations are unique" << std::endl;
@@ -106,6 +113,56 @@ NginxConfig* NginxConfig::GetBlock(const std::string& blockName, const std::stri
   return nullptr;
 }
 
+bool ParseConfigDuration(const std::string& value, std::chrono::milliseconds* duration) {
+  size_t digits = 0;
+  while (digits < value.size() && std::isdigit(static_cast<unsigned char>(value[digits]))) {
+    digits++;
+  }
+  if (digits == 0 || digits > 12) {
+    return false;
+  }
+  long long amount = std::stoll(value.substr(0, digits));
+  std::string unit = value.substr(digits);
+  if (unit == "ms") {
+    *duration = std::chrono::milliseconds(amount);
+  } else if (unit == "" || unit == "s") {
+    *duration = std::chrono::seconds(amount);
+  } else if (unit == "m") {
+    *duration = std::chrono::minutes(amount);
+  } else if (unit == "h") {
+    *duration = std::chrono::hours(amount);
+  } else if (unit == "d") {
+    *duration = std::chrono::hours(24 * amount);
+  } else {
+    return false;
+  }
+  return true;
+}
+
+bool ParseConfigSize(const std::string& value, size_t* size) {
+  size_t digits = 0;
+  while (digits < value.size() && std::isdigit(static_cast<unsigned char>(value[digits]))) {
+    digits++;
+  }
+  if (digits == 0 || digits > 12) {
+    return false;
+  }
+  size_t amount = std::stoull(value.substr(0, digits));
+  std::string unit = value.substr(digits);
+  if (unit == "") {
+    *size = amount;
+  } else if (unit == "k" || unit == "K") {
+    *size = amount << 10;
+  } else if (unit == "m" || unit == "M") {
+    *size = amount << 20;
+  } else if (unit == "g" || unit == "G") {
+    *size = amount << 30;
+  } else {
+    return false;
+  }
+  return true;
+}
+
 std::string NginxConfigStatement::ToString(int depth) {
   std::string serialized_statement;
   for (int i = 0; i < depth; ++i) {
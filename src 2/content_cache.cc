@@ -0,0 +1,93 @@
+#include "content_cache.h"
+#include <cstdio>
+#include <string>
+#include <memory>
+
+content_cache::content_cache(size_t budget): budget_(budget) {}
+
+content_cache* content_cache::get_global_cache() {
+    static content_cache cache;
+    return &cache;
+}
+
+std::string content_cache::make_etag(const std::string& content) {
+    std::uint64_t hash = 14695981039346656037ULL;
+    for (unsigned char c : content) {
+        hash ^= c;
+        hash *= 1099511628211ULL;
+    }
+    char etag[24];
+    std::snprintf(etag, sizeof(etag), "\"%016llx\"", static_cast<unsigned long long>(hash));
+    return etag;
+}
+
+std::shared_ptr<const cached_content> content_cache::get(const std::string& path, std::int64_t mtime, std::uintmax_t size) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = entries_.find(path);
+    if (it == entries_.end()) {
+        return nullptr;
+    }
+    const cached_content& content = *it->second.content;
+    if (content.mtime != mtime || content.size != size) {
+        erase(it);
+        return nullptr;
+    }
+    lru_.splice(lru_.begin(), lru_, it->second.lru);
+    return it->second.content;
+}
+
+std::shared_ptr<const cached_content> content_cache::put(const std::string& path, std::int64_t mtime, std::string content) {
+    auto entry_content = std::make_shared<cached_content>();
+    entry_content->mtime = mtime;
+    entry_content->size = content.size();
+    entry_content->etag = make_etag(content);
+    entry_content->data = std::make_shared<const std::string>(std::move(content));
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (entry_content->size > budget_) {
+        return entry_content;
+    }
+    auto it = entries_.find(path);
+    if (it != entries_.end()) {
+        erase(it);
+    }
+    while (used_ + entry_content->size > budget_ && !lru_.empty()) {
+        erase(entries_.find(lru_.back()));
+    }
+    lru_.push_front(path);
+    entries_.emplace(path, entry{entry_content, lru_.begin()});
+    used_ += entry_content->size;
+    return entry_content;
+}
+
+// Caller holds mutex_.
+void content_cache::erase(std::unordered_map<std::string, entry>::iterator it) {
+    used_ -= it->second.content->size;
+    lru_.erase(it->second.lru);
+    entries_.erase(it);
+}
+
+void content_cache::set_budget(size_t bytes) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    budget_ = bytes;
+    while (used_ > budget_ && !lru_.empty()) {
+        erase(entries_.find(lru_.back()));
+    }
+}
+
+size_t content_cache::budget() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return budget_;
+}
+
+size_t content_cache::used() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return used_;
+}
+
+void content_cache::clear() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    entries_.clear();
+    lru_.clear();
+    used_ = 0;
+}
@@ -1,28 +1,455 @@
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cctype>
+#include <cstdio>
+#include <cstring>
 #include <exception>
+#include <functional>
 #include <ios>
+#include <iterator>
 #include <stdexcept>
 #include <string>
 #include <sstream>
 #include <filesystem>
-#include <boost/uuid/uuid.hpp>
-#include <boost/uuid/uuid_generators.hpp>
-#include <boost/uuid/uuid_io.hpp>
+#include <map>
+#include <regex>
+#include <string_view>
 #include <memory>
+#include <mutex>
+#include <shared_mutex>
 #include <boost/beast/http.hpp>
 #include <boost/lexical_cast.hpp>
 #include "logger.h"
+#include "aggregate_query.h"
+#include "bounded_pool.h"
+#include "entity_locks.h"
+#include "id_generator.h"
+#include "entity_index.h"
+#include "field_index.h"
+#include "change_feed.h"
+#include "expiry_wheel.h"
+#include "shard_router.h"
+#include "replication_log.h"
+#include "replication_follower.h"
+#include "json_validator.h"
+#include "json_merge_patch.h"
 #include "file_io.h"
+#include "log_file_io.h"
+#include "durable_file_io.h"
+#include "caching_file_io.h"
+#include "compressed_file_io.h"
+#include "snapshot_file_io.h"
+#include "http_util.h"
 #include "crud_handler.h"
 namespace http = boost::beast::http;
 
-std::unique_ptr<request_handler> crud_handler::init(std::string data_path) {
-    auto file_io_ptr = std::make_shared<file_io>();
-    return std::make_unique<crud_handler>(data_path, file_io_ptr);
+struct crud_handler::changes_query {
+    std::uint64_t since = UINT64_MAX;  // no since: just report the current sequence
+    size_t limit = max_page_size;
+    unsigned wait = 0;
+};
+
+struct crud_handler::bulk_item {
+    std::string op;  // "create", "update" or "delete"
+    std::string id;
+    std::string data;
+    http::status status = http::status::unknown;
+    std::string error;
+};
+
+namespace {
+
+// Reads the next non-blank line of an NDJSON body starting at pos.
+bool next_line(const std::string& text, size_t& pos, std::string_view& line, size_t& line_number) {
+    while (pos < text.size()) {
+        size_t end = text.find('\n', pos);
+        if (end == std::string::npos) {
+            end = text.size();
+        }
+        line = std::string_view(text).substr(pos, end - pos);
+        pos = end + 1;
+        line_number++;
+        if (!line.empty() && line.back() == '\r') {
+            line.remove_suffix(1);
+        }
+        if (line.find_first_not_of(" \t") != std::string_view::npos) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Hidden names are the handler's own (the write-ahead log, the expiry
+// journal, writes in progress), so IDs cannot start with a dot.
+bool valid_id(const std::string& id) {
+    return !id.empty() && id[0] != '.' && id.find_first_of("/\\\"") == std::string::npos;
+}
+
+// True if a segment of target, before any query, starts with a dot.
+bool hidden_segment(const std::string& target) {
+    std::string_view path(target);
+    path = path.substr(0, path.find('?'));
+    size_t pos = 0;
+    while (pos < path.size()) {
+        if (path[pos] == '.') {
+            return true;
+        }
+        size_t slash = path.find('/', pos);
+        if (slash == std::string_view::npos) {
+            break;
+        }
+        pos = slash + 1;
+    }
+    return false;
+}
+
+std::string json_string(const std::string& value) {
+    std::string quoted = "\"";
+    for (char c : value) {
+        if (c == '"' || c == '\\') {
+            quoted += '\\';
+            quoted += c;
+        } else if (static_cast<unsigned char>(c) < 0x20) {
+            char escaped[8];
+            std::snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+            quoted += escaped;
+        } else {
+            quoted += c;
+        }
+    }
+    return quoted + "\"";
+}
+
+// Appends the IDs of a listing body, ["a","b"], to ids. IDs hold no quotes.
+void listed_ids(const std::string& body, std::vector<std::string>& ids) {
+    size_t open = body.find('"');
+    while (open != std::string::npos) {
+        size_t close = body.find('"', open + 1);
+        if (close == std::string::npos) {
+            return;
+        }
+        ids.push_back(body.substr(open + 1, close - open - 1));
+        open = body.find('"', close + 1);
+    }
+}
+
+// Shortest form that reads back as the same double; null if not finite.
+std::string json_number(double value) {
+    if (!std::isfinite(value)) {
+        return "null";
+    }
+    char buffer[32];
+    auto written = std::to_chars(buffer, buffer + sizeof(buffer), value);
+    return std::string(buffer, written.ptr);
+}
+
+// True if an If-Match or If-None-Match value lists etag or is "*". Weak
+// comparison also accepts W/ tags.
+bool etag_listed(boost::beast::string_view header, const std::string& etag, bool weak) {
+    std::string_view list(header.data(), header.size());
+    while (!list.empty()) {
+        size_t comma = list.find(',');
+        std::string_view tag = list.substr(0, comma);
+        list = comma == std::string_view::npos ? std::string_view() : list.substr(comma + 1);
+        size_t start = tag.find_first_not_of(" \t");
+        if (start == std::string_view::npos) {
+            continue;
+        }
+        tag = tag.substr(start, tag.find_last_not_of(" \t") - start + 1);
+        if (tag == "*") {
+            return true;
+        }
+        if (tag.substr(0, 2) == "W/") {
+            if (!weak) {
+                continue;
+            }
+            tag.remove_prefix(2);
+        }
+        if (tag == etag) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// The ETag of the gzip-encoded representation of the entity tagged etag.
+std::string gzip_etag(const std::string& etag) {
+    return etag.empty() ? "" : etag.substr(0, etag.size() - 1) + "-gzip\"";
+}
+
+// Percent-encodes a query parameter value.
+std::string url_encode(const std::string& value) {
+    std::string encoded;
+    for (unsigned char c : value) {
+        if (std::isalnum(c) || c == '-' || c == '_' || c == '.' || c == '~') {
+            encoded += c;
+        } else {
+            char escaped[4];
+            std::snprintf(escaped, sizeof(escaped), "%%%02X", c);
+            encoded += escaped;
+        }
+    }
+    return encoded;
+}
+
+// Percent-encodes what cannot appear as is in the path of a URI. Request
+// paths are used as they were sent, without decoding, so '/' and escapes
+// already in the path are left alone.
+std::string url_encode_path(const std::string& path) {
+    std::string encoded;
+    for (unsigned char c : path) {
+        if (std::isalnum(c) || std::strchr("-._~!$&'()*+,;=:@/%", c)) {
+            encoded += c;
+        } else {
+            char escaped[4];
+            std::snprintf(escaped, sizeof(escaped), "%%%02X", c);
+            encoded += escaped;
+        }
+    }
+    return encoded;
+}
+
+// The storage a CRUD location's directives ask for.
+std::shared_ptr<i_file_io> make_storage(const HandlerConfig& config) {
+    std::shared_ptr<i_file_io> storage_io;
+    // `storage log;` keeps entities in a shared log-structured store instead
+    // of one file per entity.
+    auto storage = config.directives.find("storage");
+    if (storage != config.directives.end() && storage->second == std::vector<std::string>{"log"}) {
+        std::shared_ptr<log_store> store = log_store::get_shared(config.root);
+        if (store) {
+            storage_io = std::make_shared<log_file_io>(store, config.root);
+        }
+    }
+    // `durable on;` commits every change to a write-ahead log before replying.
+    auto durable = config.directives.find("durable");
+    if (!storage_io && durable != config.directives.end() && durable->second == std::vector<std::string>{"on"}) {
+        std::shared_ptr<write_ahead_log> wal = durable_file_io::get_shared_log(config.root);
+        if (wal) {
+            storage_io = std::make_shared<durable_file_io>(wal, config.root);
+        }
+    }
+    if (!storage_io) {
+        storage_io = std::make_shared<file_io>();
+    }
+    // `file_cache 16m;` keeps recently read entities in memory. It sits under
+    // compression, so it holds the smaller stored form.
+    storage_io = caching_file_io::wrap(config, storage_io);
+    // `compress on;` keeps entities gzipped at rest, whichever the backend.
+    storage_io = compressed_file_io::wrap(config, storage_io);
+    // `backup on;` saves what a write replaces while a backup is running.
+    return snapshot_file_io::wrap(config, storage_io);
+}
+
+// `index books:author;` keeps a secondary index on the author field of books.
+std::vector<std::string> index_declarations(const HandlerConfig& config) {
+    auto index = config.directives.find("index");
+    return index != config.directives.end() ? index->second : std::vector<std::string>();
+}
+
+// Parses a whole number of seconds, as in `ttl 3600;` or X-TTL: 3600.
+bool parse_seconds(const std::string& value, unsigned& seconds) {
+    if (value.empty() || value.size() > 9 || value.find_first_not_of("0123456789") != std::string::npos) {
+        return false;
+    }
+    seconds = std::stoul(value);
+    return true;
 }
 
-crud_handler::crud_handler(std::string data_path, std::shared_ptr<i_file_io> file_io_ptr): data_path_(data_path), file_io_(file_io_ptr) {}
+// `ttl 3600;` expires the location's entities an hour after their last write.
+bool parse_ttl(const HandlerConfig& config, unsigned& ttl) {
+    ttl = 0;
+    auto directive = config.directives.find("ttl");
+    if (directive == config.directives.end()) {
+        return true;
+    }
+    return directive->second.size() == 1 && parse_seconds(directive->second[0], ttl);
+}
+
+// Reads ?since=<seq>&limit=<n>&wait=<seconds> of GET /api/_replication.
+// since is UINT64_MAX if it is not given.
+bool parse_replication_query(const std::map<std::string, std::string>& params, std::uint64_t& since, size_t& limit, unsigned& wait) {
+    since = UINT64_MAX;
+    limit = replication_follower::batch_size;
+    wait = 0;
+    auto read = [&params](const char* name, auto& value) {
+        auto found = params.find(name);
+        if (found == params.end()) {
+            return true;
+        }
+        const std::string& text = found->second;
+        return !text.empty() && std::from_chars(text.data(), text.data() + text.size(), value).ptr == text.data() + text.size();
+    };
+    if (!read("since", since) || !read("limit", limit) || !read("wait", wait) || limit == 0) {
+        return false;
+    }
+    if (limit > crud_handler::max_page_size) {
+        limit = crud_handler::max_page_size;
+    }
+    if (wait > crud_handler::max_wait_seconds) {
+        wait = crud_handler::max_wait_seconds;
+    }
+    return true;
+}
+
+// Calls visit with each entity key (such as "Books/<id>") under directory
+// after cursor, in order, until it returns false; returns false if it did.
+// prefix is directory's own key. Hidden files and directories are not
+// entities, nor are files directly under the root.
+bool visit_keys_after(const std::filesystem::path& directory, const std::string& prefix, const std::string& cursor,
+                      const std::function<bool(const std::string& key)>& visit) {
+    // A directory sorts by its name and a slash, as the keys under it do.
+    std::vector<std::pair<std::string, bool>> children;
+    std::error_code error;
+    for (std::filesystem::directory_iterator it(directory, error), end; !error && it != end; it.increment(error)) {
+        std::string name = it->path().filename().string();
+        if (name.empty() || name[0] == '.') {
+            continue;
+        }
+        if (it->is_directory(error)) {
+            children.emplace_back(name + "/", true);
+        } else if (!prefix.empty() && it->is_regular_file(error)) {
+            children.emplace_back(name, false);
+        }
+    }
+    std::sort(children.begin(), children.end());
+    for (const auto& child : children) {
+        std::string key = prefix + child.first;
+        if (!child.second) {
+            if (key > cursor && !visit(key)) {
+                return false;
+            }
+            continue;
+        }
+        // Every key under the directory starts with key, so a cursor past it
+        // that is not under it is past all of them.
+        if (cursor > key && cursor.compare(0, key.size(), key) != 0) {
+            continue;
+        }
+        if (!visit_keys_after(directory / child.first.substr(0, child.first.size() - 1), key, cursor, visit)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Runs snapshot pages and aggregates off the io threads. Made after the
+// logger, so at exit the scans in progress finish before logging is torn
+// down.
+bounded_pool& scan_pool() {
+    Logger::get_global_log();
+    static bounded_pool pool(crud_handler::scan_threads, crud_handler::max_pending_scans);
+    return pool;
+}
+
+// `replication leader;` keeps a replication log of the location's writes.
+std::shared_ptr<replication_log> leader_log(const HandlerConfig& config) {
+    auto role = config.directives.find("replication");
+    if (role == config.directives.end() || role->second != std::vector<std::string>{"leader"}) {
+        return nullptr;
+    }
+    return replication_log::get_shared(config.root);
+}
+
+}
+
+std::unique_ptr<request_handler> crud_handler::init(const HandlerConfig& config) {
+    // `minify_json on;` stores entities without insignificant whitespace.
+    auto minify = config.directives.find("minify_json");
+    bool minify_json = minify != config.directives.end() && minify->second == std::vector<std::string>{"on"};
+    unsigned ttl;
+    parse_ttl(config, ttl);  // load_config has rejected invalid values
+    return std::make_unique<crud_handler>(config.root, make_storage(config), entity_index::get_shared(config.root), minify_json,
+                                          field_index::get_shared(config.root, index_declarations(config)),
+                                          change_feed::get_shared(config.root), expiry_wheel::get_shared(config.root), ttl,
+                                          shard_router::get_shared(config.root), leader_log(config),
+                                          replication_follower::get_shared(config.root));
+}
+
+bool crud_handler::load_config(const std::vector<HandlerConfig>& handlers) {
+    for (const auto& config : handlers) {
+        if (config.name != "crud_handler") {
+            continue;
+        }
+        unsigned ttl;
+        if (!parse_ttl(config, ttl)) {
+            return false;
+        }
+        // Entities can carry X-TTL even without a location default, so every
+        // location gets a reaper. It deletes through the same storage,
+        // indexes, feed and replication log as the location's handlers.
+        auto reaper = std::make_shared<crud_handler>(config.root, make_storage(config), entity_index::get_shared(config.root), false,
+                                                     field_index::get_shared(config.root, index_declarations(config)),
+                                                     change_feed::get_shared(config.root), nullptr, 0, nullptr, leader_log(config));
+        expiry_wheel::get_shared(config.root)->start([reaper](const std::string& path, expiry_wheel& expiry) {
+            reaper->expire_entity(path, expiry);
+        });
+        // In a cluster, entities this node no longer owns move to their
+        // owner in the background, through the same storage and indexes.
+        std::shared_ptr<shard_router> shard = shard_router::get_shared(config.root);
+        if (shard) {
+            auto mover = std::make_shared<crud_handler>(config.root, make_storage(config), entity_index::get_shared(config.root), false,
+                                                        field_index::get_shared(config.root, index_declarations(config)),
+                                                        change_feed::get_shared(config.root), expiry_wheel::get_shared(config.root), 0,
+                                                        shard, leader_log(config));
+            shard->start([mover](const std::string& key, const std::string& owner) {
+                return mover->hand_off(key, owner);
+            });
+        }
+        // A follower applies its leader's writes the same way.
+        std::shared_ptr<replication_follower> follower = replication_follower::get_shared(config.root);
+        if (follower) {
+            auto applier = std::make_shared<crud_handler>(config.root, make_storage(config), entity_index::get_shared(config.root), false,
+                                                          field_index::get_shared(config.root, index_declarations(config)),
+                                                          change_feed::get_shared(config.root));
+            follower->start([applier](const replication_log::entry& written) {
+                return applier->apply_replicated(written);
+            });
+        }
+    }
+    return true;
+}
+
+crud_handler::crud_handler(std::string data_path, std::shared_ptr<i_file_io> file_io_ptr)
+    : crud_handler(data_path, file_io_ptr, std::make_shared<entity_index>()) {}
+
+crud_handler::crud_handler(std::string data_path, std::shared_ptr<i_file_io> file_io_ptr, std::shared_ptr<entity_index> index, bool minify_json,
+                           std::shared_ptr<field_index> fields, std::shared_ptr<change_feed> feed,
+                           std::shared_ptr<expiry_wheel> expiry, unsigned default_ttl,
+                           std::shared_ptr<shard_router> shard, std::shared_ptr<replication_log> replication,
+                           std::shared_ptr<replication_follower> follower)
+    : data_path_(data_path), file_io_(file_io_ptr), index_(index),
+      fields_(fields ? fields : std::make_shared<field_index>(data_path, std::vector<std::string>())),
+      feed_(feed ? feed : std::make_shared<change_feed>()),
+      expiry_(expiry), shard_(shard), replication_(replication), follower_(follower), default_ttl_(default_ttl),
+      minify_json_(minify_json) {}
 
 http::response<http::string_body> crud_handler::handle_request(http::request<http::string_body> request) {
+    if (hidden_segment(remove_prefix_dir("/api/", request.target()))) {
+        Logger::get_global_log()->logError("ERROR: Hidden path " + std::string(request.target()));
+        return create_response(http::status::bad_request,
+                                "text/plain",
+                                "Entity types and IDs cannot start with '.'");
+    }
+    if (replication_ || follower_) {
+        std::string target = remove_prefix_dir("/api/", request.target());
+        size_t pos_question = target.find('?');
+        if (request.method() == http::verb::get && target.substr(0, pos_question) == "_replication") {
+            return handle_replication_request(pos_question == std::string::npos ? "" : target.substr(pos_question + 1));
+        }
+    }
+    if (shard_ && request.method() == http::verb::get && request.target() == shard_router::status_target) {
+        return create_response(http::status::ok, "application/json",
+                               "{\"self\": " + json_string(shard_->self()) + ", \"handed_off\": " +
+                               (shard_->handed_off() ? "true" : "false") + ", \"taking_over\": " +
+                               (shard_->taking_over() ? "true" : "false") + "}");
+    }
+    if (follower_) {
+        return handle_follower_request(request);
+    }
     switch (request.method()) {
         case http::verb::post:
             return handle_post_request(request);
@@ -32,6 +459,8 @@ http::response<http::string_body> crud_handler::handle_request(http::request<htt
             return handle_put_request(request);
         case http::verb::delete_:
             return handle_delete_request(request);
+        case http::verb::patch:
+            return handle_patch_request(request);
         default:
             return create_response(http::status::method_not_allowed,
                                     "text/html",
@@ -39,14 +468,430 @@ http::response<http::string_body> crud_handler::handle_request(http::request<htt
     }
 }
 
+bool crud_handler::handle_request_async(const http::request<http::string_body>& request, response_callback respond) {
+    if (hidden_segment(remove_prefix_dir("/api/", request.target()))) {
+        return false;
+    }
+    // Each node of a cluster backs up the entities it holds.
+    if (request.method() == http::verb::get && request.target() == "/api/_backup") {
+        return snapshot_file_io::answer_backup(data_path_, file_io_, respond);
+    }
+    if (shard_ && route_to_shard(request, respond)) {
+        return true;
+    }
+    if (request.method() != http::verb::get) {
+        return false;
+    }
+    std::string target = remove_prefix_dir("/api/", request.target());
+    std::string query;
+    size_t pos_question = target.find('?');
+    if (pos_question != std::string::npos) {
+        query = target.substr(pos_question + 1);
+        target = target.substr(0, pos_question);
+    }
+    if (replication_ && target == "_replication") {
+        std::map<std::string, std::string> params = parse_query(query);
+        std::uint64_t since;
+        size_t limit;
+        unsigned wait;
+        if (params.count("snapshot") && parse_replication_query(params, since, limit, wait)) {
+            // Each page reads up to limit entities, too many for an io thread.
+            std::string root = data_path_;
+            std::shared_ptr<i_file_io> files = file_io_;
+            std::shared_ptr<expiry_wheel> expiry = expiry_;
+            std::shared_ptr<replication_log> log = replication_;
+            std::string cursor = params["cursor"];
+            post_scan([root, files, expiry, log, cursor, limit]() {
+                return snapshot_response(root, *files, expiry.get(), *log, cursor, limit);
+            }, respond);
+            return true;
+        }
+        // A follower that has everything waits here for the next write.
+        if (!parse_replication_query(params, since, limit, wait) || since == UINT64_MAX || wait == 0) {
+            return false;
+        }
+        std::shared_ptr<replication_log> log = replication_;
+        return log->watch(since, std::chrono::steady_clock::now() + std::chrono::seconds(wait), [log, since, limit, respond]() {
+            respond(replication_response(*log, since, limit));
+        });
+    }
+    size_t pos_slash = target.find_last_of('/');
+    if (pos_slash != std::string::npos && target.substr(pos_slash + 1) == "_aggregate") {
+        // The scan reads every entity of the type. It outlives this handler,
+        // so it runs on a copy sharing its storage and indexes.
+        std::shared_ptr<crud_handler> handler = std::make_shared<crud_handler>(*this);
+        http::request<http::string_body> scanned = request;
+        post_scan([handler, scanned]() { return handler->handle_request(scanned); }, respond);
+        return true;
+    }
+    if (pos_slash == std::string::npos || target.substr(pos_slash + 1) != "_changes") {
+        return false;
+    }
+    // Anything that can be answered right away, errors included, goes
+    // through handle_request.
+    changes_query changes;
+    std::string error;
+    if (!parse_changes_query(query, changes, error) || changes.wait == 0 || changes.since == UINT64_MAX) {
+        return false;
+    }
+    std::string directory = (std::filesystem::path(data_path_) / target.substr(0, pos_slash)).string();
+    std::shared_ptr<change_feed> feed = feed_;
+    return feed->watch(directory, changes.since, std::chrono::steady_clock::now() + std::chrono::seconds(changes.wait),
+                       [feed, directory, changes, respond]() {
+                           respond(changes_response(*feed, directory, changes));
+                       });
+}
+
+bool crud_handler::route_to_shard(const http::request<http::string_body>& request, response_callback respond) {
+    std::string target = remove_prefix_dir("/api/", request.target());
+    size_t pos_question = target.find('?');
+    std::string query = pos_question == std::string::npos ? "" : target.substr(pos_question + 1);
+    target = target.substr(0, pos_question);
+    // The location's own endpoints, such as _shard, are this node's.
+    if (target.empty() || target[0] == '_') {
+        return false;
+    }
+    size_t pos_slash = target.find_last_of('/');
+    std::string id = pos_slash == std::string::npos ? "" : target.substr(pos_slash + 1);
+
+    // A forwarded request is answered here; only an entity that has not
+    // been handed off yet is fetched first.
+    bool forwarded = request.find(shard_router::forwarded_header) != request.end();
+    http::request<http::string_body> routed = request;
+    std::string key = target;
+    bool create = request.method() == http::verb::post;
+    if (forwarded) {
+        if (create || id.empty() || id[0] == '_' || shard_->owner(key) != shard_->self() ||
+            (request.method() == http::verb::put && request.find(http::field::if_none_match) != request.end())) {
+            // Entities handed off or taken over arrive as PUT If-None-Match: *.
+            return false;
+        }
+    } else if (create) {
+        // A new entity goes to its owner as a PUT of a fresh ID, answered
+        // just as the POST would be. Bulk and invalid requests stay here.
+        std::string endpoint = pos_slash == std::string::npos ? target : id;
+        if (endpoint == "_bulk" || endpoint == "_import" || request.body().empty() || !has_json_content_type(request)) {
+            return false;
+        }
+        key = target + "/" + generate_id();
+        routed.method(http::verb::put);
+        routed.target("/api/" + key);
+    } else if (id.empty()) {
+        if (request.method() != http::verb::get || parse_query(query).count("ids")) {
+            return false;
+        }
+        gather_listing(request, respond);
+        return true;
+    } else if (id[0] == '_') {
+        // _changes and _aggregate cover this node's shard.
+        return false;
+    }
+
+    std::string owner = shard_->owner(key);
+    if (owner != shard_->self()) {
+        shard_->forward(owner, routed, respond);
+        return true;
+    }
+    if (create) {
+        respond(handle_request(routed));
+        return true;
+    }
+    // Ours, but while the cluster rebalances, an entity missing here may
+    // not have been handed off by its previous owner yet.
+    std::string previous = shard_->taking_over() ? shard_->previous_owner(key) : "";
+    if (previous.empty() || file_io_->exists((std::filesystem::path(data_path_) / key).string())) {
+        return false;
+    }
+    // This handler is gone once the request is taken; a copy answers it on
+    // the forwarding threads.
+    auto local = std::make_shared<crud_handler>(*this);
+    shard_->post([local, key, previous, routed, respond]() {
+        local->take_over(key, previous);
+        respond(local->handle_request(routed));
+    });
+    return true;
+}
+
+void crud_handler::gather_listing(const http::request<http::string_body>& request, response_callback respond) {
+    // Every node answers with at most one page of its own IDs; the page of
+    // the whole cluster is the first of all of them.
+    http::response<http::string_body> local = handle_request(request);
+    if (local.result() != http::status::ok) {
+        respond(local);
+        return;
+    }
+    std::string target(request.target());
+    size_t pos_question = target.find('?');
+    std::map<std::string, std::string> params = parse_query(pos_question == std::string::npos ? "" : target.substr(pos_question + 1));
+    size_t limit = params.count("limit") ? boost::lexical_cast<size_t>(params["limit"]) : 0;
+    // The next page's link is this request's with the cursor replaced.
+    std::string next = "<" + target.substr(0, pos_question) + "?";
+    std::istringstream pairs(pos_question == std::string::npos ? "" : target.substr(pos_question + 1));
+    std::string pair;
+    while (std::getline(pairs, pair, '&')) {
+        if (pair.rfind("cursor=", 0) != 0) {
+            next += pair + "&";
+        }
+    }
+
+    std::shared_ptr<shard_router> shard = shard_;
+    shard->post([shard, request, local, limit, next, respond]() {
+        std::vector<std::string> ids;
+        listed_ids(local.body(), ids);
+        bool more = local.find(http::field::link) != local.end();
+        for (const auto& peer : shard->peers()) {
+            http::response<http::string_body> listed;
+            if (!shard->exchange(peer, request, listed)) {
+                Logger::get_global_log()->logError("ERROR: Shard " + peer + " is unavailable");
+                respond(create_response(http::status::bad_gateway, "text/plain", "Shard " + peer + " is unavailable"));
+                return;
+            }
+            if (listed.result() != http::status::ok) {
+                listed.erase(http::field::connection);
+                respond(listed);
+                return;
+            }
+            more = more || listed.find(http::field::link) != listed.end();
+            listed_ids(listed.body(), ids);
+        }
+        std::sort(ids.begin(), ids.end());
+        ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+        if (limit > 0 && ids.size() > limit) {
+            ids.resize(limit);
+            more = true;
+        }
+
+        std::string body = "[";
+        for (size_t i = 0; i < ids.size(); ++i) {
+            body += (i >= 1 ? ",\"" : "\"") + ids[i] + "\"";
+        }
+        body += "]";
+        http::response<http::string_body> response = create_response(http::status::ok, "application/json", body);
+        if (more && !ids.empty()) {
+            response.set(http::field::link, next + "cursor=" + url_encode(ids.back()) + ">; rel=\"next\"");
+        }
+        respond(response);
+    });
+}
+
+void crud_handler::take_over(const std::string& key, const std::string& previous) {
+    http::request<http::string_body> get{http::verb::get, "/api/" + key, 11};
+    http::response<http::string_body> found;
+    if (!shard_->exchange(previous, get, found) || found.result() != http::status::ok) {
+        return;
+    }
+    // Kept only if nothing was written here meanwhile; either way the
+    // previous owner's copy is done with.
+    http::request<http::string_body> put{http::verb::put, "/api/" + key, 11};
+    put.set(http::field::content_type, "application/json");
+    put.set(http::field::if_none_match, "*");
+    // The previous owner reports how long the entity has left; without it
+    // the entity never expires here, rather than taking the location default.
+    auto ttl = found.find("X-TTL");
+    put.set("X-TTL", ttl != found.end() ? std::string(ttl->value()) : "0");
+    put.body() = found.body();
+    put.prepare_payload();
+    http::status stored = handle_request(put).result();
+    if (stored == http::status::created || stored == http::status::precondition_failed) {
+        http::request<http::string_body> remove{http::verb::delete_, "/api/" + key, 11};
+        http::response<http::string_body> removed;
+        shard_->exchange(previous, remove, removed);
+    }
+}
+
+bool crud_handler::hand_off(const std::string& key, const std::string& owner) {
+    std::filesystem::path entity_path = std::filesystem::path(data_path_) / key;
+    std::string entity_data;
+    unsigned ttl;
+    {
+        std::shared_lock<std::shared_mutex> lock(entity_locks::get_global_locks().for_path(entity_path));
+        // An expired entity is left to the reaper.
+        if (entity_expired(entity_path) || !file_io_->read(entity_path.string(), entity_data)) {
+            return true;  // already gone
+        }
+        ttl = remaining_ttl(entity_path);
+    }
+    // If-None-Match: * keeps a newer copy written to the owner meanwhile.
+    // The entity keeps the time it has left, or keeps not expiring.
+    http::request<http::string_body> put{http::verb::put, "/api/" + key, 11};
+    put.set(http::field::content_type, "application/json");
+    put.set(http::field::if_none_match, "*");
+    put.set("X-TTL", std::to_string(ttl));
+    put.body() = entity_data;
+    put.prepare_payload();
+    http::response<http::string_body> stored;
+    if (!shard_->exchange(owner, put, stored) ||
+        (stored.result() != http::status::created && stored.result() != http::status::precondition_failed)) {
+        return false;
+    }
+
+    std::unique_lock<std::shared_mutex> lock(entity_locks::get_global_locks().for_path(entity_path));
+    if (file_io_->delete_file(entity_path.string())) {
+        index_->remove(entity_path.parent_path().string(), entity_path.filename().string());
+        entity_deleted(entity_path);
+    }
+    file_io_->close();
+    return true;
+}
+
+http::response<http::string_body> crud_handler::handle_replication_request(const std::string& query) {
+    Logger *logger = Logger::get_global_log();
+    if (follower_) {
+        std::chrono::milliseconds lag = follower_->lag();
+        std::string body = "{\"role\": \"follower\", \"leader\": " + json_string(follower_->leader()) +
+                           ", \"last_seq\": " + std::to_string(follower_->sequence()) + ", \"lag_ms\": " +
+                           (lag == std::chrono::milliseconds::max() ? "null" : std::to_string(lag.count())) + "}";
+        return create_response(http::status::ok, "application/json", body);
+    }
+
+    std::map<std::string, std::string> params = parse_query(query);
+    std::uint64_t since;
+    size_t limit;
+    unsigned wait;
+    if (!parse_replication_query(params, since, limit, wait)) {
+        logger->logError("ERROR: Invalid _replication query: " + query);
+        return create_response(http::status::bad_request, "text/plain", "since, limit and wait must be whole numbers, limit at least 1");
+    }
+    if (params.count("snapshot")) {
+        return snapshot_response(data_path_, *file_io_, expiry_.get(), *replication_, params["cursor"], limit);
+    }
+    if (since == UINT64_MAX) {
+        return create_response(http::status::ok, "application/json",
+                               "{\"role\": \"leader\", \"last_seq\": " + std::to_string(replication_->last_sequence()) + "}");
+    }
+    return replication_response(*replication_, since, limit);
+}
+
+void crud_handler::post_scan(std::function<http::response<http::string_body>()> scan, response_callback respond) {
+    if (scan_pool().post([scan, respond]() { respond(scan()); })) {
+        return;
+    }
+    Logger::get_global_log()->logError("ERROR: Too many scans in progress");
+    http::response<http::string_body> busy = create_response(http::status::service_unavailable, "text/plain",
+                                                              "Too many scans in progress; try again shortly");
+    busy.set(http::field::retry_after, "1");
+    respond(std::move(busy));
+}
+
+http::response<http::string_body> crud_handler::snapshot_response(const std::string& root, i_file_io& files, expiry_wheel* expiry,
+                                                                  replication_log& log, const std::string& cursor, size_t limit) {
+    // Writes made during the copy are in the log after this sequence too,
+    // so the follower applies them again once it has every page.
+    std::uint64_t sequence = log.last_sequence();
+    std::string body;
+    size_t copied = 0;
+    std::string last;
+    bool more = !visit_keys_after(root, "", cursor, [&](const std::string& key) {
+        if (copied == limit || body.size() >= snapshot_page_bytes) {
+            return false;
+        }
+        std::filesystem::path path = std::filesystem::path(root) / key;
+        std::string entity_data;
+        {
+            std::shared_lock<std::shared_mutex> lock(entity_locks::get_global_locks().for_path(path));
+            if ((expiry && expiry->expired(path.string())) || !files.read(path.string(), entity_data)) {
+                return true;
+            }
+        }
+        replication_log::serialize({sequence, key, entity_data, false}, body);
+        copied++;
+        last = key;
+        return true;
+    });
+    http::response<http::string_body> response = create_response(http::status::ok, "application/octet-stream", body);
+    response.set("X-Replication-Seq", std::to_string(sequence));
+    response.set("X-Replication-More", more ? "true" : "false");
+    if (more) {
+        response.set("X-Replication-Cursor", url_encode(last));
+    }
+    return response;
+}
+
+http::response<http::string_body> crud_handler::replication_response(replication_log& log, std::uint64_t since, size_t limit) {
+    std::vector<replication_log::entry> entries;
+    std::uint64_t next;
+    bool more;
+    if (!log.since(since, limit, entries, next, more)) {
+        return create_response(http::status::gone, "text/plain",
+                               "Writes after " + std::to_string(since) + " are no longer kept; copy the location again with ?snapshot");
+    }
+    std::string body;
+    for (const auto& written : entries) {
+        replication_log::serialize(written, body);
+    }
+    http::response<http::string_body> response = create_response(http::status::ok, "application/octet-stream", body);
+    response.set("X-Replication-Seq", std::to_string(next));
+    response.set("X-Replication-More", more ? "true" : "false");
+    return response;
+}
+
+http::response<http::string_body> crud_handler::handle_follower_request(const http::request<http::string_body>& request) {
+    if (request.method() != http::verb::get) {
+        Logger::get_global_log()->logError("ERROR: Write to a read-only replica of " + follower_->leader());
+        return create_response(http::status::forbidden, "text/plain",
+                               "Read-only replica of " + follower_->leader() + "; send writes to the leader");
+    }
+    std::chrono::milliseconds lag = follower_->lag();
+    http::response<http::string_body> response;
+    if (lag > follower_->max_lag()) {
+        // Better no answer than one that may be far out of date.
+        std::string behind = lag == std::chrono::milliseconds::max() ? "has not copied its leader yet"
+                                                                      : "is " + std::to_string(lag.count()) + " ms behind its leader";
+        response = create_response(http::status::service_unavailable, "text/plain", "Replica " + behind);
+        response.set(http::field::retry_after, "1");
+    } else {
+        response = handle_get_request(request);
+    }
+    if (lag != std::chrono::milliseconds::max()) {
+        response.set(replication_follower::lag_header, std::to_string(lag.count()));
+    }
+    return response;
+}
+
+bool crud_handler::apply_replicated(const replication_log::entry& written) {
+    Logger *logger = Logger::get_global_log();
+    std::filesystem::path key(written.key);
+    if (key.is_absolute() || count_path_segments(key) < 2 || std::find(key.begin(), key.end(), "..") != key.end()) {
+        logger->logError("ERROR: Skipping replicated entity outside the location: " + written.key);
+        return true;
+    }
+    std::filesystem::path entity_path = std::filesystem::path(data_path_) / key;
+    std::unique_lock<std::shared_mutex> lock(entity_locks::get_global_locks().for_path(entity_path));
+    if (written.deleted) {
+        if (file_io_->delete_file(entity_path.string())) {
+            index_->remove(entity_path.parent_path().string(), entity_path.filename().string());
+            entity_deleted(entity_path);
+        }
+        file_io_->close();
+        return true;
+    }
+    bool is_new_file = !file_io_->exists(entity_path.string());
+    if (!create_or_update_entity(entity_path, written.data)) {
+        return false;
+    }
+    entity_written(entity_path, written.data, 0);
+    if (is_new_file) {
+        index_->add(entity_path.parent_path().string(), entity_path.filename().string());
+    }
+    return true;
+}
+
 std::string crud_handler::generate_id() {
-    static boost::uuids::random_generator generator;
-    boost::uuids::uuid id = generator();
-    return boost::uuids::to_string(id);
+    return id_generator::generate();
 }
 
 http::response<http::string_body> crud_handler::handle_post_request(const http::request<http::string_body>& request) {
     Logger *logger = Logger::get_global_log();
+
+    // POST <crud-prefix>/<entity-dir>/_bulk or /_import carries an NDJSON batch
+    std::string bulk_target = remove_prefix_dir("/api/", request.target());
+    size_t pos_endpoint = bulk_target.find_last_of('/');
+    std::string endpoint = pos_endpoint == std::string::npos ? bulk_target : bulk_target.substr(pos_endpoint + 1);
+    if (endpoint == "_bulk" || endpoint == "_import") {
+        std::string bulk_dir = pos_endpoint == std::string::npos ? "" : bulk_target.substr(0, pos_endpoint);
+        return handle_bulk_request(request, bulk_dir, endpoint == "_import");
+    }
+
     if (request.body().size() == 0) {
         logger->logError("ERROR: No data in POST request");
         return create_response(http::status::bad_request,
@@ -78,24 +923,53 @@ http::response<http::string_body> crud_handler::handle_post_request(const http::
     logger->logDebug("Filepath: " + entity_path.string());
 
     std::string entity_data = request.body();
+    std::string json_error;
+    if (!prepare_entity(entity_data, json_error)) {
+        logger->logError("ERROR: Invalid JSON in POST request: " + json_error);
+        return create_response(http::status::bad_request,
+                                "text/plain",
+                                "Invalid JSON: " + json_error);
+    }
+    unsigned ttl;
+    std::string ttl_error;
+    if (!entity_ttl(request, ttl, ttl_error)) {
+        logger->logError("ERROR: " + ttl_error);
+        return create_response(http::status::bad_request,
+                                "text/plain",
+                                ttl_error);
+    }
+    std::unique_lock<std::shared_mutex> lock(entity_locks::get_global_locks().for_path(entity_path));
     bool success = create_or_update_entity(entity_path, entity_data);
     if (!success) {
         return create_response(http::status::internal_server_error,
                                 "text/plain",
                                 "Unable to create file. Please try again later.");
     }
+    index_->add(entity_path.parent_path().string(), id);
+    entity_written(entity_path, entity_data, ttl);
     logger->logDebug("JSON data written successfully: " + entity_data);
 
     std::string body = (std::ostringstream() << "{\"id\": \"" << id << "\"}").str();
-    return create_response(http::status::created,
-                            "application/json",
-                            body);
+    http::response<http::string_body> response = create_response(http::status::created,
+                                                                  "application/json",
+                                                                  body);
+    std::string etag = entity_etag(entity_path);
+    if (!etag.empty()) {
+        response.set(http::field::etag, etag);
+    }
+    return response;
 }
 
 http::response<http::string_body> crud_handler::handle_get_request(const http::request<http::string_body>& request) {
     Logger *logger = Logger::get_global_log();
 
     std::string entity_with_id = remove_prefix_dir("/api/", request.target());
+    std::string query;
+    size_t pos_question = entity_with_id.find('?');
+    if (pos_question != std::string::npos) {
+        query = entity_with_id.substr(pos_question + 1);
+        entity_with_id = entity_with_id.substr(0, pos_question);
+    }
     if (entity_with_id.empty()) {
         logger->logError("ERROR: No entity directory specified");
         return create_response(http::status::bad_request,
@@ -122,32 +996,133 @@ http::response<http::string_body> crud_handler::handle_get_request(const http::r
     logger->logDebug("ID: " + id);
     logger->logDebug("Filepath: " + entity_path.string());
 
+    if (id == "_changes") {
+        // Without ?wait= (or once a watch ends) the changes are answered now.
+        changes_query changes;
+        std::string error;
+        if (!parse_changes_query(query, changes, error)) {
+            logger->logError("ERROR: " + error);
+            return create_response(http::status::bad_request,
+                                    "text/plain",
+                                    error);
+        }
+        return changes_response(*feed_, entity_path.parent_path().string(), changes);
+    }
+
+    if (id == "_aggregate") {
+        return handle_aggregate_request(entity_path.parent_path(), query);
+    }
+
     if (id.empty()) {
-        // No ID found, try listing all the filenames for the given entity
+        // No ID found, list the IDs of the given entity, a page at a time if
+        // the request has ?limit=<n>&cursor=<last id of previous page>
         logger->logDebug("Listing filenames in the entity path of " + (entity_path).string());
 
+        std::map<std::string, std::string> params = parse_query(query);
+        if (params.count("ids")) {
+            return handle_multi_get(entity_path, params["ids"]);
+        }
+        size_t limit = 0;
+        if (params.count("limit")) {
+            try {
+                limit = boost::lexical_cast<size_t>(params["limit"]);
+            } catch (const boost::bad_lexical_cast&) {
+                limit = 0;
+            }
+            if (limit == 0 || limit > max_page_size) {
+                logger->logError("ERROR: Invalid limit: " + params["limit"]);
+                return create_response(http::status::bad_request,
+                                        "text/plain",
+                                        "limit must be between 1 and " + std::to_string(max_page_size));
+            }
+        }
+
+        // Any other parameter filters on an indexed field, as in ?author=X
+        std::map<std::string, std::string> filters = params;
+        filters.erase("limit");
+        filters.erase("cursor");
+
         std::vector<std::string> ids;
-        if(!file_io_->list_directories(std::string(entity_path), ids)) {
+        bool more = false;
+        if (!filters.empty()) {
+            std::string error;
+            if (!find_filtered(entity_path, filters, ids, error)) {
+                logger->logError("ERROR: " + error);
+                return create_response(http::status::bad_request,
+                                        "text/plain",
+                                        error);
+            }
+            ids.erase(std::remove_if(ids.begin(), ids.end(), [&](const std::string& match) { return entity_expired(entity_path / match); }),
+                      ids.end());
+            // Page the matches the same way the index pages a whole listing.
+            auto first = params["cursor"].empty() ? ids.begin() : std::upper_bound(ids.begin(), ids.end(), params["cursor"]);
+            ids.erase(ids.begin(), first);
+            if (limit > 0 && ids.size() > limit) {
+                ids.resize(limit);
+                more = true;
+            }
+        } else if (!index_->page(*file_io_, std::string(entity_path), params["cursor"], limit, ids, more)) {
             return create_response(http::status::bad_request,
                                     "text/html",
                                     "<html><head><title>Bad Request</title></head><body><h1>400 Bad Request</h1></body></html>");
         }
+        // The next page starts after the last ID looked at, even if it has
+        // expired and is left out below.
+        std::string cursor = ids.empty() ? "" : ids.back();
+        if (expiry_) {
+            ids.erase(std::remove_if(ids.begin(), ids.end(), [&](const std::string& listed) { return entity_expired(entity_path / listed); }),
+                      ids.end());
+        }
 
-        std::ostringstream oss;
-        oss << "[";
-        for(size_t i = 0; i< ids.size(); ++i) {
-            if (i>=1) oss << ",";
-            oss << "\"" << ids[i] << "\"";
+        std::string body;
+        body.reserve(2 + ids.size() * (id_generator::id_length + 3));
+        body += "[";
+        for (size_t i = 0; i < ids.size(); ++i) {
+            if (i >= 1) body += ",";
+            body += "\"";
+            body += ids[i];
+            body += "\"";
         }
-        oss << "]";
+        body += "]";
 
-        std::string body = oss.str();
-        return create_response(http::status::ok,
-                                "application/json",
-                                body);
+        http::response<http::string_body> response = create_response(http::status::ok,
+                                                                      "application/json",
+                                                                      body);
+        if (more) {
+            std::string next = "</api/" + url_encode_path(entity) + "?";
+            for (const auto& filter : filters) {
+                next += url_encode(filter.first) + "=" + url_encode(filter.second) + "&";
+            }
+            next += "limit=" + std::to_string(limit) + "&cursor=" + url_encode(cursor) + ">; rel=\"next\"";
+            response.set(http::field::link, boost::beast::string_view(next));
+        }
+        return response;
     }
     
     std::string entity_data;
+    std::shared_lock<std::shared_mutex> lock(entity_locks::get_global_locks().for_path(entity_path));
+
+    // Expired entities are gone as soon as their deadline passes, even if
+    // the reaper has not deleted them yet.
+    if (entity_expired(entity_path)) {
+        logger->logError("ERROR: Entity at " + entity_path.string() + " has expired");
+        return create_response(http::status::not_found,
+                                "text/html",
+                                "<html><head><title>Not Found</title></head><body><h1>404 Not Found</h1></body></html>");
+    }
+
+    // An unchanged entity is answered from its metadata without reading it.
+    std::string etag = entity_etag(entity_path);
+    auto if_none_match = request.find(http::field::if_none_match);
+    if (!etag.empty() && if_none_match != request.end()) {
+        bool plain = etag_listed(if_none_match->value(), etag, true);
+        if (plain || etag_listed(if_none_match->value(), gzip_etag(etag), true)) {
+            http::response<http::string_body> response = create_response(http::status::not_modified, "application/json", "");
+            response.set(http::field::etag, plain ? etag : gzip_etag(etag));
+            response.set(http::field::vary, "Accept-Encoding");
+            return response;
+        }
+    }
 
     // Failed to open
     if (!file_io_->open(std::string(entity_path), std::ios::in)) {
@@ -157,8 +1132,13 @@ http::response<http::string_body> crud_handler::handle_get_request(const http::r
                                 "<html><head><title>Not Found</title></head><body><h1>404 Not Found</h1></body></html>");
     }
 
-    // Failed to Read
-    if (!file_io_->read(std::string(entity_path), entity_data)) {
+    // Failed to Read. A client that takes gzip gets an entity stored
+    // gzipped as it is, without inflating it here.
+    std::string encoding;
+    bool read_ok = accepts_gzip(request)
+        ? file_io_->read_stored(std::string(entity_path), entity_data, encoding)
+        : file_io_->read(std::string(entity_path), entity_data);
+    if (!read_ok) {
         logger->logError("ERROR: Failed to read file");
         return create_response(http::status::internal_server_error,
                                 "text/html",
@@ -169,9 +1149,24 @@ http::response<http::string_body> crud_handler::handle_get_request(const http::r
     logger->logDebug("JSON data retrieved successfully: " + entity_data);
 
     std::string body = entity_data;
-    return create_response(http::status::ok,
-                            "application/json",
-                            body);
+    http::response<http::string_body> response = create_response(http::status::ok,
+                                                                  "application/json",
+                                                                  body);
+    response.set(http::field::vary, "Accept-Encoding");
+    if (!encoding.empty()) {
+        // Each encoding is a distinct representation with its own ETag.
+        response.set(http::field::content_encoding, encoding);
+        etag = gzip_etag(etag);
+    }
+    if (!etag.empty()) {
+        response.set(http::field::etag, etag);
+    }
+    // A node taking the entity over keeps its deadline.
+    unsigned ttl = request.find(shard_router::forwarded_header) != request.end() ? remaining_ttl(entity_path) : 0;
+    if (ttl > 0) {
+        response.set("X-TTL", std::to_string(ttl));
+    }
+    return response;
 }
 
 http::response<http::string_body> crud_handler::handle_put_request(const http::request<http::string_body>& request) {
@@ -199,10 +1194,34 @@ http::response<http::string_body> crud_handler::handle_put_request(const http::r
                                 "File format must be <crud-prefix>/<entity-dir>/<id>");
     }
     
+    std::string entity_data = request.body();
+    std::string json_error;
+    if (!prepare_entity(entity_data, json_error)) {
+        logger->logError("ERROR: Invalid JSON in PUT request: " + json_error);
+        return create_response(http::status::bad_request,
+                                "text/plain",
+                                "Invalid JSON: " + json_error);
+    }
+    unsigned ttl;
+    std::string ttl_error;
+    if (!entity_ttl(request, ttl, ttl_error)) {
+        logger->logError("ERROR: " + ttl_error);
+        return create_response(http::status::bad_request,
+                                "text/plain",
+                                ttl_error);
+    }
+
     std::filesystem::path entity_path = std::filesystem::path(data_path_) / entity_dir;
-    bool is_new_file = !file_io_->exists(std::string(entity_path));
+    // Hold the entity for the whole check-then-write so concurrent PUTs cannot interleave.
+    std::unique_lock<std::shared_mutex> lock(entity_locks::get_global_locks().for_path(entity_path));
+    bool is_new_file = !file_io_->exists(std::string(entity_path)) || entity_expired(entity_path);
+    if (!preconditions_met(request, entity_path, !is_new_file)) {
+        logger->logError("ERROR: Precondition failed for " + entity_path.string());
+        return create_response(http::status::precondition_failed,
+                                "text/plain",
+                                "Precondition Failed");
+    }
 
-    std::string entity_data = request.body();
     bool success = create_or_update_entity(entity_path, entity_data);
     if (!success) {
         return create_response(http::status::internal_server_error,
@@ -212,20 +1231,28 @@ http::response<http::string_body> crud_handler::handle_put_request(const http::r
 
     std::string id = entity_path.filename().string();
     logger->logDebug("Request file id: " + id);
+    entity_written(entity_path, entity_data, ttl);
 
+    http::response<http::string_body> response;
     if (is_new_file) {
+        index_->add(entity_path.parent_path().string(), id);
         // file creation response
         std::string body = (std::ostringstream() << "{\"id\": \"" << id << "\"}").str();
-        return create_response(http::status::created,
-                                "application/json",
-                                body);
+        response = create_response(http::status::created,
+                                    "application/json",
+                                    body);
     } else {
         // update existing file response
         std::string body = "";
-        return create_response(http::status::no_content,
-                                "application/json",
-                                body);
+        response = create_response(http::status::no_content,
+                                    "application/json",
+                                    body);
     }
+    std::string etag = entity_etag(entity_path);
+    if (!etag.empty()) {
+        response.set(http::field::etag, etag);
+    }
+    return response;
 }
 
 http::response<http::string_body> crud_handler::handle_delete_request(const http::request<http::string_body>& request) {
@@ -259,10 +1286,20 @@ http::response<http::string_body> crud_handler::handle_delete_request(const http
     logger->logDebug("ID: " + id);
     logger->logDebug("Filepath: " + entity_path.string());
 
+    std::unique_lock<std::shared_mutex> lock(entity_locks::get_global_locks().for_path(entity_path));
+    if ((request.count(http::field::if_match) || request.count(http::field::if_none_match)) &&
+        !preconditions_met(request, entity_path, file_io_->exists(std::string(entity_path)))) {
+        logger->logError("ERROR: Precondition failed for " + entity_path.string());
+        return create_response(http::status::precondition_failed,
+                                "text/plain",
+                                "Precondition Failed");
+    }
     if (!file_io_->delete_file(std::string(entity_path))) {
         logger->logError("ERROR: Cannot delete file that does not exist at " + entity_path.string());
     }
     else {
+        index_->remove(entity_path.parent_path().string(), id);
+        entity_deleted(entity_path);
         logger->logDebug("Successfully deleted file");
     }
 
@@ -274,6 +1311,546 @@ http::response<http::string_body> crud_handler::handle_delete_request(const http
                             body);
 }
 
+http::response<http::string_body> crud_handler::handle_patch_request(const http::request<http::string_body>& request) {
+    Logger *logger = Logger::get_global_log();
+    if (request.body().size() == 0) {
+        logger->logError("ERROR: No data in PATCH request");
+        return create_response(http::status::bad_request,
+                                "text/plain",
+                                "No data in PATCH request");
+    }
+
+    auto content_type = request.find(http::field::content_type);
+    if (content_type == request.end() || content_type->value() != "application/merge-patch+json") {
+        logger->logError("ERROR: Content-Type must be application/merge-patch+json");
+        return create_response(http::status::unsupported_media_type,
+                                "text/plain",
+                                "Content-Type must be application/merge-patch+json");
+    }
+
+    std::string entity_dir = remove_prefix_dir("/api/", request.target());
+    int path_segments = count_path_segments(std::filesystem::path(entity_dir));
+    if (entity_dir.empty() || path_segments < 2) {
+        logger->logError("ERROR: File has invalid path: " + entity_dir);
+        return create_response(http::status::bad_request,
+                                "text/plain",
+                                "File format must be <crud-prefix>/<entity-dir>/<id>");
+    }
+
+    std::string json_error;
+    if (!json_validator::validate(request.body(), &json_error)) {
+        logger->logError("ERROR: Invalid JSON in PATCH request: " + json_error);
+        return create_response(http::status::bad_request,
+                                "text/plain",
+                                "Invalid JSON: " + json_error);
+    }
+    unsigned ttl;
+    std::string ttl_error;
+    if (!entity_ttl(request, ttl, ttl_error)) {
+        logger->logError("ERROR: " + ttl_error);
+        return create_response(http::status::bad_request,
+                                "text/plain",
+                                ttl_error);
+    }
+
+    std::filesystem::path entity_path = std::filesystem::path(data_path_) / entity_dir;
+    // Read, merge and write under one exclusive lock so a PATCH is atomic
+    // with respect to every other request on the entity.
+    std::unique_lock<std::shared_mutex> lock(entity_locks::get_global_locks().for_path(entity_path));
+    bool exists = file_io_->exists(std::string(entity_path)) && !entity_expired(entity_path);
+    if (!preconditions_met(request, entity_path, exists)) {
+        logger->logError("ERROR: Precondition failed for " + entity_path.string());
+        return create_response(http::status::precondition_failed,
+                                "text/plain",
+                                "Precondition Failed");
+    }
+    std::string entity_data;
+    if (!exists || !file_io_->open(std::string(entity_path), std::ios::in)) {
+        logger->logError("ERROR: Failed to open file at " + entity_path.string());
+        return create_response(http::status::not_found,
+                                "text/html",
+                                "<html><head><title>Not Found</title></head><body><h1>404 Not Found</h1></body></html>");
+    }
+    bool read_ok = file_io_->read(std::string(entity_path), entity_data);
+    file_io_->close();
+
+    std::string merged;
+    if (!read_ok || !json_merge_patch::apply(entity_data, request.body(), merged) ||
+        !prepare_entity(merged, json_error)) {
+        logger->logError("ERROR: Unable to patch entity at " + entity_path.string());
+        return create_response(http::status::internal_server_error,
+                                "text/plain",
+                                "Unable to patch entity. Please try again later.");
+    }
+    if (!create_or_update_entity(entity_path, merged)) {
+        return create_response(http::status::internal_server_error,
+                                "text/plain",
+                                "Unable to create or update file. Please try again later.");
+    }
+    entity_written(entity_path, merged, ttl);
+    logger->logDebug("JSON data patched successfully: " + merged);
+
+    http::response<http::string_body> response = create_response(http::status::no_content,
+                                                                  "application/json",
+                                                                  "");
+    std::string etag = entity_etag(entity_path);
+    if (!etag.empty()) {
+        response.set(http::field::etag, etag);
+    }
+    return response;
+}
+
+http::response<http::string_body> crud_handler::handle_bulk_request(const http::request<http::string_body>& request, const std::string& entity_dir, bool import) {
+    Logger *logger = Logger::get_global_log();
+    auto content_type = request.find(http::field::content_type);
+    if (content_type == request.end() || content_type->value() != "application/x-ndjson") {
+        logger->logError("ERROR: Content-Type must be application/x-ndjson");
+        return create_response(http::status::unsupported_media_type,
+                                "text/plain",
+                                "Content-Type must be application/x-ndjson");
+    }
+    // One TTL covers every entity the request writes.
+    unsigned ttl;
+    std::string ttl_error;
+    if (!entity_ttl(request, ttl, ttl_error)) {
+        logger->logError("ERROR: " + ttl_error);
+        return create_response(http::status::bad_request,
+                                "text/plain",
+                                ttl_error);
+    }
+    if (entity_dir.empty()) {
+        logger->logError("ERROR: No entity directory specified");
+        return create_response(http::status::bad_request,
+                                "text/plain",
+                                "No entity directory specified");
+    }
+    std::filesystem::path entity_path = std::filesystem::path(data_path_) / entity_dir;
+
+    // One line per item: {"op": "...", "id": "...", "status": <code>[, "error": "..."]}
+    std::string body;
+    auto report = [&body](const std::vector<bulk_item>& items) {
+        for (const auto& item : items) {
+            body += "{\"op\": " + json_string(item.op) + ", \"id\": " + json_string(item.id) +
+                    ", \"status\": " + std::to_string(static_cast<unsigned>(item.status));
+            if (!item.error.empty()) {
+                body += ", \"error\": " + json_string(item.error);
+            }
+            body += "}\n";
+        }
+    };
+
+    const std::string& input = request.body();
+    size_t pos = 0;
+    size_t line_number = 0;
+    std::string_view line;
+    std::vector<bulk_item> items;
+    if (import) {
+        // Every line is a new entity. Lines are committed a batch at a time,
+        // so an import of any size holds at most one batch of items.
+        while (next_line(input, pos, line, line_number)) {
+            items.push_back(bulk_item{"create", generate_id(), std::string(line)});
+            reject_invalid_entity(items.back());
+            if (items.size() == max_batch_size) {
+                commit_bulk_items(entity_path, items, ttl);
+                report(items);
+                items.clear();
+            }
+        }
+        commit_bulk_items(entity_path, items, ttl);
+        report(items);
+        logger->logDebug("Imported NDJSON into " + entity_path.string());
+        return create_response(http::status::ok, "application/x-ndjson", body);
+    }
+
+    // Action lines as in {"create": {}}, {"update": {"id": "<id>"}} or
+    // {"delete": {"id": "<id>"}}; create and update are followed by the entity.
+    static const std::regex action(R"re(\s*\{\s*"(create|update|delete)"\s*:\s*\{\s*(?:"id"\s*:\s*"([^"]*)"\s*)?\}\s*\}\s*)re");
+    while (next_line(input, pos, line, line_number)) {
+        std::cmatch match;
+        if (!std::regex_match(line.data(), line.data() + line.size(), match, action)) {
+            logger->logError("ERROR: Malformed bulk action on line " + std::to_string(line_number));
+            return create_response(http::status::bad_request,
+                                    "text/plain",
+                                    "Malformed bulk action on line " + std::to_string(line_number));
+        }
+        bulk_item item{match[1].str(), match[2].str()};
+        if (item.op != "delete") {
+            size_t action_line = line_number;
+            if (!next_line(input, pos, line, line_number)) {
+                return create_response(http::status::bad_request,
+                                        "text/plain",
+                                        "Missing entity for bulk action on line " + std::to_string(action_line));
+            }
+            item.data = std::string(line);
+        }
+        if (item.op == "create") {
+            item.id = generate_id();
+        } else if (!valid_id(item.id)) {
+            item.status = http::status::bad_request;
+            item.error = "Invalid id";
+        }
+        if (item.op != "delete") {
+            reject_invalid_entity(item);
+        }
+        items.push_back(std::move(item));
+    }
+    for (size_t start = 0; start < items.size(); start += max_batch_size) {
+        std::vector<bulk_item> batch(items.begin() + start, items.begin() + std::min(items.size(), start + max_batch_size));
+        commit_bulk_items(entity_path, batch, ttl);
+        report(batch);
+    }
+    return create_response(http::status::ok, "application/x-ndjson", body);
+}
+
+http::response<http::string_body> crud_handler::handle_aggregate_request(const std::filesystem::path& entity_path, const std::string& query) {
+    Logger *logger = Logger::get_global_log();
+    std::map<std::string, std::string> params = parse_query(query);
+    aggregate_query aggregate;
+    std::string error;
+    if (!aggregate.parse(params["op"], params["field"], params["group_by"], error)) {
+        logger->logError("ERROR: " + error);
+        return create_response(http::status::bad_request,
+                                "text/plain",
+                                error);
+    }
+
+    // Any other parameter filters on an indexed field, as in a listing.
+    std::map<std::string, std::string> filters = params;
+    filters.erase("op");
+    filters.erase("field");
+    filters.erase("group_by");
+    std::vector<std::string> ids;
+    bool more = false;
+    if (!filters.empty()) {
+        if (!find_filtered(entity_path, filters, ids, error)) {
+            logger->logError("ERROR: " + error);
+            return create_response(http::status::bad_request,
+                                    "text/plain",
+                                    error);
+        }
+    } else if (!index_->page(*file_io_, entity_path.string(), "", 0, ids, more)) {
+        return create_response(http::status::bad_request,
+                                "text/html",
+                                "<html><head><title>Bad Request</title></head><body><h1>400 Bad Request</h1></body></html>");
+    }
+
+    // Each entity is read as a GET would read it, so the scan sees whole
+    // documents and no expired ones.
+    auto read = [this, &entity_path](const std::string& id, std::string& data) {
+        std::filesystem::path path = entity_path / id;
+        std::shared_lock<std::shared_mutex> lock(entity_locks::get_global_locks().for_path(path));
+        return !entity_expired(path) && file_io_->read(path.string(), data);
+    };
+    std::map<std::string, aggregate_query::group> groups;
+    aggregate.run(ids, read, groups);
+
+    // {"count": 3, "sum": 12.5}, or with group_by
+    // {"groups": {"Acme": {"count": 2, "sum": 10}, ...}}
+    std::string name = params["op"];
+    auto result = [&aggregate, &name](const aggregate_query::group& found) {
+        std::string fields = "{\"count\": " + std::to_string(found.count);
+        if (aggregate.op() != aggregate_query::operation::count) {
+            bool empty = found.count == 0 && aggregate.op() != aggregate_query::operation::sum;
+            fields += ", \"" + name + "\": " + (empty ? "null" : json_number(found.value(aggregate.op())));
+        }
+        return fields + "}";
+    };
+    std::string body;
+    if (aggregate.group_by().empty()) {
+        body = result(groups[""]);
+    } else {
+        body = "{\"groups\": {";
+        bool first = true;
+        for (const auto& found : groups) {
+            body += (first ? "" : ", ") + json_string(found.first) + ": " + result(found.second);
+            first = false;
+        }
+        body += "}}";
+    }
+    return create_response(http::status::ok, "application/json", body);
+}
+
+bool crud_handler::parse_changes_query(const std::string& query, changes_query& changes, std::string& error) {
+    std::map<std::string, std::string> params = parse_query(query);
+    try {
+        if (params.count("since")) {
+            changes.since = boost::lexical_cast<std::uint64_t>(params["since"]);
+        }
+        if (params.count("limit")) {
+            changes.limit = boost::lexical_cast<size_t>(params["limit"]);
+        }
+        if (params.count("wait")) {
+            changes.wait = boost::lexical_cast<unsigned>(params["wait"]);
+            if (changes.wait > max_wait_seconds) {
+                changes.wait = max_wait_seconds;
+            }
+        }
+    } catch (const boost::bad_lexical_cast&) {
+        error = "since, limit and wait must be non-negative integers";
+        return false;
+    }
+    if (changes.limit == 0 || changes.limit > max_page_size) {
+        error = "limit must be between 1 and " + std::to_string(max_page_size);
+        return false;
+    }
+    return true;
+}
+
+http::response<http::string_body> crud_handler::changes_response(change_feed& feed, const std::string& directory, const changes_query& changes) {
+    std::vector<change_feed::change> found;
+    std::uint64_t next;
+    if (!feed.since(directory, changes.since, changes.limit, found, next)) {
+        return create_response(http::status::gone,
+                                "text/plain",
+                                "Changes since " + std::to_string(changes.since) + " are no longer available; list the collection again");
+    }
+    // {"changes": [{"seq": <n>, "id": "<id>", "deleted": <bool>}, ...], "last_seq": <n>}
+    std::string body = "{\"changes\": [";
+    for (size_t i = 0; i < found.size(); i++) {
+        if (i > 0) {
+            body += ", ";
+        }
+        body += "{\"seq\": " + std::to_string(found[i].sequence) + ", \"id\": " + json_string(found[i].id) +
+                ", \"deleted\": " + (found[i].deleted ? "true" : "false") + "}";
+    }
+    body += "], \"last_seq\": " + std::to_string(next) + "}";
+    return create_response(http::status::ok, "application/json", body);
+}
+
+void crud_handler::entity_written(const std::filesystem::path& path, const std::string& entity_data, unsigned ttl) {
+    fields_->update(path.parent_path().string(), path.filename().string(), entity_data);
+    feed_->record(path.parent_path().string(), path.filename().string(), false);
+    if (replication_) {
+        replication_->record(path.lexically_relative(data_path_).generic_string(), entity_data, false);
+    }
+    if (!expiry_) {
+        return;
+    }
+    // Every write restarts the clock, so entities expire ttl seconds after
+    // they were last written.
+    if (ttl > 0) {
+        expiry_->set(path.string(), expiry_wheel::clock::now() + std::chrono::seconds(ttl));
+    } else {
+        expiry_->clear(path.string());
+    }
+}
+
+void crud_handler::entity_deleted(const std::filesystem::path& path) {
+    fields_->remove(path.parent_path().string(), path.filename().string());
+    feed_->record(path.parent_path().string(), path.filename().string(), true);
+    if (replication_) {
+        replication_->record(path.lexically_relative(data_path_).generic_string(), "", true);
+    }
+    if (expiry_) {
+        expiry_->clear(path.string());
+    }
+}
+
+bool crud_handler::entity_ttl(const http::request<http::string_body>& request, unsigned& ttl, std::string& error) {
+    ttl = default_ttl_;
+    auto header = request.find("X-TTL");
+    if (header == request.end()) {
+        return true;
+    }
+    if (!parse_seconds(std::string(header->value()), ttl)) {
+        error = "X-TTL must be a whole number of seconds";
+        return false;
+    }
+    return true;
+}
+
+bool crud_handler::entity_expired(const std::filesystem::path& path) {
+    return expiry_ && expiry_->expired(path.string());
+}
+
+unsigned crud_handler::remaining_ttl(const std::filesystem::path& path) {
+    expiry_wheel::clock::time_point deadline;
+    if (!expiry_ || !expiry_->deadline(path.string(), deadline)) {
+        return 0;
+    }
+    auto left = std::chrono::ceil<std::chrono::seconds>(deadline - expiry_wheel::clock::now()).count();
+    return left > 0 ? static_cast<unsigned>(left) : 1;
+}
+
+void crud_handler::expire_entity(const std::string& path, expiry_wheel& expiry) {
+    std::filesystem::path entity_path(path);
+    std::unique_lock<std::shared_mutex> lock(entity_locks::get_global_locks().for_path(entity_path));
+    // Checked under the entity lock, so a write that renewed or cleared the
+    // deadline after it was queued keeps the entity.
+    if (!expiry.claim(path)) {
+        return;
+    }
+    if (file_io_->delete_file(path)) {
+        index_->remove(entity_path.parent_path().string(), entity_path.filename().string());
+        entity_deleted(entity_path);
+        Logger::get_global_log()->logDebug("Expired entity at " + path);
+    }
+    file_io_->close();
+}
+
+std::string crud_handler::entity_etag(const std::filesystem::path& path) {
+    std::string tag;
+    if (!file_io_->version(path.string(), tag)) {
+        return "";
+    }
+    return "\"" + tag + "\"";
+}
+
+bool crud_handler::preconditions_met(const http::request<http::string_body>& request, const std::filesystem::path& path, bool exists) {
+    auto if_match = request.find(http::field::if_match);
+    auto if_none_match = request.find(http::field::if_none_match);
+    if (if_match == request.end() && if_none_match == request.end()) {
+        return true;
+    }
+    std::string etag = exists ? entity_etag(path) : "";
+    // If-Match: the client's copy must still be current (strong comparison).
+    if (if_match != request.end()) {
+        if (!exists) {
+            return false;
+        }
+        if (if_match->value() != "*" && (etag.empty() || (!etag_listed(if_match->value(), etag, false) &&
+                                                          !etag_listed(if_match->value(), gzip_etag(etag), false)))) {
+            return false;
+        }
+    }
+    // If-None-Match: * only creates; a listed tag means the client has that version.
+    if (if_none_match != request.end() && exists &&
+        (if_none_match->value() == "*" || (!etag.empty() && (etag_listed(if_none_match->value(), etag, true) ||
+                                                             etag_listed(if_none_match->value(), gzip_etag(etag), true))))) {
+        return false;
+    }
+    return true;
+}
+
+bool crud_handler::prepare_entity(std::string& entity_data, std::string& error) {
+    if (!minify_json_) {
+        return json_validator::validate(entity_data, &error);
+    }
+    std::string minified;
+    if (!json_validator::minify(entity_data, minified, &error)) {
+        return false;
+    }
+    entity_data.swap(minified);
+    return true;
+}
+
+void crud_handler::reject_invalid_entity(bulk_item& item) {
+    std::string error;
+    if (item.status == http::status::unknown && !prepare_entity(item.data, error)) {
+        item.status = http::status::bad_request;
+        item.error = "Invalid JSON: " + error;
+    }
+}
+
+void crud_handler::commit_bulk_items(const std::filesystem::path& entity_path, std::vector<bulk_item>& items, unsigned ttl) {
+    std::vector<std::filesystem::path> paths;
+    for (const auto& item : items) {
+        paths.push_back(entity_path / item.id);
+    }
+    auto locks = entity_locks::get_global_locks().lock_all(paths);
+
+    std::vector<i_file_io::batch_op> ops;
+    std::vector<size_t> positions;
+    std::map<std::string, bool> present;  // as of the ops so far
+    for (size_t i = 0; i < items.size(); i++) {
+        bulk_item& item = items[i];
+        if (item.status != http::status::unknown) {
+            continue;
+        }
+        std::string path = paths[i].string();
+        if (item.op == "update") {
+            auto seen = present.find(path);
+            bool exists = seen != present.end() ? seen->second : file_io_->exists(path) && !entity_expired(path);
+            item.status = exists ? http::status::ok : http::status::created;
+        }
+        present[path] = item.op != "delete";
+        ops.push_back(i_file_io::batch_op{path, item.data, item.op == "delete"});
+        positions.push_back(i);
+    }
+    if (ops.empty()) {
+        return;
+    }
+
+    std::vector<bool> results;
+    file_io_->write_batch(ops, results);
+    for (size_t i = 0; i < positions.size(); i++) {
+        bulk_item& item = items[positions[i]];
+        if (item.op == "delete") {
+            item.status = results[i] ? http::status::no_content : http::status::not_found;
+            if (results[i]) {
+                index_->remove(entity_path.string(), item.id);
+                entity_deleted(entity_path / item.id);
+            }
+        } else if (!results[i]) {
+            item.status = http::status::internal_server_error;
+            item.error = "Unable to write entity";
+        } else {
+            if (item.op == "create") {
+                item.status = http::status::created;
+            }
+            index_->add(entity_path.string(), item.id);
+            entity_written(entity_path / item.id, item.data, ttl);
+        }
+    }
+}
+
+bool crud_handler::find_filtered(const std::filesystem::path& entity_path, const std::map<std::string, std::string>& filters,
+                                 std::vector<std::string>& ids, std::string& error) {
+    // Any other parameter is a mistake, not a filter nothing matches.
+    for (const auto& filter : filters) {
+        if (!fields_->indexed(entity_path.string(), filter.first)) {
+            error = "Field " + filter.first + " is not indexed";
+            return false;
+        }
+    }
+    // Every filter must match, so intersect the sorted IDs each one finds.
+    bool first = true;
+    for (const auto& filter : filters) {
+        std::vector<std::string> matches;
+        if (!fields_->find(*file_io_, entity_path.string(), filter.first, filter.second, matches)) {
+            error = "Unable to read entity directory";
+            return false;
+        }
+        if (first) {
+            ids.swap(matches);
+            first = false;
+        } else {
+            std::vector<std::string> both;
+            std::set_intersection(ids.begin(), ids.end(), matches.begin(), matches.end(), std::back_inserter(both));
+            ids.swap(both);
+        }
+        if (ids.empty()) {
+            break;
+        }
+    }
+    return true;
+}
+
+http::response<http::string_body> crud_handler::handle_multi_get(const std::filesystem::path& entity_path, const std::string& ids) {
+    // One line per id: {"id": "...", "status": 200, "data": <entity>} or a 400/404 status
+    std::string body;
+    std::istringstream list(ids);
+    std::string id;
+    while (std::getline(list, id, ',')) {
+        std::string line = "{\"id\": " + json_string(id) + ", \"status\": ";
+        std::string entity_data;
+        if (!valid_id(id)) {
+            line += "400";
+        } else {
+            std::filesystem::path path = entity_path / id;
+            std::shared_lock<std::shared_mutex> lock(entity_locks::get_global_locks().for_path(path));
+            if (!entity_expired(path) && file_io_->open(path.string(), std::ios::in) && file_io_->read(path.string(), entity_data)) {
+                line += "200, \"data\": " + entity_data;
+            } else {
+                line += "404";
+            }
+            file_io_->close();
+        }
+        body += line + "}\n";
+    }
+    return create_response(http::status::ok, "application/x-ndjson", body);
+}
+
 bool crud_handler::create_or_update_entity(const std::filesystem::path& path, const std::string& entity_data) {
     Logger *logger = Logger::get_global_log();
     try {
@@ -293,13 +1870,42 @@ bool crud_handler::create_or_update_entity(const std::filesystem::path& path, co
 
     if (!file_io_->write(entity_data)) {
         logger->logError("ERROR: Failed to write to file at " + path.string());
+        file_io_->close();
         return false;
     }
 
-    file_io_->close();
+    if (!file_io_->close()) {
+        logger->logError("ERROR: Failed to store file at " + path.string());
+        return false;
+    }
     return true;
 }
 
+std::map<std::string, std::string> crud_handler::parse_query(const std::string& query) {
+    std::map<std::string, std::string> params;
+    std::istringstream pairs(query);
+    std::string pair;
+    while (std::getline(pairs, pair, '&')) {
+        size_t pos_equals = pair.find('=');
+        std::string name = pair.substr(0, pos_equals);
+        std::string value = pos_equals == std::string::npos ? "" : pair.substr(pos_equals + 1);
+        // Percent-decode the value
+        std::string decoded;
+        for (size_t i = 0; i < value.size(); ++i) {
+            if (value[i] == '%' && i + 2 < value.size() && std::isxdigit(value[i + 1]) && std::isxdigit(value[i + 2])) {
+                decoded += static_cast<char>(std::stoi(value.substr(i + 1, 2), nullptr, 16));
+                i += 2;
+            } else if (value[i] == '+') {
+                decoded += ' ';
+            } else {
+                decoded += value[i];
+            }
+        }
+        params[name] = decoded;
+    }
+    return params;
+}
+
 std::string crud_handler::remove_prefix_dir(boost::beast::string_view prefix, boost::beast::string_view uri_view) {
     boost::beast::string_view prefix_with_no_trailing_slash = prefix.substr(0, prefix.size() - 1);
     if (uri_view == prefix_with_no_trailing_slash) {
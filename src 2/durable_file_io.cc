@@ -0,0 +1,270 @@
+#include "durable_file_io.h"
+#include "config_parser.h"
+#include "logger.h"
+#include <atomic>
+#include <chrono>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <map>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace {
+
+// Checkpoint once the log holds this much.
+const std::uint64_t checkpoint_bytes = 16 << 20;
+// Log the commit metrics this often if there were commits.
+const std::chrono::milliseconds metrics_interval = std::chrono::minutes(1);
+
+const char op_put = 'P';
+const char op_delete = 'D';
+// 'B' | (length | put or delete payload)*
+const char op_batch = 'B';
+
+// op | path length | path | data
+std::string encode(char op, const std::string& path, const std::string& data) {
+    std::uint32_t length = path.size();
+    std::string payload(1 + 4, '\0');
+    payload[0] = op;
+    std::memcpy(&payload[1], &length, 4);
+    return payload + path + data;
+}
+
+std::string wal_directory(const std::string& root) {
+    return (std::filesystem::path(root) / ".wal").string();
+}
+
+bool sync_filesystem(const std::string& root) {
+    int fd = ::open(root.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+    bool ok = ::syncfs(fd) == 0;
+    ::close(fd);
+    return ok;
+}
+
+}
+
+durable_file_io::durable_file_io(std::shared_ptr<write_ahead_log> wal, std::string root): wal_(wal), root_(root) {}
+
+bool durable_file_io::replace_file(const std::string& root, const std::string& path, const std::string& data) {
+    static std::atomic<std::uint64_t> counter{0};
+    // Temporary files live outside the entity directories so listings never see them.
+    std::string temp = (std::filesystem::path(wal_directory(root)) /
+                        ("tmp-" + std::to_string(::getpid()) + "-" + std::to_string(counter++))).string();
+    int fd = ::open(temp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        return false;
+    }
+    size_t written = 0;
+    while (written < data.size()) {
+        ssize_t n = ::write(fd, data.data() + written, data.size() - written);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            break;
+        }
+        written += n;
+    }
+    ::close(fd);
+    // No fsync here: the record is already durable in the log, and the
+    // checkpoint's syncfs flushes these files and their directory entries
+    // before the log is truncated.
+    if (written != data.size() || std::rename(temp.c_str(), path.c_str()) != 0) {
+        std::remove(temp.c_str());
+        return false;
+    }
+    return true;
+}
+
+bool durable_file_io::apply(const std::string& root, const std::string& payload) {
+    if (!payload.empty() && payload[0] == op_batch) {
+        size_t offset = 1;
+        while (offset + 4 <= payload.size()) {
+            std::uint32_t length;
+            std::memcpy(&length, &payload[offset], 4);
+            if (length > payload.size() - offset - 4) {
+                return false;
+            }
+            apply(root, payload.substr(offset + 4, length));
+            offset += 4 + length;
+        }
+        return true;
+    }
+    std::uint32_t length;
+    if (payload.size() < 5) {
+        return false;
+    }
+    std::memcpy(&length, &payload[1], 4);
+    if (length > payload.size() - 5) {
+        return false;
+    }
+    std::string path = payload.substr(5, length);
+    if (payload[0] == op_put) {
+        std::error_code ec;
+        std::filesystem::create_directories(std::filesystem::path(path).parent_path(), ec);
+        return replace_file(root, path, payload.substr(5 + length));
+    }
+    if (payload[0] == op_delete) {
+        std::error_code ec;
+        return std::filesystem::remove(path, ec);
+    }
+    return false;
+}
+
+bool durable_file_io::open(const std::string& filename, std::ios_base::openmode mode) {
+    writing_ = (mode & std::ios::out) != 0;
+    current_path_ = filename;
+    pending_.clear();
+    return writing_ || files_.open(filename, mode);
+}
+
+bool durable_file_io::write(const std::string& data) {
+    if (!writing_) {
+        return false;
+    }
+    // Each write logs everything written since open, so the record is
+    // complete even if the caller never gets to close().
+    pending_ += data;
+    return wal_->commit(encode(op_put, current_path_, pending_), [this]() {
+        return replace_file(root_, current_path_, pending_);
+    });
+}
+
+bool durable_file_io::close() {
+    // Each write has already been committed to the log.
+    writing_ = false;
+    pending_.clear();
+    return files_.close();
+}
+
+bool durable_file_io::read(const std::string& filepath, std::string& content) {
+    return files_.read(filepath, content);
+}
+
+bool durable_file_io::delete_file(const std::string& filepath) {
+    if (!files_.exists(filepath)) {
+        return false;
+    }
+    bool removed = false;
+    bool committed = wal_->commit(encode(op_delete, filepath, ""), [&filepath, &removed]() {
+        std::error_code ec;
+        removed = std::filesystem::remove(filepath, ec);
+        return !ec;
+    });
+    return committed && removed;
+}
+
+void durable_file_io::write_batch(const std::vector<batch_op>& ops, std::vector<bool>& results) {
+    results.assign(ops.size(), false);
+    std::string batch(1, op_batch);
+    std::vector<std::pair<size_t, std::string>> changes;
+    // Whether each path exists as of the ops so far in the batch.
+    std::map<std::string, bool> present;
+    for (size_t i = 0; i < ops.size(); i++) {
+        if (ops[i].remove) {
+            auto seen = present.find(ops[i].path);
+            if (!(seen != present.end() ? seen->second : files_.exists(ops[i].path))) {
+                continue;
+            }
+        }
+        present[ops[i].path] = !ops[i].remove;
+        std::string change = encode(ops[i].remove ? op_delete : op_put, ops[i].path, ops[i].data);
+        std::uint32_t length = change.size();
+        batch.append(reinterpret_cast<const char*>(&length), 4);
+        batch += change;
+        changes.emplace_back(i, std::move(change));
+    }
+    if (changes.empty()) {
+        return;
+    }
+    wal_->commit(batch, [this, &changes, &results]() {
+        for (const auto& change : changes) {
+            results[change.first] = apply(root_, change.second);
+        }
+        return true;
+    });
+}
+
+bool durable_file_io::create_directories(const std::string& path) {
+    return files_.create_directories(path);
+}
+
+bool durable_file_io::list_directories(const std::string& path, std::vector<std::string>& directories) {
+    return files_.list_directories(path, directories);
+}
+
+bool durable_file_io::exists(const std::string& filepath) {
+    return files_.exists(filepath);
+}
+
+bool durable_file_io::version(const std::string& filepath, std::string& tag) {
+    // Each write renames a new file into place, so the inode changes too.
+    return files_.version(filepath, tag);
+}
+
+std::shared_ptr<write_ahead_log> durable_file_io::get_shared_log(const std::string& root) {
+    // Made first, so at exit the logs' reporter threads stop before logging
+    // is torn down.
+    Logger::get_global_log();
+    static std::mutex mutex;
+    static std::map<std::string, std::shared_ptr<write_ahead_log>> logs;
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = logs.find(root);
+    if (it != logs.end()) {
+        return it->second;
+    }
+    try {
+        std::filesystem::create_directories(wal_directory(root));
+        auto wal = std::make_shared<write_ahead_log>((std::filesystem::path(wal_directory(root)) / "wal.log").string());
+        // Redo everything logged since the last checkpoint; puts and deletes
+        // are idempotent, so records that were already applied are harmless.
+        size_t replayed = 0;
+        if (!wal->replay([&root, &replayed](const std::string& payload) {
+                apply(root, payload);
+                replayed++;
+            })) {
+            return nullptr;
+        }
+        auto flush = [root]() { return sync_filesystem(root); };
+        if (!wal->checkpoint(flush)) {
+            return nullptr;
+        }
+        if (replayed > 0) {
+            Logger::get_global_log()->logInfo("Replayed " + std::to_string(replayed) + " write-ahead log records in " + root);
+        }
+        wal->set_checkpoint(checkpoint_bytes, flush);
+        wal->report_metrics(metrics_interval);
+        logs[root] = wal;
+        return wal;
+    } catch (const std::exception&) {
+        return nullptr;
+    }
+}
+
+bool durable_file_io::load_config(const std::vector<HandlerConfig>& handlers) {
+    for (const auto& handler : handlers) {
+        auto durable = handler.directives.find("durable");
+        if (handler.name != "crud_handler" || durable == handler.directives.end()) {
+            continue;
+        }
+        if (durable->second == std::vector<std::string>{"off"}) {
+            continue;
+        }
+        // The log-structured store is not covered by this log.
+        auto storage = handler.directives.find("storage");
+        bool log_storage = storage != handler.directives.end() && storage->second == std::vector<std::string>{"log"};
+        if (durable->second != std::vector<std::string>{"on"} || log_storage || get_shared_log(handler.root) == nullptr) {
+            return false;
+        }
+    }
+    return true;
+}
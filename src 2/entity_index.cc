@@ -0,0 +1,179 @@
+#include "entity_index.h"
+#include <cerrno>
+#include <cstdint>
+#include <filesystem>
+#include <mutex>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+namespace {
+
+// "root/Shoes", "root/Shoes/" and "root/./Shoes" are one entity.
+std::string key(const std::string& directory) {
+    std::filesystem::path normal = std::filesystem::path(directory).lexically_normal();
+    if (!normal.has_filename() && normal.has_parent_path()) {
+        normal = normal.parent_path();
+    }
+    return normal.string();
+}
+
+// Changes to the files of a directory, and the directory going away.
+const std::uint32_t watched_events = IN_CREATE | IN_MOVED_TO | IN_DELETE | IN_MOVED_FROM | IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR;
+
+}
+
+entity_index::entity_index(bool watch_files): watch_files_(watch_files) {}
+
+entity_index::~entity_index() {
+    if (watching_.joinable()) {
+        std::uint64_t one = 1;
+        (void)::write(stop_fd_, &one, sizeof(one));
+        watching_.join();
+    }
+    if (inotify_fd_ >= 0) {
+        ::close(inotify_fd_);
+    }
+    if (stop_fd_ >= 0) {
+        ::close(stop_fd_);
+    }
+}
+
+bool entity_index::page(i_file_io& files, const std::string& directory, const std::string& cursor,
+                        size_t limit, std::vector<std::string>& ids, bool& more) {
+    std::string name = key(directory);
+    std::shared_lock<std::shared_mutex> read_lock(mutex_);
+    auto entity = entities_.find(name);
+    if (entity == entities_.end()) {
+        read_lock.unlock();
+        std::unique_lock<std::shared_mutex> write_lock(mutex_);
+        entity = entities_.find(name);
+        if (entity == entities_.end()) {
+            // Listing under the exclusive lock means no add() or remove()
+            // can slip in between the listing and the index taking over.
+            // The watch goes first, so a change made during the listing
+            // is seen by one or the other.
+            watch(name, directory);
+            std::vector<std::string> listed;
+            if (!files.list_directories(directory, listed)) {
+                return false;
+            }
+            entity = entities_.emplace(name, std::set<std::string>(listed.begin(), listed.end())).first;
+        }
+        write_lock.unlock();
+        read_lock.lock();
+    }
+
+    const std::set<std::string>& sorted = entity->second;
+    auto it = cursor.empty() ? sorted.begin() : sorted.upper_bound(cursor);
+    for (size_t taken = 0; it != sorted.end() && (limit == 0 || taken < limit); ++it, ++taken) {
+        ids.push_back(*it);
+    }
+    more = it != sorted.end();
+    return true;
+}
+
+void entity_index::add(const std::string& directory, const std::string& id) {
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+    auto entity = entities_.find(key(directory));
+    if (entity != entities_.end()) {
+        entity->second.insert(id);
+    }
+}
+
+void entity_index::remove(const std::string& directory, const std::string& id) {
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+    auto entity = entities_.find(key(directory));
+    if (entity != entities_.end()) {
+        entity->second.erase(id);
+    }
+}
+
+void entity_index::watch(const std::string& name, const std::string& directory) {
+    if (!watch_files_) {
+        return;
+    }
+    if (inotify_fd_ < 0) {
+        inotify_fd_ = ::inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        stop_fd_ = ::eventfd(0, EFD_CLOEXEC);
+        if (inotify_fd_ < 0 || stop_fd_ < 0) {
+            watch_files_ = false;
+            return;
+        }
+    }
+    // Fails if the directory does not exist (yet, or with storage that
+    // keeps none); the entity is then only kept current by the handlers.
+    int descriptor = ::inotify_add_watch(inotify_fd_, directory.c_str(), watched_events);
+    if (descriptor < 0) {
+        return;
+    }
+    watches_[descriptor] = name;
+    if (!watching_.joinable()) {
+        watching_ = std::thread(&entity_index::watch_loop, this);
+    }
+}
+
+void entity_index::watch_loop() {
+    alignas(inotify_event) char buffer[16384];
+    while (true) {
+        pollfd fds[2] = {{inotify_fd_, POLLIN, 0}, {stop_fd_, POLLIN, 0}};
+        if (::poll(fds, 2, -1) < 0 && errno != EINTR) {
+            return;
+        }
+        if (fds[1].revents) {
+            return;
+        }
+        ssize_t length = ::read(inotify_fd_, buffer, sizeof(buffer));
+        if (length <= 0) {
+            continue;
+        }
+
+        std::unique_lock<std::shared_mutex> lock(mutex_);
+        for (ssize_t offset = 0; offset < length;) {
+            const inotify_event* event = reinterpret_cast<const inotify_event*>(buffer + offset);
+            offset += sizeof(inotify_event) + event->len;
+            if (event->mask & IN_Q_OVERFLOW) {
+                // Events were lost; every entity is listed again.
+                entities_.clear();
+                continue;
+            }
+            auto watch = watches_.find(event->wd);
+            if (watch == watches_.end()) {
+                continue;
+            }
+            if (event->mask & IN_IGNORED) {
+                // The watch is gone, along with the directory.
+                entities_.erase(watch->second);
+                watches_.erase(watch);
+                continue;
+            }
+            if (event->mask & (IN_DELETE_SELF | IN_MOVE_SELF)) {
+                entities_.erase(watch->second);
+                ::inotify_rm_watch(inotify_fd_, event->wd);
+                continue;
+            }
+            auto entity = entities_.find(watch->second);
+            // Dot files are writes in progress, renamed into place when done.
+            if (entity == entities_.end() || event->len == 0 || event->name[0] == '.' || (event->mask & IN_ISDIR)) {
+                continue;
+            }
+            if (event->mask & (IN_CREATE | IN_MOVED_TO)) {
+                entity->second.insert(event->name);
+            } else if (event->mask & (IN_DELETE | IN_MOVED_FROM)) {
+                entity->second.erase(event->name);
+            }
+        }
+    }
+}
+
+std::shared_ptr<entity_index> entity_index::get_shared(const std::string& root) {
+    static std::mutex mutex;
+    static std::map<std::string, std::shared_ptr<entity_index>> indexes;
+    std::lock_guard<std::mutex> lock(mutex);
+    std::shared_ptr<entity_index>& index = indexes[root];
+    if (!index) {
+        index = std::make_shared<entity_index>();
+    }
+    return index;
+}
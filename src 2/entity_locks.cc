@@ -0,0 +1,41 @@
+#include "entity_locks.h"
+#include <algorithm>
+#include <functional>
+#include <string>
+
+entity_locks::entity_locks(size_t stripes) {
+    size_t count = 1;
+    while (count < stripes) {
+        count <<= 1;
+    }
+    stripes_ = std::make_unique<stripe[]>(count);
+    mask_ = count - 1;
+}
+
+std::shared_mutex& entity_locks::for_path(const std::filesystem::path& path) {
+    size_t hash = std::hash<std::string>()(path.lexically_normal().string());
+    return stripes_[hash & mask_].mutex;
+}
+
+std::vector<std::unique_lock<std::shared_mutex>> entity_locks::lock_all(const std::vector<std::filesystem::path>& paths) {
+    std::vector<std::shared_mutex*> mutexes;
+    for (const auto& path : paths) {
+        mutexes.push_back(&for_path(path));
+    }
+    std::sort(mutexes.begin(), mutexes.end());
+    mutexes.erase(std::unique(mutexes.begin(), mutexes.end()), mutexes.end());
+    std::vector<std::unique_lock<std::shared_mutex>> locks;
+    for (std::shared_mutex* mutex : mutexes) {
+        locks.emplace_back(*mutex);
+    }
+    return locks;
+}
+
+size_t entity_locks::stripe_count() const {
+    return mask_ + 1;
+}
+
+entity_locks& entity_locks::get_global_locks() {
+    static entity_locks locks;
+    return locks;
+}
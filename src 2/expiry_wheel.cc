@@ -0,0 +1,294 @@
+#include "expiry_wheel.h"
+#include "logger.h"
+#include <algorithm>
+#include <cerrno>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace {
+
+// Rest between reaping batches, leaving the entity locks and the disk to
+// requests.
+const std::chrono::milliseconds batch_pause(10);
+
+// Journals smaller than this are never rewritten.
+const size_t min_rewrite_records = 1024;
+
+std::int64_t to_ms(expiry_wheel::clock::time_point time) {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(time.time_since_epoch()).count();
+}
+
+// "<deadline> <length> <path>\n", with the deadline in ms since the epoch,
+// or 0 if the path no longer expires.
+std::string record(const std::string& path, std::int64_t deadline) {
+    return std::to_string(deadline) + " " + std::to_string(path.size()) + " " + path + "\n";
+}
+
+bool write_all(int fd, const std::string& data) {
+    size_t written = 0;
+    while (written < data.size()) {
+        ssize_t n = ::write(fd, data.data() + written, data.size() - written);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        written += n;
+    }
+    return true;
+}
+
+}
+
+expiry_wheel::expiry_wheel(const std::string& journal_path, std::chrono::milliseconds tick, size_t slots, size_t batch)
+    : journal_path_(journal_path), tick_ms_(std::max<std::int64_t>(tick.count(), 1)),
+      batch_(std::max<size_t>(batch, 1)), slots_(std::max<size_t>(slots, 1)) {
+    // The tick in progress is not over, so it has not been swept.
+    last_tick_ = to_ms(clock::now()) / tick_ms_ - 1;
+    if (!journal_path_.empty()) {
+        replay();
+    }
+}
+
+expiry_wheel::~expiry_wheel() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    wake_.notify_all();
+    if (reaping_.joinable()) {
+        reaping_.join();
+    }
+    if (journal_fd_ >= 0) {
+        ::fdatasync(journal_fd_);
+        ::close(journal_fd_);
+    }
+}
+
+void expiry_wheel::start(reaper reap) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (reap_ || stopping_) {
+        return;
+    }
+    reap_ = std::move(reap);
+    reaping_ = std::thread(&expiry_wheel::reap_loop, this);
+}
+
+void expiry_wheel::set(const std::string& path, clock::time_point deadline) {
+    std::int64_t ms = std::max<std::int64_t>(to_ms(deadline), 1);
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        deadlines_[path] = ms;
+        file(path, ms);
+        journal(path, ms);
+    }
+    wake_.notify_one();
+}
+
+void expiry_wheel::clear(const std::string& path) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    // Its entry in the wheel goes stale and is dropped when swept.
+    if (deadlines_.erase(path) > 0) {
+        journal(path, 0);
+        wake_.notify_one();
+    }
+}
+
+bool expiry_wheel::expired(const std::string& path, clock::time_point now) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto found = deadlines_.find(path);
+    return found != deadlines_.end() && found->second <= to_ms(now);
+}
+
+bool expiry_wheel::deadline(const std::string& path, clock::time_point& at) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto found = deadlines_.find(path);
+    if (found == deadlines_.end()) {
+        return false;
+    }
+    at = clock::time_point(std::chrono::milliseconds(found->second));
+    return true;
+}
+
+bool expiry_wheel::claim(const std::string& path) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto found = deadlines_.find(path);
+    if (found == deadlines_.end() || found->second > to_ms(clock::now())) {
+        return false;
+    }
+    deadlines_.erase(found);
+    journal(path, 0);
+    return true;
+}
+
+size_t expiry_wheel::size() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return deadlines_.size();
+}
+
+bool expiry_wheel::current(const entry& queued) const {
+    auto found = deadlines_.find(queued.path);
+    return found != deadlines_.end() && found->second == queued.deadline;
+}
+
+void expiry_wheel::file(const std::string& path, std::int64_t deadline) {
+    // Deadlines in a tick already swept go in the next one.
+    std::int64_t tick = std::max(deadline / tick_ms_, last_tick_ + 1);
+    slots_[tick % slots_.size()].push_back(entry{path, deadline});
+}
+
+void expiry_wheel::journal(const std::string& path, std::int64_t deadline) {
+    if (journal_path_.empty()) {
+        return;
+    }
+    if (journal_fd_ < 0) {
+        std::error_code error;
+        std::filesystem::create_directories(std::filesystem::path(journal_path_).parent_path(), error);
+        journal_fd_ = ::open(journal_path_.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+        if (journal_fd_ < 0) {
+            Logger::get_global_log()->logError("ERROR: Unable to open expiry journal " + journal_path_);
+            return;
+        }
+    }
+    if (!write_all(journal_fd_, record(path, deadline))) {
+        Logger::get_global_log()->logError("ERROR: Unable to write expiry journal " + journal_path_);
+        return;
+    }
+    journal_records_++;
+    journal_dirty_ = true;
+}
+
+void expiry_wheel::replay() {
+    std::ifstream in(journal_path_, std::ios::binary);
+    if (!in) {
+        return;
+    }
+    // A torn record at the tail, from a crash mid-append, ends the replay.
+    std::int64_t deadline;
+    size_t length;
+    while (in >> deadline >> length && in.get() == ' ') {
+        std::string path(length, '\0');
+        if (!in.read(&path[0], length) || in.get() != '\n') {
+            break;
+        }
+        if (deadline == 0) {
+            deadlines_.erase(path);
+        } else {
+            deadlines_[path] = deadline;
+        }
+    }
+    for (const auto& deadline : deadlines_) {
+        file(deadline.first, deadline.second);
+    }
+    if (!deadlines_.empty()) {
+        Logger::get_global_log()->logInfo("Loaded " + std::to_string(deadlines_.size()) + " expiry deadlines from " + journal_path_);
+    }
+    rewrite_journal();
+}
+
+void expiry_wheel::rewrite_journal() {
+    std::string temporary = journal_path_ + ".tmp";
+    int fd = ::open(temporary.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        Logger::get_global_log()->logError("ERROR: Unable to rewrite expiry journal " + journal_path_);
+        return;
+    }
+    std::string records;
+    for (const auto& deadline : deadlines_) {
+        records += record(deadline.first, deadline.second);
+    }
+    if (!write_all(fd, records) || ::fdatasync(fd) != 0 ||
+        ::rename(temporary.c_str(), journal_path_.c_str()) != 0) {
+        Logger::get_global_log()->logError("ERROR: Unable to rewrite expiry journal " + journal_path_);
+        ::close(fd);
+        ::unlink(temporary.c_str());
+        return;
+    }
+    ::close(fd);
+    if (journal_fd_ >= 0) {
+        ::close(journal_fd_);
+    }
+    journal_fd_ = ::open(journal_path_.c_str(), O_WRONLY | O_APPEND | O_CLOEXEC);
+    journal_records_ = deadlines_.size();
+    journal_dirty_ = false;
+}
+
+void expiry_wheel::reap_loop() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (!stopping_) {
+        if (due_.empty()) {
+            if (journal_dirty_ && journal_fd_ >= 0) {
+                // Only this thread replaces the journal, so the descriptor
+                // stays valid while the lock is released for the sync.
+                int fd = journal_fd_;
+                journal_dirty_ = false;
+                lock.unlock();
+                ::fdatasync(fd);
+                lock.lock();
+            }
+            if (journal_records_ > min_rewrite_records && journal_records_ > 4 * deadlines_.size()) {
+                rewrite_journal();
+            }
+            if (deadlines_.empty()) {
+                wake_.wait(lock);
+                continue;
+            }
+            // Sleep until the tick in progress is over, then sweep every
+            // slot of the ticks that ended.
+            wake_.wait_until(lock, clock::time_point(std::chrono::milliseconds((last_tick_ + 2) * tick_ms_)));
+            std::int64_t now_tick = to_ms(clock::now()) / tick_ms_;
+            std::int64_t first = std::max(last_tick_ + 1, now_tick - static_cast<std::int64_t>(slots_.size()));
+            for (std::int64_t tick = first; tick < now_tick; tick++) {
+                std::vector<entry>& slot = slots_[tick % slots_.size()];
+                std::int64_t tick_end = (tick + 1) * tick_ms_;
+                size_t kept = 0;
+                for (auto& queued : slot) {
+                    if (!current(queued)) {
+                        continue;  // cleared or set again since
+                    }
+                    if (queued.deadline < tick_end) {
+                        due_.push_back(queued.path);
+                    } else {
+                        // Due on a later turn of the wheel.
+                        if (&slot[kept] != &queued) {
+                            slot[kept] = std::move(queued);
+                        }
+                        kept++;
+                    }
+                }
+                slot.resize(kept);
+            }
+            last_tick_ = std::max(last_tick_, now_tick - 1);
+            continue;
+        }
+
+        std::vector<std::string> batch;
+        while (!due_.empty() && batch.size() < batch_) {
+            batch.push_back(std::move(due_.front()));
+            due_.pop_front();
+        }
+        lock.unlock();
+        for (const auto& path : batch) {
+            reap_(path, *this);
+        }
+        lock.lock();
+        if (!due_.empty()) {
+            wake_.wait_for(lock, batch_pause);
+        }
+    }
+}
+
+std::shared_ptr<expiry_wheel> expiry_wheel::get_shared(const std::string& root) {
+    static std::mutex mutex;
+    static std::map<std::string, std::shared_ptr<expiry_wheel>> wheels;
+    std::lock_guard<std::mutex> lock(mutex);
+    std::shared_ptr<expiry_wheel>& wheel = wheels[root];
+    if (!wheel) {
+        wheel = std::make_shared<expiry_wheel>((std::filesystem::path(root) / ".ttl" / "expiry.log").string());
+    }
+    return wheel;
+}
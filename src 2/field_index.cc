@@ -0,0 +1,261 @@
+#include "field_index.h"
+#include "json_validator.h"
+#include <filesystem>
+#include <ios>
+#include <mutex>
+
+namespace {
+
+// "root/Shoes", "root/Shoes/" and "root/./Shoes" are one entity.
+std::string key(const std::string& directory) {
+    std::filesystem::path normal = std::filesystem::path(directory).lexically_normal();
+    if (!normal.has_filename() && normal.has_parent_path()) {
+        normal = normal.parent_path();
+    }
+    return normal.string();
+}
+
+// Steps over the string whose opening quote is at json[i], unescaping it
+// into out (if given).
+bool read_string(std::string_view json, size_t& i, std::string* out) {
+    size_t start = i;
+    bool escaped = false;
+    if (!json_validator::skip_string(json, i, escaped)) {
+        return false;
+    }
+    return !out || json_validator::unescape(json.substr(start, i - start), *out);
+}
+
+// Reads the value at json[i]. Sets value to its indexed form and returns
+// true in scalar if it is not an object or array.
+bool read_value(std::string_view json, size_t& i, std::string& value, bool& scalar) {
+    value.clear();
+    if (i >= json.size()) {
+        return false;
+    }
+    scalar = json[i] != '{' && json[i] != '[';
+    if (json[i] == '"') {
+        return read_string(json, i, &value);
+    }
+    if (scalar) {
+        size_t start = i;
+        while (i < json.size() && json[i] != ',' && json[i] != '}' && json[i] != ']' &&
+               json[i] != ' ' && json[i] != '\t' && json[i] != '\n' && json[i] != '\r') {
+            i++;
+        }
+        value = json.substr(start, i - start);
+        return i > start;
+    }
+    // Skip the nested object or array, stepping over strings whole so
+    // brackets inside them do not count.
+    size_t depth = 0;
+    while (i < json.size()) {
+        char c = json[i];
+        if (c == '"') {
+            if (!read_string(json, i, nullptr)) {
+                return false;
+            }
+            continue;
+        }
+        i++;
+        if (c == '{' || c == '[') {
+            depth++;
+        } else if ((c == '}' || c == ']') && --depth == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+}
+
+field_index::field_index(const std::string& root, const std::vector<std::string>& declarations)
+    : root_(key(root)) {
+    for (const auto& declaration : declarations) {
+        size_t colon = declaration.rfind(':');
+        if (colon == std::string::npos) {
+            everywhere_.insert(declaration);
+        } else if (colon + 1 < declaration.size()) {
+            declared_[key(declaration.substr(0, colon))].insert(declaration.substr(colon + 1));
+        }
+    }
+}
+
+std::set<std::string> field_index::fields_of(const std::string& directory) const {
+    std::set<std::string> fields = everywhere_;
+    auto declared = declared_.find(std::filesystem::path(key(directory)).lexically_relative(root_).string());
+    if (declared != declared_.end()) {
+        fields.insert(declared->second.begin(), declared->second.end());
+    }
+    return fields;
+}
+
+bool field_index::indexed(const std::string& directory, const std::string& field) const {
+    return fields_of(directory).count(field) > 0;
+}
+
+bool field_index::find(i_file_io& files, const std::string& directory, const std::string& field,
+                       const std::string& value, std::vector<std::string>& ids) {
+    std::string name = key(directory);
+    std::shared_lock<std::shared_mutex> read_lock(mutex_);
+    auto found = entities_.find(name);
+    if (found == entities_.end()) {
+        read_lock.unlock();
+        std::set<std::string> fields = fields_of(name);
+        if (!fields.count(field)) {
+            return false;
+        }
+        std::unique_lock<std::shared_mutex> write_lock(mutex_);
+        found = entities_.find(name);
+        if (found == entities_.end()) {
+            // As in entity_index, loading under the exclusive lock means an
+            // update() racing the load is applied after it, not lost.
+            std::vector<std::string> listed;
+            if (!files.list_directories(directory, listed)) {
+                return false;
+            }
+            entity loaded;
+            for (const auto& indexed_field : fields) {
+                loaded.fields[indexed_field];
+            }
+            std::string data;
+            std::map<std::string, std::string> values;
+            for (const auto& id : listed) {
+                std::string path = (std::filesystem::path(directory) / id).string();
+                if (files.open(path, std::ios::in) && files.read(path, data) && extract(data, values)) {
+                    insert(loaded, id, values);
+                }
+                files.close();
+            }
+            found = entities_.emplace(name, std::move(loaded)).first;
+        }
+        write_lock.unlock();
+        read_lock.lock();
+    }
+
+    auto values = found->second.fields.find(field);
+    if (values == found->second.fields.end()) {
+        return false;
+    }
+    auto matched = values->second.find(value);
+    if (matched != values->second.end()) {
+        ids.insert(ids.end(), matched->second.begin(), matched->second.end());
+    }
+    return true;
+}
+
+void field_index::update(const std::string& directory, const std::string& id, std::string_view data) {
+    std::string name = key(directory);
+    if (fields_of(name).empty()) {
+        return;
+    }
+    std::map<std::string, std::string> values;
+    bool parsed = extract(data, values);
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+    auto found = entities_.find(name);
+    if (found != entities_.end()) {
+        erase(found->second, id);
+        if (parsed) {
+            insert(found->second, id, values);
+        }
+    }
+}
+
+void field_index::remove(const std::string& directory, const std::string& id) {
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+    auto found = entities_.find(key(directory));
+    if (found != entities_.end()) {
+        erase(found->second, id);
+    }
+}
+
+void field_index::insert(entity& found, const std::string& id, const std::map<std::string, std::string>& values) {
+    std::map<std::string, std::string> indexed;
+    for (const auto& value : values) {
+        auto field = found.fields.find(value.first);
+        if (field != found.fields.end()) {
+            field->second[value.second].insert(id);
+            indexed.insert(value);
+        }
+    }
+    if (!indexed.empty()) {
+        found.values[id] = std::move(indexed);
+    }
+}
+
+void field_index::erase(entity& found, const std::string& id) {
+    auto previous = found.values.find(id);
+    if (previous == found.values.end()) {
+        return;
+    }
+    for (const auto& value : previous->second) {
+        auto& ids_by_value = found.fields[value.first];
+        auto ids = ids_by_value.find(value.second);
+        if (ids != ids_by_value.end()) {
+            ids->second.erase(id);
+            if (ids->second.empty()) {
+                ids_by_value.erase(ids);
+            }
+        }
+    }
+    found.values.erase(previous);
+}
+
+bool field_index::extract(std::string_view json, std::map<std::string, std::string>& values) {
+    values.clear();
+    size_t i = 0;
+    json_validator::skip_space(json, i);
+    if (i >= json.size() || json[i] != '{') {
+        return false;
+    }
+    i++;
+    json_validator::skip_space(json, i);
+    if (i < json.size() && json[i] == '}') {
+        return true;
+    }
+    std::string name;
+    std::string value;
+    while (i < json.size()) {
+        name.clear();
+        bool scalar;
+        if (json[i] != '"' || !read_string(json, i, &name)) {
+            return false;
+        }
+        json_validator::skip_space(json, i);
+        if (i >= json.size() || json[i] != ':') {
+            return false;
+        }
+        i++;
+        json_validator::skip_space(json, i);
+        if (!read_value(json, i, value, scalar)) {
+            return false;
+        }
+        if (scalar) {
+            // A repeated name keeps its last value, as most JSON parsers do.
+            values[name] = value;
+        } else {
+            values.erase(name);
+        }
+        json_validator::skip_space(json, i);
+        if (i < json.size() && json[i] == '}') {
+            return true;
+        }
+        if (i >= json.size() || json[i] != ',') {
+            return false;
+        }
+        i++;
+        json_validator::skip_space(json, i);
+    }
+    return false;
+}
+
+std::shared_ptr<field_index> field_index::get_shared(const std::string& root, const std::vector<std::string>& declarations) {
+    static std::mutex mutex;
+    static std::map<std::string, std::shared_ptr<field_index>> indexes;
+    std::lock_guard<std::mutex> lock(mutex);
+    std::shared_ptr<field_index>& index = indexes[root];
+    if (!index) {
+        index = std::make_shared<field_index>(root, declarations);
+    }
+    return index;
+}
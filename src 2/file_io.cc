@@ -4,9 +4,47 @@
 #include <fstream>
 #include <filesystem>
 #include <vector>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <sstream>
+#include <unordered_map>
+#include <sys/stat.h>
 
+namespace {
+
+// Times each path has been opened for writing by this process. Files are
+// rewritten in place, so the inode stays put, and two same-size writes can
+// land within one tick of the modification time; the count still differs.
+class write_generations {
+public:
+    void bump(const std::string& path) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        generations_[path]++;
+    }
+
+    std::uint64_t get(const std::string& path) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = generations_.find(path);
+        return it == generations_.end() ? 0 : it->second;
+    }
+
+private:
+    std::mutex mutex_;
+    std::unordered_map<std::string, std::uint64_t> generations_;
+};
+
+write_generations& generations() {
+    static write_generations table;
+    return table;
+}
+
+}
 
 bool file_io::open(const std::string& filename, std::ios_base::openmode mode) {
+    if (mode & std::ios::out) {
+        generations().bump(filename);
+    }
     file_.open(filename, mode);
     return file_.is_open();
 }
@@ -39,10 +77,12 @@ bool file_io::delete_file(const std::string& filepath) {
     return std::filesystem::remove(filepath);
 }
 
-void file_io::close() {
+bool file_io::close() {
     if (file_.is_open()) {
         file_.close();
+        return !file_.fail();
     }
+    return true;
 }
 
 bool file_io::create_directories(const std::string& path) {
@@ -64,4 +104,19 @@ bool file_io::list_directories(const std::string& path, std::vector<std::string>
 
 bool file_io::exists(const std::string& filepath) {
     return std::filesystem::exists(filepath);
-}
\ No newline at end of file
+}
+
+bool file_io::version(const std::string& filepath, std::string& tag) {
+    struct stat st;
+    if (::stat(filepath.c_str(), &st) != 0) {
+        return false;
+    }
+    char buffer[96];
+    std::snprintf(buffer, sizeof(buffer), "%llx-%llx-%llx-%llx-%llx",
+                  static_cast<unsigned long long>(st.st_dev), static_cast<unsigned long long>(st.st_ino),
+                  static_cast<unsigned long long>(st.st_size),
+                  static_cast<unsigned long long>(st.st_mtim.tv_sec) * 1000000000ULL + st.st_mtim.tv_nsec,
+                  static_cast<unsigned long long>(generations().get(filepath)));
+    tag = buffer;
+    return true;
+}
@@ -0,0 +1,71 @@
+#include "hash_ring.h"
+
+hash_ring::hash_ring(size_t points_per_node): points_per_node_(points_per_node) {}
+
+std::uint64_t hash_ring::hash(std::string_view text) {
+    std::uint64_t h = 14695981039346656037ull;
+    for (unsigned char c : text) {
+        h ^= c;
+        h *= 1099511628211ull;
+    }
+    // FNV-1a alone leaves similar keys close together; finish with the
+    // splitmix64 mixer so they land all over the ring.
+    h ^= h >> 30;
+    h *= 0xbf58476d1ce4e5b9ull;
+    h ^= h >> 27;
+    h *= 0x94d049bb133111ebull;
+    h ^= h >> 31;
+    return h;
+}
+
+void hash_ring::add(const std::string& node) {
+    if (!nodes_.insert(node).second) {
+        return;
+    }
+    for (size_t i = 0; i < points_per_node_; i++) {
+        std::uint64_t point = hash(node + "#" + std::to_string(i));
+        auto placed = points_.emplace(point, node);
+        // The rare point two nodes share goes to the smaller name, so the
+        // ring does not depend on the order nodes were added in.
+        if (!placed.second && node < placed.first->second) {
+            placed.first->second = node;
+        }
+    }
+}
+
+void hash_ring::remove(const std::string& node) {
+    if (!nodes_.erase(node)) {
+        return;
+    }
+    // Rebuilt from scratch, so points the removed node had taken from
+    // another go back to it.
+    std::set<std::string> remaining;
+    remaining.swap(nodes_);
+    points_.clear();
+    for (const auto& other : remaining) {
+        add(other);
+    }
+}
+
+std::string hash_ring::owner(std::string_view key) const {
+    if (points_.empty()) {
+        return "";
+    }
+    auto point = points_.lower_bound(hash(key));
+    return point == points_.end() ? points_.begin()->second : point->second;
+}
+
+std::string hash_ring::owner_without(std::string_view key, const std::string& node) const {
+    auto start = points_.lower_bound(hash(key));
+    for (auto it = start; it != points_.end(); ++it) {
+        if (it->second != node) {
+            return it->second;
+        }
+    }
+    for (auto it = points_.begin(); it != start; ++it) {
+        if (it->second != node) {
+            return it->second;
+        }
+    }
+    return "";
+}
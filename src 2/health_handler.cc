@@ -1,10 +1,15 @@
 #include <string>
 #include <memory>
+#include <atomic>
 #include <boost/beast/http.hpp>
 #include "health_handler.h"
 namespace http = boost::beast::http;
 
-std::unique_ptr<request_handler> health_handler::init(std::string root) {
+namespace {
+std::atomic<int> pending_warmups{0};
+}
+
+std::unique_ptr<request_handler> health_handler::init(const HandlerConfig& config) {
     return std::make_unique<health_handler>();
 }
 
@@ -14,8 +19,25 @@ http::response<http::string_body> health_handler::handle_request(http::request<h
     http::response<http::string_body> response;
     response.version(11);
     response.set(http::field::content_type, "text/plain");
-    response.result(http::status::ok);
-    response.body() = "OK";
+    if (ready()) {
+        response.result(http::status::ok);
+        response.body() = "OK";
+    } else {
+        response.result(http::status::service_unavailable);
+        response.body() = "WARMING UP";
+    }
     response.prepare_payload();
     return response;
-}
\ No newline at end of file
+}
+
+void health_handler::begin_warmup() {
+    pending_warmups++;
+}
+
+void health_handler::end_warmup() {
+    pending_warmups--;
+}
+
+bool health_handler::ready() {
+    return pending_warmups == 0;
+}
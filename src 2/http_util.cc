@@ -0,0 +1,34 @@
+#include "http_util.h"
+#include <algorithm>
+#include <string>
+#include <boost/algorithm/string/predicate.hpp>
+
+bool accepts_gzip(const http::request<http::string_body>& request) {
+    auto accept_encoding = request.find(http::field::accept_encoding);
+    if(accept_encoding == request.end()) {
+        return false;
+    }
+    std::string value = std::string(accept_encoding->value());
+    size_t start = 0;
+    while(start <= value.size()) {
+        size_t end = value.find(',', start);
+        std::string coding = value.substr(start, end == std::string::npos ? std::string::npos : end - start);
+        std::string params = "";
+        if(coding.find(';') != std::string::npos) {
+            params = coding.substr(coding.find(';') + 1);
+            coding = coding.substr(0, coding.find(';'));
+        }
+        coding.erase(0, coding.find_first_not_of(" \t"));
+        coding.erase(coding.find_last_not_of(" \t") + 1);
+        params.erase(std::remove(params.begin(), params.end(), ' '), params.end());
+        bool refused = params == "q=0" || params == "q=0.0" || params == "q=0.00" || params == "q=0.000";
+        if((boost::iequals(coding, "gzip") || coding == "*") && !refused) {
+            return true;
+        }
+        if(end == std::string::npos) {
+            break;
+        }
+        start = end + 1;
+    }
+    return false;
+}
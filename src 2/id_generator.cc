@@ -0,0 +1,74 @@
+#include "id_generator.h"
+#include <chrono>
+#include <random>
+
+namespace {
+
+const char hex_digits[] = "0123456789abcdef";
+
+std::uint64_t now_ms() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+}
+
+id_generator::id_generator() {
+    std::random_device device;
+    state_ = (std::uint64_t(device()) << 32) ^ device();
+}
+
+// splitmix64: fast, and good enough for the non-secret random tail of an ID.
+std::uint64_t id_generator::random() {
+    std::uint64_t z = (state_ += 0x9e3779b97f4a7c15ULL);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+void id_generator::next(char* out) {
+    std::uint64_t ms = now_ms();
+    if (ms > last_ms_) {
+        last_ms_ = ms;
+        // Start each millisecond low in the counter's range so there is
+        // room to count up before borrowing the next millisecond.
+        counter_ = random() & 0x7ff;
+    } else if (++counter_ > 0xfff) {
+        // Out of counter in this millisecond (or the clock went back):
+        // move to the next one to stay strictly increasing.
+        last_ms_++;
+        counter_ = 0;
+    }
+
+    unsigned char bytes[16];
+    for (int i = 0; i < 6; i++) {
+        bytes[i] = last_ms_ >> (40 - 8 * i);
+    }
+    bytes[6] = 0x70 | (counter_ >> 8);
+    bytes[7] = counter_;
+    std::uint64_t tail = random();
+    bytes[8] = 0x80 | ((tail >> 56) & 0x3f);
+    for (int i = 9; i < 16; i++) {
+        bytes[i] = tail >> (8 * (15 - i));
+    }
+
+    char* p = out;
+    for (int i = 0; i < 16; i++) {
+        if (i == 4 || i == 6 || i == 8 || i == 10) {
+            *p++ = '-';
+        }
+        *p++ = hex_digits[bytes[i] >> 4];
+        *p++ = hex_digits[bytes[i] & 0xf];
+    }
+}
+
+std::string id_generator::next() {
+    std::string id(id_length, '\0');
+    next(&id[0]);
+    return id;
+}
+
+std::string id_generator::generate() {
+    thread_local id_generator generator;
+    return generator.next();
+}
@@ -0,0 +1,195 @@
+#include "json_merge_patch.h"
+#include "json_validator.h"
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace {
+
+// A parsed JSON value. Objects keep their members; everything else keeps
+// the text it was written as. Views point into the input documents.
+struct node {
+    struct member;
+    bool object = false;
+    std::string_view text;
+    std::vector<member> members;
+};
+
+struct node::member {
+    std::string name;       // unescaped, for comparing
+    std::string_view key;   // as written, quotes included
+    node value;
+};
+
+// Steps over the string whose opening quote is at json[i], unescaping it
+// into name (if given) so differently escaped spellings compare equal.
+bool skip_string(std::string_view json, size_t& i, std::string* name) {
+    size_t start = i;
+    bool escaped = false;
+    if (!json_validator::skip_string(json, i, escaped)) {
+        return false;
+    }
+    return !name || json_validator::unescape(json.substr(start, i - start), *name);
+}
+
+// Steps over an array or scalar starting at json[i].
+bool skip_value(std::string_view json, size_t& i) {
+    size_t depth = 0;
+    while (i < json.size()) {
+        char c = json[i];
+        if (c == '"') {
+            if (!skip_string(json, i, nullptr)) {
+                return false;
+            }
+            if (depth == 0) {
+                return true;
+            }
+            continue;
+        }
+        if (depth == 0 && (c == ',' || c == '}' || c == ']' || c == ' ' || c == '\t' || c == '\n' || c == '\r')) {
+            return true;
+        }
+        i++;
+        if (c == '{' || c == '[') {
+            depth++;
+        } else if ((c == '}' || c == ']') && --depth == 0) {
+            return true;
+        }
+    }
+    return depth == 0;
+}
+
+bool parse(std::string_view json, size_t& i, node& value, size_t depth) {
+    json_validator::skip_space(json, i);
+    if (i >= json.size() || depth > json_validator::max_depth) {
+        return false;
+    }
+    size_t start = i;
+    if (json[i] != '{') {
+        if (!skip_value(json, i) || i == start) {
+            return false;
+        }
+        value.text = json.substr(start, i - start);
+        return true;
+    }
+    value.object = true;
+    i++;
+    json_validator::skip_space(json, i);
+    if (i < json.size() && json[i] == '}') {
+        i++;
+        return true;
+    }
+    while (i < json.size()) {
+        node::member member;
+        size_t key_start = i;
+        if (json[i] != '"' || !skip_string(json, i, &member.name)) {
+            return false;
+        }
+        member.key = json.substr(key_start, i - key_start);
+        json_validator::skip_space(json, i);
+        if (i >= json.size() || json[i] != ':') {
+            return false;
+        }
+        i++;
+        if (!parse(json, i, member.value, depth + 1)) {
+            return false;
+        }
+        value.members.push_back(std::move(member));
+        json_validator::skip_space(json, i);
+        if (i < json.size() && json[i] == '}') {
+            i++;
+            return true;
+        }
+        if (i >= json.size() || json[i] != ',') {
+            return false;
+        }
+        i++;
+        json_validator::skip_space(json, i);
+    }
+    return false;
+}
+
+bool parse_document(std::string_view json, node& value) {
+    size_t i = 0;
+    if (!parse(json, i, value, 0)) {
+        return false;
+    }
+    json_validator::skip_space(json, i);
+    return i == json.size();
+}
+
+bool is_null(const node& value) {
+    return !value.object && value.text == "null";
+}
+
+// MergePatch(Target, Patch) from RFC 7396, section 2.
+void merge(node& target, node& patch) {
+    if (!patch.object) {
+        target = std::move(patch);
+        return;
+    }
+    if (!target.object) {
+        target = node();
+        target.object = true;
+    }
+    for (auto& change : patch.members) {
+        auto existing = target.members.begin();
+        while (existing != target.members.end() && existing->name != change.name) {
+            ++existing;
+        }
+        if (is_null(change.value)) {
+            if (existing != target.members.end()) {
+                target.members.erase(existing);
+            }
+            continue;
+        }
+        if (existing == target.members.end()) {
+            target.members.push_back(node::member{change.name, change.key, node()});
+            existing = target.members.end() - 1;
+        }
+        merge(existing->value, change.value);
+    }
+}
+
+size_t measure(const node& value) {
+    if (!value.object) {
+        return value.text.size();
+    }
+    size_t size = 2;
+    for (const auto& member : value.members) {
+        size += member.key.size() + 2 + measure(member.value);
+    }
+    return size;
+}
+
+void write(const node& value, std::string& out) {
+    if (!value.object) {
+        out += value.text;
+        return;
+    }
+    out += '{';
+    for (size_t i = 0; i < value.members.size(); i++) {
+        if (i > 0) {
+            out += ',';
+        }
+        out += value.members[i].key;
+        out += ':';
+        write(value.members[i].value, out);
+    }
+    out += '}';
+}
+
+}
+
+bool json_merge_patch::apply(std::string_view target, std::string_view patch, std::string& out) {
+    node document;
+    node changes;
+    if (!parse_document(target, document) || !parse_document(patch, changes)) {
+        return false;
+    }
+    merge(document, changes);
+    out.clear();
+    out.reserve(measure(document));
+    write(document, out);
+    return true;
+}
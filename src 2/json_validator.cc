@@ -0,0 +1,510 @@
+#include "json_validator.h"
+#include <cstdint>
+#include <cstring>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace {
+
+// Character classes, so the hot loops test a byte with one load.
+enum : unsigned char { space = 1, plain = 2 };
+
+struct char_table {
+    unsigned char classes[256] = {};
+    constexpr char_table() {
+        for (int c = 0x20; c < 0x80; c++) {
+            classes[c] = plain;
+        }
+        classes[static_cast<unsigned char>('"')] = 0;
+        classes[static_cast<unsigned char>('\\')] = 0;
+        classes[static_cast<unsigned char>(' ')] = space | plain;
+        classes[static_cast<unsigned char>('\n')] = space;
+        classes[static_cast<unsigned char>('\r')] = space;
+        classes[static_cast<unsigned char>('\t')] = space;
+    }
+};
+
+constexpr char_table table;
+
+bool read_hex(std::string_view json, size_t& i, unsigned& code) {
+    if (i + 4 > json.size()) {
+        return false;
+    }
+    code = 0;
+    for (size_t end = i + 4; i < end; i++) {
+        char c = json[i];
+        code <<= 4;
+        if (c >= '0' && c <= '9') {
+            code |= c - '0';
+        } else if (c >= 'a' && c <= 'f') {
+            code |= c - 'a' + 10;
+        } else if (c >= 'A' && c <= 'F') {
+            code |= c - 'A' + 10;
+        } else {
+            return false;
+        }
+    }
+    return true;
+}
+
+void append_utf8(std::string& out, unsigned code) {
+    if (code < 0x80) {
+        out += static_cast<char>(code);
+    } else if (code < 0x800) {
+        out += static_cast<char>(0xc0 | (code >> 6));
+        out += static_cast<char>(0x80 | (code & 0x3f));
+    } else if (code < 0x10000) {
+        out += static_cast<char>(0xe0 | (code >> 12));
+        out += static_cast<char>(0x80 | ((code >> 6) & 0x3f));
+        out += static_cast<char>(0x80 | (code & 0x3f));
+    } else {
+        out += static_cast<char>(0xf0 | (code >> 18));
+        out += static_cast<char>(0x80 | ((code >> 12) & 0x3f));
+        out += static_cast<char>(0x80 | ((code >> 6) & 0x3f));
+        out += static_cast<char>(0x80 | (code & 0x3f));
+    }
+}
+
+bool is_space(unsigned char c) {
+    return table.classes[c] & space;
+}
+
+bool is_plain(unsigned char c) {
+    return table.classes[c] & plain;
+}
+
+bool is_digit(unsigned char c) {
+    return c >= '0' && c <= '9';
+}
+
+bool is_hex(unsigned char c) {
+    return is_digit(c) || (c >= 'a' && c <= 'f') || (c >= 'A' && c <= 'F');
+}
+
+// Parses one JSON text. With Minify, every significant byte is copied to out.
+template <bool Minify>
+class parser {
+public:
+    parser(std::string_view text, std::string* out): data_(text.data()), size_(text.size()), out_(out) {}
+
+    bool parse(std::string* error) {
+        if (Minify) {
+            // The output is never longer than the input.
+            out_->resize(size_);
+        }
+        bool ok = value() && (skip_space(), pos_ == size_ || fail("unexpected data after JSON value"));
+        if (Minify) {
+            copy();
+            out_->resize(written_);
+        }
+        if (!ok && error) {
+            *error = std::string(message_) + " at offset " + std::to_string(pos_);
+        }
+        return ok;
+    }
+
+private:
+    bool fail(const char* message) {
+        message_ = message;
+        return false;
+    }
+
+    void copy() {
+        std::memcpy(&(*out_)[written_], data_ + copied_, pos_ - copied_);
+        written_ += pos_ - copied_;
+    }
+
+    void skip_space() {
+        // Usually there is no whitespace, or a single space after ':' or ','.
+        if (pos_ >= size_ || !is_space(data_[pos_])) {
+            return;
+        }
+        // Minified output is the input minus the whitespace skipped here, so
+        // copy everything since the previous run of whitespace first.
+        if (Minify) {
+            copy();
+        }
+        if (++pos_ >= size_ || !is_space(data_[pos_])) {
+            copied_ = pos_;
+            return;
+        }
+#if defined(__SSE2__)
+        // Indented documents have long runs of spaces; skip them in blocks.
+        while (pos_ + 16 <= size_ && is_space(data_[pos_])) {
+            __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data_ + pos_));
+            __m128i space = _mm_or_si128(
+                _mm_or_si128(_mm_cmpeq_epi8(block, _mm_set1_epi8(' ')), _mm_cmpeq_epi8(block, _mm_set1_epi8('\n'))),
+                _mm_or_si128(_mm_cmpeq_epi8(block, _mm_set1_epi8('\r')), _mm_cmpeq_epi8(block, _mm_set1_epi8('\t'))));
+            unsigned mask = ~_mm_movemask_epi8(space) & 0xffff;
+            if (mask != 0) {
+                pos_ += __builtin_ctz(mask);
+                copied_ = pos_;
+                return;
+            }
+            pos_ += 16;
+        }
+#endif
+        while (pos_ < size_ && is_space(data_[pos_])) {
+            pos_++;
+        }
+        copied_ = pos_;
+    }
+
+    // Skips plain string bytes: anything but '"', '\\', control characters
+    // and non-ASCII bytes, which need a closer look.
+    void skip_plain() {
+#if defined(__SSE2__)
+        while (pos_ + 16 <= size_) {
+            __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data_ + pos_));
+            // A signed compare against 0x20 catches both control characters
+            // (0x00-0x1f) and non-ASCII bytes (0x80-0xff, negative as int8).
+            __m128i special = _mm_or_si128(
+                _mm_or_si128(_mm_cmpeq_epi8(block, _mm_set1_epi8('"')), _mm_cmpeq_epi8(block, _mm_set1_epi8('\\'))),
+                _mm_cmplt_epi8(block, _mm_set1_epi8(0x20)));
+            unsigned mask = _mm_movemask_epi8(special);
+            if (mask != 0) {
+                pos_ += __builtin_ctz(mask);
+                return;
+            }
+            pos_ += 16;
+        }
+#endif
+        while (pos_ < size_ && is_plain(data_[pos_])) {
+            pos_++;
+        }
+    }
+
+    // Validates one UTF-8 sequence starting at a non-ASCII byte.
+    bool utf8() {
+        const unsigned char* s = reinterpret_cast<const unsigned char*>(data_ + pos_);
+        size_t left = size_ - pos_;
+        std::uint32_t code;
+        size_t length;
+        if (s[0] >= 0xc2 && s[0] <= 0xdf) {
+            length = 2;
+            code = s[0] & 0x1f;
+        } else if (s[0] >= 0xe0 && s[0] <= 0xef) {
+            length = 3;
+            code = s[0] & 0x0f;
+        } else if (s[0] >= 0xf0 && s[0] <= 0xf4) {
+            length = 4;
+            code = s[0] & 0x07;
+        } else {
+            return fail("invalid UTF-8");
+        }
+        if (left < length) {
+            return fail("invalid UTF-8");
+        }
+        for (size_t i = 1; i < length; i++) {
+            if ((s[i] & 0xc0) != 0x80) {
+                return fail("invalid UTF-8");
+            }
+            code = (code << 6) | (s[i] & 0x3f);
+        }
+        // Reject overlong forms, surrogates and code points past U+10FFFF.
+        if ((length == 3 && code < 0x800) || (length == 4 && (code < 0x10000 || code > 0x10ffff)) ||
+            (code >= 0xd800 && code <= 0xdfff)) {
+            return fail("invalid UTF-8");
+        }
+        pos_ += length;
+        return true;
+    }
+
+    bool string() {
+        pos_++;  // opening quote
+        while (true) {
+            skip_plain();
+            if (pos_ >= size_) {
+                return fail("unterminated string");
+            }
+            unsigned char c = data_[pos_];
+            if (c == '"') {
+                pos_++;
+                return true;
+            }
+            if (c == '\\') {
+                if (pos_ + 1 >= size_) {
+                    return fail("unterminated string");
+                }
+                char escape = data_[pos_ + 1];
+                if (escape == 'u') {
+                    if (pos_ + 6 > size_ || !is_hex(data_[pos_ + 2]) || !is_hex(data_[pos_ + 3]) ||
+                        !is_hex(data_[pos_ + 4]) || !is_hex(data_[pos_ + 5])) {
+                        return fail("invalid \\u escape");
+                    }
+                    pos_ += 6;
+                } else if (std::strchr("\"\\/bfnrt", escape) != nullptr && escape != '\0') {
+                    pos_ += 2;
+                } else {
+                    return fail("invalid escape");
+                }
+            } else if (c < 0x20) {
+                return fail("control character in string");
+            } else if (!utf8()) {
+                return false;
+            }
+        }
+    }
+
+    bool number() {
+        if (data_[pos_] == '-') {
+            pos_++;
+        }
+        if (pos_ < size_ && data_[pos_] == '0') {
+            pos_++;
+        } else if (pos_ < size_ && is_digit(data_[pos_])) {
+            while (pos_ < size_ && is_digit(data_[pos_])) {
+                pos_++;
+            }
+        } else {
+            return fail("invalid number");
+        }
+        if (pos_ < size_ && data_[pos_] == '.') {
+            pos_++;
+            if (pos_ >= size_ || !is_digit(data_[pos_])) {
+                return fail("invalid number");
+            }
+            while (pos_ < size_ && is_digit(data_[pos_])) {
+                pos_++;
+            }
+        }
+        if (pos_ < size_ && (data_[pos_] == 'e' || data_[pos_] == 'E')) {
+            pos_++;
+            if (pos_ < size_ && (data_[pos_] == '+' || data_[pos_] == '-')) {
+                pos_++;
+            }
+            if (pos_ >= size_ || !is_digit(data_[pos_])) {
+                return fail("invalid number");
+            }
+            while (pos_ < size_ && is_digit(data_[pos_])) {
+                pos_++;
+            }
+        }
+        return true;
+    }
+
+    bool literal(const char* word, size_t length) {
+        if (size_ - pos_ < length || std::memcmp(data_ + pos_, word, length) != 0) {
+            return fail("invalid literal");
+        }
+        pos_ += length;
+        return true;
+    }
+
+    // Scalars are parsed directly; objects and arrays keep their nesting on
+    // an explicit stack rather than the call stack.
+    bool value() {
+        char stack[json_validator::max_depth];  // '{' or '['
+        size_t depth = 0;
+        while (true) {
+            skip_space();
+            if (pos_ >= size_) {
+                return fail("unexpected end of input");
+            }
+            char c = data_[pos_];
+            bool scalar = true;
+            if (c == '{' || c == '[') {
+                if (depth >= json_validator::max_depth) {
+                    return fail("nesting too deep");
+                }
+                pos_++;
+                skip_space();
+                char close = c == '{' ? '}' : ']';
+                if (pos_ < size_ && data_[pos_] == close) {
+                    pos_++;
+                } else {
+                    stack[depth++] = c;
+                    scalar = false;
+                    if (c == '{' && !key()) {
+                        return false;
+                    }
+                }
+            } else if (c == '"') {
+                if (!string()) {
+                    return false;
+                }
+            } else if (c == '-' || is_digit(c)) {
+                if (!number()) {
+                    return false;
+                }
+            } else if (c == 't') {
+                if (!literal("true", 4)) {
+                    return false;
+                }
+            } else if (c == 'f') {
+                if (!literal("false", 5)) {
+                    return false;
+                }
+            } else if (c == 'n') {
+                if (!literal("null", 4)) {
+                    return false;
+                }
+            } else {
+                return fail("unexpected character");
+            }
+            if (!scalar) {
+                continue;
+            }
+
+            // A value is complete: close containers until another member is due.
+            while (true) {
+                if (depth == 0) {
+                    return true;
+                }
+                skip_space();
+                if (pos_ >= size_) {
+                    return fail("unexpected end of input");
+                }
+                char container = stack[depth - 1];
+                char next = data_[pos_];
+                if (next == ',') {
+                    pos_++;
+                    if (container == '{' && !(skip_space(), key())) {
+                        return false;
+                    }
+                    break;
+                }
+                if (next != (container == '{' ? '}' : ']')) {
+                    return fail(container == '{' ? "expected ',' or '}'" : "expected ',' or ']'");
+                }
+                pos_++;
+                depth--;
+            }
+        }
+    }
+
+    // Parses "name" : inside an object, leaving pos_ at the member's value.
+    bool key() {
+        if (pos_ >= size_ || data_[pos_] != '"') {
+            return fail("expected string key");
+        }
+        if (!string()) {
+            return false;
+        }
+        skip_space();
+        if (pos_ >= size_ || data_[pos_] != ':') {
+            return fail("expected ':'");
+        }
+        pos_++;
+        return true;
+    }
+
+    const char* data_;
+    size_t size_;
+    size_t pos_ = 0;
+    size_t copied_ = 0;  // minify: input before this is already in out_
+    size_t written_ = 0;
+    std::string* out_;
+    const char* message_ = "";
+};
+
+}
+
+bool json_validator::validate(std::string_view text, std::string* error) {
+    return parser<false>(text, nullptr).parse(error);
+}
+
+bool json_validator::minify(std::string_view text, std::string& out, std::string* error) {
+    return parser<true>(text, &out).parse(error);
+}
+
+bool json_validator::unescape(std::string_view text, std::string& out) {
+    if (text.size() < 2 || text.front() != '"' || text.back() != '"') {
+        return false;
+    }
+    size_t end = text.size() - 1;
+    for (size_t i = 1; i < end;) {
+        char c = text[i++];
+        if (c == '"') {
+            return false;
+        }
+        if (c != '\\') {
+            out += c;
+            continue;
+        }
+        if (i >= end) {
+            return false;
+        }
+        char escaped = text[i++];
+        unsigned code;
+        switch (escaped) {
+            case '"': case '\\': case '/': code = escaped; break;
+            case 'b': code = '\b'; break;
+            case 'f': code = '\f'; break;
+            case 'n': code = '\n'; break;
+            case 'r': code = '\r'; break;
+            case 't': code = '\t'; break;
+            case 'u': {
+                if (i + 4 > end || !read_hex(text, i, code)) {
+                    return false;
+                }
+                // A high surrogate followed by a low one is a single character.
+                unsigned low;
+                size_t next = i + 2;
+                if (code >= 0xd800 && code < 0xdc00 && next + 4 <= end && text.substr(i, 2) == "\\u" &&
+                    read_hex(text, next, low) && low >= 0xdc00 && low < 0xe000) {
+                    code = 0x10000 + ((code - 0xd800) << 10) + (low - 0xdc00);
+                    i = next;
+                }
+                break;
+            }
+            default:
+                return false;
+        }
+        append_utf8(out, code);
+    }
+    return true;
+}
+
+void json_validator::skip_space(std::string_view json, size_t& i) {
+#if defined(__SSE2__)
+    while (i + 16 <= json.size() && is_space(json[i])) {
+        __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(json.data() + i));
+        __m128i space = _mm_or_si128(
+            _mm_or_si128(_mm_cmpeq_epi8(block, _mm_set1_epi8(' ')), _mm_cmpeq_epi8(block, _mm_set1_epi8('\n'))),
+            _mm_or_si128(_mm_cmpeq_epi8(block, _mm_set1_epi8('\r')), _mm_cmpeq_epi8(block, _mm_set1_epi8('\t'))));
+        unsigned mask = ~_mm_movemask_epi8(space) & 0xffff;
+        if (mask != 0) {
+            i += __builtin_ctz(mask);
+            return;
+        }
+        i += 16;
+    }
+#endif
+    while (i < json.size() && is_space(json[i])) {
+        i++;
+    }
+}
+
+bool json_validator::skip_string(std::string_view json, size_t& i, bool& escaped) {
+    i++;
+    while (true) {
+#if defined(__SSE2__)
+        // Most of a document is string contents; look for the closing quote
+        // or a backslash 16 bytes at a time.
+        while (i + 16 <= json.size()) {
+            __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(json.data() + i));
+            unsigned mask = _mm_movemask_epi8(
+                _mm_or_si128(_mm_cmpeq_epi8(block, _mm_set1_epi8('"')), _mm_cmpeq_epi8(block, _mm_set1_epi8('\\'))));
+            if (mask != 0) {
+                i += __builtin_ctz(mask);
+                break;
+            }
+            i += 16;
+        }
+#endif
+        while (i < json.size() && json[i] != '"' && json[i] != '\\') {
+            i++;
+        }
+        if (i >= json.size()) {
+            return false;
+        }
+        if (json[i] == '"') {
+            i++;
+            return true;
+        }
+        escaped = true;
+        i += 2;
+    }
+}
@@ -0,0 +1,118 @@
+#include "log_file_io.h"
+#include "config_parser.h"
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+log_file_io::log_file_io(std::shared_ptr<log_store> store, std::string root): store_(store), root_(root) {}
+
+bool log_file_io::to_key(const std::string& path, std::string& key) const {
+    std::string relative = std::filesystem::path(path).lexically_relative(root_).generic_string();
+    if (relative.empty() || relative.rfind("..", 0) == 0) {
+        return false;
+    }
+    key = relative == "." ? "" : relative;
+    return true;
+}
+
+bool log_file_io::open(const std::string& filename, std::ios_base::openmode mode) {
+    if (!to_key(filename, current_key_)) {
+        return false;
+    }
+    writing_ = (mode & std::ios::out) != 0;
+    pending_.clear();
+    return writing_ || store_->contains(current_key_);
+}
+
+bool log_file_io::write(const std::string& data) {
+    if (!writing_) {
+        return false;
+    }
+    // The pieces are appended to the log as one record on close(), which
+    // reports whether it was stored, rather than storing everything written
+    // so far on every write.
+    pending_ += data;
+    return true;
+}
+
+bool log_file_io::close() {
+    bool stored = !writing_ || store_->put(current_key_, pending_);
+    writing_ = false;
+    pending_.clear();
+    return stored;
+}
+
+bool log_file_io::read(const std::string& filepath, std::string& content) {
+    std::string key;
+    return to_key(filepath, key) && store_->get(key, content);
+}
+
+bool log_file_io::delete_file(const std::string& filepath) {
+    std::string key;
+    return to_key(filepath, key) && store_->remove(key);
+}
+
+bool log_file_io::create_directories(const std::string& path) {
+    // Nothing to create: a key's parents exist once it is stored.
+    return false;
+}
+
+bool log_file_io::list_directories(const std::string& path, std::vector<std::string>& directories) {
+    std::string key;
+    return to_key(path, key) && store_->list(key, directories);
+}
+
+bool log_file_io::exists(const std::string& filepath) {
+    std::string key;
+    return to_key(filepath, key) && store_->contains(key);
+}
+
+bool log_file_io::version(const std::string& filepath, std::string& tag) {
+    std::string key;
+    std::uint64_t sequence;
+    if (!to_key(filepath, key) || !store_->version(key, sequence)) {
+        return false;
+    }
+    char buffer[24];
+    std::snprintf(buffer, sizeof(buffer), "s%llx", static_cast<unsigned long long>(sequence));
+    tag = buffer;
+    return true;
+}
+
+void log_file_io::write_batch(const std::vector<batch_op>& ops, std::vector<bool>& results) {
+    std::vector<log_store::write_op> writes;
+    std::vector<size_t> positions;
+    for (size_t i = 0; i < ops.size(); i++) {
+        std::string key;
+        if (to_key(ops[i].path, key)) {
+            writes.push_back(log_store::write_op{key, ops[i].data, ops[i].remove});
+            positions.push_back(i);
+        }
+    }
+    std::vector<bool> applied;
+    results.assign(ops.size(), false);
+    if (!store_->write_batch(writes, applied)) {
+        return;
+    }
+    for (size_t i = 0; i < positions.size(); i++) {
+        results[positions[i]] = applied[i];
+    }
+}
+
+bool log_file_io::load_config(const std::vector<HandlerConfig>& handlers) {
+    for (const auto& handler : handlers) {
+        auto storage = handler.directives.find("storage");
+        if (handler.name != "crud_handler" || storage == handler.directives.end()) {
+            continue;
+        }
+        if (storage->second == std::vector<std::string>{"file"}) {
+            continue;
+        }
+        if (storage->second != std::vector<std::string>{"log"} || log_store::get_shared(handler.root) == nullptr) {
+            return false;
+        }
+    }
+    return true;
+}
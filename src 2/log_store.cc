@@ -0,0 +1,575 @@
+#include "log_store.h"
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <stdexcept>
+#include <string>
+#include <unordered_set>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <zlib.h>
+
+namespace {
+
+const size_t header_size = 4 + 8 + 4 + 4 + 1;
+
+enum record_type : std::uint8_t {
+    record_put = 0,
+    record_tombstone = 1,
+    // First record of a compacted segment: the comma-separated ids of the
+    // segments it replaces, which recovery deletes if they are still around.
+    record_replaces = 2,
+};
+
+std::string segment_name(std::uint32_t id) {
+    return "segment-" + std::to_string(id) + ".log";
+}
+
+std::string encode(std::uint64_t sequence, std::uint8_t type, const std::string& key, const std::string& value) {
+    std::string record(header_size + key.size() + value.size(), '\0');
+    std::uint32_t key_length = key.size();
+    std::uint32_t value_length = value.size();
+    std::memcpy(&record[4], &sequence, 8);
+    std::memcpy(&record[12], &key_length, 4);
+    std::memcpy(&record[16], &value_length, 4);
+    record[20] = type;
+    std::memcpy(&record[header_size], key.data(), key.size());
+    std::memcpy(&record[header_size + key.size()], value.data(), value.size());
+    std::uint32_t crc = crc32(0, reinterpret_cast<const Bytef*>(record.data() + 4), record.size() - 4);
+    std::memcpy(&record[0], &crc, 4);
+    return record;
+}
+
+bool write_all(int fd, const std::string& data, std::uint64_t offset) {
+    size_t written = 0;
+    while (written < data.size()) {
+        ssize_t n = ::pwrite(fd, data.data() + written, data.size() - written, offset + written);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        written += n;
+    }
+    return true;
+}
+
+bool read_all(int fd, std::string& data, size_t length, std::uint64_t offset) {
+    data.resize(length);
+    size_t done = 0;
+    while (done < length) {
+        ssize_t n = ::pread(fd, &data[done], length - done, offset + done);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        done += n;
+    }
+    return true;
+}
+
+void sync_directory(const std::string& directory) {
+    int fd = ::open(directory.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd >= 0) {
+        ::fsync(fd);
+        ::close(fd);
+    }
+}
+
+}
+
+log_store::segment::segment(std::uint32_t id, int fd, std::string path): id(id), fd(fd), path(path) {}
+
+log_store::segment::~segment() {
+    ::close(fd);
+}
+
+log_store::log_store(const std::string& directory): log_store(directory, options()) {}
+
+log_store::log_store(const std::string& directory, options opts): directory_(directory), options_(opts) {
+    std::error_code ec;
+    std::filesystem::create_directories(directory_, ec);
+    if (!std::filesystem::is_directory(directory_, ec)) {
+        throw std::runtime_error("Unable to create " + directory_);
+    }
+    recover();
+    if (options_.background_compaction) {
+        compactor_ = std::thread([this]() { compaction_loop(); });
+    }
+}
+
+log_store::~log_store() {
+    {
+        std::lock_guard<std::mutex> lock(wake_mutex_);
+        stopping_ = true;
+    }
+    wake_.notify_all();
+    if (compactor_.joinable()) {
+        compactor_.join();
+    }
+}
+
+std::shared_ptr<log_store::segment> log_store::open_segment(std::uint32_t id, bool create) {
+    std::string path = (std::filesystem::path(directory_) / segment_name(id)).string();
+    int fd = ::open(path.c_str(), O_RDWR | O_CLOEXEC | (create ? O_CREAT | O_EXCL : 0), 0644);
+    if (fd < 0) {
+        throw std::runtime_error("Unable to open " + path + ": " + std::strerror(errno));
+    }
+    auto seg = std::make_shared<segment>(id, fd, path);
+    struct stat st;
+    if (::fstat(fd, &st) == 0) {
+        seg->size = st.st_size;
+    }
+    return seg;
+}
+
+void log_store::recover() {
+    std::vector<std::uint32_t> ids;
+    for (const auto& entry : std::filesystem::directory_iterator(directory_)) {
+        std::string name = entry.path().filename().string();
+        if (name.size() > 8 && name.compare(name.size() - 8, 8, ".compact") == 0) {
+            // An interrupted compaction never got renamed into place.
+            std::filesystem::remove(entry.path());
+            continue;
+        }
+        if (name.rfind("segment-", 0) == 0 && name.size() > 12 && name.compare(name.size() - 4, 4, ".log") == 0) {
+            try {
+                ids.push_back(std::stoul(name.substr(8, name.size() - 12)));
+            } catch (const std::exception&) {
+                continue;
+            }
+        }
+    }
+    std::sort(ids.begin(), ids.end());
+
+    // Finish any compaction that was renamed into place but crashed before
+    // deleting the segments it replaced.
+    std::unordered_set<std::uint32_t> replaced;
+    for (std::uint32_t id : ids) {
+        auto seg = open_segment(id, false);
+        std::string header;
+        std::uint32_t key_length = 0, value_length = 0;
+        if (seg->size >= header_size && read_all(seg->fd, header, header_size, 0) && header[20] == record_replaces) {
+            std::memcpy(&key_length, &header[12], 4);
+            std::memcpy(&value_length, &header[16], 4);
+            std::string list;
+            if (read_all(seg->fd, list, value_length, header_size + key_length)) {
+                size_t start = 0;
+                while (start < list.size()) {
+                    size_t end = list.find(',', start);
+                    replaced.insert(std::stoul(list.substr(start, end - start)));
+                    start = end == std::string::npos ? list.size() : end + 1;
+                }
+            }
+        }
+    }
+
+    // Tombstones seen so far, so an older put replayed later (from a
+    // compacted segment) does not resurrect a deleted key.
+    std::unordered_map<std::string, std::uint64_t> deleted;
+    for (size_t i = 0; i < ids.size(); i++) {
+        std::uint32_t id = ids[i];
+        if (replaced.count(id)) {
+            std::filesystem::remove(std::filesystem::path(directory_) / segment_name(id));
+            continue;
+        }
+        auto seg = open_segment(id, false);
+        segments_[id] = seg;
+
+        std::string data;
+        if (!read_all(seg->fd, data, seg->size, 0)) {
+            throw std::runtime_error("Unable to read " + seg->path);
+        }
+        std::uint64_t offset = 0;
+        while (offset + header_size <= data.size()) {
+            std::uint32_t crc, key_length, value_length;
+            std::uint64_t sequence;
+            std::memcpy(&crc, &data[offset], 4);
+            std::memcpy(&sequence, &data[offset + 4], 8);
+            std::memcpy(&key_length, &data[offset + 12], 4);
+            std::memcpy(&value_length, &data[offset + 16], 4);
+            std::uint8_t type = data[offset + 20];
+            std::uint64_t length = header_size + std::uint64_t(key_length) + value_length;
+            if (length > data.size() - offset ||
+                crc != crc32(0, reinterpret_cast<const Bytef*>(data.data() + offset + 4), length - 4)) {
+                break;
+            }
+            std::string key = data.substr(offset + header_size, key_length);
+            next_sequence_ = std::max(next_sequence_, sequence + 1);
+            if (type == record_put || type == record_tombstone) {
+                auto existing = index_.find(key);
+                auto tombstone = deleted.find(key);
+                bool newer = (existing == index_.end() || existing->second.sequence < sequence) &&
+                             (tombstone == deleted.end() || tombstone->second < sequence);
+                if (newer) {
+                    location loc{seg, offset + header_size + key_length, value_length, sequence};
+                    index(key, loc, type == record_tombstone);
+                    if (type == record_tombstone) {
+                        deleted[key] = sequence;
+                    }
+                }
+            }
+            offset += length;
+        }
+        if (offset < seg->size) {
+            // Torn or corrupt tail: drop it so new appends start on a record boundary.
+            if (::ftruncate(seg->fd, offset) != 0) {
+                throw std::runtime_error("Unable to truncate " + seg->path);
+            }
+            seg->size = offset;
+        }
+        total_bytes_ += seg->size;
+        next_segment_ = id + 1;
+    }
+
+    if (!segments_.empty() && segments_.rbegin()->second->size < options_.segment_size) {
+        active_ = segments_.rbegin()->second;
+    } else {
+        active_ = open_segment(next_segment_++, true);
+        segments_[active_->id] = active_;
+    }
+}
+
+void log_store::index(const std::string& key, const location& loc, bool tombstone) {
+    auto it = index_.find(key);
+    if (it != index_.end()) {
+        live_bytes_ -= header_size + key.size() + it->second.length;
+    }
+    std::string parent = key.find('/') == std::string::npos ? "" : key.substr(0, key.find_last_of('/'));
+    std::string name = key.substr(key.find_last_of('/') + 1);
+    if (tombstone) {
+        if (it != index_.end()) {
+            index_.erase(it);
+            children_[parent].erase(name);
+        }
+        return;
+    }
+    index_[key] = loc;
+    live_bytes_ += header_size + key.size() + loc.length;
+    children_[parent].insert(name);
+}
+
+bool log_store::append(const std::string& key, const std::string& value, bool tombstone, location* written) {
+    std::uint64_t sequence = next_sequence_++;
+    std::string record = encode(sequence, tombstone ? record_tombstone : record_put, key, value);
+    if (!write_all(active_->fd, record, active_->size)) {
+        // Leave any partial record to be overwritten by the next append.
+        return false;
+    }
+    *written = location{active_, active_->size + header_size + key.size(), static_cast<std::uint32_t>(value.size()), sequence};
+    active_->size += record.size();
+    total_bytes_ += record.size();
+    if (active_->size >= options_.segment_size) {
+        roll();
+    }
+    return true;
+}
+
+void log_store::roll() {
+    ::fdatasync(active_->fd);
+    active_ = open_segment(next_segment_++, true);
+    segments_[active_->id] = active_;
+}
+
+bool log_store::put(const std::string& key, const std::string& value) {
+    bool compact_now;
+    {
+        std::unique_lock<std::shared_mutex> lock(mutex_);
+        location loc;
+        if (!append(key, value, false, &loc)) {
+            return false;
+        }
+        index(key, loc, false);
+        compact_now = compaction_due();
+    }
+    if (options_.background_compaction && compact_now) {
+        wake_.notify_one();
+    }
+    return true;
+}
+
+bool log_store::remove(const std::string& key) {
+    bool compact_now;
+    {
+        std::unique_lock<std::shared_mutex> lock(mutex_);
+        if (index_.find(key) == index_.end()) {
+            return false;
+        }
+        location loc;
+        if (!append(key, "", true, &loc)) {
+            return false;
+        }
+        index(key, loc, true);
+        compact_now = compaction_due();
+    }
+    if (options_.background_compaction && compact_now) {
+        wake_.notify_one();
+    }
+    return true;
+}
+
+bool log_store::write_batch(const std::vector<write_op>& ops, std::vector<bool>& results) {
+    results.assign(ops.size(), false);
+    bool compact_now;
+    {
+        std::unique_lock<std::shared_mutex> lock(mutex_);
+        struct pending {
+            size_t op;
+            std::uint64_t offset;  // of the record within batch
+            std::uint64_t sequence;
+        };
+        std::string batch;
+        std::vector<pending> appended;
+        // Whether each key exists as of the ops so far in the batch.
+        std::unordered_map<std::string, bool> present;
+        for (size_t i = 0; i < ops.size(); i++) {
+            const write_op& op = ops[i];
+            if (op.remove) {
+                auto seen = present.find(op.key);
+                bool exists = seen != present.end() ? seen->second : index_.count(op.key) > 0;
+                if (!exists) {
+                    continue;
+                }
+            }
+            present[op.key] = !op.remove;
+            std::uint64_t sequence = next_sequence_++;
+            appended.push_back(pending{i, batch.size(), sequence});
+            batch += encode(sequence, op.remove ? record_tombstone : record_put, op.key, op.remove ? "" : op.value);
+        }
+        if (batch.empty()) {
+            return true;
+        }
+        if (!write_all(active_->fd, batch, active_->size)) {
+            return false;
+        }
+        for (const pending& record : appended) {
+            const write_op& op = ops[record.op];
+            std::uint32_t length = op.remove ? 0 : op.value.size();
+            location loc{active_, active_->size + record.offset + header_size + op.key.size(), length, record.sequence};
+            index(op.key, loc, op.remove);
+            results[record.op] = true;
+        }
+        active_->size += batch.size();
+        total_bytes_ += batch.size();
+        if (active_->size >= options_.segment_size) {
+            roll();
+        }
+        compact_now = compaction_due();
+    }
+    if (options_.background_compaction && compact_now) {
+        wake_.notify_one();
+    }
+    return true;
+}
+
+bool log_store::get(const std::string& key, std::string& value) {
+    location loc;
+    {
+        std::shared_lock<std::shared_mutex> lock(mutex_);
+        auto it = index_.find(key);
+        if (it == index_.end()) {
+            return false;
+        }
+        loc = it->second;
+    }
+    // The segment stays open while loc holds it, even if compaction unlinks it.
+    return read_all(loc.seg->fd, value, loc.length, loc.offset);
+}
+
+bool log_store::contains(const std::string& key) {
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    return index_.find(key) != index_.end();
+}
+
+bool log_store::version(const std::string& key, std::uint64_t& sequence) {
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    auto it = index_.find(key);
+    if (it == index_.end()) {
+        return false;
+    }
+    sequence = it->second.sequence;
+    return true;
+}
+
+bool log_store::list(const std::string& prefix, std::vector<std::string>& names) {
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    auto it = children_.find(prefix);
+    if (it == children_.end()) {
+        return false;
+    }
+    names.insert(names.end(), it->second.begin(), it->second.end());
+    return true;
+}
+
+bool log_store::sync() {
+    std::shared_ptr<segment> active;
+    {
+        std::shared_lock<std::shared_mutex> lock(mutex_);
+        active = active_;
+    }
+    return ::fdatasync(active->fd) == 0;
+}
+
+bool log_store::needs_compaction() {
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    return compaction_due();
+}
+
+// Caller holds mutex_.
+bool log_store::compaction_due() {
+    std::uint64_t dead = total_bytes_ - live_bytes_;
+    return segments_.size() > 1 && total_bytes_ > 0 && dead >= options_.compaction_ratio * total_bytes_;
+}
+
+bool log_store::compact() {
+    std::lock_guard<std::mutex> compaction_lock(compaction_mutex_);
+
+    std::vector<std::shared_ptr<segment>> sealed;
+    std::vector<std::pair<std::string, location>> live;
+    std::uint32_t output_id;
+    {
+        std::unique_lock<std::shared_mutex> lock(mutex_);
+        // An empty active segment has nothing to compact; rolling it
+        // would only leave another empty segment behind.
+        if (active_->size > 0) {
+            roll();
+        }
+        for (const auto& seg : segments_) {
+            if (seg.second != active_) {
+                sealed.push_back(seg.second);
+            }
+        }
+        if (sealed.empty()) {
+            return true;
+        }
+        for (const auto& entry : index_) {
+            if (entry.second.seg != active_) {
+                live.push_back(entry);
+            }
+        }
+        output_id = next_segment_++;
+    }
+
+    // Copy the live records outside the lock; readers and writers carry on.
+    std::string replaces;
+    for (const auto& seg : sealed) {
+        replaces += (replaces.empty() ? "" : ",") + std::to_string(seg->id);
+    }
+    std::string path = (std::filesystem::path(directory_) / segment_name(output_id)).string();
+    std::string temp = path + ".compact";
+    int fd = ::open(temp.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        return false;
+    }
+    std::string buffer = encode(0, record_replaces, "", replaces);
+    std::vector<std::uint64_t> offsets;
+    std::uint64_t size = 0;
+    bool ok = true;
+    for (const auto& entry : live) {
+        std::string value;
+        if (!read_all(entry.second.seg->fd, value, entry.second.length, entry.second.offset)) {
+            ok = false;
+            break;
+        }
+        offsets.push_back(size + buffer.size() + header_size + entry.first.size());
+        buffer += encode(entry.second.sequence, record_put, entry.first, value);
+        if (buffer.size() >= (1 << 20)) {
+            ok = write_all(fd, buffer, size);
+            size += buffer.size();
+            buffer.clear();
+            if (!ok) {
+                break;
+            }
+        }
+    }
+    ok = ok && write_all(fd, buffer, size) && ::fsync(fd) == 0;
+    size += buffer.size();
+    ::close(fd);
+    if (!ok || std::rename(temp.c_str(), path.c_str()) != 0) {
+        std::filesystem::remove(temp);
+        return false;
+    }
+    sync_directory(directory_);
+
+    auto output = open_segment(output_id, false);
+    {
+        std::unique_lock<std::shared_mutex> lock(mutex_);
+        for (size_t i = 0; i < live.size(); i++) {
+            auto it = index_.find(live[i].first);
+            // Skip keys rewritten or deleted while we were copying.
+            if (it != index_.end() && it->second.seg == live[i].second.seg && it->second.offset == live[i].second.offset) {
+                it->second.seg = output;
+                it->second.offset = offsets[i];
+            }
+        }
+        for (const auto& seg : sealed) {
+            segments_.erase(seg->id);
+            total_bytes_ -= seg->size;
+        }
+        segments_[output_id] = output;
+        total_bytes_ += output->size;
+    }
+    for (const auto& seg : sealed) {
+        ::unlink(seg->path.c_str());
+    }
+    sync_directory(directory_);
+    return true;
+}
+
+void log_store::compaction_loop() {
+    std::unique_lock<std::mutex> lock(wake_mutex_);
+    while (!stopping_) {
+        wake_.wait_for(lock, std::chrono::seconds(5));
+        if (stopping_) {
+            break;
+        }
+        lock.unlock();
+        if (needs_compaction()) {
+            compact();
+        }
+        lock.lock();
+    }
+}
+
+size_t log_store::size() {
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    return index_.size();
+}
+
+std::uint64_t log_store::total_bytes() {
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    return total_bytes_;
+}
+
+std::uint64_t log_store::live_bytes() {
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    return live_bytes_;
+}
+
+size_t log_store::segment_count() {
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    return segments_.size();
+}
+
+std::shared_ptr<log_store> log_store::get_shared(const std::string& directory) {
+    static std::mutex mutex;
+    static std::map<std::string, std::shared_ptr<log_store>> stores;
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = stores.find(directory);
+    if (it != stores.end()) {
+        return it->second;
+    }
+    try {
+        auto store = std::make_shared<log_store>(directory);
+        stores[directory] = store;
+        return store;
+    } catch (const std::exception&) {
+        return nullptr;
+    }
+}
@@ -0,0 +1,96 @@
+#include "markdown_cache.h"
+#include <exception>
+#include <string>
+#include <memory>
+
+markdown_cache::markdown_cache(size_t max_bytes): max_bytes_(max_bytes) {}
+
+markdown_cache* markdown_cache::get_global_cache() {
+    static markdown_cache cache;
+    return &cache;
+}
+
+std::shared_ptr<const std::string> markdown_cache::get(const std::string& path, std::int64_t mtime, std::uintmax_t size,
+                                                       const std::function<std::string()>& render) {
+    std::promise<std::shared_ptr<const std::string>> promise;
+    html_future cached;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = entries_.find(path);
+        if (it != entries_.end() && it->second.mtime == mtime && it->second.size == size) {
+            cached = it->second.html;
+            lru_.splice(lru_.begin(), lru_, it->second.lru);
+            hits_++;
+        } else if (it != entries_.end()) {
+            // The document changed: replace the stale render in place.
+            used_ -= it->second.bytes;
+            lru_.splice(lru_.begin(), lru_, it->second.lru);
+            it->second = entry{mtime, size, promise.get_future().share(), 0, lru_.begin()};
+        } else {
+            lru_.push_front(path);
+            entries_.emplace(path, entry{mtime, size, promise.get_future().share(), 0, lru_.begin()});
+        }
+    }
+
+    // Hit: wait outside the lock in case another thread is still rendering.
+    if (cached.valid()) {
+        return cached.get();
+    }
+
+    std::shared_ptr<const std::string> html;
+    try {
+        renders_++;
+        html = std::make_shared<const std::string>(render());
+        promise.set_value(html);
+    } catch (...) {
+        // Drop the failed entry so the next request retries the render.
+        promise.set_exception(std::current_exception());
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = entries_.find(path);
+        if (it != entries_.end() && it->second.mtime == mtime && it->second.size == size && it->second.bytes == 0) {
+            lru_.erase(it->second.lru);
+            entries_.erase(it);
+        }
+        throw;
+    }
+
+    // Count the render against the budget now that its size is known.
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = entries_.find(path);
+    if (it != entries_.end() && it->second.mtime == mtime && it->second.size == size && it->second.bytes == 0) {
+        it->second.bytes = html->size() + path.size();
+        used_ += it->second.bytes;
+        evict();
+    }
+    return html;
+}
+
+void markdown_cache::evict() {
+    // A document larger than the whole budget is not kept either.
+    while (used_ > max_bytes_ && !lru_.empty()) {
+        auto it = entries_.find(lru_.back());
+        used_ -= it->second.bytes;
+        entries_.erase(it);
+        lru_.pop_back();
+    }
+}
+
+void markdown_cache::clear() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    entries_.clear();
+    lru_.clear();
+    used_ = 0;
+}
+
+size_t markdown_cache::used() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return used_;
+}
+
+size_t markdown_cache::hits() const {
+    return hits_;
+}
+
+size_t markdown_cache::renders() const {
+    return renders_;
+}
@@ -1,27 +1,45 @@
+#include <algorithm>
 #include <exception>
 #include <ios>
 #include <stdexcept>
 #include <string>
 #include <sstream>
 #include <filesystem>
-#include <boost/uuid/uuid.hpp>
-#include <boost/uuid/uuid_generators.hpp>
-#include <boost/uuid/uuid_io.hpp>
 #include <memory>
+#include <mutex>
+#include <shared_mutex>
 #include <boost/beast/http.hpp>
 #include <boost/lexical_cast.hpp>
 #include "logger.h"
+#include "async_file_io.h"
+#include "entity_locks.h"
+#include "id_generator.h"
 #include "file_io.h"
+#include "caching_file_io.h"
+#include "compressed_file_io.h"
+#include "snapshot_file_io.h"
 #include "markdown_handler.h"
 #include "markdown_to_html.h"
 namespace http = boost::beast::http;
 
-std::unique_ptr<request_handler> markdown_handler::init(std::string data_path) {
-    auto file_io_ptr = std::make_shared<file_io>();
-    return std::make_unique<markdown_handler>(data_path, file_io_ptr);
+std::unique_ptr<request_handler> markdown_handler::init(const HandlerConfig& config) {
+    // `compress on;` keeps documents gzipped at rest, and `backup on;` saves
+    // what a write replaces while a backup is running.
+    auto file_io_ptr = snapshot_file_io::wrap(config,
+        compressed_file_io::wrap(config, caching_file_io::wrap(config, std::make_shared<file_io>())));
+    // `async_io on;` answers requests without blocking an io thread on the disk.
+    auto async_io = config.directives.find("async_io");
+    std::shared_ptr<async_file_io> async_io_ptr;
+    if (async_io != config.directives.end() && async_io->second == std::vector<std::string>{"on"}) {
+        async_io_ptr = async_file_io::get_shared();
+    }
+    return std::make_unique<markdown_handler>(config.root, file_io_ptr, async_io_ptr, entity_index::get_shared(config.root));
 }
 
-markdown_handler::markdown_handler(std::string data_path, std::shared_ptr<i_file_io> file_io_ptr): data_path_(data_path), file_io_(file_io_ptr) {}
+markdown_handler::markdown_handler(std::string data_path, std::shared_ptr<i_file_io> file_io_ptr, std::shared_ptr<async_file_io> async_io_ptr,
+                                   std::shared_ptr<entity_index> index_ptr)
+    : data_path_(data_path), file_io_(file_io_ptr), async_io_(async_io_ptr),
+      index_(index_ptr ? index_ptr : std::make_shared<entity_index>()) {}
 
 http::response<http::string_body> markdown_handler::handle_request(http::request<http::string_body> request) {
     switch (request.method()) {
@@ -41,9 +59,7 @@ http::response<http::string_body> markdown_handler::handle_request(http::request
 }
 
 std::string markdown_handler::generate_id() {
-    static boost::uuids::random_generator generator;
-    boost::uuids::uuid id = generator();
-    return boost::uuids::to_string(id);
+    return id_generator::generate();
 }
 
 http::response<http::string_body> markdown_handler::create_markdown_file(const http::request<http::string_body>& request) {
@@ -72,12 +88,14 @@ http::response<http::string_body> markdown_handler::create_markdown_file(const h
     logger->logDebug("Filepath: " + entity_path.string());
 
     std::string entity_data = request.body();
+    std::unique_lock<std::shared_mutex> lock(entity_locks::get_global_locks().for_path(entity_path));
     bool success = create_or_update_entity(entity_path, entity_data);
     if (!success) {
         return create_response(http::status::internal_server_error,
                                 "text/plain",
                                 "Unable to create file. Please try again later.");
     }
+    index_->add(entity_path.parent_path().string(), id);
     logger->logDebug("Markdown file written successfully: " + entity_data);
 
     std::string body = (std::ostringstream() << "{\"id\": \"" << id << "\"}").str();
@@ -138,28 +156,19 @@ http::response<http::string_body> markdown_handler::get_markdown_file(const http
         // No ID found, try listing all the filenames for the given entity
         logger->logDebug("Listing filenames in the entity path of " + (entity_path).string());
 
+        // The index lists the directory once, then follows changes to it.
         std::vector<std::string> ids;
-        if(!file_io_->list_directories(std::string(entity_path), ids)) {
+        bool more = false;
+        if(!index_->page(*file_io_, std::string(entity_path), "", 0, ids, more)) {
             return create_response(http::status::bad_request,
                                     "text/html",
                                     "<html><head><title>Bad Request</title></head><body><h1>400 Bad Request</h1></body></html>");
         }
-
-        std::ostringstream oss;
-        oss << "[";
-        for(size_t i = 0; i< ids.size(); ++i) {
-            if (i>=1) oss << ",";
-            oss << "\"" << ids[i] << "\"";
-        }
-        oss << "]";
-
-        std::string body = oss.str();
-        return create_response(http::status::ok,
-                                "application/json",
-                                body);
+        return list_response(std::move(ids));
     }
     
     std::string entity_data;
+    std::shared_lock<std::shared_mutex> lock(entity_locks::get_global_locks().for_path(entity_path));
 
     // Failed to open
     if (!file_io_->open(std::string(entity_path), std::ios::in)) {
@@ -180,6 +189,29 @@ http::response<http::string_body> markdown_handler::get_markdown_file(const http
     file_io_->close();
     logger->logDebug("Markdown file retrieved successfully: " + entity_data);
 
+    return document_response(entity_data, convert_to_html);
+}
+
+http::response<http::string_body> markdown_handler::list_response(std::vector<std::string> ids) {
+    // IDs are time-ordered, so sorting lists entities in creation order.
+    std::sort(ids.begin(), ids.end());
+
+    std::ostringstream oss;
+    oss << "[";
+    for(size_t i = 0; i< ids.size(); ++i) {
+        if (i>=1) oss << ",";
+        oss << "\"" << ids[i] << "\"";
+    }
+    oss << "]";
+
+    std::string body = oss.str();
+    return create_response(http::status::ok,
+                            "application/json",
+                            body);
+}
+
+http::response<http::string_body> markdown_handler::document_response(const std::string& entity_data, bool convert_to_html) {
+    Logger *logger = Logger::get_global_log();
     std::string body = entity_data;
     if (convert_to_html) {
         MarkdownToHtml converter;
@@ -194,6 +226,131 @@ http::response<http::string_body> markdown_handler::get_markdown_file(const http
                             body);
 }
 
+bool markdown_handler::handle_request_async(const http::request<http::string_body>& request, response_callback respond) {
+    if (request.method() == http::verb::get && request.target() == "/markdown/_backup") {
+        return snapshot_file_io::answer_backup(data_path_, file_io_, respond);
+    }
+    if (!async_io_) {
+        return false;
+    }
+    // Requests that fail validation touch no files and are answered by
+    // handle_request as usual.
+    switch (request.method()) {
+        case http::verb::get:
+            return get_markdown_file_async(request, respond);
+        case http::verb::post:
+        case http::verb::put:
+            return write_markdown_file_async(request, respond);
+        case http::verb::delete_:
+            return delete_markdown_file_async(request, respond);
+        default:
+            return false;
+    }
+}
+
+bool markdown_handler::get_markdown_file_async(const http::request<http::string_body>& request, response_callback respond) {
+    std::string entity_with_id = remove_prefix_dir("/markdown/", request.target());
+    bool convert_to_html = true;
+    size_t pos_question = entity_with_id.find_last_of('?');
+    if (pos_question != std::string::npos) {
+        std::string url_parameters = entity_with_id.substr(pos_question+1);
+        if (url_parameters != "raw=true" && url_parameters != "raw=false") {
+            return false;
+        }
+        convert_to_html = url_parameters == "raw=false";
+        entity_with_id = entity_with_id.substr(0, pos_question);
+    }
+    if (entity_with_id.empty()) {
+        return false;
+    }
+
+    std::string entity_path = (std::filesystem::path(data_path_) / std::filesystem::path(entity_with_id)).string();
+    size_t pos_slash = entity_with_id.find_last_of('/');
+    if (pos_slash == std::string::npos || pos_slash + 1 == entity_with_id.size()) {
+        async_io_->list(entity_path, [respond](bool ok, std::vector<std::string> ids) {
+            if (!ok) {
+                respond(create_response(http::status::bad_request,
+                                        "text/html",
+                                        "<html><head><title>Bad Request</title></head><body><h1>400 Bad Request</h1></body></html>"));
+                return;
+            }
+            respond(list_response(std::move(ids)));
+        });
+        return true;
+    }
+
+    // No entity lock: async writes replace documents with a rename, so a
+    // read sees either the old document or the new one.
+    async_io_->read(entity_path, [respond, entity_path, convert_to_html](bool ok, std::string entity_data) {
+        if (!ok) {
+            Logger::get_global_log()->logError("ERROR: Failed to read file at " + entity_path);
+            respond(create_response(http::status::not_found,
+                                    "text/html",
+                                    "<html><head><title>Not Found</title></head><body><h1>404 Not Found</h1></body></html>"));
+            return;
+        }
+        respond(document_response(entity_data, convert_to_html));
+    });
+    return true;
+}
+
+bool markdown_handler::write_markdown_file_async(const http::request<http::string_body>& request, response_callback respond) {
+    std::string entity_dir = remove_prefix_dir("/markdown/", request.target());
+    bool create = request.method() == http::verb::post;
+    if (!has_markdown_content_type(request) || entity_dir.empty() ||
+        (!create && count_path_segments(std::filesystem::path(entity_dir)) < 2)) {
+        return false;
+    }
+
+    std::filesystem::path entity_path = std::filesystem::path(data_path_) / entity_dir;
+    if (create) {
+        entity_path /= generate_id();
+    }
+    std::string id = entity_path.filename().string();
+    // A stat, to tell a created document from a replaced one.
+    bool is_new_file = create || !std::filesystem::exists(entity_path);
+    std::string error = create ? "Unable to create file. Please try again later."
+                               : "Unable to create or update file. Please try again later.";
+    std::shared_ptr<async_file_io> async_io = async_io_;
+    std::string path = entity_path.string();
+    std::string entity_data = request.body();
+    async_io->mkdir(entity_path.parent_path().string(), [async_io, path, entity_data, id, is_new_file, error, respond](bool ok) {
+        if (!ok) {
+            Logger::get_global_log()->logError("ERROR: Failed to create directories for " + path);
+            respond(create_response(http::status::internal_server_error, "text/plain", error));
+            return;
+        }
+        async_io->write(path, entity_data, [path, id, is_new_file, error, respond](bool ok) {
+            if (!ok) {
+                Logger::get_global_log()->logError("ERROR: Failed to write to file at " + path);
+                respond(create_response(http::status::internal_server_error, "text/plain", error));
+            } else if (is_new_file) {
+                respond(create_response(http::status::created,
+                                        "application/json",
+                                        "{\"id\": \"" + id + "\"}"));
+            } else {
+                respond(create_response(http::status::no_content, "application/json", ""));
+            }
+        });
+    });
+    return true;
+}
+
+bool markdown_handler::delete_markdown_file_async(const http::request<http::string_body>& request, response_callback respond) {
+    std::string entity_with_id = remove_prefix_dir("/markdown/", request.target());
+    if (entity_with_id.empty() || count_path_segments(std::filesystem::path(entity_with_id)) < 2) {
+        return false;
+    }
+    std::string entity_path = (std::filesystem::path(data_path_) / std::filesystem::path(entity_with_id)).string();
+    async_io_->unlink(entity_path, [entity_path, respond](bool ok) {
+        if (!ok) {
+            Logger::get_global_log()->logError("ERROR: Cannot delete file that does not exist at " + entity_path);
+        }
+        respond(create_response(http::status::no_content, "application/json", ""));
+    });
+    return true;
+}
+
 http::response<http::string_body> markdown_handler::update_markdown_file(const http::request<http::string_body>& request) {
     Logger *logger = Logger::get_global_log();
     
@@ -214,6 +371,8 @@ http::response<http::string_body> markdown_handler::update_markdown_file(const h
     }
     
     std::filesystem::path entity_path = std::filesystem::path(data_path_) / entity_dir;
+    // Hold the entity for the whole check-then-write so concurrent PUTs cannot interleave.
+    std::unique_lock<std::shared_mutex> lock(entity_locks::get_global_locks().for_path(entity_path));
     bool is_new_file = !file_io_->exists(std::string(entity_path));
 
     std::string entity_data = request.body();
@@ -225,6 +384,7 @@ http::response<http::string_body> markdown_handler::update_markdown_file(const h
     }
 
     std::string id = entity_path.filename().string();
+    index_->add(entity_path.parent_path().string(), id);
     logger->logDebug("Request file id: " + id);
 
     if (is_new_file) {
@@ -273,10 +433,12 @@ http::response<http::string_body> markdown_handler::delete_markdown_file(const h
     logger->logDebug("ID: " + id);
     logger->logDebug("Filepath: " + entity_path.string());
 
+    std::unique_lock<std::shared_mutex> lock(entity_locks::get_global_locks().for_path(entity_path));
     if (!file_io_->delete_file(std::string(entity_path))) {
         logger->logError("ERROR: Cannot delete file that does not exist at " + entity_path.string());
     }
     else {
+        index_->remove(entity_path.parent_path().string(), entity_path.filename().string());
         logger->logDebug("Successfully deleted file");
     }
 
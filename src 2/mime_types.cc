@@ -0,0 +1,435 @@
+#include "mime_types.h"
+#include "config_parser.h"
+#include <array>
+#include <cctype>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace {
+
+struct mime_entry {
+    std::string_view extension;
+    std::string_view type;
+};
+
+// Built-in extension table, based on the mime.types shipped with nginx plus
+// common web, document, source and media formats.
+constexpr std::array<mime_entry, 249> builtin_types = {{
+    // Text
+    {"html", "text/html"}, {"htm", "text/html"}, {"shtml", "text/html"},
+    {"css", "text/css"},
+    {"xml", "text/xml"},
+    {"mml", "text/mathml"},
+    {"txt", "text/plain"}, {"text", "text/plain"}, {"conf", "text/plain"}, {"log", "text/plain"},
+    {"jad", "text/vnd.sun.j2me.app-descriptor"},
+    {"wml", "text/vnd.wap.wml"},
+    {"htc", "text/x-component"},
+    {"md", "text/markdown"}, {"markdown", "text/markdown"},
+    {"csv", "text/csv"},
+    {"tsv", "text/tab-separated-values"},
+    {"ics", "text/calendar"},
+    {"vcf", "text/vcard"},
+    {"vtt", "text/vtt"},
+    {"mjs", "text/javascript"},
+    {"py", "text/x-python"},
+    {"c", "text/x-c"}, {"h", "text/x-c"},
+    {"cc", "text/x-c++src"}, {"cpp", "text/x-c++src"}, {"cxx", "text/x-c++src"},
+    {"hh", "text/x-c++hdr"}, {"hpp", "text/x-c++hdr"}, {"hxx", "text/x-c++hdr"},
+    {"java", "text/x-java"},
+    {"rb", "text/x-ruby"},
+    {"diff", "text/x-diff"}, {"patch", "text/x-diff"},
+    {"rst", "text/x-rst"},
+    {"sgml", "text/sgml"}, {"sgm", "text/sgml"},
+
+    // Images
+    {"gif", "image/gif"},
+    {"jpeg", "image/jpeg"}, {"jpg", "image/jpeg"}, {"jpe", "image/jpeg"},
+    {"avif", "image/avif"},
+    {"png", "image/png"},
+    {"apng", "image/apng"},
+    {"svg", "image/svg+xml"}, {"svgz", "image/svg+xml"},
+    {"tif", "image/tiff"}, {"tiff", "image/tiff"},
+    {"wbmp", "image/vnd.wap.wbmp"},
+    {"webp", "image/webp"},
+    {"ico", "image/x-icon"},
+    {"cur", "image/x-icon"},
+    {"jng", "image/x-jng"},
+    {"bmp", "image/x-ms-bmp"},
+    {"heic", "image/heic"},
+    {"heif", "image/heif"},
+    {"jxl", "image/jxl"},
+    {"jp2", "image/jp2"},
+    {"psd", "image/vnd.adobe.photoshop"},
+    {"ppm", "image/x-portable-pixmap"},
+    {"pgm", "image/x-portable-graymap"},
+    {"pbm", "image/x-portable-bitmap"},
+    {"pnm", "image/x-portable-anymap"},
+    {"xbm", "image/x-xbitmap"},
+    {"xpm", "image/x-xpixmap"},
+    {"xwd", "image/x-xwindowdump"},
+    {"tga", "image/x-tga"},
+    {"pcx", "image/x-pcx"},
+    {"ras", "image/x-cmu-raster"},
+    {"rgb", "image/x-rgb"},
+
+    // Fonts
+    {"woff", "font/woff"},
+    {"woff2", "font/woff2"},
+    {"ttf", "font/ttf"},
+    {"otf", "font/otf"},
+    {"ttc", "font/collection"},
+    {"eot", "application/vnd.ms-fontobject"},
+
+    // Applications
+    {"js", "application/javascript"},
+    {"atom", "application/atom+xml"},
+    {"rss", "application/rss+xml"},
+    {"jar", "application/java-archive"}, {"war", "application/java-archive"}, {"ear", "application/java-archive"},
+    {"json", "application/json"},
+    {"map", "application/json"},
+    {"jsonld", "application/ld+json"},
+    {"geojson", "application/geo+json"},
+    {"webmanifest", "application/manifest+json"},
+    {"ndjson", "application/x-ndjson"},
+    {"ipynb", "application/x-ipynb+json"},
+    {"yaml", "application/yaml"}, {"yml", "application/yaml"},
+    {"toml", "application/toml"},
+    {"hqx", "application/mac-binhex40"},
+    {"doc", "application/msword"}, {"dot", "application/msword"},
+    {"pdf", "application/pdf"},
+    {"ps", "application/postscript"}, {"eps", "application/postscript"}, {"ai", "application/postscript"},
+    {"rtf", "application/rtf"},
+    {"m3u8", "application/vnd.apple.mpegurl"},
+    {"kml", "application/vnd.google-earth.kml+xml"},
+    {"kmz", "application/vnd.google-earth.kmz"},
+    {"gpx", "application/gpx+xml"},
+    {"xls", "application/vnd.ms-excel"}, {"xlt", "application/vnd.ms-excel"},
+    {"ppt", "application/vnd.ms-powerpoint"}, {"pps", "application/vnd.ms-powerpoint"},
+    {"mpp", "application/vnd.ms-project"},
+    {"msg", "application/vnd.ms-outlook"},
+    {"vsd", "application/vnd.visio"},
+    {"odg", "application/vnd.oasis.opendocument.graphics"},
+    {"odp", "application/vnd.oasis.opendocument.presentation"},
+    {"ods", "application/vnd.oasis.opendocument.spreadsheet"},
+    {"odt", "application/vnd.oasis.opendocument.text"},
+    {"odf", "application/vnd.oasis.opendocument.formula"},
+    {"pptx", "application/vnd.openxmlformats-officedocument.presentationml.presentation"},
+    {"ppsx", "application/vnd.openxmlformats-officedocument.presentationml.slideshow"},
+    {"potx", "application/vnd.openxmlformats-officedocument.presentationml.template"},
+    {"xlsx", "application/vnd.openxmlformats-officedocument.spreadsheetml.sheet"},
+    {"xltx", "application/vnd.openxmlformats-officedocument.spreadsheetml.template"},
+    {"docx", "application/vnd.openxmlformats-officedocument.wordprocessingml.document"},
+    {"dotx", "application/vnd.openxmlformats-officedocument.wordprocessingml.template"},
+    {"docm", "application/vnd.ms-word.document.macroenabled.12"},
+    {"xlsm", "application/vnd.ms-excel.sheet.macroenabled.12"},
+    {"pptm", "application/vnd.ms-powerpoint.presentation.macroenabled.12"},
+    {"wmlc", "application/vnd.wap.wmlc"},
+    {"wasm", "application/wasm"},
+    {"epub", "application/epub+zip"},
+    {"azw", "application/vnd.amazon.ebook"},
+    {"apk", "application/vnd.android.package-archive"},
+    {"mpkg", "application/vnd.apple.installer+xml"},
+    {"xul", "application/vnd.mozilla.xul+xml"},
+    {"mvt", "application/vnd.mapbox-vector-tile"},
+    {"sqlite", "application/vnd.sqlite3"}, {"sqlite3", "application/vnd.sqlite3"},
+    {"7z", "application/x-7z-compressed"},
+    {"cco", "application/x-cocoa"},
+    {"jardiff", "application/x-java-archive-diff"},
+    {"jnlp", "application/x-java-jnlp-file"},
+    {"run", "application/x-makeself"},
+    {"pl", "application/x-perl"}, {"pm", "application/x-perl"},
+    {"prc", "application/x-pilot"}, {"pdb", "application/x-pilot"},
+    {"rar", "application/x-rar-compressed"},
+    {"rpm", "application/x-redhat-package-manager"},
+    {"sea", "application/x-sea"},
+    {"swf", "application/x-shockwave-flash"},
+    {"sit", "application/x-stuffit"},
+    {"tcl", "application/x-tcl"}, {"tk", "application/x-tcl"},
+    {"der", "application/x-x509-ca-cert"}, {"pem", "application/x-x509-ca-cert"}, {"crt", "application/x-x509-ca-cert"},
+    {"p12", "application/x-pkcs12"}, {"pfx", "application/x-pkcs12"},
+    {"asc", "application/pgp-signature"},
+    {"xpi", "application/x-xpinstall"},
+    {"xhtml", "application/xhtml+xml"}, {"xht", "application/xhtml+xml"},
+    {"xspf", "application/xspf+xml"},
+    {"xsl", "application/xslt+xml"}, {"xslt", "application/xslt+xml"},
+    {"rdf", "application/rdf+xml"},
+    {"smil", "application/smil+xml"}, {"smi", "application/smil+xml"},
+    {"mathml", "application/mathml+xml"},
+    {"zip", "application/zip"},
+    {"gz", "application/gzip"}, {"tgz", "application/gzip"},
+    {"bz2", "application/x-bzip2"},
+    {"xz", "application/x-xz"},
+    {"zst", "application/zstd"},
+    {"tar", "application/x-tar"},
+    {"cpio", "application/x-cpio"},
+    {"shar", "application/x-shar"},
+    {"lzh", "application/x-lzh-compressed"}, {"lha", "application/x-lzh-compressed"},
+    {"ace", "application/x-ace-compressed"},
+    {"arc", "application/x-freearc"},
+    {"sh", "application/x-sh"},
+    {"csh", "application/x-csh"},
+    {"php", "application/x-httpd-php"},
+    {"sql", "application/sql"},
+    {"latex", "application/x-latex"},
+    {"tex", "application/x-tex"},
+    {"dvi", "application/x-dvi"},
+    {"man", "application/x-troff-man"},
+    {"abw", "application/x-abiword"},
+    {"mdb", "application/x-msaccess"},
+    {"pub", "application/x-mspublisher"},
+    {"torrent", "application/x-bittorrent"},
+    {"srt", "application/x-subrip"},
+    {"hdf", "application/x-hdf"},
+    {"nc", "application/netcdf"},
+    {"cbor", "application/cbor"},
+    {"ogx", "application/ogg"},
+    {"rm", "application/vnd.rn-realmedia"},
+    {"bin", "application/octet-stream"}, {"exe", "application/octet-stream"}, {"dll", "application/octet-stream"},
+    {"deb", "application/octet-stream"},
+    {"dmg", "application/octet-stream"},
+    {"iso", "application/octet-stream"}, {"img", "application/octet-stream"},
+    {"msi", "application/octet-stream"}, {"msp", "application/octet-stream"}, {"msm", "application/octet-stream"},
+
+    // Audio
+    {"mid", "audio/midi"}, {"midi", "audio/midi"}, {"kar", "audio/midi"},
+    {"mp3", "audio/mpeg"},
+    {"ogg", "audio/ogg"}, {"oga", "audio/ogg"},
+    {"opus", "audio/opus"},
+    {"m4a", "audio/x-m4a"},
+    {"ra", "audio/x-realaudio"},
+    {"wav", "audio/wav"},
+    {"flac", "audio/flac"},
+    {"aac", "audio/aac"},
+    {"weba", "audio/webm"},
+    {"aif", "audio/x-aiff"}, {"aiff", "audio/x-aiff"},
+    {"wma", "audio/x-ms-wma"},
+    {"amr", "audio/amr"},
+    {"m3u", "audio/x-mpegurl"},
+    {"pls", "audio/x-scpls"},
+
+    // Video
+    {"3gpp", "video/3gpp"}, {"3gp", "video/3gpp"},
+    {"ts", "video/mp2t"},
+    {"mp4", "video/mp4"},
+    {"mpeg", "video/mpeg"}, {"mpg", "video/mpeg"},
+    {"mov", "video/quicktime"},
+    {"webm", "video/webm"},
+    {"flv", "video/x-flv"},
+    {"m4v", "video/x-m4v"},
+    {"mng", "video/x-mng"},
+    {"asx", "video/x-ms-asf"}, {"asf", "video/x-ms-asf"},
+    {"wmv", "video/x-ms-wmv"},
+    {"avi", "video/x-msvideo"},
+    {"ogv", "video/ogg"},
+    {"mkv", "video/x-matroska"},
+
+    // 3D models
+    {"gltf", "model/gltf+json"},
+    {"glb", "model/gltf-binary"},
+    {"stl", "model/stl"},
+    {"obj", "model/obj"},
+}};
+
+constexpr char to_lower(char c) {
+    return (c >= 'A' && c <= 'Z') ? static_cast<char>(c - 'A' + 'a') : c;
+}
+
+}  // namespace
+
+mime_types::mime_types() {
+    load_builtin();
+}
+
+mime_types* mime_types::get_global_table() {
+    static mime_types table;
+    return &table;
+}
+
+size_t mime_types::builtin_size() {
+    return builtin_types.size();
+}
+
+// FNV-1a over the lowercased extension.
+std::uint64_t mime_types::hash(std::string_view extension) {
+    std::uint64_t h = 14695981039346656037ULL;
+    for (char c : extension) {
+        h ^= static_cast<unsigned char>(to_lower(c));
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+bool mime_types::equals(std::string_view lowercase, std::string_view extension) {
+    if (lowercase.size() != extension.size()) {
+        return false;
+    }
+    for (size_t i = 0; i < extension.size(); i++) {
+        if (lowercase[i] != to_lower(extension[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+std::string_view mime_types::lookup(std::string_view extension) const {
+    if (extension.empty() || slots_.empty()) {
+        return default_type_;
+    }
+    size_t mask = slots_.size() - 1;
+    for (size_t i = hash(extension) & mask; !slots_[i].extension.empty(); i = (i + 1) & mask) {
+        if (equals(slots_[i].extension, extension)) {
+            return slots_[i].type;
+        }
+    }
+    return default_type_;
+}
+
+void mime_types::add(std::string_view type, std::string_view extension) {
+    if (extension.empty()) {
+        return;
+    }
+    // Keep the load factor at or below one half so probe chains stay short.
+    if ((size_ + 1) * 2 > slots_.size()) {
+        rehash(slots_.empty() ? 64 : slots_.size() * 2);
+    }
+    size_t mask = slots_.size() - 1;
+    size_t i = hash(extension) & mask;
+    for (; !slots_[i].extension.empty(); i = (i + 1) & mask) {
+        if (equals(slots_[i].extension, extension)) {
+            slots_[i].type = std::string(type);
+            return;
+        }
+    }
+    slots_[i].extension.resize(extension.size());
+    for (size_t j = 0; j < extension.size(); j++) {
+        slots_[i].extension[j] = to_lower(extension[j]);
+    }
+    slots_[i].type = std::string(type);
+    size_++;
+}
+
+void mime_types::rehash(size_t capacity) {
+    std::vector<slot> old = std::move(slots_);
+    slots_.assign(capacity, slot());
+    size_t mask = capacity - 1;
+    for (auto& entry : old) {
+        if (entry.extension.empty()) {
+            continue;
+        }
+        size_t i = hash(entry.extension) & mask;
+        while (!slots_[i].extension.empty()) {
+            i = (i + 1) & mask;
+        }
+        slots_[i] = std::move(entry);
+    }
+}
+
+void mime_types::clear() {
+    slots_.clear();
+    size_ = 0;
+}
+
+size_t mime_types::size() const {
+    return size_;
+}
+
+const std::string& mime_types::default_type() const {
+    return default_type_;
+}
+
+void mime_types::set_default_type(std::string_view type) {
+    default_type_ = std::string(type);
+}
+
+void mime_types::load_builtin() {
+    rehash(512);
+    for (const auto& entry : builtin_types) {
+        add(entry.type, entry.extension);
+    }
+}
+
+bool mime_types::load_config(NginxConfig& config) {
+    bool replaced = false;
+    for (const auto& statement : config.statements_) {
+        if (statement->tokens_.empty()) {
+            continue;
+        }
+        const std::string& directive = statement->tokens_[0];
+        if (directive == "types" && statement->child_block_) {
+            if (!replaced) {
+                clear();
+                replaced = true;
+            }
+            for (const auto& type_statement : statement->child_block_->statements_) {
+                for (size_t i = 1; i < type_statement->tokens_.size(); i++) {
+                    add(type_statement->tokens_[0], type_statement->tokens_[i]);
+                }
+            }
+        } else if (directive == "types_file" && statement->tokens_.size() > 1) {
+            if (!replaced) {
+                clear();
+                replaced = true;
+            }
+            if (!load_file(statement->tokens_[1])) {
+                return false;
+            }
+        } else if (directive == "default_type" && statement->tokens_.size() > 1) {
+            set_default_type(statement->tokens_[1]);
+        }
+    }
+    return true;
+}
+
+bool mime_types::load_file(const std::string& path) {
+    std::ifstream file(path);
+    if (!file.is_open()) {
+        return false;
+    }
+    std::stringstream buffer;
+    buffer << file.rdbuf();
+    std::string contents = buffer.str();
+
+    // nginx format: reuse the config parser and read the types block.
+    if (contents.find('{') != std::string::npos) {
+        NginxConfigParser parser;
+        NginxConfig config;
+        std::istringstream input(contents);
+        if (!parser.Parse(&input, &config)) {
+            return false;
+        }
+        NginxConfig* types = config.GetBlock("types");
+        if (types == nullptr) {
+            return false;
+        }
+        for (const auto& statement : types->statements_) {
+            for (size_t i = 1; i < statement->tokens_.size(); i++) {
+                add(statement->tokens_[0], statement->tokens_[i]);
+            }
+        }
+        return true;
+    }
+
+    // Apache/Debian format: "type ext ext ..." per line, '#' comments.
+    std::istringstream lines(contents);
+    std::string line;
+    while (std::getline(lines, line)) {
+        size_t comment = line.find('#');
+        if (comment != std::string::npos) {
+            line.erase(comment);
+        }
+        std::istringstream words(line);
+        std::string type;
+        std::string extension;
+        if (!(words >> type)) {
+            continue;
+        }
+        while (words >> extension) {
+            add(type, extension);
+        }
+    }
+    return true;
+}
@@ -5,7 +5,7 @@
 #include "notfound_handler.h"
 namespace http = boost::beast::http;
 
-std::unique_ptr<request_handler> notfound_handler::init(std::string root) {
+std::unique_ptr<request_handler> notfound_handler::init(const HandlerConfig& config) {
     return std::make_unique<notfound_handler>();
 }
 
@@ -0,0 +1,228 @@
+#include "open_file_cache.h"
+#include "config_parser.h"
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <string>
+#include <memory>
+
+namespace {
+
+std::int64_t mtime_ns(const struct stat& st) {
+    return static_cast<std::int64_t>(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+}
+
+bool same_file(const open_file& file, const struct stat& st) {
+    return file.device == st.st_dev && file.inode == st.st_ino &&
+           file.size == static_cast<std::uintmax_t>(st.st_size) && file.mtime == mtime_ns(st);
+}
+
+}  // namespace
+
+open_file::~open_file() {
+    if (fd >= 0) {
+        ::close(fd);
+    }
+}
+
+bool open_file::read(std::string& content) const {
+    if (fd < 0) {
+        return false;
+    }
+    content.resize(size);
+    size_t offset = 0;
+    while (offset < size) {
+        ssize_t n = ::pread(fd, &content[offset], size - offset, offset);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            content.resize(offset);
+            return false;
+        }
+        offset += n;
+    }
+    return true;
+}
+
+open_file_cache::open_file_cache() {}
+
+open_file_cache* open_file_cache::get_global_cache() {
+    static open_file_cache cache;
+    return &cache;
+}
+
+std::shared_ptr<const open_file> open_file_cache::open_uncached(const std::string& path) {
+    auto file = std::make_shared<open_file>();
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        file->error = errno;
+        return file;
+    }
+    struct stat st;
+    if (::fstat(fd, &st) != 0) {
+        file->error = errno;
+        ::close(fd);
+        return file;
+    }
+    file->exists = true;
+    file->is_directory = S_ISDIR(st.st_mode);
+    file->size = st.st_size;
+    file->mtime = mtime_ns(st);
+    file->device = st.st_dev;
+    file->inode = st.st_ino;
+    if (file->is_directory) {
+        // Directories are never served, so don't hold a descriptor for them.
+        ::close(fd);
+    } else {
+        file->fd = fd;
+    }
+    return file;
+}
+
+std::shared_ptr<const open_file> open_file_cache::open(const std::string& path) {
+    bool enabled;
+    std::shared_ptr<const open_file> previous;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        enabled = max_ > 0;
+        auto it = entries_.find(path);
+        if (enabled && it != entries_.end()) {
+            entry& cached = it->second;
+            clock::time_point now = clock::now();
+            if (now - cached.validated < valid_) {
+                hits_++;
+                cached.last_used = now;
+                lru_.splice(lru_.begin(), lru_, cached.lru);
+                return cached.file;
+            }
+            previous = cached.file;
+        }
+    }
+    if (!enabled) {
+        misses_++;
+        return open_uncached(path);
+    }
+
+    // Miss or stale entry: touch the filesystem without holding the lock.
+    std::shared_ptr<const open_file> file;
+    struct stat st;
+    if (previous && previous->exists && !previous->is_directory &&
+        ::stat(path.c_str(), &st) == 0 && same_file(*previous, st)) {
+        // Unchanged since it was opened; keep the descriptor.
+        hits_++;
+        file = previous;
+    } else {
+        misses_++;
+        file = open_uncached(path);
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (max_ == 0 || (!file->exists && !cache_errors_)) {
+        auto it = entries_.find(path);
+        if (it != entries_.end()) {
+            lru_.erase(it->second.lru);
+            entries_.erase(it);
+        }
+        return file;
+    }
+    clock::time_point now = clock::now();
+    auto it = entries_.find(path);
+    if (it != entries_.end()) {
+        it->second.file = file;
+        it->second.validated = now;
+        it->second.last_used = now;
+        lru_.splice(lru_.begin(), lru_, it->second.lru);
+        return file;
+    }
+    evict(now);
+    lru_.push_front(path);
+    entries_.emplace(path, entry{file, now, now, lru_.begin()});
+    return file;
+}
+
+// Drops entries unused for longer than inactive_, then the least recently
+// used ones until there is room for one more. Caller holds mutex_.
+void open_file_cache::evict(clock::time_point now) {
+    while (!lru_.empty()) {
+        auto it = entries_.find(lru_.back());
+        if (entries_.size() < max_ && now - it->second.last_used < inactive_) {
+            break;
+        }
+        entries_.erase(it);
+        lru_.pop_back();
+    }
+}
+
+void open_file_cache::configure(size_t max, std::chrono::milliseconds inactive, std::chrono::milliseconds valid, bool cache_errors) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    max_ = max;
+    inactive_ = inactive;
+    valid_ = valid;
+    cache_errors_ = cache_errors;
+    entries_.clear();
+    lru_.clear();
+}
+
+bool open_file_cache::load_config(NginxConfig& config) {
+    size_t max = 0;
+    std::chrono::milliseconds inactive = std::chrono::seconds(60);
+    std::chrono::milliseconds valid = std::chrono::seconds(60);
+    bool cache_errors = true;
+    for (const auto& statement : config.statements_) {
+        const auto& tokens = statement->tokens_;
+        if (tokens.size() < 2) {
+            continue;
+        }
+        if (tokens[0] == "open_file_cache") {
+            if (tokens[1] == "off") {
+                max = 0;
+                continue;
+            }
+            for (size_t i = 1; i < tokens.size(); i++) {
+                if (tokens[i].rfind("max=", 0) == 0) {
+                    if (!ParseConfigSize(tokens[i].substr(4), &max)) {
+                        return false;
+                    }
+                } else if (tokens[i].rfind("inactive=", 0) == 0) {
+                    if (!ParseConfigDuration(tokens[i].substr(9), &inactive)) {
+                        return false;
+                    }
+                } else {
+                    return false;
+                }
+            }
+        } else if (tokens[0] == "open_file_cache_valid") {
+            if (!ParseConfigDuration(tokens[1], &valid)) {
+                return false;
+            }
+        } else if (tokens[0] == "open_file_cache_errors") {
+            if (tokens[1] != "on" && tokens[1] != "off") {
+                return false;
+            }
+            cache_errors = tokens[1] == "on";
+        }
+    }
+    configure(max, inactive, valid, cache_errors);
+    return true;
+}
+
+void open_file_cache::clear() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    entries_.clear();
+    lru_.clear();
+}
+
+size_t open_file_cache::size() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return entries_.size();
+}
+
+size_t open_file_cache::hits() const {
+    return hits_;
+}
+
+size_t open_file_cache::misses() const {
+    return misses_;
+}
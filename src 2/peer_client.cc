@@ -0,0 +1,123 @@
+#include "peer_client.h"
+#include <boost/asio/connect.hpp>
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/ip/tcp.hpp>
+#include <boost/beast/core/flat_buffer.hpp>
+#include <boost/beast/core/tcp_stream.hpp>
+
+struct peer_client::connection {
+    boost::asio::io_context io;
+    boost::beast::tcp_stream stream{io};
+    boost::beast::flat_buffer buffer;
+
+    // Runs the operation started on io to completion.
+    void run() {
+        io.restart();
+        io.run();
+    }
+};
+
+peer_client::peer_client(std::chrono::seconds timeout, std::uint64_t body_limit, size_t max_idle)
+    : timeout_(timeout), body_limit_(body_limit), max_idle_(max_idle) {}
+
+peer_client::~peer_client() = default;
+
+bool peer_client::split_node(const std::string& node, std::string& host, std::string& port) {
+    size_t colon = node.rfind(':');
+    if (colon == std::string::npos || colon == 0 || colon + 1 == node.size() ||
+        node.find_first_not_of("0123456789", colon + 1) != std::string::npos || node.size() - colon > 6) {
+        return false;
+    }
+    host = node.substr(0, colon);
+    port = node.substr(colon + 1);
+    return std::stoul(port) > 0 && std::stoul(port) < 65536;
+}
+
+std::unique_ptr<peer_client::connection> peer_client::checkout(const std::string& node, bool& reused) {
+    {
+        std::lock_guard<std::mutex> lock(idle_mutex_);
+        auto& idle = idle_[node];
+        if (!idle.empty()) {
+            std::unique_ptr<connection> found = std::move(idle.back());
+            idle.pop_back();
+            reused = true;
+            return found;
+        }
+    }
+    reused = false;
+    std::string host, port;
+    if (!split_node(node, host, port)) {
+        return nullptr;
+    }
+    auto fresh = std::make_unique<connection>();
+    boost::beast::error_code ec;
+    boost::asio::ip::tcp::resolver resolver(fresh->io);
+    auto endpoints = resolver.resolve(host, port, ec);
+    if (ec) {
+        return nullptr;
+    }
+    fresh->stream.expires_after(timeout_);
+    fresh->stream.async_connect(endpoints, [&ec](const boost::beast::error_code& error, const boost::asio::ip::tcp::endpoint&) {
+        ec = error;
+    });
+    fresh->run();
+    if (ec) {
+        return nullptr;
+    }
+    fresh->stream.socket().set_option(boost::asio::ip::tcp::no_delay(true), ec);
+    return fresh;
+}
+
+void peer_client::checkin(const std::string& node, std::unique_ptr<connection> idle) {
+    std::lock_guard<std::mutex> lock(idle_mutex_);
+    auto& pool = idle_[node];
+    if (pool.size() < max_idle_) {
+        pool.push_back(std::move(idle));
+    }
+}
+
+bool peer_client::exchange(const std::string& node, http::request<http::string_body> request, http::response<http::string_body>& response) {
+    request.set(http::field::host, node);
+    request.keep_alive(true);
+    request.prepare_payload();
+    for (int attempt = 0; attempt < 2; attempt++) {
+        bool reused = false;
+        std::unique_ptr<connection> peer = checkout(node, reused);
+        if (!peer) {
+            return false;
+        }
+        boost::beast::error_code ec;
+        peer->stream.expires_after(timeout_);
+        http::async_write(peer->stream, request, [&ec](const boost::beast::error_code& error, size_t) { ec = error; });
+        peer->run();
+        http::response_parser<http::string_body> parser;
+        parser.body_limit(body_limit_);
+        if (!ec) {
+            peer->stream.expires_after(timeout_);
+            http::async_read_header(peer->stream, peer->buffer, parser, [&ec](const boost::beast::error_code& error, size_t) { ec = error; });
+            peer->run();
+        }
+        // The parser does not hold a Content-Length body that arrives along
+        // with its header to the limit, so the length is checked up front.
+        if (!ec && parser.content_length() && *parser.content_length() > body_limit_) {
+            ec = http::error::body_limit;
+        }
+        if (!ec && !parser.is_done()) {
+            peer->stream.expires_after(timeout_);
+            http::async_read(peer->stream, peer->buffer, parser, [&ec](const boost::beast::error_code& error, size_t) { ec = error; });
+            peer->run();
+        }
+        if (!ec) {
+            response = parser.release();
+            if (response.keep_alive()) {
+                checkin(node, std::move(peer));
+            }
+            return true;
+        }
+        // A response that is too large would be just as large again.
+        if (!reused || ec == http::error::body_limit) {
+            return false;
+        }
+    }
+    return false;
+}
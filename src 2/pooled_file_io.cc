@@ -0,0 +1,130 @@
+#include "pooled_file_io.h"
+#include <boost/asio/post.hpp>
+#include <cerrno>
+#include <filesystem>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+bool read_file(const std::string& path, std::string& content) {
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat st;
+    content.clear();
+    if (::fstat(fd, &st) == 0 && st.st_size > 0) {
+        content.reserve(st.st_size);
+    }
+    char buffer[65536];
+    ssize_t n;
+    while ((n = ::read(fd, buffer, sizeof(buffer))) != 0) {
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0) {
+            ::close(fd);
+            return false;
+        }
+        content.append(buffer, n);
+    }
+    ::close(fd);
+    return true;
+}
+
+bool write_all(int fd, const std::string& data) {
+    size_t written = 0;
+    while (written < data.size()) {
+        ssize_t n = ::write(fd, data.data() + written, data.size() - written);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        written += n;
+    }
+    return true;
+}
+
+}
+
+pooled_file_io::pooled_file_io(boost::asio::io_context& io, size_t threads)
+    : io_(io), pool_(std::max<size_t>(threads, 1)) {}
+
+pooled_file_io::~pooled_file_io() {
+    pool_.join();
+}
+
+void pooled_file_io::read(const std::string& path, read_completion done) {
+    boost::asio::post(pool_, [this, path, done]() {
+        auto content = std::make_shared<std::string>();
+        bool ok = read_file(path, *content);
+        boost::asio::post(io_, [done, ok, content]() { done(ok, std::move(*content)); });
+    });
+}
+
+void pooled_file_io::write(const std::string& path, std::string data, completion done) {
+    auto contents = std::make_shared<std::string>(std::move(data));
+    boost::asio::post(pool_, [this, path, contents, done]() {
+        std::string temporary = temporary_path(path);
+        int fd = ::open(temporary.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        bool ok = fd >= 0 && write_all(fd, *contents);
+        if (fd >= 0) {
+            ok = ::close(fd) == 0 && ok;
+        }
+        ok = ok && ::rename(temporary.c_str(), path.c_str()) == 0;
+        if (!ok && fd >= 0) {
+            ::unlink(temporary.c_str());
+        }
+        boost::asio::post(io_, [done, ok]() { done(ok); });
+    });
+}
+
+void pooled_file_io::fsync(const std::string& path, completion done) {
+    boost::asio::post(pool_, [this, path, done]() {
+        int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        bool ok = fd >= 0 && ::fsync(fd) == 0;
+        if (fd >= 0) {
+            ::close(fd);
+        }
+        boost::asio::post(io_, [done, ok]() { done(ok); });
+    });
+}
+
+void pooled_file_io::unlink(const std::string& path, completion done) {
+    boost::asio::post(pool_, [this, path, done]() {
+        bool ok = ::unlink(path.c_str()) == 0;
+        boost::asio::post(io_, [done, ok]() { done(ok); });
+    });
+}
+
+void pooled_file_io::mkdir(const std::string& path, completion done) {
+    boost::asio::post(pool_, [this, path, done]() {
+        std::error_code error;
+        std::filesystem::create_directories(path, error);
+        bool ok = !error && std::filesystem::is_directory(path, error);
+        boost::asio::post(io_, [done, ok]() { done(ok); });
+    });
+}
+
+void pooled_file_io::list(const std::string& path, list_completion done) {
+    boost::asio::post(pool_, [this, path, done]() {
+        auto names = std::make_shared<std::vector<std::string>>();
+        std::error_code error;
+        for (std::filesystem::directory_iterator it(path, error), end; !error && it != end; it.increment(error)) {
+            std::string name = it->path().filename().string();
+            if (it->is_regular_file(error) && !is_temporary(name)) {
+                names->push_back(name);
+            }
+        }
+        bool ok = !error;
+        boost::asio::post(io_, [done, ok, names]() { done(ok, std::move(*names)); });
+    });
+}
+
+const char* pooled_file_io::backend() const {
+    return "threads";
+}
@@ -0,0 +1,264 @@
+#include "replication_follower.h"
+#include "logger.h"
+#include <charconv>
+#include <filesystem>
+#include <set>
+
+namespace {
+
+std::mutex shared_mutex;
+
+// Made after the logger, so at exit the followers stop before logging is
+// torn down.
+std::map<std::string, std::shared_ptr<replication_follower>>& shared_followers() {
+    Logger::get_global_log();
+    static std::map<std::string, std::shared_ptr<replication_follower>> followers;
+    return followers;
+}
+
+// How soon a failed copy or poll is tried again.
+const std::chrono::seconds retry_pause(1);
+
+bool parse_sequence(boost::beast::string_view text, std::uint64_t& sequence) {
+    return !text.empty() && std::from_chars(text.data(), text.data() + text.size(), sequence).ptr == text.data() + text.size();
+}
+
+}
+
+replication_follower::replication_follower(const std::string& leader, const std::string& root, std::chrono::seconds max_lag)
+    : leader_(leader), root_(root), max_lag_(max_lag), client_(leader_timeout, max_response_size, 1) {}
+
+replication_follower::~replication_follower() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    wake_.notify_all();
+    if (following_.joinable()) {
+        following_.join();
+    }
+}
+
+std::uint64_t replication_follower::sequence() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return sequence_;
+}
+
+std::chrono::milliseconds replication_follower::lag() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!caught_up_) {
+        return std::chrono::milliseconds::max();
+    }
+    return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - caught_up_at_);
+}
+
+bool replication_follower::current() {
+    return lag() <= max_lag_;
+}
+
+void replication_follower::start(apply write) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (following_.joinable()) {
+        return;
+    }
+    write_ = std::move(write);
+    following_ = std::thread(&replication_follower::follow_loop, this);
+}
+
+bool replication_follower::pause(std::chrono::milliseconds period) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    return !wake_.wait_for(lock, period, [this]() { return stopping_; });
+}
+
+void replication_follower::follow_loop() {
+    Logger* logger = Logger::get_global_log();
+    bool failing = false;
+    while (pause(std::chrono::milliseconds(0))) {
+        bool synced;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            synced = synced_;
+        }
+        bool done = synced ? poll() : copy();
+        if (done) {
+            if (failing) {
+                logger->logInfo("Following " + leader_ + " again for " + root_);
+            }
+            failing = false;
+            continue;
+        }
+        if (!failing) {
+            logger->logError("ERROR: Unable to follow " + leader_ + " for " + root_ + ", retrying");
+        }
+        failing = true;
+        if (!pause(retry_pause)) {
+            return;
+        }
+    }
+}
+
+bool replication_follower::copy() {
+    // The copy comes a page at a time. Writes made while it does are in the
+    // leader's log after the first page's sequence.
+    std::uint64_t sequence = 0;
+    std::set<std::string> copied;
+    size_t pages = 0;
+    std::string cursor;  // percent-encoded, as the leader sent it
+    while (true) {
+        if (!pause(std::chrono::milliseconds(0))) {
+            return false;
+        }
+        http::response<http::string_body> response;
+        std::vector<replication_log::entry> entries;
+        std::uint64_t page_sequence;
+        if (!fetch("/api/_replication?snapshot&limit=" + std::to_string(batch_size) + (cursor.empty() ? "" : "&cursor=" + cursor), response)) {
+            return false;
+        }
+        if (response.result() == http::status::service_unavailable) {
+            // The leader is busy; ask for the same page again.
+            if (!pause(retry_pause)) {
+                return false;
+            }
+            continue;
+        }
+        if (response.result() != http::status::ok || !parse_sequence(response["X-Replication-Seq"], page_sequence) ||
+            !replication_log::parse(response.body(), entries)) {
+            return false;
+        }
+        if (pages++ == 0) {
+            sequence = page_sequence;
+        }
+        for (const auto& written : entries) {
+            if (!write_(written)) {
+                return false;
+            }
+            copied.insert(written.key);
+        }
+        if (response["X-Replication-More"] != "true") {
+            break;
+        }
+        cursor = std::string(response["X-Replication-Cursor"]);
+        if (cursor.empty()) {
+            return false;
+        }
+    }
+    // Whatever else is stored here was deleted on the leader while this
+    // follower was not following it. Hidden files and directories are not
+    // entities, nor are files directly under the root.
+    std::error_code error;
+    std::filesystem::path root(root_);
+    std::vector<std::string> stale;
+    for (std::filesystem::recursive_directory_iterator it(root, error), end; !error && it != end; it.increment(error)) {
+        std::string name = it->path().filename().string();
+        if (!name.empty() && name[0] == '.') {
+            if (it->is_directory(error)) {
+                it.disable_recursion_pending();
+            }
+            continue;
+        }
+        std::string key = it->path().lexically_relative(root).generic_string();
+        if (it.depth() > 0 && it->is_regular_file(error) && !copied.count(key)) {
+            stale.push_back(key);
+        }
+    }
+    for (const auto& key : stale) {
+        if (!write_(replication_log::entry{sequence, key, "", true})) {
+            return false;
+        }
+    }
+    Logger::get_global_log()->logInfo("Copied " + std::to_string(copied.size()) + " entities from " + leader_ + " to " + root_ +
+                                      " in " + std::to_string(pages) + " pages");
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    sequence_ = sequence;
+    synced_ = true;
+    return true;
+}
+
+bool replication_follower::poll() {
+    std::uint64_t since = sequence();
+    http::response<http::string_body> response;
+    if (!fetch("/api/_replication?since=" + std::to_string(since) + "&limit=" + std::to_string(batch_size) +
+               "&wait=" + std::to_string(poll_wait.count()), response)) {
+        return false;
+    }
+    auto answered = std::chrono::steady_clock::now();
+    if (response.result() == http::status::gone) {
+        // The leader restarted, or this follower fell too far behind.
+        Logger::get_global_log()->logInfo("Writes after " + std::to_string(since) + " are gone from " + leader_ + ", copying " + root_ + " again");
+        std::lock_guard<std::mutex> lock(mutex_);
+        synced_ = false;
+        caught_up_ = false;
+        return true;
+    }
+    std::vector<replication_log::entry> entries;
+    std::uint64_t next;
+    if (response.result() != http::status::ok || !parse_sequence(response["X-Replication-Seq"], next) ||
+        !replication_log::parse(response.body(), entries)) {
+        return false;
+    }
+    for (const auto& written : entries) {
+        if (!write_(written)) {
+            return false;
+        }
+        std::lock_guard<std::mutex> lock(mutex_);
+        sequence_ = written.sequence;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    sequence_ = std::max(sequence_, next);
+    if (response["X-Replication-More"] != "true") {
+        // The response had everything the leader had when it answered.
+        caught_up_ = true;
+        caught_up_at_ = answered;
+    }
+    return true;
+}
+
+bool replication_follower::fetch(const std::string& target, http::response<http::string_body>& response) {
+    return client_.exchange(leader_, http::request<http::string_body>{http::verb::get, target, 11}, response);
+}
+
+bool replication_follower::load_config(const std::vector<HandlerConfig>& handlers) {
+    for (const auto& handler : handlers) {
+        if (handler.name != "crud_handler") {
+            continue;
+        }
+        auto role = handler.directives.find("replication");
+        auto max_lag = handler.directives.find("replication_max_lag");
+        unsigned long lag = default_max_lag;
+        if (max_lag != handler.directives.end()) {
+            const std::vector<std::string>& value = max_lag->second;
+            if (value.size() != 1 || value[0].empty() || value[0].size() > 9 ||
+                value[0].find_first_not_of("0123456789") != std::string::npos || (lag = std::stoul(value[0])) == 0) {
+                return false;
+            }
+        }
+        if (role == handler.directives.end()) {
+            continue;
+        }
+        // Copies are made from the entity files under the root.
+        auto storage = handler.directives.find("storage");
+        if (storage != handler.directives.end() && storage->second == std::vector<std::string>{"log"}) {
+            return false;
+        }
+        if (role->second == std::vector<std::string>{"leader"}) {
+            continue;
+        }
+        std::string host, port;
+        if (role->second.size() != 2 || role->second[0] != "follower" || !peer_client::split_node(role->second[1], host, port)) {
+            return false;
+        }
+        std::lock_guard<std::mutex> lock(shared_mutex);
+        if (!shared_followers().count(handler.root)) {
+            shared_followers()[handler.root] = std::make_shared<replication_follower>(role->second[1], handler.root, std::chrono::seconds(lag));
+        }
+    }
+    return true;
+}
+
+std::shared_ptr<replication_follower> replication_follower::get_shared(const std::string& root) {
+    std::lock_guard<std::mutex> lock(shared_mutex);
+    auto found = shared_followers().find(root);
+    return found != shared_followers().end() ? found->second : nullptr;
+}
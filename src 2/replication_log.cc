@@ -0,0 +1,174 @@
+#include "replication_log.h"
+#include <algorithm>
+#include <charconv>
+#include <map>
+
+replication_log::replication_log(size_t max_bytes, size_t max_watchers)
+    : max_bytes_(max_bytes), max_watchers_(max_watchers) {
+    start_ = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+    next_sequence_ = start_ + 1;
+}
+
+replication_log::~replication_log() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    wake_.notify_all();
+    if (deadlines_.joinable()) {
+        deadlines_.join();
+    }
+}
+
+void replication_log::record(const std::string& key, const std::string& data, bool deleted) {
+    std::list<watcher> woken;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        std::uint64_t sequence = next_sequence_++;
+        entries_.push_back(entry{sequence, key, deleted ? "" : data, deleted});
+        bytes_ += key.size() + entries_.back().data.size();
+        // The newest write is kept even if it is larger than the whole log.
+        while (bytes_ > max_bytes_ && entries_.size() > 1) {
+            bytes_ -= entries_.front().key.size() + entries_.front().data.size();
+            start_ = entries_.front().sequence;
+            entries_.pop_front();
+        }
+        for (auto it = watchers_.begin(); it != watchers_.end();) {
+            auto next = std::next(it);
+            if (it->since < sequence) {
+                woken.splice(woken.end(), watchers_, it);
+            }
+            it = next;
+        }
+    }
+    for (auto& woke : woken) {
+        woke.notify();
+    }
+}
+
+bool replication_log::since(std::uint64_t since, size_t limit, std::vector<entry>& entries, std::uint64_t& next, bool& more) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    next = next_sequence_ - 1;
+    more = false;
+    if (since < start_) {
+        return false;
+    }
+    auto it = std::upper_bound(entries_.begin(), entries_.end(), since,
+                               [](std::uint64_t sequence, const entry& written) { return sequence < written.sequence; });
+    for (size_t taken = 0; it != entries_.end() && (limit == 0 || taken < limit); ++it, ++taken) {
+        entries.push_back(*it);
+    }
+    if (it != entries_.end()) {
+        next = entries.back().sequence;
+        more = true;
+    }
+    return true;
+}
+
+std::uint64_t replication_log::last_sequence() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return next_sequence_ - 1;
+}
+
+bool replication_log::watch(std::uint64_t since, std::chrono::steady_clock::time_point deadline, std::function<void()> notify) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (stopping_) {
+            return false;
+        }
+        // Checked under the lock record() takes, so no write can slip in
+        // between this check and registering the watcher.
+        if (next_sequence_ - 1 <= since && since >= start_) {
+            if (watchers_.size() >= max_watchers_) {
+                return false;
+            }
+            watchers_.push_back(watcher{since, deadline, std::move(notify)});
+            if (!deadlines_.joinable()) {
+                deadlines_ = std::thread(&replication_log::deadline_loop, this);
+            }
+            wake_.notify_one();
+            return true;
+        }
+    }
+    notify();
+    return true;
+}
+
+void replication_log::deadline_loop() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (!stopping_) {
+        if (watchers_.empty()) {
+            wake_.wait(lock);
+            continue;
+        }
+        auto earliest = std::min_element(watchers_.begin(), watchers_.end(),
+                                         [](const watcher& a, const watcher& b) { return a.deadline < b.deadline; })->deadline;
+        if (wake_.wait_until(lock, earliest) != std::cv_status::timeout) {
+            continue;
+        }
+        std::list<watcher> expired;
+        auto now = std::chrono::steady_clock::now();
+        for (auto it = watchers_.begin(); it != watchers_.end();) {
+            auto next = std::next(it);
+            if (it->deadline <= now) {
+                expired.splice(expired.end(), watchers_, it);
+            }
+            it = next;
+        }
+        lock.unlock();
+        for (auto& timed_out : expired) {
+            timed_out.notify();
+        }
+        lock.lock();
+    }
+}
+
+void replication_log::serialize(const entry& written, std::string& body) {
+    body += std::to_string(written.sequence);
+    body += written.deleted ? " -" : " " + std::to_string(written.data.size());
+    body += " " + written.key + "\n";
+    body += written.data;
+}
+
+bool replication_log::parse(const std::string& body, std::vector<entry>& entries) {
+    size_t pos = 0;
+    while (pos < body.size()) {
+        size_t end = body.find('\n', pos);
+        size_t first = body.find(' ', pos);
+        size_t second = first == std::string::npos ? first : body.find(' ', first + 1);
+        if (end == std::string::npos || second == std::string::npos || second >= end) {
+            return false;
+        }
+        entry read{0, body.substr(second + 1, end - second - 1), "", false};
+        if (std::from_chars(body.data() + pos, body.data() + first, read.sequence).ptr != body.data() + first ||
+            read.key.empty()) {
+            return false;
+        }
+        pos = end + 1;
+        if (body.compare(first + 1, second - first - 1, "-") == 0) {
+            read.deleted = true;
+        } else {
+            size_t length = 0;
+            if (std::from_chars(body.data() + first + 1, body.data() + second, length).ptr != body.data() + second ||
+                length > body.size() - pos) {
+                return false;
+            }
+            read.data = body.substr(pos, length);
+            pos += length;
+        }
+        entries.push_back(std::move(read));
+    }
+    return true;
+}
+
+std::shared_ptr<replication_log> replication_log::get_shared(const std::string& root) {
+    static std::mutex mutex;
+    static std::map<std::string, std::shared_ptr<replication_log>> logs;
+    std::lock_guard<std::mutex> lock(mutex);
+    std::shared_ptr<replication_log>& log = logs[root];
+    if (!log) {
+        log = std::make_shared<replication_log>();
+    }
+    return log;
+}
@@ -35,12 +35,12 @@ std::unique_ptr<request_handler> router::match(const std::string& path, std::str
   // Look for a handler with longest matching prefix
   int longest_match = 0;
   std::string handler_name = "";
-  std::string root = "";
+  const HandlerConfig* matched = nullptr;
   for (const auto& handler: handlers_) {
     if (path.find(handler.path) == 0 && handler.path.size() > longest_match) {
       longest_match = handler.path.size();
       handler_name = handler.name;
-      root = handler.root;
+      matched = &handler;
     }
   }
 
@@ -50,5 +50,5 @@ std::unique_ptr<request_handler> router::match(const std::string& path, std::str
     return nullptr;
   }
   log_handler_name = handler_name;
-  return factory(root);
+  return factory(*matched);
 }
@@ -16,6 +16,19 @@
 #include "server.h"
 #include "config_parser.h"
 #include "logger.h"
+#include "mime_types.h"
+#include "open_file_cache.h"
+#include "static_preloader.h"
+#include "asset_bundle.h"
+#include "log_file_io.h"
+#include "durable_file_io.h"
+#include "async_file_io.h"
+#include "caching_file_io.h"
+#include "compressed_file_io.h"
+#include "snapshot_file_io.h"
+#include "crud_handler.h"
+#include "shard_router.h"
+#include "replication_follower.h"
 
 using boost::asio::ip::tcp;
 
@@ -45,6 +58,18 @@ int main(int argc, char* argv[]) {
       return 1;
     }
 
+    if (!mime_types::get_global_table()->load_config(config)) {
+      std::cerr << "Unable to read types_file" << std::endl;
+      logger->logError("Unable to read types_file\n");
+      return 1;
+    }
+
+    if (!open_file_cache::get_global_cache()->load_config(config)) {
+      std::cerr << "Invalid open_file_cache configuration" << std::endl;
+      logger->logError("Invalid open_file_cache configuration\n");
+      return 1;
+    }
+
     std::vector<HandlerConfig> handlers = config.GetRequestHandlers();
     if (handlers.empty()) {
       std::cerr << "Please provide at least one handler, and ensure serving locations are unique" << std::endl;
@@ -53,7 +78,55 @@ int main(int argc, char* argv[]) {
     }
 
 
+    if (!asset_bundle::load_config(handlers)) {
+      std::cerr << "Unable to open asset bundle" << std::endl;
+      logger->logError("Unable to open asset bundle\n");
+      return 1;
+    }
+
+    if (!log_file_io::load_config(handlers) || !durable_file_io::load_config(handlers) ||
+        !compressed_file_io::load_config(handlers) || !caching_file_io::load_config(handlers) ||
+        !snapshot_file_io::load_config(handlers)) {
+      std::cerr << "Invalid storage configuration" << std::endl;
+      logger->logError("Invalid storage configuration\n");
+      return 1;
+    }
+
+    if (!shard_router::load_config(handlers)) {
+      std::cerr << "Invalid shard configuration" << std::endl;
+      logger->logError("Invalid shard configuration\n");
+      return 1;
+    }
+
+    if (!replication_follower::load_config(handlers)) {
+      std::cerr << "Invalid replication configuration" << std::endl;
+      logger->logError("Invalid replication configuration\n");
+      return 1;
+    }
+
+    // Starts reaping expired CRUD entities, including deadlines from before a restart.
+    if (!crud_handler::load_config(handlers)) {
+      std::cerr << "Invalid ttl directive" << std::endl;
+      logger->logError("Invalid ttl directive\n");
+      return 1;
+    }
+
+    // Warm-up runs in the background; /health reports 503 until it is done.
+    if (!static_preloader::start(handlers)) {
+      std::cerr << "Invalid preload directive" << std::endl;
+      logger->logError("Invalid preload directive\n");
+      return 1;
+    }
+
     boost::asio::io_service io_service;
+
+    // Completions of asynchronous file operations run on the io threads.
+    if (!async_file_io::load_config(handlers, io_service)) {
+      std::cerr << "Invalid async_io directive" << std::endl;
+      logger->logError("Invalid async_io directive\n");
+      return 1;
+    }
+
     server s(io_service, std::stoi(port), handlers);
 
     boost::asio::signal_set signals(io_service, SIGTERM, SIGINT);
@@ -79,6 +152,7 @@ int main(int argc, char* argv[]) {
 
     // Wait for all threads in the pool to exit
     threads.join_all();
+    async_file_io::set_shared(nullptr);
 
 
   } catch (std::exception& e) {
@@ -6,6 +6,7 @@
 #include <boost/bind.hpp>
 #include <boost/beast/http.hpp>
 #include <boost/lexical_cast.hpp>
+#include <cstdio>
 #include <iostream>
 #include <memory>
 #include <vector>
@@ -59,11 +60,29 @@ void session::handle_read(const boost::system::error_code& error, size_t bytes_t
 
     if (parser_->is_done()) {
       http::request<http::string_body> parsed = parser_->release();
-      std::string response = process_request(parsed);
-      write_response(error, response);
-
       // reset the parser
       parser_.emplace();
+
+      std::string log_handler_name = "";
+      std::unique_ptr<request_handler> handler = router_.match(std::string(parsed.target()), log_handler_name);
+      // An asynchronous handler answers later, from whichever thread has
+      // the response; the write is posted back to this socket's executor.
+      auto request = std::make_shared<http::request<http::string_body>>(std::move(parsed));
+      auto callback = [this, request, log_handler_name](http::response<http::string_body> response) {
+        logger->logResponseMetric(*request, response, log_handler_name, response_metric);
+        if (response.find(request_handler::spooled_body_header) != response.end()) {
+          write_spooled_response(std::move(response));
+          return;
+        }
+        std::string text = boost::lexical_cast<std::string>(response);
+        boost::asio::post(socket_.get_executor(), [this, text]() {
+          write_response(boost::system::error_code(), text);
+        });
+      };
+      if (handler != nullptr && handler->handle_request_async(*request, callback)) {
+        return;
+      }
+      write_response(error, respond(*request, handler.get(), log_handler_name));
     } else {
       logger->logDebug("Request not complete, continue reading");
       do_read();
@@ -75,15 +94,18 @@ void session::handle_read(const boost::system::error_code& error, size_t bytes_t
 }
 
 std::string session::process_request(http::request<http::string_body>& parsed) {
-  logger->logDebug("Processing the Request");
   std::string log_handler_name = "";
+  std::string path = std::string(parsed.target());
+  std::unique_ptr<request_handler> handler = router_.match(path, log_handler_name);
+  return respond(parsed, handler.get(), log_handler_name);
+}
+
+std::string session::respond(http::request<http::string_body>& parsed, request_handler* handler, const std::string& log_handler_name) {
+  logger->logDebug("Processing the Request");
 
   http::response<http::string_body> response;
   response.version(11);
 
-  std::string path = std::string(parsed.target());
-
-  std::unique_ptr<request_handler> handler = router_.match(path, log_handler_name);
   if (handler == nullptr) {
     response.result(http::status::internal_server_error);
     logger->logResponseMetric(parsed, response, log_handler_name, response_metric);
@@ -115,6 +137,36 @@ void session::write_response(const boost::system::error_code& error, std::string
   logger->logDebug("Response: " + response);
 }
 
+void session::write_spooled_response(http::response<http::string_body> response) {
+  std::string path = std::string(response[request_handler::spooled_body_header]);
+  auto spooled = std::make_shared<http::response<http::file_body>>(response.result(), response.version());
+  for (const auto& field : response) {
+    if (field.name_string() != request_handler::spooled_body_header && field.name() != http::field::content_length) {
+      spooled->set(field.name_string(), field.value());
+    }
+  }
+  boost::beast::error_code ec;
+  spooled->body().open(path.c_str(), boost::beast::file_mode::scan, ec);
+  // The open descriptor keeps the contents readable until the write ends.
+  std::remove(path.c_str());
+  if (ec) {
+    logger->logError("ERROR: Unable to open spooled response body " + path);
+    http::response<http::string_body> failed{http::status::internal_server_error, response.version()};
+    failed.prepare_payload();
+    std::string text = boost::lexical_cast<std::string>(failed);
+    boost::asio::post(socket_.get_executor(), [this, text]() {
+      write_response(boost::system::error_code(), text);
+    });
+    return;
+  }
+  spooled->prepare_payload();
+  boost::asio::post(socket_.get_executor(), [this, spooled]() {
+    http::async_write(socket_, *spooled, [this, spooled](const boost::system::error_code& error, size_t) {
+      handle_write(error);
+    });
+  });
+}
+
 void session::read_request(const boost::system::error_code& error) {
   socket_.async_read_some(boost::asio::buffer(data_, max_length),
         boost::bind(&session::handle_read, this,
@@ -0,0 +1,227 @@
+#include "shard_router.h"
+#include "logger.h"
+#include <boost/asio/post.hpp>
+#include <algorithm>
+#include <filesystem>
+
+namespace {
+
+std::mutex shared_mutex;
+std::map<std::string, std::shared_ptr<shard_router>> shared_routers;
+
+// Entities handed off before the pass pauses, and for how long.
+const size_t handoff_batch = 100;
+const std::chrono::milliseconds handoff_pause(10);
+// How soon a pass that could not move everything is tried again.
+const std::chrono::seconds handoff_retry(5);
+// How often peers are asked whether they have handed off.
+const std::chrono::seconds status_poll(1);
+
+}
+
+shard_router::shard_router(const std::string& self, const std::vector<std::string>& nodes, const std::string& root, size_t threads)
+    : self_(self), root_(root), peers_(peer_timeout, max_response_size, max_idle_connections),
+      forwarding_(std::max<size_t>(threads, 1)) {
+    for (const auto& node : nodes) {
+        ring_.add(node);
+    }
+    ring_.add(self);
+    handed_off_ = ring_.nodes().size() < 2;
+    taking_over_ = !handed_off_;
+}
+
+shard_router::~shard_router() {
+    {
+        std::lock_guard<std::mutex> lock(rebalance_mutex_);
+        stopping_ = true;
+    }
+    rebalance_wake_.notify_all();
+    if (rebalancing_.joinable()) {
+        rebalancing_.join();
+    }
+    forwarding_.join();
+}
+
+std::vector<std::string> shard_router::peers() const {
+    std::vector<std::string> others;
+    for (const auto& node : ring_.nodes()) {
+        if (node != self_) {
+            others.push_back(node);
+        }
+    }
+    return others;
+}
+
+std::string shard_router::owner(const std::string& key) const {
+    return ring_.owner(key);
+}
+
+std::string shard_router::previous_owner(const std::string& key) const {
+    return ring_.owner_without(key, self_);
+}
+
+bool shard_router::exchange(const std::string& node, http::request<http::string_body> request, http::response<http::string_body>& response) {
+    // Forwarded requests are PUT, PATCH, DELETE or GET, so the peer client
+    // may send one again.
+    request.set(forwarded_header, self_);
+    return peers_.exchange(node, std::move(request), response);
+}
+
+void shard_router::post(std::function<void()> task) {
+    boost::asio::post(forwarding_, std::move(task));
+}
+
+void shard_router::forward(const std::string& node, http::request<http::string_body> request, response_callback respond) {
+    post([this, node, request, respond]() {
+        http::response<http::string_body> response;
+        if (!exchange(node, request, response)) {
+            Logger::get_global_log()->logError("ERROR: Shard " + node + " is unavailable");
+            response = {};
+            response.version(11);
+            response.result(http::status::bad_gateway);
+            response.set(http::field::content_type, "text/plain");
+            response.body() = "Shard " + node + " is unavailable";
+            response.prepare_payload();
+        }
+        // The client's connection has its own keep-alive.
+        response.erase(http::field::connection);
+        respond(std::move(response));
+    });
+}
+
+void shard_router::start(handoff move) {
+    std::lock_guard<std::mutex> lock(rebalance_mutex_);
+    if (rebalancing_.joinable() || ring_.nodes().size() < 2) {
+        return;
+    }
+    move_ = std::move(move);
+    rebalancing_ = std::thread(&shard_router::rebalance_loop, this);
+}
+
+void shard_router::rebalance_loop() {
+    auto window_end = std::chrono::steady_clock::now() + takeover_window;
+    if (!hand_off_all()) {
+        return;
+    }
+    handed_off_ = true;
+    // Until every node has handed off, an entity missing here may still be
+    // on its previous owner.
+    std::unique_lock<std::mutex> lock(rebalance_mutex_);
+    while (!stopping_) {
+        lock.unlock();
+        bool settled = peers_handed_off() || std::chrono::steady_clock::now() >= window_end;
+        lock.lock();
+        if (settled) {
+            taking_over_ = false;
+            Logger::get_global_log()->logInfo("Rebalancing of " + root_ + " is done");
+            return;
+        }
+        rebalance_wake_.wait_for(lock, status_poll, [this]() { return stopping_; });
+    }
+}
+
+bool shard_router::hand_off_all() {
+    Logger* logger = Logger::get_global_log();
+    std::unique_lock<std::mutex> lock(rebalance_mutex_);
+    while (!stopping_) {
+        lock.unlock();
+        // Keys are collected first, so handing them off does not disturb
+        // the walk. Hidden files and directories (the write-ahead log, writes
+        // in progress) and files directly under the root are not entities.
+        std::vector<std::string> keys;
+        std::error_code error;
+        std::filesystem::path root(root_);
+        for (std::filesystem::recursive_directory_iterator it(root, error), end; !error && it != end; it.increment(error)) {
+            std::string name = it->path().filename().string();
+            if (!name.empty() && name[0] == '.') {
+                if (it->is_directory(error)) {
+                    it.disable_recursion_pending();
+                }
+                continue;
+            }
+            if (it.depth() > 0 && it->is_regular_file(error)) {
+                std::string key = it->path().lexically_relative(root).generic_string();
+                if (ring_.owner(key) != self_) {
+                    keys.push_back(key);
+                }
+            }
+        }
+
+        size_t moved = 0;
+        size_t failed = 0;
+        for (size_t i = 0; i < keys.size(); i++) {
+            if (move_(keys[i], ring_.owner(keys[i]))) {
+                moved++;
+            } else {
+                failed++;
+            }
+            if ((i + 1) % handoff_batch == 0) {
+                lock.lock();
+                if (rebalance_wake_.wait_for(lock, handoff_pause, [this]() { return stopping_; })) {
+                    return false;
+                }
+                lock.unlock();
+            }
+        }
+        if (moved > 0 || failed > 0) {
+            logger->logInfo("Handed off " + std::to_string(moved) + " entities of " + root_ + " to other shards, " +
+                            std::to_string(failed) + " left to retry");
+        }
+
+        lock.lock();
+        if (failed == 0) {
+            return true;
+        }
+        rebalance_wake_.wait_for(lock, handoff_retry, [this]() { return stopping_; });
+    }
+    return false;
+}
+
+bool shard_router::peers_handed_off() {
+    for (const auto& peer : peers()) {
+        http::request<http::string_body> status{http::verb::get, status_target, 11};
+        http::response<http::string_body> reported;
+        if (!exchange(peer, status, reported) || reported.result() != http::status::ok ||
+            reported.body().find("\"handed_off\": true") == std::string::npos) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool shard_router::load_config(const std::vector<HandlerConfig>& handlers) {
+    for (const auto& handler : handlers) {
+        auto nodes = handler.directives.find("shard_nodes");
+        auto self = handler.directives.find("shard_self");
+        if (handler.name != "crud_handler" || (nodes == handler.directives.end() && self == handler.directives.end())) {
+            continue;
+        }
+        if (nodes == handler.directives.end() || self == handler.directives.end() || self->second.size() != 1 ||
+            std::find(nodes->second.begin(), nodes->second.end(), self->second[0]) == nodes->second.end()) {
+            return false;
+        }
+        std::string host, port;
+        for (const auto& node : nodes->second) {
+            if (!peer_client::split_node(node, host, port)) {
+                return false;
+            }
+        }
+        // Hand-offs walk the entity files, which the log-structured store
+        // does not have.
+        auto storage = handler.directives.find("storage");
+        if (storage != handler.directives.end() && storage->second == std::vector<std::string>{"log"}) {
+            return false;
+        }
+        std::lock_guard<std::mutex> lock(shared_mutex);
+        if (!shared_routers.count(handler.root)) {
+            shared_routers[handler.root] = std::make_shared<shard_router>(self->second[0], nodes->second, handler.root);
+        }
+    }
+    return true;
+}
+
+std::shared_ptr<shard_router> shard_router::get_shared(const std::string& root) {
+    std::lock_guard<std::mutex> lock(shared_mutex);
+    auto found = shared_routers.find(root);
+    return found != shared_routers.end() ? found->second : nullptr;
+}
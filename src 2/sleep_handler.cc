@@ -6,7 +6,7 @@
 #include "sleep_handler.h"
 namespace http = boost::beast::http;
 
-std::unique_ptr<request_handler> sleep_handler::init(std::string root) {
+std::unique_ptr<request_handler> sleep_handler::init(const HandlerConfig& config) {
     return std::make_unique<sleep_handler>();
 }
 
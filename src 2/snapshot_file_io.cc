@@ -0,0 +1,462 @@
+#include "snapshot_file_io.h"
+#include "compressed_file_io.h"
+#include "entity_locks.h"
+#include "file_io.h"
+#include "logger.h"
+#include "tar_archive.h"
+#include <chrono>
+#include <cstdio>
+#include <ctime>
+#include <filesystem>
+#include <fstream>
+#include <shared_mutex>
+#include <sstream>
+
+namespace {
+
+std::mutex shared_mutex;
+
+// Made after the logger, so at exit a running backup finishes before
+// logging is torn down.
+std::map<std::string, std::shared_ptr<snapshot_file_io::snapshot>>& shared_snapshots() {
+    Logger::get_global_log();
+    static std::map<std::string, std::shared_ptr<snapshot_file_io::snapshot>> snapshots;
+    return snapshots;
+}
+
+// "root/Shoes/a" and "./root//Shoes/a" are one file.
+std::string key(const std::string& path) {
+    return std::filesystem::path(path).lexically_normal().string();
+}
+
+bool directive_is(const HandlerConfig& config, const char* name, const char* value) {
+    auto directive = config.directives.find(name);
+    return directive != config.directives.end() && directive->second == std::vector<std::string>{value};
+}
+
+// True if root does not exist or holds nothing but hidden files.
+bool empty_root(const std::string& root) {
+    std::error_code error;
+    for (std::filesystem::directory_iterator it(root, error), end; !error && it != end; it.increment(error)) {
+        std::string name = it->path().filename().string();
+        if (name.empty() || name[0] != '.') {
+            return false;
+        }
+    }
+    return true;
+}
+
+}
+
+snapshot_file_io::snapshot::snapshot(const std::string& root, size_t memory_limit): root_(root), memory_limit_(memory_limit) {
+    // Archives and copies left behind by a backup the server did not finish.
+    std::error_code error;
+    std::filesystem::remove_all(directory(), error);
+}
+
+snapshot_file_io::snapshot::~snapshot() {
+    if (backup_.joinable()) {
+        backup_.join();
+    }
+}
+
+std::string snapshot_file_io::snapshot::directory() const {
+    return (std::filesystem::path(root_) / ".backup").string();
+}
+
+bool snapshot_file_io::snapshot::begin() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (open_) {
+        return false;
+    }
+    open_ = true;
+    generation_++;
+    next_spill_ = 0;
+    clear_saved();
+    taken_.clear();
+    preserved_ = 0;
+    spilled_ = 0;
+    return true;
+}
+
+void snapshot_file_io::snapshot::run(std::function<void()> job) {
+    // Only one snapshot is open at a time, so the previous job has closed
+    // its snapshot and is at most sending its response.
+    if (backup_.joinable()) {
+        backup_.join();
+    }
+    backup_ = std::thread(std::move(job));
+}
+
+void snapshot_file_io::snapshot::clear_saved() {
+    for (const auto& saved : before_) {
+        if (!saved.second.spill.empty()) {
+            std::remove(saved.second.spill.c_str());
+        }
+    }
+    before_.clear();
+    memory_ = 0;
+}
+
+bool snapshot_file_io::snapshot::load(const saved_copy& saved, std::string& content) {
+    if (saved.spill.empty()) {
+        content = saved.content;
+        return true;
+    }
+    std::ifstream in(saved.spill, std::ios::binary);
+    std::ostringstream contents;
+    contents << in.rdbuf();
+    content = contents.str();
+    return !in.bad();
+}
+
+void snapshot_file_io::snapshot::preserve(i_file_io& inner, const std::string& path) {
+    std::string name = key(path);
+    std::uint64_t generation;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!open_ || taken_.count(name) || before_.count(name)) {
+            return;
+        }
+        generation = generation_;
+    }
+
+    // Read, and spill if need be, without holding up other writers or the
+    // archive. The caller holds the entity's lock, so the file cannot change
+    // meanwhile, and the archive waits for it before taking this file.
+    saved_copy saved;
+    saved.existed = inner.read(path, saved.content);
+    if (!saved.existed) {
+        saved.content.clear();
+    }
+    bool spill;
+    size_t sequence;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!open_ || generation_ != generation) {
+            return;
+        }
+        spill = memory_ + saved.content.size() > memory_limit_;
+        if (!spill) {
+            memory_ += saved.content.size();
+        }
+        sequence = next_spill_++;
+    }
+    if (spill) {
+        std::error_code error;
+        std::filesystem::create_directories(directory(), error);
+        saved.spill = (std::filesystem::path(directory()) / ("saved-" + std::to_string(generation) + "-" +
+                       std::to_string(sequence))).string();
+        std::ofstream out(saved.spill, std::ios::binary | std::ios::trunc);
+        out << saved.content;
+        out.close();
+        if (!out) {
+            Logger::get_global_log()->logError("ERROR: Unable to save " + path + " for a backup");
+            std::remove(saved.spill.c_str());
+            saved.spill.clear();
+            // Kept in memory after all rather than lost from the backup.
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (open_ && generation_ == generation) {
+                memory_ += saved.content.size();
+            }
+        } else {
+            saved.content.clear();
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!open_ || generation_ != generation || taken_.count(name) || before_.count(name)) {
+        // The snapshot closed, or the archive or another writer got to the
+        // file first.
+        if (!saved.spill.empty()) {
+            std::remove(saved.spill.c_str());
+        } else if (open_ && generation_ == generation) {
+            memory_ -= saved.content.size();
+        }
+        return;
+    }
+    spilled_ += saved.spill.empty() ? 0 : 1;
+    before_[name] = std::move(saved);
+    preserved_++;
+}
+
+size_t snapshot_file_io::snapshot::preserved() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return preserved_;
+}
+
+size_t snapshot_file_io::snapshot::spilled() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return spilled_;
+}
+
+bool snapshot_file_io::snapshot::archive(i_file_io& files, const std::string& tar_path, size_t& count) {
+    count = 0;
+    std::uint64_t mtime = std::chrono::duration_cast<std::chrono::seconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+    std::filesystem::path root = std::filesystem::path(root_).lexically_normal();
+
+    // Files created after the snapshot opened are listed too, and left out
+    // below, since they were saved as not existing.
+    std::vector<std::filesystem::path> paths;
+    std::error_code error;
+    for (std::filesystem::recursive_directory_iterator it(root_, error), end; !error && it != end; it.increment(error)) {
+        std::string name = it->path().filename().string();
+        if (!name.empty() && name[0] == '.') {
+            if (it->is_directory(error)) {
+                it.disable_recursion_pending();
+            }
+            continue;
+        }
+        if (it->is_regular_file(error)) {
+            paths.push_back(it->path());
+        }
+    }
+
+    // One file at a time goes through memory on its way to the archive.
+    std::filesystem::create_directories(std::filesystem::path(tar_path).parent_path(), error);
+    std::ofstream out(tar_path, std::ios::binary | std::ios::trunc);
+    bool complete = static_cast<bool>(out);
+    auto append = [&](const std::string& name, const std::string& content) {
+        std::string entry;
+        if (tar_archive::append(std::filesystem::path(name).lexically_relative(root).generic_string(), content, mtime, entry)) {
+            out.write(entry.data(), entry.size());
+            count++;
+        }
+    };
+
+    std::set<std::string> listed;
+    for (const auto& path : paths) {
+        if (!complete) {
+            break;
+        }
+        std::string name = key(path.string());
+        listed.insert(name);
+        std::string content;
+        bool existed = true;
+        {
+            // A write that began before the snapshot opened finishes first.
+            std::shared_lock<std::shared_mutex> entity(entity_locks::get_global_locks().for_path(path));
+            std::unique_lock<std::mutex> lock(mutex_);
+            auto saved = before_.find(name);
+            if (saved != before_.end()) {
+                existed = saved->second.existed;
+                if (existed && !load(saved->second, content)) {
+                    complete = false;
+                }
+            } else {
+                // From here on writers leave the file to change freely.
+                taken_.insert(name);
+                lock.unlock();
+                if (!files.read(path.string(), content)) {
+                    complete = false;
+                }
+            }
+        }
+        if (!complete) {
+            Logger::get_global_log()->logError("ERROR: Unable to read " + path.string() + " for a backup");
+            break;
+        }
+        if (existed) {
+            append(name, content);
+        }
+    }
+
+    // Files deleted before the walk reached them are only in the saved copies.
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (const auto& saved : before_) {
+        if (!complete) {
+            break;
+        }
+        std::string content;
+        if (saved.second.existed && !listed.count(saved.first)) {
+            complete = load(saved.second, content);
+            append(saved.first, content);
+        }
+    }
+    std::string end;
+    tar_archive::finish(end);
+    out.write(end.data(), end.size());
+    out.close();
+    complete = complete && static_cast<bool>(out);
+    if (!complete) {
+        std::remove(tar_path.c_str());
+    }
+    open_ = false;
+    clear_saved();
+    taken_.clear();
+    return complete;
+}
+
+snapshot_file_io::snapshot_file_io(std::shared_ptr<i_file_io> inner, std::shared_ptr<snapshot> state)
+    : inner_(inner), state_(state) {}
+
+bool snapshot_file_io::open(const std::string& filename, std::ios_base::openmode mode) {
+    if (mode & std::ios::out) {
+        state_->preserve(*inner_, filename);
+    }
+    return inner_->open(filename, mode);
+}
+
+bool snapshot_file_io::write(const std::string& data) {
+    return inner_->write(data);
+}
+
+bool snapshot_file_io::close() {
+    return inner_->close();
+}
+
+bool snapshot_file_io::read(const std::string& filepath, std::string& content) {
+    return inner_->read(filepath, content);
+}
+
+bool snapshot_file_io::read_stored(const std::string& filepath, std::string& content, std::string& encoding) {
+    return inner_->read_stored(filepath, content, encoding);
+}
+
+bool snapshot_file_io::delete_file(const std::string& filepath) {
+    state_->preserve(*inner_, filepath);
+    return inner_->delete_file(filepath);
+}
+
+bool snapshot_file_io::create_directories(const std::string& path) {
+    return inner_->create_directories(path);
+}
+
+bool snapshot_file_io::list_directories(const std::string& path, std::vector<std::string>& directories) {
+    return inner_->list_directories(path, directories);
+}
+
+bool snapshot_file_io::exists(const std::string& filepath) {
+    return inner_->exists(filepath);
+}
+
+bool snapshot_file_io::version(const std::string& filepath, std::string& tag) {
+    return inner_->version(filepath, tag);
+}
+
+void snapshot_file_io::write_batch(const std::vector<batch_op>& ops, std::vector<bool>& results) {
+    for (const auto& op : ops) {
+        state_->preserve(*inner_, op.path);
+    }
+    inner_->write_batch(ops, results);
+}
+
+std::shared_ptr<i_file_io> snapshot_file_io::wrap(const HandlerConfig& config, std::shared_ptr<i_file_io> storage) {
+    std::shared_ptr<snapshot> state = get_shared(config.root);
+    if (!state || !directive_is(config, "backup", "on")) {
+        return storage;
+    }
+    return std::make_shared<snapshot_file_io>(storage, state);
+}
+
+bool snapshot_file_io::restore(const std::string& archive_path, const std::string& root, i_file_io& storage, size_t& count) {
+    count = 0;
+    std::ifstream in(archive_path, std::ios::binary);
+    if (!in) {
+        return false;
+    }
+    std::ostringstream contents;
+    contents << in.rdbuf();
+    return tar_archive::extract(contents.str(), [&](const std::string& name, const std::string& content) {
+        std::filesystem::path path = std::filesystem::path(root) / name;
+        try {
+            storage.create_directories(path.parent_path().string());
+        } catch (const std::exception&) {
+            return false;
+        }
+        bool written = storage.open(path.string(), std::ios::out | std::ios::trunc) && storage.write(content);
+        written = storage.close() && written;
+        count += written ? 1 : 0;
+        return written;
+    });
+}
+
+bool snapshot_file_io::load_config(const std::vector<HandlerConfig>& handlers) {
+    Logger* logger = Logger::get_global_log();
+    for (const auto& handler : handlers) {
+        if (handler.name != "crud_handler" && handler.name != "markdown_handler") {
+            continue;
+        }
+        auto backup = handler.directives.find("backup");
+        auto restore_from = handler.directives.find("restore_from");
+        if (backup != handler.directives.end() && !directive_is(handler, "backup", "off")) {
+            // Writes that skip this decorator would slip past the snapshot,
+            // and the log-structured store keeps no files to archive.
+            if (!directive_is(handler, "backup", "on") || directive_is(handler, "storage", "log") ||
+                directive_is(handler, "async_io", "on")) {
+                return false;
+            }
+            std::lock_guard<std::mutex> lock(shared_mutex);
+            if (!shared_snapshots().count(handler.root)) {
+                shared_snapshots()[handler.root] = std::make_shared<snapshot>(handler.root);
+            }
+        }
+        if (restore_from == handler.directives.end()) {
+            continue;
+        }
+        if (restore_from->second.size() != 1 || directive_is(handler, "storage", "log")) {
+            return false;
+        }
+        if (!empty_root(handler.root)) {
+            logger->logInfo("Not restoring " + restore_from->second[0] + ": " + handler.root + " already has data");
+            continue;
+        }
+        // Through compression, if the location has it, so the files read
+        // back as they would have been written by the handlers.
+        std::shared_ptr<i_file_io> storage = compressed_file_io::wrap(handler, std::make_shared<file_io>());
+        size_t count;
+        if (!restore(restore_from->second[0], handler.root, *storage, count)) {
+            logger->logError("ERROR: Unable to restore " + handler.root + " from " + restore_from->second[0]);
+            return false;
+        }
+        logger->logInfo("Restored " + std::to_string(count) + " files of " + handler.root + " from " + restore_from->second[0]);
+    }
+    return true;
+}
+
+std::shared_ptr<snapshot_file_io::snapshot> snapshot_file_io::get_shared(const std::string& root) {
+    std::lock_guard<std::mutex> lock(shared_mutex);
+    auto found = shared_snapshots().find(root);
+    return found != shared_snapshots().end() ? found->second : nullptr;
+}
+
+bool snapshot_file_io::answer_backup(const std::string& root, std::shared_ptr<i_file_io> files, response_callback respond) {
+    std::shared_ptr<snapshot> state = get_shared(root);
+    if (!state) {
+        return false;
+    }
+    http::response<http::string_body> response;
+    response.version(11);
+    if (!state->begin()) {
+        response.result(http::status::conflict);
+        response.set(http::field::content_type, "text/plain");
+        response.body() = "A backup of this location is already running";
+        response.prepare_payload();
+        respond(std::move(response));
+        return true;
+    }
+    // The snapshot is open from here, so the archive is of the location as
+    // it was when the request arrived, however long reading it takes.
+    state->run([state, root, files, respond, response]() mutable {
+        std::string name = "backup-" + std::to_string(std::time(nullptr)) + ".tar";
+        std::string tar = (std::filesystem::path(state->directory()) / name).string();
+        size_t count;
+        if (state->archive(*files, tar, count)) {
+            Logger::get_global_log()->logInfo("Backed up " + std::to_string(count) + " files of " + root + ", " +
+                                              std::to_string(state->preserved()) + " of them copied on write (" +
+                                              std::to_string(state->spilled()) + " spilled to disk)");
+            response.result(http::status::ok);
+            response.set(http::field::content_type, "application/x-tar");
+            response.set(http::field::content_disposition, "attachment; filename=\"" + name + "\"");
+            response.set("X-Backup-Files", std::to_string(count));
+            response.set(request_handler::spooled_body_header, tar);
+        } else {
+            response.result(http::status::internal_server_error);
+            response.set(http::field::content_type, "text/plain");
+            response.body() = "Unable to read every file for the backup";
+        }
+        response.prepare_payload();
+        respond(std::move(response));
+    });
+    return true;
+}
@@ -1,18 +1,50 @@
 #include <string>
+#include <memory>
+#include <stdexcept>
 #include <filesystem>
-#include <cstdio>
-#include <sstream>
 #include <boost/beast/http.hpp>
 #include <boost/lexical_cast.hpp>
 #include "static_handler.h"
+#include "http_util.h"
 #include "markdown_to_html.h"
+#include "markdown_cache.h"
+#include "mime_types.h"
+#include "open_file_cache.h"
+#include "content_cache.h"
+#include "asset_bundle.h"
 namespace http = boost::beast::http;
 
-std::unique_ptr<request_handler> static_handler::init(std::string root) {
-    return std::make_unique<static_handler>(root);
+namespace {
+
+// Sets the ETag header and turns the response into a 304 if the request's
+// If-None-Match already names it.
+void apply_etag(const http::request<http::string_body>& request, http::response<http::string_body>& response,
+                const std::string& etag) {
+    response.set(http::field::etag, etag);
+    auto if_none_match = request.find(http::field::if_none_match);
+    if(if_none_match != request.end() &&
+       (if_none_match->value() == etag || if_none_match->value() == "*")) {
+        response.result(http::status::not_modified);
+        response.body() = "";
+    }
+}
+
 }
 
-static_handler::static_handler(std::string root): root_(root) {}
+std::unique_ptr<request_handler> static_handler::init(const HandlerConfig& config) {
+    auto bundle = config.directives.find("bundle");
+    if(bundle != config.directives.end() && !bundle->second.empty()) {
+        std::shared_ptr<const asset_bundle> shared = asset_bundle::get_shared(bundle->second[0]);
+        if(shared) {
+            return std::make_unique<static_handler>(shared);
+        }
+    }
+    return std::make_unique<static_handler>(config.root, config.directives.count("preload") > 0);
+}
+
+static_handler::static_handler(std::string root, bool use_content_cache): root_(root), use_content_cache_(use_content_cache) {}
+
+static_handler::static_handler(std::shared_ptr<const asset_bundle> bundle): use_content_cache_(false), bundle_(bundle) {}
 
 http::response<http::string_body> static_handler::handle_request(http::request<http::string_body> request) {
     http::response<http::string_body> response;
@@ -27,8 +59,18 @@ http::response<http::string_body> static_handler::handle_request(http::request<h
         filepath = filepath.substr(0, filepath.find_last_of("?"));
     }
 
+    if(bundle_) {
+        return handle_bundle_request(request, filepath, parameter);
+    }
+
+    // A single open + fstat (or a cache hit) answers both "does it exist"
+    // and "is it a directory", and gives the descriptor to read from. The
+    // path is normalised so it matches the keys static_preloader caches under.
+    std::string path = std::filesystem::path(root_ + filepath).lexically_normal().string();
+    std::shared_ptr<const open_file> file = open_file_cache::get_global_cache()->open(path);
+
     // File found.
-    if(std::filesystem::exists(root_ + filepath) && !std::filesystem::is_directory(root_ + filepath)) {
+    if(file->exists && !file->is_directory) {
         response.result(http::status::ok);
 
         // Determine content type.
@@ -37,43 +79,66 @@ http::response<http::string_body> static_handler::handle_request(http::request<h
         if(filename.find_last_of(".") != std::string::npos) {
             file_extension = filename.substr(filename.find_last_of(".") + 1);
         }
-        if(file_extension == "html" || file_extension == "md") {
+        if(file_extension == "md") {
+            // Markdown is rendered to HTML unless raw=true is requested.
             response.set(http::field::content_type, "text/html");
-        } else if(file_extension == "jpg" || file_extension == "jpeg") {
-            response.set(http::field::content_type, "image/jpeg");
-        } else if(file_extension == "txt") {
-            response.set(http::field::content_type, "text/plain");
-        } else if(file_extension == "zip") {
-            response.set(http::field::content_type, "application/zip");
         } else {
-            response.set(http::field::content_type, "application/octet-stream");
+            std::string_view content_type = mime_types::get_global_table()->lookup(file_extension);
+            response.set(http::field::content_type, boost::beast::string_view(content_type.data(), content_type.size()));
         }
 
-        // Load file into payload.
-        std::FILE* file = std::fopen((root_ + filepath).c_str(), "r");
-        std::stringstream payload;
-        int current = std::fgetc(file);
-        while(current != EOF) {
-            payload.put(current);
-            current = std::fgetc(file);
+        // Preloaded locations serve contents and ETags from the content cache.
+        std::shared_ptr<const cached_content> cached;
+        if(use_content_cache_) {
+            content_cache* cache = content_cache::get_global_cache();
+            cached = cache->get(path, file->mtime, file->size);
+            std::string content;
+            if(!cached && file->read(content)) {
+                cached = cache->put(path, file->mtime, std::move(content));
+            }
         }
-        std::fclose(file);
 
         // Process file if necessary.
+        bool read_ok = true;
+        std::string etag = cached ? cached->etag : "";
         if(file_extension == "md") {
-            MarkdownToHtml parser;
             if(parameter == "" || parameter == "raw=false") {
-                response.body() = parser.convert(payload.str());
+                std::shared_ptr<const std::string> html = render_markdown(path, file, cached);
+                read_ok = html != nullptr;
+                if(read_ok) {
+                    response.body() = *html;
+                }
+                // The rendered page is a different representation than the source.
+                if(!etag.empty()) {
+                    etag.insert(etag.size() - 1, "-html");
+                }
             } else if(parameter == "raw=true") {
                 response.set(http::field::content_type, "text/plain");
-                response.body() = payload.str();
+                if(cached) {
+                    response.body() = *cached->data;
+                } else {
+                    read_ok = file->read(response.body());
+                }
             } else {
                 response.set(http::field::content_type, "text/plain");
                 response.result(http::status::bad_request);
                 response.body() = "Bad request";
+                etag = "";
             }
+        } else if(cached) {
+            response.body() = *cached->data;
         } else {
-            response.body() = payload.str();
+            read_ok = file->read(response.body());
+        }
+
+        if(read_ok && !etag.empty()) {
+            apply_etag(request, response, etag);
+        }
+
+        if(!read_ok) {
+            response.set(http::field::content_type, "text/plain");
+            response.result(http::status::internal_server_error);
+            response.body() = "Unable to read file";
         }
 
     // File not found.
@@ -85,3 +150,88 @@ http::response<http::string_body> static_handler::handle_request(http::request<h
     response.prepare_payload();
     return response;
 }
+
+// Serves a request from the mapped bundle: no open, stat or read, and the
+// body is a single copy out of the mapping (string_body owns its storage).
+http::response<http::string_body> static_handler::handle_bundle_request(const http::request<http::string_body>& request,
+                                                                        const std::string& filepath, const std::string& parameter) {
+    http::response<http::string_body> response;
+    response.version(11);
+
+    asset found;
+    if(!bundle_->find(filepath, &found)) {
+        response.result(http::status::not_found);
+        response.body() = "File not found";
+        response.prepare_payload();
+        return response;
+    }
+    response.result(http::status::ok);
+
+    std::string file_extension = "";
+    std::string filename = filepath.substr(filepath.find_last_of("/") + 1);
+    if(filename.find_last_of(".") != std::string::npos) {
+        file_extension = filename.substr(filename.find_last_of(".") + 1);
+    }
+
+    std::string etag = std::string(found.etag);
+    if(file_extension == "md") {
+        if(parameter == "" || parameter == "raw=false") {
+            std::shared_ptr<const std::string> html = markdown_cache::get_global_cache()->get(
+                bundle_->path() + filepath, found.mtime, found.data.size(), [&found]() {
+                    MarkdownToHtml parser;
+                    return parser.convert(std::string(found.data));
+                });
+            response.set(http::field::content_type, "text/html");
+            response.body() = *html;
+            etag.insert(etag.size() - 1, "-html");
+        } else if(parameter == "raw=true") {
+            response.set(http::field::content_type, "text/plain");
+            response.body().assign(found.data.data(), found.data.size());
+        } else {
+            response.set(http::field::content_type, "text/plain");
+            response.result(http::status::bad_request);
+            response.body() = "Bad request";
+            etag = "";
+        }
+    } else {
+        response.set(http::field::content_type, boost::beast::string_view(found.content_type.data(), found.content_type.size()));
+        if(!found.gzip.empty()) {
+            response.set(http::field::vary, "Accept-Encoding");
+        }
+        if(!found.gzip.empty() && accepts_gzip(request)) {
+            // Each encoding is a distinct representation with its own ETag.
+            response.set(http::field::content_encoding, "gzip");
+            response.body().assign(found.gzip.data(), found.gzip.size());
+            etag.insert(etag.size() - 1, "-gzip");
+        } else {
+            response.body().assign(found.data.data(), found.data.size());
+        }
+    }
+
+    if(!etag.empty()) {
+        apply_etag(request, response, etag);
+    }
+    response.prepare_payload();
+    return response;
+}
+
+// Rendered HTML is shared across requests until the file's mtime or size
+// changes. Returns nullptr if the file could not be read.
+std::shared_ptr<const std::string> static_handler::render_markdown(const std::string& path, std::shared_ptr<const open_file> file,
+                                                                   std::shared_ptr<const cached_content> cached) {
+    try {
+        return markdown_cache::get_global_cache()->get(path, file->mtime, file->size, [&file, &cached]() {
+            MarkdownToHtml parser;
+            if(cached) {
+                return parser.convert(*cached->data);
+            }
+            std::string markdown;
+            if(!file->read(markdown)) {
+                throw std::runtime_error("Unable to read file");
+            }
+            return parser.convert(markdown);
+        });
+    } catch(const std::runtime_error&) {
+        return nullptr;
+    }
+}
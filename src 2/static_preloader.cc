@@ -0,0 +1,131 @@
+#include "static_preloader.h"
+#include "content_cache.h"
+#include "health_handler.h"
+#include "logger.h"
+#include "markdown_cache.h"
+#include "markdown_to_html.h"
+#include "open_file_cache.h"
+#include <algorithm>
+#include <chrono>
+#include <exception>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include <boost/asio/post.hpp>
+#include <boost/asio/thread_pool.hpp>
+
+namespace {
+const size_t default_preload_budget = 64 << 20;
+}
+
+static_preloader::static_preloader(std::string root, size_t budget, size_t threads)
+    : root_(root), budget_(budget), threads_(std::max<size_t>(threads, 1)) {}
+
+void static_preloader::run() {
+    // Collect the file list first; reading and rendering is what runs in parallel.
+    std::vector<std::string> paths;
+    std::error_code ec;
+    auto options = std::filesystem::directory_options::skip_permission_denied;
+    for (auto it = std::filesystem::recursive_directory_iterator(root_, options, ec);
+         !ec && it != std::filesystem::recursive_directory_iterator(); it.increment(ec)) {
+        if (it->is_regular_file(ec)) {
+            // Keys must match the path static_handler builds: root + request
+            // target, normalised the same way on both sides.
+            std::filesystem::path relative = it->path().lexically_relative(root_);
+            paths.push_back((std::filesystem::path(root_) / relative).lexically_normal().string());
+        }
+    }
+
+    boost::asio::thread_pool pool(threads_);
+    for (const auto& path : paths) {
+        boost::asio::post(pool, [this, path]() { load(path); });
+    }
+    pool.join();
+}
+
+void static_preloader::load(const std::string& path) {
+    std::shared_ptr<const open_file> file = open_file_cache::get_global_cache()->open(path);
+    if (!file->exists || file->is_directory) {
+        return;
+    }
+
+    // Reserve room in this location's budget before reading; files that do
+    // not fit still get their descriptor warmed above.
+    size_t reserved = bytes_.load();
+    do {
+        if (reserved + file->size > budget_) {
+            return;
+        }
+    } while (!bytes_.compare_exchange_weak(reserved, reserved + file->size));
+    std::string content;
+    if (!file->read(content)) {
+        bytes_.fetch_sub(file->size);
+        return;
+    }
+    std::shared_ptr<const cached_content> cached = content_cache::get_global_cache()->put(path, file->mtime, std::move(content));
+    files_++;
+
+    if (path.size() > 3 && path.compare(path.size() - 3, 3, ".md") == 0) {
+        // A page that fails to render is left for static_handler to report
+        // when it is requested; it must not take the pool thread down.
+        try {
+            markdown_cache::get_global_cache()->get(path, file->mtime, file->size, [&cached]() {
+                MarkdownToHtml parser;
+                return parser.convert(*cached->data);
+            });
+            rendered_++;
+        } catch(const std::exception& e) {
+            Logger::get_global_log()->logWarning("Unable to render " + path + " for preload: " + e.what());
+        }
+    }
+}
+
+size_t static_preloader::files_loaded() const {
+    return files_;
+}
+
+size_t static_preloader::bytes_loaded() const {
+    return bytes_;
+}
+
+size_t static_preloader::markdown_rendered() const {
+    return rendered_;
+}
+
+bool static_preloader::start(const std::vector<HandlerConfig>& handlers) {
+    std::vector<std::pair<std::string, size_t>> preloads;
+    size_t total_budget = 0;
+    for (const auto& handler : handlers) {
+        auto directive = handler.directives.find("preload");
+        if (handler.name != "static_handler" || directive == handler.directives.end()) {
+            continue;
+        }
+        size_t budget = default_preload_budget;
+        if (!directive->second.empty() && !ParseConfigSize(directive->second[0], &budget)) {
+            return false;
+        }
+        preloads.emplace_back(handler.root, budget);
+        total_budget += budget;
+    }
+
+    content_cache::get_global_cache()->set_budget(total_budget);
+    size_t threads = std::max(1u, std::thread::hardware_concurrency());
+    for (const auto& preload : preloads) {
+        health_handler::begin_warmup();
+        std::thread([preload, threads]() {
+            Logger* logger = Logger::get_global_log();
+            auto start = std::chrono::steady_clock::now();
+            static_preloader preloader(preload.first, preload.second, threads);
+            preloader.run();
+            auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
+            logger->logInfo("Preloaded " + std::to_string(preloader.files_loaded()) + " files (" +
+                            std::to_string(preloader.bytes_loaded()) + " bytes, " +
+                            std::to_string(preloader.markdown_rendered()) + " markdown rendered) from " +
+                            preload.first + " in " + std::to_string(elapsed.count()) + " ms");
+            health_handler::end_warmup();
+        }).detach();
+    }
+    return true;
+}
@@ -0,0 +1,153 @@
+#include "tar_archive.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+
+namespace {
+
+const size_t block_size = 512;
+
+// Offsets and lengths of the ustar header fields used here.
+const size_t name_offset = 0, name_length = 100;
+const size_t mode_offset = 100;
+const size_t uid_offset = 108;
+const size_t gid_offset = 116;
+const size_t size_offset = 124, size_length = 12;
+const size_t mtime_offset = 136, mtime_length = 12;
+const size_t checksum_offset = 148, checksum_length = 8;
+const size_t type_offset = 156;
+const size_t magic_offset = 257;
+const size_t prefix_offset = 345, prefix_length = 155;
+
+// Writes value as zero-padded octal filling all but the last byte of the
+// field, which stays NUL. Returns false if it does not fit.
+bool put_octal(char* field, size_t length, std::uint64_t value) {
+    char digits[32];
+    int written = std::snprintf(digits, sizeof(digits), "%0*llo", static_cast<int>(length - 1), static_cast<unsigned long long>(value));
+    if (written < 0 || static_cast<size_t>(written) > length - 1) {
+        return false;
+    }
+    std::memcpy(field, digits, length - 1);
+    return true;
+}
+
+// Reads an octal field, which may be padded with spaces or NULs.
+bool get_octal(const char* field, size_t length, std::uint64_t& value) {
+    size_t i = 0;
+    while (i < length && field[i] == ' ') {
+        i++;
+    }
+    value = 0;
+    bool digits = false;
+    for (; i < length && field[i] >= '0' && field[i] <= '7'; i++) {
+        value = value * 8 + (field[i] - '0');
+        digits = true;
+    }
+    for (; i < length; i++) {
+        if (field[i] != ' ' && field[i] != '\0') {
+            return false;
+        }
+    }
+    return digits;
+}
+
+// The header's checksum: the sum of its bytes, counting the checksum field
+// itself as spaces.
+std::uint64_t checksum(const unsigned char* header) {
+    std::uint64_t sum = 0;
+    for (size_t i = 0; i < block_size; i++) {
+        sum += i >= checksum_offset && i < checksum_offset + checksum_length ? ' ' : header[i];
+    }
+    return sum;
+}
+
+std::string field_string(const char* field, size_t length) {
+    return std::string(field, strnlen(field, length));
+}
+
+}
+
+bool tar_archive::safe_name(const std::string& name) {
+    std::filesystem::path path(name);
+    if (name.empty() || path.is_absolute() || path.has_root_name()) {
+        return false;
+    }
+    for (const auto& part : path) {
+        if (part == "..") {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool tar_archive::append(const std::string& name, const std::string& content, std::uint64_t mtime, std::string& archive) {
+    if (!safe_name(name)) {
+        return false;
+    }
+    // Names past 100 bytes are split at a slash into prefix and name.
+    std::string prefix;
+    std::string rest = name;
+    if (name.size() > name_length) {
+        size_t slash = name.find('/', name.size() - name_length - 1);
+        if (slash == std::string::npos || slash > prefix_length || slash + 1 == name.size()) {
+            return false;
+        }
+        prefix = name.substr(0, slash);
+        rest = name.substr(slash + 1);
+    }
+
+    char header[block_size] = {};
+    std::memcpy(header + name_offset, rest.data(), rest.size());
+    std::memcpy(header + prefix_offset, prefix.data(), prefix.size());
+    if (!put_octal(header + mode_offset, 8, 0644) || !put_octal(header + uid_offset, 8, 0) || !put_octal(header + gid_offset, 8, 0) ||
+        !put_octal(header + size_offset, size_length, content.size()) || !put_octal(header + mtime_offset, mtime_length, mtime)) {
+        return false;
+    }
+    header[type_offset] = '0';
+    std::memcpy(header + magic_offset, "ustar\0" "00", 8);
+    // Six octal digits, a NUL and a space, as tar(1) writes it.
+    std::snprintf(header + checksum_offset, checksum_length, "%06llo",
+                  static_cast<unsigned long long>(checksum(reinterpret_cast<unsigned char*>(header))));
+    header[checksum_offset + checksum_length - 1] = ' ';
+
+    archive.append(header, block_size);
+    archive += content;
+    archive.append((block_size - content.size() % block_size) % block_size, '\0');
+    return true;
+}
+
+void tar_archive::finish(std::string& archive) {
+    archive.append(2 * block_size, '\0');
+}
+
+bool tar_archive::extract(const std::string& archive, const file_visitor& visit) {
+    size_t pos = 0;
+    while (pos + block_size <= archive.size()) {
+        const char* header = archive.data() + pos;
+        if (std::all_of(header, header + block_size, [](char c) { return c == '\0'; })) {
+            return true;
+        }
+        std::uint64_t stored_checksum;
+        std::uint64_t size;
+        if (!get_octal(header + checksum_offset, checksum_length, stored_checksum) ||
+            stored_checksum != checksum(reinterpret_cast<const unsigned char*>(header)) ||
+            !get_octal(header + size_offset, size_length, size) || size > archive.size() - pos - block_size) {
+            return false;
+        }
+        std::string name = field_string(header + name_offset, name_length);
+        std::string prefix = field_string(header + prefix_offset, prefix_length);
+        if (!prefix.empty()) {
+            name = prefix + "/" + name;
+        }
+        char type = header[type_offset];
+        if (type == '0' || type == '\0') {
+            if (!safe_name(name) || !visit(name, archive.substr(pos + block_size, size))) {
+                return false;
+            }
+        }
+        pos += block_size + (size + block_size - 1) / block_size * block_size;
+    }
+    // Archives end with zero blocks; one that stops short was cut off.
+    return false;
+}
@@ -0,0 +1,493 @@
+#include "uring_file_io.h"
+#include <boost/asio/post.hpp>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <filesystem>
+#include <vector>
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace {
+
+int io_uring_setup(unsigned entries, io_uring_params* params) {
+    return static_cast<int>(::syscall(__NR_io_uring_setup, entries, params));
+}
+
+int io_uring_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags) {
+    return static_cast<int>(::syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, nullptr, 0));
+}
+
+int io_uring_register(int fd, unsigned opcode, void* arg, unsigned args) {
+    return static_cast<int>(::syscall(__NR_io_uring_register, fd, opcode, arg, args));
+}
+
+// Every opcode the operations use; without one of them the ring is no use.
+const std::uint8_t required_opcodes[] = {
+    IORING_OP_READ, IORING_OP_WRITE, IORING_OP_OPENAT, IORING_OP_CLOSE, IORING_OP_FSYNC,
+    IORING_OP_RENAMEAT, IORING_OP_UNLINKAT, IORING_OP_MKDIRAT,
+};
+
+bool supports_opcodes(int ring_fd) {
+    const unsigned ops = 256;
+    std::vector<char> buffer(sizeof(io_uring_probe) + ops * sizeof(io_uring_probe_op), 0);
+    io_uring_probe* probe = reinterpret_cast<io_uring_probe*>(buffer.data());
+    if (io_uring_register(ring_fd, IORING_REGISTER_PROBE, probe, ops) < 0) {
+        return false;
+    }
+    for (std::uint8_t opcode : required_opcodes) {
+        if (opcode > probe->last_op || !(probe->ops[opcode].flags & IO_URING_OP_SUPPORTED)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// A read starts with this much room and doubles it whenever it fills up.
+const size_t initial_read_size = 16384;
+
+}
+
+// An operation in progress: which step it is on and what the steps share.
+struct uring_file_io::operation {
+    enum kind_t { read, write, fsync, unlink, mkdir } kind;
+    int step = 0;
+    std::string path;
+    std::string temporary;  // write: the file renamed over path
+    std::string data;       // read: what was read so far; write: what to write
+    size_t offset = 0;
+    int fd = -1;
+    bool ok = true;
+    std::vector<std::string> parents;  // mkdir: each directory down to path
+    size_t parent = 0;
+    completion done;
+    read_completion read_done;
+};
+
+std::shared_ptr<uring_file_io> uring_file_io::open(boost::asio::io_context& io, unsigned entries) {
+    std::shared_ptr<uring_file_io> ring(new uring_file_io(io));
+    if (!ring->setup(entries)) {
+        return nullptr;
+    }
+    return ring;
+}
+
+uring_file_io::uring_file_io(boost::asio::io_context& io): io_(io), lister_(io, 1) {}
+
+bool uring_file_io::setup(unsigned entries) {
+    io_uring_params params;
+    std::memset(&params, 0, sizeof(params));
+    ring_fd_ = io_uring_setup(std::max(entries, 2u), &params);
+    if (ring_fd_ < 0) {
+        return false;
+    }
+    // Completions are never dropped, so a full completion queue only
+    // makes io_uring_enter wait.
+    if (!(params.features & IORING_FEAT_NODROP) || !supports_opcodes(ring_fd_)) {
+        return false;
+    }
+
+    sq_ring_size_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cq_ring_size_ = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    bool single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+    if (single_mmap) {
+        sq_ring_size_ = cq_ring_size_ = std::max(sq_ring_size_, cq_ring_size_);
+    }
+    sq_ring_ = ::mmap(nullptr, sq_ring_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_SQ_RING);
+    if (sq_ring_ == MAP_FAILED) {
+        sq_ring_ = nullptr;
+        return false;
+    }
+    if (single_mmap) {
+        cq_ring_ = sq_ring_;
+    } else {
+        cq_ring_ = ::mmap(nullptr, cq_ring_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_CQ_RING);
+        if (cq_ring_ == MAP_FAILED) {
+            cq_ring_ = nullptr;
+            return false;
+        }
+    }
+    sqes_size_ = params.sq_entries * sizeof(io_uring_sqe);
+    void* sqes = ::mmap(nullptr, sqes_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_SQES);
+    if (sqes == MAP_FAILED) {
+        return false;
+    }
+    sqes_ = static_cast<io_uring_sqe*>(sqes);
+
+    char* sq = static_cast<char*>(sq_ring_);
+    sq_head_ = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+    sq_tail_ = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+    sq_mask_ = reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+    sq_array_ = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+    char* cq = static_cast<char*>(cq_ring_);
+    cq_head_ = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+    cq_tail_ = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+    cq_mask_ = reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+    cqes_ = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+    entries_ = params.sq_entries;
+
+    event_fd_ = ::eventfd(0, EFD_CLOEXEC);
+    if (event_fd_ < 0) {
+        return false;
+    }
+    thread_ = std::thread(&uring_file_io::loop, this);
+    return true;
+}
+
+uring_file_io::~uring_file_io() {
+    if (thread_.joinable()) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stopping_ = true;
+        }
+        std::uint64_t one = 1;
+        (void)::write(event_fd_, &one, sizeof(one));
+        thread_.join();
+    }
+    if (sqes_) {
+        ::munmap(sqes_, sqes_size_);
+    }
+    if (cq_ring_ && cq_ring_ != sq_ring_) {
+        ::munmap(cq_ring_, cq_ring_size_);
+    }
+    if (sq_ring_) {
+        ::munmap(sq_ring_, sq_ring_size_);
+    }
+    if (event_fd_ >= 0) {
+        ::close(event_fd_);
+    }
+    if (ring_fd_ >= 0) {
+        ::close(ring_fd_);
+    }
+}
+
+void uring_file_io::read(const std::string& path, read_completion done) {
+    operation* op = new operation{operation::read};
+    op->path = path;
+    op->read_done = std::move(done);
+    enqueue(op);
+}
+
+void uring_file_io::write(const std::string& path, std::string data, completion done) {
+    operation* op = new operation{operation::write};
+    op->path = path;
+    op->temporary = temporary_path(path);
+    op->data = std::move(data);
+    op->done = std::move(done);
+    enqueue(op);
+}
+
+void uring_file_io::fsync(const std::string& path, completion done) {
+    operation* op = new operation{operation::fsync};
+    op->path = path;
+    op->done = std::move(done);
+    enqueue(op);
+}
+
+void uring_file_io::unlink(const std::string& path, completion done) {
+    operation* op = new operation{operation::unlink};
+    op->path = path;
+    op->done = std::move(done);
+    enqueue(op);
+}
+
+void uring_file_io::mkdir(const std::string& path, completion done) {
+    operation* op = new operation{operation::mkdir};
+    op->path = path;
+    std::filesystem::path parent;
+    for (const auto& part : std::filesystem::path(path).lexically_normal()) {
+        parent /= part;
+        if (!part.empty() && part != "." && part != ".." && part != "/") {
+            op->parents.push_back(parent.string());
+        }
+    }
+    op->done = std::move(done);
+    enqueue(op);
+}
+
+void uring_file_io::list(const std::string& path, list_completion done) {
+    lister_.list(path, std::move(done));
+}
+
+const char* uring_file_io::backend() const {
+    return "io_uring";
+}
+
+size_t uring_file_io::submit_calls() const {
+    return submit_calls_;
+}
+
+size_t uring_file_io::submitted() const {
+    return submitted_;
+}
+
+void uring_file_io::enqueue(operation* op) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        queued_.push_back(op);
+    }
+    std::uint64_t one = 1;
+    (void)::write(event_fd_, &one, sizeof(one));
+}
+
+io_uring_sqe* uring_file_io::prepare(operation* op, std::uint8_t opcode) {
+    // Only this thread moves the tail, and every operation has at most one
+    // step in the ring, so there is always a free entry.
+    unsigned tail = *sq_tail_;
+    unsigned index = tail & *sq_mask_;
+    io_uring_sqe* sqe = &sqes_[index];
+    std::memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = opcode;
+    sqe->fd = AT_FDCWD;
+    sqe->user_data = reinterpret_cast<std::uint64_t>(op);
+    sq_array_[index] = index;
+    __atomic_store_n(sq_tail_, tail + 1, __ATOMIC_RELEASE);
+    to_submit_++;
+    return sqe;
+}
+
+void uring_file_io::arm_wakeup() {
+    io_uring_sqe* sqe = prepare(nullptr, IORING_OP_READ);
+    sqe->fd = event_fd_;
+    sqe->addr = reinterpret_cast<std::uint64_t>(&event_count_);
+    sqe->len = sizeof(event_count_);
+}
+
+void uring_file_io::loop() {
+    arm_wakeup();
+    while (true) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (stopping_ && queued_.empty() && active_ == 0) {
+                break;
+            }
+            // One entry stays with the eventfd read.
+            while (!queued_.empty() && active_ + 1 < entries_) {
+                operation* op = queued_.front();
+                queued_.pop_front();
+                active_++;
+                advance(op, 0);
+            }
+        }
+
+        unsigned submitting = to_submit_;
+        int result = io_uring_enter(ring_fd_, to_submit_, 1, IORING_ENTER_GETEVENTS);
+        if (result < 0 && errno != EINTR && errno != EBUSY && errno != EAGAIN) {
+            break;
+        }
+        if (result > 0) {
+            to_submit_ -= result;
+            submit_calls_++;
+            submitted_ += result;
+        } else if (submitting > 0 && result < 0) {
+            continue;  // try the submission again
+        }
+
+        unsigned head = *cq_head_;
+        unsigned tail = __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE);
+        for (; head != tail; head++) {
+            const io_uring_cqe& cqe = cqes_[head & *cq_mask_];
+            operation* op = reinterpret_cast<operation*>(cqe.user_data);
+            int res = cqe.res;
+            __atomic_store_n(cq_head_, head + 1, __ATOMIC_RELEASE);
+            if (op == nullptr) {
+                arm_wakeup();
+            } else {
+                advance(op, res);
+            }
+        }
+    }
+}
+
+void uring_file_io::advance(operation* op, int result) {
+    io_uring_sqe* sqe;
+    switch (op->kind) {
+    case operation::read:
+        switch (op->step) {
+        case 0:
+            sqe = prepare(op, IORING_OP_OPENAT);
+            sqe->addr = reinterpret_cast<std::uint64_t>(op->path.c_str());
+            sqe->open_flags = O_RDONLY | O_CLOEXEC;
+            op->step = 1;
+            return;
+        case 1:
+            if (result < 0) {
+                return finish(op, false);
+            }
+            op->fd = result;
+            op->data.resize(initial_read_size);
+            break;
+        case 2:
+            if (result <= 0) {
+                // The end of the file, or an error.
+                op->ok = result == 0;
+                op->data.resize(op->offset);
+                sqe = prepare(op, IORING_OP_CLOSE);
+                sqe->fd = op->fd;
+                op->step = 3;
+                return;
+            }
+            op->offset += result;
+            if (op->offset == op->data.size()) {
+                op->data.resize(op->data.size() * 2);
+            }
+            break;
+        default:
+            return finish(op, op->ok);
+        }
+        sqe = prepare(op, IORING_OP_READ);
+        sqe->fd = op->fd;
+        sqe->addr = reinterpret_cast<std::uint64_t>(&op->data[op->offset]);
+        sqe->len = op->data.size() - op->offset;
+        sqe->off = op->offset;
+        op->step = 2;
+        return;
+
+    case operation::write:
+        switch (op->step) {
+        case 0:
+            sqe = prepare(op, IORING_OP_OPENAT);
+            sqe->addr = reinterpret_cast<std::uint64_t>(op->temporary.c_str());
+            sqe->open_flags = O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC;
+            sqe->len = 0644;
+            op->step = 1;
+            return;
+        case 1:
+            if (result < 0) {
+                return finish(op, false);
+            }
+            op->fd = result;
+            break;
+        case 2:
+            if (result <= 0) {
+                op->ok = false;
+            } else {
+                op->offset += result;
+            }
+            break;
+        case 3:
+            op->ok = op->ok && result == 0;
+            if (op->ok) {
+                sqe = prepare(op, IORING_OP_RENAMEAT);
+                sqe->addr = reinterpret_cast<std::uint64_t>(op->temporary.c_str());
+                sqe->len = AT_FDCWD;
+                sqe->addr2 = reinterpret_cast<std::uint64_t>(op->path.c_str());
+                op->step = 4;
+                return;
+            }
+            sqe = prepare(op, IORING_OP_UNLINKAT);
+            sqe->addr = reinterpret_cast<std::uint64_t>(op->temporary.c_str());
+            op->step = 5;
+            return;
+        case 4:
+            if (result == 0) {
+                return finish(op, true);
+            }
+            op->ok = false;
+            sqe = prepare(op, IORING_OP_UNLINKAT);
+            sqe->addr = reinterpret_cast<std::uint64_t>(op->temporary.c_str());
+            op->step = 5;
+            return;
+        default:
+            return finish(op, false);
+        }
+        if (op->ok && op->offset < op->data.size()) {
+            sqe = prepare(op, IORING_OP_WRITE);
+            sqe->fd = op->fd;
+            sqe->addr = reinterpret_cast<std::uint64_t>(op->data.data() + op->offset);
+            sqe->len = op->data.size() - op->offset;
+            sqe->off = op->offset;
+            op->step = 2;
+            return;
+        }
+        sqe = prepare(op, IORING_OP_CLOSE);
+        sqe->fd = op->fd;
+        op->step = 3;
+        return;
+
+    case operation::fsync:
+        switch (op->step) {
+        case 0:
+            sqe = prepare(op, IORING_OP_OPENAT);
+            sqe->addr = reinterpret_cast<std::uint64_t>(op->path.c_str());
+            sqe->open_flags = O_RDONLY | O_CLOEXEC;
+            op->step = 1;
+            return;
+        case 1:
+            if (result < 0) {
+                return finish(op, false);
+            }
+            op->fd = result;
+            sqe = prepare(op, IORING_OP_FSYNC);
+            sqe->fd = op->fd;
+            op->step = 2;
+            return;
+        case 2:
+            op->ok = result == 0;
+            sqe = prepare(op, IORING_OP_CLOSE);
+            sqe->fd = op->fd;
+            op->step = 3;
+            return;
+        default:
+            return finish(op, op->ok);
+        }
+
+    case operation::unlink:
+        if (op->step == 0) {
+            sqe = prepare(op, IORING_OP_UNLINKAT);
+            sqe->addr = reinterpret_cast<std::uint64_t>(op->path.c_str());
+            op->step = 1;
+            return;
+        }
+        return finish(op, result == 0);
+
+    case operation::mkdir:
+        switch (op->step) {
+        case 0:
+            if (op->parents.empty()) {
+                return finish(op, true);
+            }
+            // Usually only the last directory is missing; the parents are
+            // only walked if it cannot be made.
+            sqe = prepare(op, IORING_OP_MKDIRAT);
+            sqe->addr = reinterpret_cast<std::uint64_t>(op->parents.back().c_str());
+            sqe->len = 0755;
+            op->step = 1;
+            return;
+        case 1:
+            if (result != -ENOENT) {
+                return finish(op, result == 0 || result == -EEXIST);
+            }
+            break;
+        default:
+            if (result != 0 && result != -EEXIST) {
+                return finish(op, false);
+            }
+            if (++op->parent == op->parents.size()) {
+                return finish(op, true);
+            }
+        }
+        sqe = prepare(op, IORING_OP_MKDIRAT);
+        sqe->addr = reinterpret_cast<std::uint64_t>(op->parents[op->parent].c_str());
+        sqe->len = 0755;
+        op->step = 2;
+        return;
+    }
+}
+
+void uring_file_io::finish(operation* op, bool ok) {
+    if (op->kind == operation::read) {
+        auto done = std::move(op->read_done);
+        auto content = std::make_shared<std::string>(ok ? std::move(op->data) : std::string());
+        boost::asio::post(io_, [done, ok, content]() { done(ok, std::move(*content)); });
+    } else {
+        auto done = std::move(op->done);
+        boost::asio::post(io_, [done, ok]() { done(ok); });
+    }
+    delete op;
+    active_--;
+}
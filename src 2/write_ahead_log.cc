@@ -0,0 +1,276 @@
+#include "write_ahead_log.h"
+#include "logger.h"
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <zlib.h>
+
+namespace {
+
+const size_t frame_header_size = 8;
+
+bool write_all(int fd, const std::string& data, std::uint64_t offset) {
+    size_t written = 0;
+    while (written < data.size()) {
+        ssize_t n = ::pwrite(fd, data.data() + written, data.size() - written, offset + written);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        written += n;
+    }
+    return true;
+}
+
+std::string frame(const std::string& payload) {
+    std::string record(frame_header_size + payload.size(), '\0');
+    std::uint32_t crc = crc32(0, reinterpret_cast<const Bytef*>(payload.data()), payload.size());
+    std::uint32_t length = payload.size();
+    std::memcpy(&record[0], &crc, 4);
+    std::memcpy(&record[4], &length, 4);
+    std::memcpy(&record[frame_header_size], payload.data(), payload.size());
+    return record;
+}
+
+}
+
+void log2_histogram::record(std::uint64_t value) {
+    int bucket = value == 0 ? 0 : 64 - __builtin_clzll(value);
+    if (bucket >= buckets) {
+        bucket = buckets - 1;
+    }
+    counts_[bucket]++;
+    std::uint64_t seen = max_.load();
+    while (value > seen && !max_.compare_exchange_weak(seen, value)) {
+    }
+}
+
+std::uint64_t log2_histogram::count() const {
+    std::uint64_t total = 0;
+    for (int i = 0; i < buckets; i++) {
+        total += counts_[i];
+    }
+    return total;
+}
+
+std::uint64_t log2_histogram::percentile(double p) const {
+    std::uint64_t total = count();
+    if (total == 0) {
+        return 0;
+    }
+    std::uint64_t rank = std::max<std::uint64_t>(1, std::ceil(p / 100.0 * total));
+    std::uint64_t seen = 0;
+    for (int i = 0; i < buckets; i++) {
+        seen += counts_[i];
+        if (seen >= rank) {
+            // Bucket i holds values in [2^(i-1), 2^i).
+            return i == 0 ? 0 : std::min<std::uint64_t>((1ULL << i) - 1, max_);
+        }
+    }
+    return max_;
+}
+
+std::uint64_t log2_histogram::max() const {
+    return max_;
+}
+
+std::string log2_histogram::summary() const {
+    return "count=" + std::to_string(count()) + " p50=" + std::to_string(percentile(50)) +
+           " p90=" + std::to_string(percentile(90)) + " p99=" + std::to_string(percentile(99)) +
+           " max=" + std::to_string(max());
+}
+
+write_ahead_log::write_ahead_log(const std::string& path): path_(path) {
+    fd_ = ::open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (fd_ < 0) {
+        throw std::runtime_error("Unable to open " + path + ": " + std::strerror(errno));
+    }
+    struct stat st;
+    if (::fstat(fd_, &st) == 0) {
+        size_ = st.st_size;
+    }
+}
+
+write_ahead_log::~write_ahead_log() {
+    {
+        std::lock_guard<std::mutex> lock(reporter_mutex_);
+        stopping_ = true;
+    }
+    reporter_wake_.notify_all();
+    if (reporter_.joinable()) {
+        reporter_.join();
+    }
+    ::close(fd_);
+}
+
+bool write_ahead_log::replay(const std::function<void(const std::string&)>& apply) {
+    std::unique_lock<std::shared_mutex> checkpoint_lock(checkpoint_mutex_);
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::string data(size_, '\0');
+    size_t done = 0;
+    while (done < data.size()) {
+        ssize_t n = ::pread(fd_, &data[done], data.size() - done, done);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        done += n;
+    }
+
+    std::uint64_t offset = 0;
+    while (offset + frame_header_size <= data.size()) {
+        std::uint32_t crc, length;
+        std::memcpy(&crc, &data[offset], 4);
+        std::memcpy(&length, &data[offset + 4], 4);
+        if (length > data.size() - offset - frame_header_size ||
+            crc != crc32(0, reinterpret_cast<const Bytef*>(data.data() + offset + frame_header_size), length)) {
+            break;
+        }
+        apply(data.substr(offset + frame_header_size, length));
+        offset += frame_header_size + length;
+    }
+    if (offset < size_) {
+        // Drop the torn tail so new records follow the last intact one.
+        if (::ftruncate(fd_, offset) != 0) {
+            return false;
+        }
+        size_ = offset;
+    }
+    return true;
+}
+
+bool write_ahead_log::commit(const std::string& payload, const std::function<bool()>& apply) {
+    auto start = std::chrono::steady_clock::now();
+    std::shared_lock<std::shared_mutex> checkpoint_lock(checkpoint_mutex_);
+    std::string record = frame(payload);
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        if (failed_) {
+            return false;
+        }
+        pending_ += record;
+        pending_records_++;
+        std::uint64_t batch = open_batch_;
+        while (durable_batch_ < batch && !failed_) {
+            if (flushing_) {
+                flushed_.wait(lock);
+                continue;
+            }
+            // Lead a flush of everything pending, including other callers' records.
+            flushing_ = true;
+            std::string data;
+            data.swap(pending_);
+            size_t records = pending_records_;
+            pending_records_ = 0;
+            std::uint64_t flushing = open_batch_++;
+            std::uint64_t offset = size_;
+            lock.unlock();
+            bool ok = write_all(fd_, data, offset) && ::fdatasync(fd_) == 0;
+            lock.lock();
+            flushing_ = false;
+            if (ok) {
+                durable_batch_ = flushing;
+                size_ += data.size();
+                fsyncs_++;
+                batch_sizes_.record(records);
+            } else {
+                failed_ = true;
+                Logger::get_global_log()->logError("Write-ahead log " + path_ + " failed: " + std::strerror(errno));
+            }
+            flushed_.notify_all();
+        }
+        if (durable_batch_ < batch) {
+            return false;
+        }
+    }
+    commits_++;
+    commit_latency_us_.record(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count());
+
+    bool applied = apply();
+    checkpoint_lock.unlock();
+
+    // One caller runs the checkpoint; the rest carry on.
+    if (checkpoint_bytes_ > 0 && size() >= checkpoint_bytes_ && !checkpointing_.exchange(true)) {
+        checkpoint(checkpoint_flush_);
+        checkpointing_ = false;
+    }
+    return applied;
+}
+
+bool write_ahead_log::checkpoint(const std::function<bool()>& flush) {
+    std::unique_lock<std::shared_mutex> checkpoint_lock(checkpoint_mutex_);
+    // No commit is in flight now, so nothing is pending or being flushed.
+    if (size() == 0) {
+        return true;
+    }
+    if (!flush()) {
+        return false;
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (::ftruncate(fd_, 0) != 0 || ::fdatasync(fd_) != 0) {
+        return false;
+    }
+    size_ = 0;
+    log_metrics();
+    return true;
+}
+
+void write_ahead_log::set_checkpoint(std::uint64_t bytes, std::function<bool()> flush) {
+    checkpoint_bytes_ = bytes;
+    checkpoint_flush_ = flush;
+}
+
+std::uint64_t write_ahead_log::size() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return size_;
+}
+
+std::uint64_t write_ahead_log::commits() const {
+    return commits_;
+}
+
+std::uint64_t write_ahead_log::fsyncs() const {
+    return fsyncs_;
+}
+
+const log2_histogram& write_ahead_log::batch_sizes() const {
+    return batch_sizes_;
+}
+
+const log2_histogram& write_ahead_log::commit_latency_us() const {
+    return commit_latency_us_;
+}
+
+void write_ahead_log::report_metrics(std::chrono::milliseconds interval) {
+    std::lock_guard<std::mutex> lock(reporter_mutex_);
+    if (reporter_.joinable()) {
+        return;
+    }
+    reporter_ = std::thread([this, interval]() {
+        std::uint64_t reported = commits();
+        std::unique_lock<std::mutex> lock(reporter_mutex_);
+        while (!reporter_wake_.wait_for(lock, interval, [this]() { return stopping_; })) {
+            if (commits() != reported) {
+                reported = commits();
+                log_metrics();
+            }
+        }
+    });
+}
+
+void write_ahead_log::log_metrics() const {
+    Logger* logger = Logger::get_global_log();
+    logger->logInfo("[WalMetrics] log:" + path_ + " commits:" + std::to_string(commits()) + " fsyncs:" + std::to_string(fsyncs()));
+    logger->logInfo("[WalMetrics] log:" + path_ + " batch_size " + batch_sizes_.summary());
+    logger->logInfo("[WalMetrics] log:" + path_ + " commit_latency_us " + commit_latency_us_.summary());
+}
@@ -0,0 +1,109 @@
+#include <gtest/gtest.h>
+#include "aggregate_query.h"
+#include <atomic>
+#include <map>
+#include <string>
+#include <vector>
+
+TEST(AggregateQueryTest, ExtractsOnlyNamedFields) {
+  std::vector<std::string_view> values;
+  ASSERT_TRUE(aggregate_query::extract(
+      " { \"name\" : \"a \\\"long\\\" name with a } and a \\\\ in it\", \"nested\": {\"price\": 1, \"s\": \"]\"},"
+      " \"pr\\u0069ce\": 12.5, \"tags\": [1, [2]], \"brand\": \"Acme\" } ",
+      {"price", "brand", "missing"}, values));
+  EXPECT_EQ(values, (std::vector<std::string_view>{"12.5", "\"Acme\"", ""}));
+
+  EXPECT_TRUE(aggregate_query::extract("{}", {"price"}, values));
+  EXPECT_EQ(values[0], "");
+  EXPECT_FALSE(aggregate_query::extract("[1, 2]", {"price"}, values));
+  EXPECT_FALSE(aggregate_query::extract("{\"price\": ", {"price"}, values));
+  EXPECT_FALSE(aggregate_query::extract("{\"price\" 1}", {"price"}, values));
+}
+
+TEST(AggregateQueryTest, ParsesQueries) {
+  aggregate_query query;
+  std::string error;
+  EXPECT_TRUE(query.parse("count", "", "", error));
+  EXPECT_TRUE(query.parse("avg", "price", "brand", error));
+  EXPECT_EQ(query.op(), aggregate_query::operation::avg);
+  EXPECT_EQ(query.group_by(), "brand");
+  EXPECT_FALSE(query.parse("sum", "", "", error));
+  EXPECT_EQ(error, "op=sum needs a field");
+  EXPECT_FALSE(query.parse("median", "price", "", error));
+  EXPECT_FALSE(query.parse("", "", "", error));
+}
+
+TEST(AggregateQueryTest, FoldsNumericFields) {
+  aggregate_query query;
+  std::string error;
+  ASSERT_TRUE(query.parse("sum", "price", "", error));
+  std::map<std::string, aggregate_query::group> groups;
+  EXPECT_TRUE(query.add("{\"price\": 2.5}", groups));
+  EXPECT_TRUE(query.add("{\"price\": -1e1}", groups));
+  EXPECT_TRUE(query.add("{\"price\": 4}", groups));
+  // Not numbers, so not folded.
+  EXPECT_FALSE(query.add("{\"price\": \"4\"}", groups));
+  EXPECT_FALSE(query.add("{\"price\": null}", groups));
+  EXPECT_FALSE(query.add("{\"cost\": 4}", groups));
+  EXPECT_FALSE(query.add("not json", groups));
+
+  const aggregate_query::group& all = groups[""];
+  EXPECT_EQ(all.count, 3u);
+  EXPECT_DOUBLE_EQ(all.value(aggregate_query::operation::sum), -3.5);
+  EXPECT_DOUBLE_EQ(all.value(aggregate_query::operation::min), -10);
+  EXPECT_DOUBLE_EQ(all.value(aggregate_query::operation::max), 4);
+  EXPECT_DOUBLE_EQ(all.value(aggregate_query::operation::avg), -3.5 / 3);
+}
+
+TEST(AggregateQueryTest, GroupsByScalars) {
+  aggregate_query query;
+  std::string error;
+  ASSERT_TRUE(query.parse("count", "", "brand", error));
+  std::map<std::string, aggregate_query::group> groups;
+  EXPECT_TRUE(query.add("{\"brand\": \"Acme\"}", groups));
+  EXPECT_TRUE(query.add("{\"brand\": \"Ac\\u006de\"}", groups));
+  EXPECT_TRUE(query.add("{\"brand\": 7}", groups));
+  EXPECT_TRUE(query.add("{\"brand\": null}", groups));
+  EXPECT_FALSE(query.add("{\"brand\": {\"name\": \"Acme\"}}", groups));
+  EXPECT_FALSE(query.add("{\"model\": \"X\"}", groups));
+
+  ASSERT_EQ(groups.size(), 3u);
+  EXPECT_EQ(groups["Acme"].count, 2u);
+  EXPECT_EQ(groups["7"].count, 1u);
+  EXPECT_EQ(groups["null"].count, 1u);
+}
+
+TEST(AggregateQueryTest, ScansEveryEntity) {
+  aggregate_query query;
+  std::string error;
+  ASSERT_TRUE(query.parse("max", "n", "even", error));
+  std::vector<std::string> ids;
+  for (int i = 0; i < 1000; i++) {
+    ids.push_back(std::to_string(i));
+  }
+  std::atomic<int> reads{0};
+  auto read = [&reads](const std::string& id, std::string& data) {
+    reads++;
+    int n = std::stoi(id);
+    if (n % 100 == 99) {
+      return false;  // skipped, like an expired entity
+    }
+    data = "{\"n\": " + id + ", \"even\": " + (n % 2 == 0 ? "true" : "false") + "}";
+    return true;
+  };
+
+  std::map<std::string, aggregate_query::group> groups;
+  query.run(ids, read, groups);
+  EXPECT_EQ(reads, 1000);
+  ASSERT_EQ(groups.size(), 2u);
+  EXPECT_EQ(groups["true"].count, 500u);
+  EXPECT_EQ(groups["false"].count, 490u);
+  EXPECT_DOUBLE_EQ(groups["true"].max, 998);
+  EXPECT_DOUBLE_EQ(groups["false"].max, 997);
+  EXPECT_DOUBLE_EQ(groups["false"].min, 1);
+
+  // Nothing to scan.
+  groups.clear();
+  query.run({}, read, groups);
+  EXPECT_TRUE(groups.empty());
+}
@@ -0,0 +1,136 @@
+#include <gtest/gtest.h>
+#include "asset_bundle.h"
+#include "config_parser.h"
+#include "mime_types.h"
+#include <zlib.h>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <string>
+
+class AssetBundleTest : public ::testing::Test {
+protected:
+  std::filesystem::path root = std::filesystem::temp_directory_path() / "asset_bundle_test";
+  std::string bundle_path = (std::filesystem::temp_directory_path() / "asset_bundle_test.bundle").string();
+
+  void SetUp() override {
+    std::filesystem::remove_all(root);
+    std::filesystem::create_directories(root / "static" / "nested");
+    std::ofstream(root / "static" / "index.html") << "<html>" << std::string(4096, 'x') << "</html>";
+    std::ofstream(root / "static" / "nested" / "a.txt") << "STUFF\n";
+    std::ofstream(root / "static" / "Doc.MD") << "# Doc";
+  }
+
+  void TearDown() override {
+    std::filesystem::remove_all(root);
+    std::filesystem::remove(bundle_path);
+  }
+
+  static std::string gunzip(std::string_view data) {
+    z_stream stream;
+    std::memset(&stream, 0, sizeof(stream));
+    inflateInit2(&stream, 15 + 16);
+    std::string out(1 << 16, '\0');
+    stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data.data()));
+    stream.avail_in = data.size();
+    stream.next_out = reinterpret_cast<Bytef*>(&out[0]);
+    stream.avail_out = out.size();
+    inflate(&stream, Z_FINISH);
+    out.resize(stream.total_out);
+    inflateEnd(&stream);
+    return out;
+  }
+};
+
+TEST_F(AssetBundleTest, PacksAndFindsDirectory) {
+  asset_bundle_writer writer;
+  mime_types types;
+  ASSERT_TRUE(writer.add_directory(root.string(), types));
+  ASSERT_TRUE(writer.write(bundle_path));
+
+  asset_bundle bundle;
+  ASSERT_TRUE(bundle.open(bundle_path));
+  EXPECT_EQ(bundle.size(), 3);
+
+  asset found;
+  ASSERT_TRUE(bundle.find("/static/nested/a.txt", &found));
+  EXPECT_EQ(found.data, "STUFF\n");
+  EXPECT_EQ(found.content_type, "text/plain");
+  EXPECT_EQ(found.etag.size(), 18);
+  EXPECT_TRUE(found.gzip.empty());
+  EXPECT_GT(found.mtime, 0);
+
+  ASSERT_TRUE(bundle.find("/static/index.html", &found));
+  EXPECT_EQ(found.content_type, "text/html");
+  ASSERT_FALSE(found.gzip.empty());
+  EXPECT_LT(found.gzip.size(), found.data.size());
+  EXPECT_EQ(gunzip(found.gzip), found.data);
+
+  ASSERT_TRUE(bundle.find("/static/Doc.MD", &found));
+  EXPECT_EQ(found.content_type, "text/markdown");
+
+  EXPECT_FALSE(bundle.find("/static/missing.txt", &found));
+  EXPECT_FALSE(bundle.find("static/nested/a.txt", &found));
+}
+
+TEST_F(AssetBundleTest, ManyEntries) {
+  asset_bundle_writer writer;
+  for (int i = 0; i < 5000; i++) {
+    writer.add("/f" + std::to_string(i), "text/plain", std::to_string(i), i);
+  }
+  ASSERT_TRUE(writer.write(bundle_path));
+
+  asset_bundle bundle;
+  ASSERT_TRUE(bundle.open(bundle_path));
+  for (int i = 0; i < 5000; i++) {
+    asset found;
+    ASSERT_TRUE(bundle.find("/f" + std::to_string(i), &found));
+    ASSERT_EQ(found.data, std::to_string(i));
+    ASSERT_EQ(found.mtime, i);
+  }
+}
+
+TEST_F(AssetBundleTest, EmptyBundle) {
+  asset_bundle_writer writer;
+  ASSERT_TRUE(writer.write(bundle_path));
+  asset_bundle bundle;
+  ASSERT_TRUE(bundle.open(bundle_path));
+  asset found;
+  EXPECT_FALSE(bundle.find("/", &found));
+}
+
+TEST_F(AssetBundleTest, RejectsDuplicatePaths) {
+  asset_bundle_writer writer;
+  writer.add("/a", "text/plain", "A", 0);
+  writer.add("/a", "text/plain", "B", 0);
+  EXPECT_FALSE(writer.write(bundle_path));
+}
+
+TEST_F(AssetBundleTest, RejectsInvalidFiles) {
+  asset_bundle bundle;
+  EXPECT_FALSE(bundle.open(bundle_path));
+
+  std::ofstream(bundle_path) << "not a bundle, just some text that is long enough for a header";
+  EXPECT_FALSE(bundle.open(bundle_path));
+
+  // A truncated bundle fails validation instead of faulting on lookup.
+  asset_bundle_writer writer;
+  writer.add("/a", "text/plain", std::string(1000, 'a'), 0);
+  ASSERT_TRUE(writer.write(bundle_path));
+  std::filesystem::resize_file(bundle_path, 600);
+  EXPECT_FALSE(bundle.open(bundle_path));
+}
+
+TEST_F(AssetBundleTest, LoadConfig) {
+  asset_bundle_writer writer;
+  ASSERT_TRUE(writer.write(bundle_path));
+
+  HandlerConfig config = {"static_handler", "/static", ""};
+  config.directives["bundle"] = {bundle_path};
+  EXPECT_TRUE(asset_bundle::load_config({config}));
+  EXPECT_NE(asset_bundle::get_shared(bundle_path), nullptr);
+  EXPECT_EQ(asset_bundle::get_shared(bundle_path), asset_bundle::get_shared(bundle_path));
+
+  config.directives["bundle"] = {bundle_path + ".missing"};
+  EXPECT_FALSE(asset_bundle::load_config({config}));
+}
@@ -0,0 +1,179 @@
+#include <gtest/gtest.h>
+#include "async_file_io.h"
+#include "config_parser.h"
+#include "uring_file_io.h"
+#include <boost/asio/executor_work_guard.hpp>
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Runs every test on both backends; the io_uring run is skipped where the
+// kernel does not offer it.
+class AsyncFileIoTest : public ::testing::TestWithParam<bool> {
+protected:
+  boost::asio::io_context io;
+  boost::asio::executor_work_guard<boost::asio::io_context::executor_type> work = boost::asio::make_work_guard(io);
+  std::filesystem::path root = std::filesystem::temp_directory_path() / "async_file_io_test";
+  std::shared_ptr<async_file_io> files;
+
+  void SetUp() override {
+    std::filesystem::remove_all(root);
+    std::filesystem::create_directories(root);
+    bool threads = GetParam();
+    if (threads) {
+      files = async_file_io::create(io, 2, true);
+    } else {
+      files = uring_file_io::open(io);
+      if (!files) {
+        GTEST_SKIP() << "io_uring is not available";
+      }
+    }
+  }
+
+  void TearDown() override {
+    files.reset();
+    std::filesystem::remove_all(root);
+  }
+
+  std::string path(const std::string& name) {
+    return (root / name).string();
+  }
+
+  // Runs completions until done() holds, for up to five seconds.
+  template <typename Predicate>
+  bool run_until(Predicate done) {
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+    while (!done() && std::chrono::steady_clock::now() < deadline) {
+      io.run_for(std::chrono::milliseconds(10));
+    }
+    return done();
+  }
+
+  bool write(const std::string& name, const std::string& data) {
+    int result = -1;
+    files->write(path(name), data, [&result](bool ok) { result = ok; });
+    return run_until([&result]() { return result != -1; }) && result == 1;
+  }
+
+  bool read(const std::string& name, std::string& content) {
+    int result = -1;
+    files->read(path(name), [&result, &content](bool ok, std::string data) {
+      result = ok;
+      content = std::move(data);
+    });
+    return run_until([&result]() { return result != -1; }) && result == 1;
+  }
+
+  bool call(void (async_file_io::*operation)(const std::string&, async_file_io::completion), const std::string& name) {
+    int result = -1;
+    ((*files).*operation)(path(name), [&result](bool ok) { result = ok; });
+    return run_until([&result]() { return result != -1; }) && result == 1;
+  }
+};
+
+TEST_P(AsyncFileIoTest, WritesAndReads) {
+  EXPECT_EQ(files->backend(), std::string(GetParam() ? "threads" : "io_uring"));
+  ASSERT_TRUE(write("a.md", "# Title"));
+  std::string content;
+  ASSERT_TRUE(read("a.md", content));
+  EXPECT_EQ(content, "# Title");
+
+  // Bigger than one read, and replaced by a shorter file.
+  std::string big(100000, 'x');
+  big[99999] = 'y';
+  ASSERT_TRUE(write("a.md", big));
+  ASSERT_TRUE(read("a.md", content));
+  EXPECT_EQ(content, big);
+  ASSERT_TRUE(write("a.md", ""));
+  ASSERT_TRUE(read("a.md", content));
+  EXPECT_EQ(content, "");
+  EXPECT_TRUE(call(&async_file_io::fsync, "a.md"));
+
+  EXPECT_FALSE(read("missing.md", content));
+  EXPECT_FALSE(write("missing/a.md", "# Title"));
+  EXPECT_FALSE(call(&async_file_io::fsync, "missing.md"));
+}
+
+TEST_P(AsyncFileIoTest, UnlinksAndMakesDirectories) {
+  EXPECT_TRUE(call(&async_file_io::mkdir, "Docs/2024/06"));
+  EXPECT_TRUE(std::filesystem::is_directory(root / "Docs" / "2024" / "06"));
+  EXPECT_TRUE(call(&async_file_io::mkdir, "Docs/2024/06"));
+  EXPECT_TRUE(call(&async_file_io::mkdir, "Docs/2024/07"));
+
+  ASSERT_TRUE(write("Docs/1", "# One"));
+  EXPECT_TRUE(call(&async_file_io::unlink, "Docs/1"));
+  EXPECT_FALSE(std::filesystem::exists(root / "Docs" / "1"));
+  EXPECT_FALSE(call(&async_file_io::unlink, "Docs/1"));
+}
+
+TEST_P(AsyncFileIoTest, ListsFiles) {
+  ASSERT_TRUE(call(&async_file_io::mkdir, "Docs/sub"));
+  ASSERT_TRUE(write("Docs/1", "# One"));
+  ASSERT_TRUE(write("Docs/2", "# Two"));
+  // A write in progress leaves a temporary file, which is not listed.
+  std::ofstream(path("Docs/.3.tmp-1-1")) << "# Th";
+
+  int result = -1;
+  std::vector<std::string> names;
+  files->list(path("Docs"), [&](bool ok, std::vector<std::string> listed) {
+    result = ok;
+    names = std::move(listed);
+  });
+  ASSERT_TRUE(run_until([&result]() { return result != -1; }));
+  EXPECT_EQ(result, 1);
+  std::sort(names.begin(), names.end());
+  EXPECT_EQ(names, (std::vector<std::string>{"1", "2"}));
+
+  result = -1;
+  files->list(path("Missing"), [&](bool ok, std::vector<std::string> listed) { result = ok; });
+  ASSERT_TRUE(run_until([&result]() { return result != -1; }));
+  EXPECT_EQ(result, 0);
+}
+
+TEST_P(AsyncFileIoTest, RunsManyAtOnce) {
+  ASSERT_TRUE(call(&async_file_io::mkdir, "Docs"));
+  const int count = 300;  // more than fit in the ring at once
+  int written = 0;
+  for (int i = 0; i < count; i++) {
+    files->write(path("Docs/" + std::to_string(i)), "# " + std::to_string(i), [&written](bool ok) { written += ok; });
+  }
+  ASSERT_TRUE(run_until([&written]() { return written == count; }));
+
+  int matched = 0;
+  for (int i = 0; i < count; i++) {
+    files->read(path("Docs/" + std::to_string(i)), [&matched, i](bool ok, std::string content) {
+      matched += ok && content == "# " + std::to_string(i);
+    });
+  }
+  ASSERT_TRUE(run_until([&matched]() { return matched == count; }));
+
+  auto ring = std::dynamic_pointer_cast<uring_file_io>(files);
+  if (ring) {
+    // Steps queued together go to the kernel in one call.
+    EXPECT_LT(ring->submit_calls(), ring->submitted());
+  }
+}
+
+INSTANTIATE_TEST_SUITE_P(Backends, AsyncFileIoTest, ::testing::Values(false, true),
+                         [](const ::testing::TestParamInfo<bool>& info) { return info.param ? "Threads" : "IoUring"; });
+
+TEST(AsyncFileIoConfigTest, LoadsConfig) {
+  boost::asio::io_context io;
+  HandlerConfig off{"markdown_handler", "/markdown", "./off", {{"async_io", {"off"}}}};
+  EXPECT_TRUE(async_file_io::load_config({off}, io));
+  EXPECT_EQ(async_file_io::get_shared(), nullptr);
+
+  HandlerConfig compressed{"markdown_handler", "/markdown", "./compressed", {{"async_io", {"on"}}, {"compress", {"on"}}}};
+  EXPECT_FALSE(async_file_io::load_config({compressed}, io));
+  HandlerConfig unknown{"markdown_handler", "/markdown", "./unknown", {{"async_io", {"maybe"}}}};
+  EXPECT_FALSE(async_file_io::load_config({unknown}, io));
+
+  HandlerConfig on{"markdown_handler", "/markdown", "./on", {{"async_io", {"on"}}}};
+  EXPECT_TRUE(async_file_io::load_config({on}, io));
+  EXPECT_NE(async_file_io::get_shared(), nullptr);
+  async_file_io::set_shared(nullptr);
+}
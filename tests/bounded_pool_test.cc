@@ -0,0 +1,46 @@
+#include <gtest/gtest.h>
+#include "bounded_pool.h"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+TEST(BoundedPoolTest, RunsTasks) {
+  std::atomic<int> ran{0};
+  {
+    bounded_pool pool(2, 8);
+    for (int i = 0; i < 8; i++) {
+      EXPECT_TRUE(pool.post([&ran]() { ran++; }));
+    }
+  }
+  EXPECT_EQ(ran, 8);
+}
+
+TEST(BoundedPoolTest, RefusesWhenSaturated) {
+  std::mutex mutex;
+  std::condition_variable released;
+  bool release = false;
+  auto blocked = [&]() {
+    std::unique_lock<std::mutex> lock(mutex);
+    released.wait(lock, [&]() { return release; });
+  };
+
+  bounded_pool pool(1, 2);
+  EXPECT_TRUE(pool.post(blocked));
+  EXPECT_TRUE(pool.post(blocked));
+  EXPECT_EQ(pool.pending(), 2u);
+  EXPECT_FALSE(pool.post([]() {}));
+
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    release = true;
+  }
+  released.notify_all();
+  auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+  while (pool.pending() > 0 && std::chrono::steady_clock::now() < deadline) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+  }
+  EXPECT_EQ(pool.pending(), 0u);
+  EXPECT_TRUE(pool.post([]() {}));
+}
@@ -0,0 +1,187 @@
+#include <gtest/gtest.h>
+#include "caching_file_io.h"
+#include "config_parser.h"
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+// In-memory backend that counts the reads and listings that reach it.
+class counting_file_io : public i_file_io {
+public:
+  std::map<std::string, std::string> files;
+  std::string current;
+  int reads = 0;
+  int listings = 0;
+  std::function<void()> on_read;
+
+  bool open(const std::string& filename, std::ios_base::openmode mode) override {
+    current = filename;
+    if (mode & std::ios::out) {
+      files[filename] = "";
+      return true;
+    }
+    return files.count(filename) > 0;
+  }
+  bool write(const std::string& data) override {
+    files[current] += data;
+    return true;
+  }
+  bool close() override {
+    current.clear();
+    return true;
+  }
+  bool read(const std::string& filepath, std::string& content) override {
+    reads++;
+    if (on_read) {
+      on_read();
+    }
+    auto found = files.find(filepath);
+    if (found == files.end()) {
+      return false;
+    }
+    content = found->second;
+    return true;
+  }
+  bool delete_file(const std::string& filepath) override {
+    return files.erase(filepath) > 0;
+  }
+  bool create_directories(const std::string& path) override {
+    return true;
+  }
+  bool list_directories(const std::string& path, std::vector<std::string>& directories) override {
+    listings++;
+    for (const auto& file : files) {
+      if (file.first.rfind(path + "/", 0) == 0) {
+        directories.push_back(file.first.substr(path.size() + 1));
+      }
+    }
+    return true;
+  }
+  bool exists(const std::string& filepath) override {
+    return files.count(filepath) > 0;
+  }
+};
+
+class CachingFileIoTest : public ::testing::Test {
+protected:
+  std::shared_ptr<counting_file_io> inner = std::make_shared<counting_file_io>();
+  std::shared_ptr<caching_file_io::cache> cache = std::make_shared<caching_file_io::cache>(1 << 20);
+  caching_file_io files{inner, cache};
+
+  void write(const std::string& path, const std::string& data) {
+    ASSERT_TRUE(files.open(path, std::ios::out | std::ios::trunc));
+    ASSERT_TRUE(files.write(data));
+    files.close();
+  }
+};
+
+TEST_F(CachingFileIoTest, ReadsThrough) {
+  inner->files["root/Shoes/1"] = "{\"size\": 9}";
+  std::string content;
+  ASSERT_TRUE(files.open("root/Shoes/1", std::ios::in));
+  ASSERT_TRUE(files.read("root/Shoes/1", content));
+  files.close();
+  EXPECT_EQ(content, "{\"size\": 9}");
+  EXPECT_EQ(inner->reads, 1);
+
+  // Spelled differently, it is still the same file.
+  ASSERT_TRUE(files.read("./root/Shoes/../Shoes/1", content));
+  EXPECT_TRUE(files.exists("root/Shoes/1"));
+  EXPECT_EQ(inner->reads, 1);
+  EXPECT_EQ(cache->hits(), 3);
+
+  EXPECT_FALSE(files.open("root/Shoes/2", std::ios::in));
+  EXPECT_FALSE(files.read("root/Shoes/2", content));
+  EXPECT_EQ(cache->size(), 1);
+}
+
+TEST_F(CachingFileIoTest, WritesInvalidate) {
+  write("root/Shoes/1", "{\"size\": 9}");
+  std::string content;
+  ASSERT_TRUE(files.read("root/Shoes/1", content));
+  write("root/Shoes/1", "{\"size\": 10}");
+  ASSERT_TRUE(files.read("root/Shoes/1", content));
+  EXPECT_EQ(content, "{\"size\": 10}");
+
+  std::vector<bool> results;
+  files.write_batch({{"root/Shoes/1", "{\"size\": 11}"}}, results);
+  ASSERT_TRUE(files.read("root/Shoes/1", content));
+  EXPECT_EQ(content, "{\"size\": 11}");
+
+  ASSERT_TRUE(files.delete_file("root/Shoes/1"));
+  EXPECT_FALSE(files.read("root/Shoes/1", content));
+  EXPECT_FALSE(files.exists("root/Shoes/1"));
+}
+
+TEST_F(CachingFileIoTest, CachesListings) {
+  write("root/Shoes/1", "{}");
+  std::vector<std::string> ids;
+  ASSERT_TRUE(files.list_directories("root/Shoes", ids));
+  ids.clear();
+  ASSERT_TRUE(files.list_directories("root/Shoes/", ids));
+  EXPECT_EQ(ids, std::vector<std::string>{"1"});
+  EXPECT_EQ(inner->listings, 1);
+
+  write("root/Shoes/2", "{}");
+  ids.clear();
+  ASSERT_TRUE(files.list_directories("root/Shoes", ids));
+  EXPECT_EQ(ids, (std::vector<std::string>{"1", "2"}));
+  ASSERT_TRUE(files.delete_file("root/Shoes/1"));
+  ids.clear();
+  ASSERT_TRUE(files.list_directories("root/Shoes", ids));
+  EXPECT_EQ(ids, std::vector<std::string>{"2"});
+  EXPECT_EQ(inner->listings, 3);
+}
+
+TEST_F(CachingFileIoTest, StaysWithinBudget) {
+  auto small = std::make_shared<caching_file_io::cache>(100);
+  caching_file_io bounded(inner, small);
+  std::string content;
+  for (int i = 0; i < 10; i++) {
+    inner->files["root/Shoes/" + std::to_string(i)] = std::string(30, 'x');
+    ASSERT_TRUE(bounded.read("root/Shoes/" + std::to_string(i), content));
+    EXPECT_LE(small->used(), 100);
+  }
+  EXPECT_EQ(small->size(), 2);
+
+  // The most recently used stay.
+  ASSERT_TRUE(bounded.read("root/Shoes/9", content));
+  EXPECT_EQ(inner->reads, 10);
+  inner->files["root/Shoes/big"] = std::string(200, 'x');
+  ASSERT_TRUE(bounded.read("root/Shoes/big", content));
+  EXPECT_EQ(content.size(), 200);
+  EXPECT_EQ(small->size(), 2);
+}
+
+TEST_F(CachingFileIoTest, SkipsRacedLoads) {
+  inner->files["root/Shoes/1"] = "{\"size\": 9}";
+  // Another handler writes the entity while this one is reading it.
+  inner->on_read = [this]() {
+    inner->on_read = nullptr;
+    caching_file_io writer(inner, cache);
+    ASSERT_TRUE(writer.open("root/Shoes/1", std::ios::out | std::ios::trunc));
+    ASSERT_TRUE(writer.write("{\"size\": 10}"));
+    writer.close();
+  };
+  std::string content;
+  ASSERT_TRUE(files.read("root/Shoes/1", content));
+  EXPECT_EQ(cache->size(), 0);
+  ASSERT_TRUE(files.read("root/Shoes/1", content));
+  EXPECT_EQ(content, "{\"size\": 10}");
+}
+
+TEST_F(CachingFileIoTest, LoadsConfig) {
+  HandlerConfig config{"crud_handler", "/api", "./caching_file_io_test", {{"file_cache", {"16m"}}}};
+  EXPECT_TRUE(caching_file_io::load_config({config}));
+  EXPECT_NE(dynamic_cast<caching_file_io*>(caching_file_io::wrap(config, inner).get()), nullptr);
+  EXPECT_EQ(caching_file_io::get_shared("./caching_file_io_test", 0)->budget(), 16 << 20);
+
+  HandlerConfig off{"markdown_handler", "/markdown", "./off", {{"file_cache", {"off"}}}};
+  EXPECT_TRUE(caching_file_io::load_config({off}));
+  EXPECT_EQ(caching_file_io::wrap(off, inner), inner);
+
+  HandlerConfig invalid{"crud_handler", "/api", "./invalid", {{"file_cache", {"lots"}}}};
+  EXPECT_FALSE(caching_file_io::load_config({invalid}));
+}
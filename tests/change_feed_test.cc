@@ -0,0 +1,126 @@
+#include <gtest/gtest.h>
+#include "change_feed.h"
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <thread>
+#include <vector>
+
+class ChangeFeedTest : public ::testing::Test {
+protected:
+  change_feed feed = change_feed(4, 2);
+
+  std::uint64_t latest() {
+    std::vector<change_feed::change> changes;
+    std::uint64_t next = 0;
+    EXPECT_TRUE(feed.since("./root/Shoes", UINT64_MAX, 0, changes, next));
+    return next;
+  }
+
+  std::vector<std::string> ids_since(std::uint64_t since, size_t limit, std::uint64_t& next) {
+    std::vector<change_feed::change> changes;
+    EXPECT_TRUE(feed.since("./root/Shoes", since, limit, changes, next));
+    std::vector<std::string> ids;
+    for (const auto& change : changes) {
+      ids.push_back(change.id + (change.deleted ? "-" : "+"));
+    }
+    return ids;
+  }
+};
+
+TEST_F(ChangeFeedTest, ReportsChangesInOrder) {
+  std::uint64_t start = latest();
+  feed.record("./root/Shoes", "a", false);
+  feed.record("root/Shoes/", "b", false);
+  feed.record("./root/Hats", "x", false);
+  feed.record("./root/Shoes", "a", true);
+
+  std::uint64_t next = 0;
+  EXPECT_EQ(ids_since(start, 0, next), (std::vector<std::string>{"a+", "b+", "a-"}));
+  EXPECT_EQ(next, latest());
+  EXPECT_GT(next, start);
+  EXPECT_TRUE(ids_since(next, 0, next).empty());
+}
+
+TEST_F(ChangeFeedTest, PagesWithLimit) {
+  std::uint64_t start = latest();
+  for (std::string id : {"a", "b", "c"}) {
+    feed.record("./root/Shoes", id, false);
+  }
+  std::uint64_t next = 0;
+  EXPECT_EQ(ids_since(start, 2, next), (std::vector<std::string>{"a+", "b+"}));
+  EXPECT_EQ(ids_since(next, 2, next), (std::vector<std::string>{"c+"}));
+  EXPECT_EQ(next, latest());
+}
+
+TEST_F(ChangeFeedTest, DroppedHistoryIsReported) {
+  std::uint64_t start = latest();
+  feed.record("./root/Shoes", "a", false);
+  std::uint64_t after_first = latest();
+  for (std::string id : {"b", "c", "d", "e"}) {
+    feed.record("./root/Shoes", id, false);
+  }
+  std::vector<change_feed::change> changes;
+  std::uint64_t next;
+  EXPECT_FALSE(feed.since("./root/Shoes", start, 0, changes, next));
+  EXPECT_EQ(ids_since(after_first, 0, next), (std::vector<std::string>{"b+", "c+", "d+", "e+"}));
+  // Sequences from before the feed began are never complete.
+  EXPECT_FALSE(feed.since("./root/Hats", 1, 0, changes, next));
+}
+
+TEST_F(ChangeFeedTest, WatchWakesOnChange) {
+  std::uint64_t start = latest();
+  std::atomic<int> notified{0};
+  ASSERT_TRUE(feed.watch("./root/Shoes", start, std::chrono::steady_clock::now() + std::chrono::seconds(30),
+                         [&notified]() { notified++; }));
+  EXPECT_EQ(feed.watchers(), 1);
+  feed.record("./root/Hats", "x", false);
+  EXPECT_EQ(notified, 0);
+  feed.record("./root/Shoes", "a", false);
+  EXPECT_EQ(notified, 1);
+  EXPECT_EQ(feed.watchers(), 0);
+  feed.record("./root/Shoes", "b", false);
+  EXPECT_EQ(notified, 1);
+
+  // A change the watcher has not seen yet answers it at once.
+  ASSERT_TRUE(feed.watch("./root/Shoes", start, std::chrono::steady_clock::now() + std::chrono::seconds(30),
+                         [&notified]() { notified++; }));
+  EXPECT_EQ(notified, 2);
+  EXPECT_EQ(feed.watchers(), 0);
+}
+
+TEST_F(ChangeFeedTest, WatchTimesOut) {
+  std::atomic<bool> notified{false};
+  auto started = std::chrono::steady_clock::now();
+  ASSERT_TRUE(feed.watch("./root/Shoes", latest(), started + std::chrono::milliseconds(50),
+                         [&notified]() { notified = true; }));
+  while (!notified && std::chrono::steady_clock::now() - started < std::chrono::seconds(5)) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+  }
+  EXPECT_TRUE(notified);
+  EXPECT_GE(std::chrono::steady_clock::now() - started, std::chrono::milliseconds(50));
+  EXPECT_EQ(feed.watchers(), 0);
+}
+
+TEST_F(ChangeFeedTest, LimitsWatchers) {
+  auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(30);
+  EXPECT_TRUE(feed.watch("./root/Shoes", latest(), deadline, []() {}));
+  EXPECT_TRUE(feed.watch("./root/Shoes", latest(), deadline, []() {}));
+  EXPECT_FALSE(feed.watch("./root/Shoes", latest(), deadline, []() {}));
+  feed.record("./root/Shoes", "a", false);
+  EXPECT_EQ(feed.watchers(), 0);
+}
+
+TEST_F(ChangeFeedTest, SequencesContinueAcrossFeeds) {
+  // A feed begins at the current time, so a new process's sequences are
+  // past every sequence an older one handed out.
+  std::uint64_t old_latest = latest();
+  std::this_thread::sleep_for(std::chrono::milliseconds(2));
+  change_feed restarted;
+  std::vector<change_feed::change> changes;
+  std::uint64_t next;
+  ASSERT_TRUE(restarted.since("./root/Shoes", UINT64_MAX, 0, changes, next));
+  EXPECT_GT(next, old_latest);
+  EXPECT_FALSE(restarted.since("./root/Shoes", old_latest, 0, changes, next));
+}
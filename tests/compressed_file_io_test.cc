@@ -0,0 +1,155 @@
+#include <gtest/gtest.h>
+#include "compressed_file_io.h"
+#include "config_parser.h"
+#include "file_io.h"
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+class CompressedFileIoTest : public ::testing::Test {
+protected:
+  std::filesystem::path root = std::filesystem::temp_directory_path() / "compressed_file_io_test";
+  std::shared_ptr<file_io> plain = std::make_shared<file_io>();
+
+  void SetUp() override {
+    std::filesystem::remove_all(root);
+    std::filesystem::create_directories(root / "Shoes");
+  }
+
+  void TearDown() override {
+    std::filesystem::remove_all(root);
+  }
+
+  std::string path(const std::string& id) {
+    return (root / "Shoes" / id).string();
+  }
+
+  std::string on_disk(const std::string& id) {
+    std::ifstream file(path(id), std::ios::binary);
+    std::stringstream contents;
+    contents << file.rdbuf();
+    return contents.str();
+  }
+
+  std::string entity(int i) {
+    return "{\"brand\": \"Acme\", \"model\": \"Runner " + std::to_string(i) + "\", \"size\": " + std::to_string(i % 14) +
+           ", \"color\": \"blue\", \"in_stock\": true}";
+  }
+
+  void write(i_file_io& files, const std::string& id, const std::string& data) {
+    ASSERT_TRUE(files.open(path(id), std::ios::out | std::ios::trunc));
+    ASSERT_TRUE(files.write(data));
+    files.close();
+  }
+};
+
+TEST_F(CompressedFileIoTest, CompressesAtRest) {
+  compressed_file_io files(plain, root.string());
+  std::string data;
+  for (int i = 0; i < 50; i++) {
+    data += entity(i) + "\n";
+  }
+  write(files, "1", data);
+
+  std::string stored = on_disk("1");
+  EXPECT_EQ(stored.substr(0, 2), "\x1f\x8b");
+  EXPECT_LT(stored.size() * 5, data.size());
+  std::string read;
+  ASSERT_TRUE(files.read(path("1"), read));
+  EXPECT_EQ(read, data);
+}
+
+TEST_F(CompressedFileIoTest, ReadsStoredGzip) {
+  compressed_file_io files(plain, root.string());
+  write(files, "1", entity(1));
+  std::string content;
+  std::string encoding;
+  ASSERT_TRUE(files.read_stored(path("1"), content, encoding));
+  EXPECT_EQ(encoding, "gzip");
+  EXPECT_EQ(content, on_disk("1"));
+
+  // Files from before compression was turned on are read as they are.
+  write(*plain, "2", entity(2));
+  ASSERT_TRUE(files.read_stored(path("2"), content, encoding));
+  EXPECT_EQ(encoding, "");
+  EXPECT_EQ(content, entity(2));
+  ASSERT_TRUE(files.read(path("2"), content));
+  EXPECT_EQ(content, entity(2));
+}
+
+TEST_F(CompressedFileIoTest, ConcatenatesWrites) {
+  compressed_file_io files(plain, root.string());
+  ASSERT_TRUE(files.open(path("1"), std::ios::out | std::ios::trunc));
+  ASSERT_TRUE(files.write("{\"a\": "));
+  ASSERT_TRUE(files.write("1}"));
+  files.close();
+  std::string read;
+  ASSERT_TRUE(files.read(path("1"), read));
+  EXPECT_EQ(read, "{\"a\": 1}");
+
+  std::string corrupt = on_disk("1");
+  corrupt.resize(corrupt.size() - 3);
+  std::ofstream(path("1"), std::ios::binary | std::ios::trunc) << corrupt;
+  EXPECT_FALSE(files.read(path("1"), read));
+}
+
+TEST_F(CompressedFileIoTest, CompressesAgainstDictionary) {
+  std::vector<std::string> samples;
+  for (int i = 0; i < 20; i++) {
+    samples.push_back(entity(i));
+  }
+  std::string dictionary = compressed_file_io::train(samples, 1024);
+  ASSERT_FALSE(dictionary.empty());
+  EXPECT_LE(dictionary.size(), 1024);
+  EXPECT_NE(dictionary.find("\"brand\": \"Acme\""), std::string::npos);
+
+  auto dictionaries = std::make_shared<compressed_file_io::dictionaries>();
+  (*dictionaries)["Shoes"] = dictionary;
+  compressed_file_io files(plain, root.string(), dictionaries);
+  compressed_file_io without(plain, root.string());
+  write(files, "1", entity(99));
+  write(without, "2", entity(99));
+
+  std::string stored = on_disk("1");
+  EXPECT_EQ(stored.substr(0, 2), "\x1f\x9e");
+  EXPECT_LT(stored.size(), on_disk("2").size() / 2);
+  std::string content;
+  std::string encoding;
+  ASSERT_TRUE(files.read_stored(path("1"), content, encoding));
+  EXPECT_EQ(encoding, "");
+  EXPECT_EQ(content, entity(99));
+  EXPECT_FALSE(without.read(path("1"), content));
+}
+
+TEST_F(CompressedFileIoTest, CompressesBatches) {
+  compressed_file_io files(plain, root.string());
+  std::vector<bool> results;
+  files.write_batch({{path("1"), entity(1)}, {path("2"), entity(2)}, {path("1"), "", true}}, results);
+  EXPECT_EQ(results, (std::vector<bool>{true, true, true}));
+  EXPECT_FALSE(files.exists(path("1")));
+  EXPECT_EQ(on_disk("2").substr(0, 2), "\x1f\x8b");
+  std::string read;
+  ASSERT_TRUE(files.read(path("2"), read));
+  EXPECT_EQ(read, entity(2));
+}
+
+TEST_F(CompressedFileIoTest, LoadsConfig) {
+  std::ofstream((root / "shoes.dict").string()) << "\"brand\": \"Acme\"";
+  HandlerConfig config{"crud_handler", "/api", (root / "compressed").string(), {{"compress", {"on"}}}};
+  config.directives["compress_dictionary"] = {"Shoes:" + (root / "shoes.dict").string()};
+  EXPECT_TRUE(compressed_file_io::load_config({config}));
+  EXPECT_NE(dynamic_cast<compressed_file_io*>(compressed_file_io::wrap(config, plain).get()), nullptr);
+
+  HandlerConfig off{"markdown_handler", "/markdown", (root / "off").string(), {{"compress", {"off"}}}};
+  EXPECT_TRUE(compressed_file_io::load_config({off}));
+  EXPECT_EQ(compressed_file_io::wrap(off, plain), plain);
+
+  HandlerConfig unknown{"crud_handler", "/api", (root / "unknown").string(), {{"compress", {"zstd"}}}};
+  EXPECT_FALSE(compressed_file_io::load_config({unknown}));
+  HandlerConfig missing{"crud_handler", "/api", (root / "missing").string(),
+                        {{"compress", {"on"}}, {"compress_dictionary", {"Shoes:" + (root / "missing.dict").string()}}}};
+  EXPECT_FALSE(compressed_file_io::load_config({missing}));
+}
@@ -182,6 +182,17 @@ TEST_F(NginxConfigParserTestFixture, GetRequestHandlersSuccess) {
   EXPECT_EQ(block.size(), 2);
 }
 
+TEST_F(NginxConfigParserTestFixture, GetRequestHandlersDirectives) {
+  bool success = parser.Parse("test_configs/config_with_preload", &out_config);
+  EXPECT_TRUE(success);
+
+  std::vector<HandlerConfig> block = out_config.GetRequestHandlers();
+  ASSERT_EQ(block.size(), 1);
+  ASSERT_EQ(block[0].directives.count("preload"), 1);
+  EXPECT_EQ(block[0].directives["preload"], std::vector<std::string>{"32m"});
+  EXPECT_EQ(block[0].directives["root"], std::vector<std::string>{"/usr/src/projects/new-grad-ten-years-experience/static"});
+}
+
 TEST_F(NginxConfigParserTestFixture, GetRequestHandlersAbsPathSuccess) {
   bool success = parser.Parse("test_configs/config_with_handlers_absolute_path", &out_config);
   EXPECT_TRUE(success);
@@ -197,3 +208,34 @@ TEST_F(NginxConfigParserTestFixture, GetRequestHandlersDuplicateLocations) {
   std::vector<HandlerConfig> block = out_config.GetRequestHandlers();
   EXPECT_EQ(block.size(), 0);
 }
+
+TEST(ParseConfigValueTest, Durations) {
+  std::chrono::milliseconds duration;
+  ASSERT_TRUE(ParseConfigDuration("30", &duration));
+  EXPECT_EQ(duration, std::chrono::seconds(30));
+  ASSERT_TRUE(ParseConfigDuration("20s", &duration));
+  EXPECT_EQ(duration, std::chrono::seconds(20));
+  ASSERT_TRUE(ParseConfigDuration("500ms", &duration));
+  EXPECT_EQ(duration, std::chrono::milliseconds(500));
+  ASSERT_TRUE(ParseConfigDuration("5m", &duration));
+  EXPECT_EQ(duration, std::chrono::minutes(5));
+  ASSERT_TRUE(ParseConfigDuration("2h", &duration));
+  EXPECT_EQ(duration, std::chrono::hours(2));
+  EXPECT_FALSE(ParseConfigDuration("", &duration));
+  EXPECT_FALSE(ParseConfigDuration("s", &duration));
+  EXPECT_FALSE(ParseConfigDuration("10x", &duration));
+}
+
+TEST(ParseConfigValueTest, Sizes) {
+  size_t size;
+  ASSERT_TRUE(ParseConfigSize("512", &size));
+  EXPECT_EQ(size, 512);
+  ASSERT_TRUE(ParseConfigSize("64k", &size));
+  EXPECT_EQ(size, 64 * 1024);
+  ASSERT_TRUE(ParseConfigSize("16m", &size));
+  EXPECT_EQ(size, 16 * 1024 * 1024);
+  ASSERT_TRUE(ParseConfigSize("1G", &size));
+  EXPECT_EQ(size, 1024 * 1024 * 1024);
+  EXPECT_FALSE(ParseConfigSize("m", &size));
+  EXPECT_FALSE(ParseConfigSize("12q", &size));
+}
@@ -0,0 +1,65 @@
+#include <gtest/gtest.h>
+#include "content_cache.h"
+#include <string>
+
+class ContentCacheTest : public ::testing::Test {
+protected:
+  content_cache cache = content_cache(16);
+};
+
+TEST_F(ContentCacheTest, MissWhenEmpty) {
+  EXPECT_EQ(cache.get("/a", 1, 5), nullptr);
+}
+
+TEST_F(ContentCacheTest, HitWithSameMtimeAndSize) {
+  auto put = cache.put("/a", 1, "STUFF");
+  auto got = cache.get("/a", 1, 5);
+  ASSERT_NE(got, nullptr);
+  EXPECT_EQ(got, put);
+  EXPECT_EQ(*got->data, "STUFF");
+  EXPECT_EQ(cache.used(), 5);
+}
+
+TEST_F(ContentCacheTest, StaleEntryIsDropped) {
+  cache.put("/a", 1, "STUFF");
+  EXPECT_EQ(cache.get("/a", 2, 5), nullptr);
+  EXPECT_EQ(cache.get("/a", 1, 6), nullptr);
+  EXPECT_EQ(cache.used(), 0);
+}
+
+TEST_F(ContentCacheTest, EvictsLeastRecentlyUsed) {
+  cache.put("/a", 1, "AAAAAA");
+  cache.put("/b", 1, "BBBBBB");
+  cache.get("/a", 1, 6);
+  cache.put("/c", 1, "CCCCCC");
+  EXPECT_NE(cache.get("/a", 1, 6), nullptr);
+  EXPECT_EQ(cache.get("/b", 1, 6), nullptr);
+  EXPECT_NE(cache.get("/c", 1, 6), nullptr);
+  EXPECT_LE(cache.used(), cache.budget());
+}
+
+TEST_F(ContentCacheTest, OversizedContentIsReturnedButNotKept) {
+  auto put = cache.put("/big", 1, std::string(32, 'x'));
+  ASSERT_NE(put, nullptr);
+  EXPECT_EQ(put->data->size(), 32);
+  EXPECT_EQ(cache.get("/big", 1, 32), nullptr);
+  EXPECT_EQ(cache.used(), 0);
+}
+
+TEST_F(ContentCacheTest, ShrinkingBudgetEvicts) {
+  cache.put("/a", 1, "AAAAAA");
+  cache.put("/b", 1, "BBBBBB");
+  cache.set_budget(6);
+  EXPECT_LE(cache.used(), 6);
+  EXPECT_EQ(cache.get("/a", 1, 6), nullptr);
+}
+
+TEST_F(ContentCacheTest, EtagDependsOnContent) {
+  std::string etag = content_cache::make_etag("STUFF");
+  EXPECT_EQ(etag.size(), 18);
+  EXPECT_EQ(etag.front(), '"');
+  EXPECT_EQ(etag.back(), '"');
+  EXPECT_EQ(etag, content_cache::make_etag("STUFF"));
+  EXPECT_NE(etag, content_cache::make_etag("STUFF\n"));
+  EXPECT_EQ(cache.put("/a", 1, "STUFF")->etag, etag);
+}
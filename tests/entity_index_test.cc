@@ -0,0 +1,149 @@
+#include <gtest/gtest.h>
+#include "entity_index.h"
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <ios>
+#include <thread>
+#include <string>
+#include <vector>
+
+// Lists a fixed set of IDs and counts how often it is asked to.
+class listing_file_io : public i_file_io {
+public:
+  std::vector<std::string> listed;
+  int listings = 0;
+
+  bool open(const std::string&, std::ios_base::openmode) override { return false; }
+  bool write(const std::string&) override { return false; }
+  bool close() override { return true; }
+  bool read(const std::string&, std::string&) override { return false; }
+  bool delete_file(const std::string&) override { return false; }
+  bool create_directories(const std::string&) override { return false; }
+  bool list_directories(const std::string& path, std::vector<std::string>& directories) override {
+    listings++;
+    if (path.find("missing") != std::string::npos) {
+      return false;
+    }
+    directories = listed;
+    return true;
+  }
+  bool exists(const std::string&) override { return false; }
+};
+
+class EntityIndexTest : public ::testing::Test {
+protected:
+  listing_file_io files;
+  entity_index index;
+
+  std::vector<std::string> page(const std::string& cursor, size_t limit, bool& more) {
+    std::vector<std::string> ids;
+    EXPECT_TRUE(index.page(files, "./root/Shoes", cursor, limit, ids, more));
+    return ids;
+  }
+};
+
+TEST_F(EntityIndexTest, ListsEverythingSorted) {
+  files.listed = {"c", "a", "b"};
+  bool more = true;
+  EXPECT_EQ(page("", 0, more), (std::vector<std::string>{"a", "b", "c"}));
+  EXPECT_FALSE(more);
+}
+
+TEST_F(EntityIndexTest, PagesWithCursor) {
+  files.listed = {"e", "d", "c", "b", "a"};
+  bool more = false;
+  EXPECT_EQ(page("", 2, more), (std::vector<std::string>{"a", "b"}));
+  EXPECT_TRUE(more);
+  EXPECT_EQ(page("b", 2, more), (std::vector<std::string>{"c", "d"}));
+  EXPECT_TRUE(more);
+  EXPECT_EQ(page("d", 2, more), (std::vector<std::string>{"e"}));
+  EXPECT_FALSE(more);
+  EXPECT_TRUE(page("e", 2, more).empty());
+  EXPECT_FALSE(more);
+}
+
+TEST_F(EntityIndexTest, LoadsOnce) {
+  files.listed = {"a"};
+  bool more;
+  page("", 0, more);
+  page("", 0, more);
+  // Trailing slashes and dots name the same entity.
+  std::vector<std::string> ids;
+  EXPECT_TRUE(index.page(files, "./root/./Shoes/", "", 0, ids, more));
+  EXPECT_EQ(files.listings, 1);
+}
+
+TEST_F(EntityIndexTest, CursorSurvivesChanges) {
+  files.listed = {"a", "b", "c", "d"};
+  bool more;
+  EXPECT_EQ(page("", 2, more), (std::vector<std::string>{"a", "b"}));
+  // The cursor entity itself is deleted and a new one lands before it.
+  index.remove("./root/Shoes", "b");
+  index.add("./root/Shoes", "aa");
+  index.add("./root/Shoes", "e");
+  EXPECT_EQ(page("b", 0, more), (std::vector<std::string>{"c", "d", "e"}));
+}
+
+TEST_F(EntityIndexTest, UpdatesBeforeLoadAreIgnored) {
+  index.add("./root/Shoes", "z");
+  files.listed = {"a"};
+  bool more;
+  EXPECT_EQ(page("", 0, more), std::vector<std::string>{"a"});
+}
+
+TEST_F(EntityIndexTest, MissingDirectory) {
+  std::vector<std::string> ids;
+  bool more;
+  EXPECT_FALSE(index.page(files, "./root/missing", "", 0, ids, more));
+}
+
+TEST_F(EntityIndexTest, SharedPerRoot) {
+  EXPECT_EQ(entity_index::get_shared("./a"), entity_index::get_shared("./a"));
+  EXPECT_NE(entity_index::get_shared("./a"), entity_index::get_shared("./b"));
+}
+
+TEST_F(EntityIndexTest, TracksExternalChanges) {
+  std::filesystem::path directory = std::filesystem::temp_directory_path() / "entity_index_test" / "Shoes";
+  std::filesystem::remove_all(directory.parent_path());
+  std::filesystem::create_directories(directory);
+  std::ofstream(directory / "a") << "{}";
+  files.listed = {"a"};
+
+  // Polls the index until it lists expected, for up to five seconds.
+  auto lists = [&](const std::vector<std::string>& expected) {
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+    std::vector<std::string> ids;
+    bool more;
+    do {
+      ids.clear();
+      EXPECT_TRUE(index.page(files, directory.string(), "", 0, ids, more));
+      if (ids == expected) {
+        return true;
+      }
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    } while (std::chrono::steady_clock::now() < deadline);
+    return false;
+  };
+
+  EXPECT_TRUE(lists({"a"}));
+  std::ofstream(directory / "b") << "{}";
+  EXPECT_TRUE(lists({"a", "b"}));
+  std::filesystem::rename(directory / "a", directory / "c");
+  EXPECT_TRUE(lists({"b", "c"}));
+  std::filesystem::remove(directory / "b");
+  EXPECT_TRUE(lists({"c"}));
+  // Writes in progress and subdirectories are not entities.
+  std::ofstream(directory / ".d.tmp") << "{}";
+  std::filesystem::create_directory(directory / "sub");
+  std::filesystem::rename(directory / ".d.tmp", directory / "d");
+  EXPECT_TRUE(lists({"c", "d"}));
+  EXPECT_EQ(files.listings, 1);
+
+  // A removed directory is listed from storage again.
+  std::filesystem::remove_all(directory);
+  files.listed = {"x"};
+  EXPECT_TRUE(lists({"x"}));
+  EXPECT_EQ(files.listings, 2);
+  std::filesystem::remove_all(directory.parent_path());
+}
@@ -0,0 +1,174 @@
+#include <gtest/gtest.h>
+#include "entity_locks.h"
+#include "crud_handler.h"
+#include "file_io.h"
+#include <algorithm>
+#include <atomic>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <shared_mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <boost/beast/http.hpp>
+
+namespace http = boost::beast::http;
+
+TEST(EntityLocksTest, StripeCountIsPowerOfTwo) {
+  EXPECT_EQ(entity_locks(1).stripe_count(), 1);
+  EXPECT_EQ(entity_locks(100).stripe_count(), 128);
+  EXPECT_EQ(entity_locks(256).stripe_count(), 256);
+}
+
+TEST(EntityLocksTest, EquivalentPathsShareAStripe) {
+  entity_locks locks;
+  EXPECT_EQ(&locks.for_path("./root/Shoes/1"), &locks.for_path("./root/Shoes/1"));
+  EXPECT_EQ(&locks.for_path("./root/Shoes/1"), &locks.for_path("./root//Shoes/./1"));
+  EXPECT_EQ(&entity_locks::get_global_locks(), &entity_locks::get_global_locks());
+}
+
+TEST(EntityLocksTest, ReadersShareWritersExclude) {
+  entity_locks locks(1);
+  std::shared_mutex& mutex = locks.for_path("a");
+  std::shared_lock<std::shared_mutex> reader(mutex);
+  std::thread other_reader([&mutex]() {
+    EXPECT_TRUE(mutex.try_lock_shared());
+    mutex.unlock_shared();
+    EXPECT_FALSE(mutex.try_lock());
+  });
+  other_reader.join();
+}
+
+TEST(EntityLocksTest, CountersStayConsistent) {
+  entity_locks locks(4);
+  const int threads = 8;
+  const int iterations = 2000;
+  std::vector<long> counters(16, 0);
+  std::vector<std::thread> workers;
+  for (int t = 0; t < threads; t++) {
+    workers.emplace_back([&, t]() {
+      for (int i = 0; i < iterations; i++) {
+        int key = (t + i) % counters.size();
+        std::unique_lock<std::shared_mutex> lock(locks.for_path(std::to_string(key)));
+        counters[key]++;
+      }
+    });
+  }
+  for (auto& worker : workers) {
+    worker.join();
+  }
+  long total = 0;
+  for (long counter : counters) {
+    total += counter;
+  }
+  EXPECT_EQ(total, threads * iterations);
+}
+
+TEST(EntityLocksTest, LockAllTakesEachStripeOnce) {
+  entity_locks locks(2);
+  // More paths than stripes, with repeats: must not self-deadlock.
+  auto held = locks.lock_all({"a", "b", "c", "a", "d"});
+  EXPECT_LE(held.size(), 2);
+  std::thread other([&locks]() {
+    for (const auto& path : {"a", "b", "c", "d"}) {
+      EXPECT_FALSE(locks.for_path(path).try_lock_shared());
+    }
+  });
+  other.join();
+}
+
+class CrudConcurrencyTest : public testing::Test {
+protected:
+  std::filesystem::path root = std::filesystem::temp_directory_path() / "entity_locks_test";
+
+  void SetUp() override {
+    std::filesystem::remove_all(root);
+  }
+
+  void TearDown() override {
+    std::filesystem::remove_all(root);
+  }
+
+  // The router builds one handler per request, so each call gets its own.
+  http::response<http::string_body> send(http::verb method, const std::string& target, const std::string& body) {
+    crud_handler handler(root.string(), std::make_shared<file_io>());
+    http::request<http::string_body> request;
+    request.method(method);
+    request.target(target);
+    request.version(11);
+    if (!body.empty()) {
+      request.set(http::field::content_type, "application/json");
+      request.body() = body;
+      request.prepare_payload();
+    }
+    return handler.handle_request(request);
+  }
+
+  static std::string body_for(int writer) {
+    return "{\"writer\": \"" + std::string(8192, 'a' + writer) + "\"}";
+  }
+};
+
+TEST_F(CrudConcurrencyTest, ConcurrentPutsAndGetsNeverInterleave) {
+  const int writers = 4;
+  const int readers = 4;
+  const int iterations = 50;
+  ASSERT_EQ(send(http::verb::put, "/api/Shoes/hot", body_for(0)).result(), http::status::created);
+
+  std::set<std::string> valid;
+  for (int w = 0; w < writers; w++) {
+    valid.insert(body_for(w));
+  }
+
+  std::atomic<int> torn{0};
+  std::vector<std::thread> threads;
+  for (int w = 0; w < writers; w++) {
+    threads.emplace_back([&, w]() {
+      for (int i = 0; i < iterations; i++) {
+        send(http::verb::put, "/api/Shoes/hot", body_for(w));
+      }
+    });
+  }
+  for (int r = 0; r < readers; r++) {
+    threads.emplace_back([&]() {
+      for (int i = 0; i < iterations; i++) {
+        auto response = send(http::verb::get, "/api/Shoes/hot", "");
+        if (response.result() != http::status::ok || valid.count(response.body()) == 0) {
+          torn++;
+        }
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  EXPECT_EQ(torn, 0);
+}
+
+TEST_F(CrudConcurrencyTest, ConcurrentPostsGetDistinctIds) {
+  const int threads = 8;
+  const int per_thread = 25;
+  std::mutex ids_mutex;
+  std::set<std::string> ids;
+  std::vector<std::thread> posters;
+  for (int t = 0; t < threads; t++) {
+    posters.emplace_back([&]() {
+      for (int i = 0; i < per_thread; i++) {
+        auto response = send(http::verb::post, "/api/Shoes", "{\"size\": 10}");
+        ASSERT_EQ(response.result(), http::status::created);
+        std::lock_guard<std::mutex> lock(ids_mutex);
+        ids.insert(response.body());
+      }
+    });
+  }
+  for (auto& poster : posters) {
+    poster.join();
+  }
+  EXPECT_EQ(ids.size(), threads * per_thread);
+
+  auto listing = send(http::verb::get, "/api/Shoes", "");
+  ASSERT_EQ(listing.result(), http::status::ok);
+  EXPECT_EQ(std::count(listing.body().begin(), listing.body().end(), ','), threads * per_thread - 1);
+}
@@ -0,0 +1,131 @@
+#include <gtest/gtest.h>
+#include "expiry_wheel.h"
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+class ExpiryWheelTest : public ::testing::Test {
+protected:
+  std::filesystem::path root = std::filesystem::temp_directory_path() / "expiry_wheel_test";
+  std::string journal_path = (root / ".ttl" / "expiry.log").string();
+  std::mutex mutex;
+  std::vector<std::string> reaped;
+
+  void SetUp() override {
+    std::filesystem::remove_all(root);
+  }
+
+  void TearDown() override {
+    std::filesystem::remove_all(root);
+  }
+
+  void start(expiry_wheel& wheel) {
+    wheel.start([this](const std::string& path, expiry_wheel& wheel) {
+      if (wheel.claim(path)) {
+        std::lock_guard<std::mutex> lock(mutex);
+        reaped.push_back(path);
+      }
+    });
+  }
+
+  // Waits up to five seconds for count entities to be reaped.
+  std::vector<std::string> wait_for_reaped(size_t count) {
+    auto started = std::chrono::steady_clock::now();
+    while (std::chrono::steady_clock::now() - started < std::chrono::seconds(5)) {
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (reaped.size() >= count) {
+          std::vector<std::string> sorted = reaped;
+          std::sort(sorted.begin(), sorted.end());
+          return sorted;
+        }
+      }
+      std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+    std::lock_guard<std::mutex> lock(mutex);
+    return reaped;
+  }
+};
+
+TEST_F(ExpiryWheelTest, ReportsExpired) {
+  expiry_wheel wheel("");
+  auto now = expiry_wheel::clock::now();
+  wheel.set("root/Shoes/1", now + std::chrono::seconds(60));
+  EXPECT_FALSE(wheel.expired("root/Shoes/1", now));
+  EXPECT_TRUE(wheel.expired("root/Shoes/1", now + std::chrono::seconds(60)));
+  EXPECT_FALSE(wheel.claim("root/Shoes/1"));
+
+  wheel.set("root/Shoes/1", now - std::chrono::seconds(1));
+  EXPECT_TRUE(wheel.expired("root/Shoes/1", now));
+  wheel.clear("root/Shoes/1");
+  EXPECT_FALSE(wheel.expired("root/Shoes/1", now));
+  EXPECT_EQ(wheel.size(), 0);
+
+  wheel.set("root/Shoes/2", now - std::chrono::seconds(1));
+  EXPECT_TRUE(wheel.claim("root/Shoes/2"));
+  EXPECT_FALSE(wheel.claim("root/Shoes/2"));
+}
+
+TEST_F(ExpiryWheelTest, ReapsDueEntities) {
+  expiry_wheel wheel("", std::chrono::milliseconds(10), 8, 2);
+  auto now = expiry_wheel::clock::now();
+  wheel.set("root/Shoes/late", now + std::chrono::seconds(60));
+  wheel.set("root/Shoes/cleared", now + std::chrono::milliseconds(20));
+  wheel.clear("root/Shoes/cleared");
+  wheel.set("root/Shoes/renewed", now + std::chrono::milliseconds(20));
+  wheel.set("root/Shoes/renewed", now + std::chrono::seconds(60));
+  // Past one turn of the wheel, so filed in a slot swept before it is due.
+  wheel.set("root/Shoes/next_turn", now + std::chrono::milliseconds(150));
+  for (std::string id : {"a", "b", "c", "d", "e"}) {
+    wheel.set("root/Shoes/" + id, now + std::chrono::milliseconds(30));
+  }
+  start(wheel);
+
+  EXPECT_EQ(wait_for_reaped(6), (std::vector<std::string>{"root/Shoes/a", "root/Shoes/b", "root/Shoes/c",
+                                                           "root/Shoes/d", "root/Shoes/e", "root/Shoes/next_turn"}));
+  EXPECT_GE(expiry_wheel::clock::now() - now, std::chrono::milliseconds(150));
+  EXPECT_EQ(wheel.size(), 2);
+  EXPECT_FALSE(wheel.expired("root/Shoes/renewed"));
+}
+
+TEST_F(ExpiryWheelTest, ReapsOverdueOnStart) {
+  expiry_wheel wheel("", std::chrono::milliseconds(10));
+  wheel.set("root/Shoes/1", expiry_wheel::clock::now() - std::chrono::hours(1));
+  start(wheel);
+  EXPECT_EQ(wait_for_reaped(1), (std::vector<std::string>{"root/Shoes/1"}));
+}
+
+TEST_F(ExpiryWheelTest, DeadlinesSurviveRestart) {
+  auto later = expiry_wheel::clock::now() + std::chrono::hours(1);
+  {
+    expiry_wheel wheel(journal_path);
+    wheel.set("root/Shoes/kept", later);
+    wheel.set("root/Shoes/with space", later);
+    wheel.set("root/Shoes/cleared", later);
+    wheel.clear("root/Shoes/cleared");
+    wheel.set("root/Shoes/due", expiry_wheel::clock::now() - std::chrono::seconds(1));
+  }
+  // A torn record from a crash mid-append is ignored.
+  std::ofstream(journal_path, std::ios::app) << "12345 40 root/Sho";
+
+  expiry_wheel wheel(journal_path, std::chrono::milliseconds(10));
+  EXPECT_EQ(wheel.size(), 3);
+  EXPECT_FALSE(wheel.expired("root/Shoes/kept"));
+  EXPECT_TRUE(wheel.expired("root/Shoes/kept", later));
+  EXPECT_TRUE(wheel.expired("root/Shoes/with space", later));
+  EXPECT_FALSE(wheel.expired("root/Shoes/cleared", later));
+  start(wheel);
+  EXPECT_EQ(wait_for_reaped(1), (std::vector<std::string>{"root/Shoes/due"}));
+
+  // The replay rewrote the journal without the cleared and torn records.
+  std::ifstream journal(journal_path);
+  std::string contents((std::istreambuf_iterator<char>(journal)), std::istreambuf_iterator<char>());
+  EXPECT_EQ(contents.find("cleared"), std::string::npos);
+  EXPECT_EQ(contents.find("12345"), std::string::npos);
+}
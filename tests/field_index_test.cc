@@ -0,0 +1,130 @@
+#include <gtest/gtest.h>
+#include "field_index.h"
+#include <ios>
+#include <map>
+#include <string>
+#include <vector>
+
+// Serves entities from a map of path -> JSON and counts the reads.
+class map_file_io : public i_file_io {
+public:
+  std::map<std::string, std::string> files;
+  int reads = 0;
+
+  bool open(const std::string& path, std::ios_base::openmode) override { return files.count(path) > 0; }
+  bool write(const std::string&) override { return false; }
+  bool close() override { return true; }
+  bool read(const std::string& path, std::string& content) override {
+    reads++;
+    auto file = files.find(path);
+    if (file == files.end()) {
+      return false;
+    }
+    content = file->second;
+    return true;
+  }
+  bool delete_file(const std::string&) override { return false; }
+  bool create_directories(const std::string&) override { return false; }
+  bool list_directories(const std::string& path, std::vector<std::string>& directories) override {
+    if (path.find("missing") != std::string::npos) {
+      return false;
+    }
+    for (const auto& file : files) {
+      directories.push_back(file.first.substr(file.first.find_last_of('/') + 1));
+    }
+    return true;
+  }
+  bool exists(const std::string& path) override { return files.count(path) > 0; }
+};
+
+class FieldIndexTest : public ::testing::Test {
+protected:
+  map_file_io files;
+  field_index index = field_index("./root", {"books:author", "books:year", "title"});
+
+  std::vector<std::string> find(const std::string& field, const std::string& value) {
+    std::vector<std::string> ids;
+    EXPECT_TRUE(index.find(files, "./root/books", field, value, ids));
+    return ids;
+  }
+};
+
+TEST_F(FieldIndexTest, ExtractsTopLevelScalars) {
+  std::map<std::string, std::string> values;
+  ASSERT_TRUE(field_index::extract(
+      " { \"a\" : \"x\\\"y\\u00e9\", \"b\": 12.5, \"c\": true, \"d\": null, \"e\": {\"a\": \"}\"}, \"f\": [1, [2]] } ",
+      values));
+  EXPECT_EQ(values, (std::map<std::string, std::string>{
+                        {"a", "x\"y\xc3\xa9"}, {"b", "12.5"}, {"c", "true"}, {"d", "null"}}));
+}
+
+TEST_F(FieldIndexTest, ExtractRejectsNonObjects) {
+  std::map<std::string, std::string> values;
+  EXPECT_TRUE(field_index::extract("{}", values));
+  EXPECT_TRUE(values.empty());
+  EXPECT_FALSE(field_index::extract("[1, 2]", values));
+  EXPECT_FALSE(field_index::extract("{\"a\": ", values));
+  EXPECT_FALSE(field_index::extract("{\"a\" 1}", values));
+}
+
+TEST_F(FieldIndexTest, ExtractJoinsSurrogatePairs) {
+  std::map<std::string, std::string> values;
+  ASSERT_TRUE(field_index::extract("{\"a\": \"\\ud83d\\ude00\"}", values));
+  EXPECT_EQ(values["a"], "\xf0\x9f\x98\x80");
+}
+
+TEST_F(FieldIndexTest, DeclarationsArePerEntityType) {
+  EXPECT_TRUE(index.indexed("./root/books", "author"));
+  EXPECT_TRUE(index.indexed("root/books/", "year"));
+  EXPECT_TRUE(index.indexed("./root/books", "title"));
+  EXPECT_FALSE(index.indexed("./root/books", "pages"));
+  EXPECT_FALSE(index.indexed("./root/authors", "author"));
+  EXPECT_TRUE(index.indexed("./root/authors", "title"));
+}
+
+TEST_F(FieldIndexTest, LoadsOnceAndFinds) {
+  files.files = {{"./root/books/1", "{\"author\": \"Le Guin\", \"year\": 1969}"},
+                 {"./root/books/2", "{\"author\": \"Banks\", \"year\": \"1987\"}"},
+                 {"./root/books/3", "{\"author\": \"Le Guin\", \"year\": 1974}"},
+                 {"./root/books/4", "not json"}};
+  EXPECT_EQ(find("author", "Le Guin"), (std::vector<std::string>{"1", "3"}));
+  EXPECT_EQ(files.reads, 4);
+  EXPECT_EQ(find("year", "1987"), (std::vector<std::string>{"2"}));
+  EXPECT_TRUE(find("author", "Nobody").empty());
+  EXPECT_EQ(files.reads, 4);
+}
+
+TEST_F(FieldIndexTest, UpdatesMoveEntitiesBetweenValues) {
+  files.files = {{"./root/books/1", "{\"author\": \"Le Guin\"}"}};
+  EXPECT_EQ(find("author", "Le Guin"), (std::vector<std::string>{"1"}));
+
+  index.update("./root/books", "1", "{\"author\": \"Banks\"}");
+  index.update("./root/books", "2", "{\"author\": \"Banks\", \"year\": 1987}");
+  EXPECT_TRUE(find("author", "Le Guin").empty());
+  EXPECT_EQ(find("author", "Banks"), (std::vector<std::string>{"1", "2"}));
+  EXPECT_EQ(find("year", "1987"), (std::vector<std::string>{"2"}));
+
+  index.update("./root/books", "2", "{\"author\": {\"name\": \"Banks\"}}");
+  index.remove("./root/books", "1");
+  EXPECT_TRUE(find("author", "Banks").empty());
+  EXPECT_TRUE(find("year", "1987").empty());
+}
+
+TEST_F(FieldIndexTest, ChangesBeforeLoadingAreReadFromStorage) {
+  index.update("./root/books", "1", "{\"author\": \"Banks\"}");
+  files.files = {{"./root/books/1", "{\"author\": \"Le Guin\"}"}};
+  EXPECT_TRUE(find("author", "Banks").empty());
+  EXPECT_EQ(find("author", "Le Guin"), (std::vector<std::string>{"1"}));
+}
+
+TEST_F(FieldIndexTest, FindFailsForUnindexedFieldOrMissingDirectory) {
+  std::vector<std::string> ids;
+  EXPECT_FALSE(index.find(files, "./root/books", "pages", "100", ids));
+  EXPECT_FALSE(index.find(files, "./root/missing", "title", "x", ids));
+}
+
+TEST_F(FieldIndexTest, SharedPerRoot) {
+  auto first = field_index::get_shared("./shared_root", {"books:author"});
+  EXPECT_EQ(field_index::get_shared("./shared_root", {}), first);
+  EXPECT_TRUE(first->indexed("./shared_root/books", "author"));
+}
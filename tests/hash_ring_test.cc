@@ -0,0 +1,81 @@
+#include <gtest/gtest.h>
+#include "hash_ring.h"
+#include <map>
+#include <string>
+
+namespace {
+
+std::string key(int i) {
+  return "Books/" + std::to_string(i);
+}
+
+}
+
+TEST(HashRingTest, EmptyRingOwnsNothing) {
+  hash_ring ring;
+  EXPECT_EQ(ring.owner("Books/1"), "");
+  ring.add("a:1");
+  EXPECT_EQ(ring.owner("Books/1"), "a:1");
+  EXPECT_EQ(ring.owner_without("Books/1", "a:1"), "");
+}
+
+TEST(HashRingTest, SpreadsKeysEvenly) {
+  hash_ring ring;
+  ring.add("127.0.0.1:8080");
+  ring.add("127.0.0.1:8081");
+  ring.add("127.0.0.1:8082");
+  std::map<std::string, int> owned;
+  for (int i = 0; i < 30000; i++) {
+    owned[ring.owner(key(i))]++;
+  }
+  ASSERT_EQ(owned.size(), 3u);
+  for (const auto& node : owned) {
+    EXPECT_GT(node.second, 7500) << node.first;
+    EXPECT_LT(node.second, 12500) << node.first;
+  }
+}
+
+TEST(HashRingTest, SameNodesSameRing) {
+  hash_ring forward;
+  hash_ring backward;
+  for (int n = 0; n < 5; n++) {
+    forward.add("node" + std::to_string(n) + ":80");
+    backward.add("node" + std::to_string(4 - n) + ":80");
+  }
+  for (int i = 0; i < 1000; i++) {
+    EXPECT_EQ(forward.owner(key(i)), backward.owner(key(i)));
+  }
+}
+
+TEST(HashRingTest, JoiningNodeOnlyTakesKeys) {
+  hash_ring ring;
+  ring.add("a:1");
+  ring.add("b:1");
+  ring.add("c:1");
+  std::map<int, std::string> before;
+  for (int i = 0; i < 20000; i++) {
+    before[i] = ring.owner(key(i));
+  }
+
+  ring.add("d:1");
+  int moved = 0;
+  for (int i = 0; i < 20000; i++) {
+    std::string owner = ring.owner(key(i));
+    if (owner != before[i]) {
+      // Keys only move to the new node, from the node the ring without it
+      // would pick.
+      EXPECT_EQ(owner, "d:1");
+      EXPECT_EQ(ring.owner_without(key(i), "d:1"), before[i]);
+      moved++;
+    }
+  }
+  // About a quarter of the keys.
+  EXPECT_GT(moved, 3500);
+  EXPECT_LT(moved, 6500);
+
+  ring.remove("d:1");
+  for (int i = 0; i < 20000; i++) {
+    EXPECT_EQ(ring.owner(key(i)), before[i]);
+  }
+  EXPECT_EQ(ring.nodes().size(), 3u);
+}
@@ -0,0 +1,23 @@
+#include <gtest/gtest.h>
+#include "http_util.h"
+#include <string>
+
+namespace {
+
+http::request<http::string_body> with_accept_encoding(const std::string& value) {
+  http::request<http::string_body> request{http::verb::get, "/", 11};
+  request.set(http::field::accept_encoding, value);
+  return request;
+}
+
+}
+
+TEST(HttpUtilTest, AcceptsGzip) {
+  EXPECT_TRUE(accepts_gzip(with_accept_encoding("gzip")));
+  EXPECT_TRUE(accepts_gzip(with_accept_encoding("br, GZip;q=0.5")));
+  EXPECT_TRUE(accepts_gzip(with_accept_encoding("*")));
+  EXPECT_FALSE(accepts_gzip(with_accept_encoding("br, identity")));
+  EXPECT_FALSE(accepts_gzip(with_accept_encoding("gzip;q=0")));
+  EXPECT_FALSE(accepts_gzip(with_accept_encoding("gzip; q=0.000")));
+  EXPECT_FALSE(accepts_gzip(http::request<http::string_body>{http::verb::get, "/", 11}));
+}
@@ -0,0 +1,60 @@
+#include <gtest/gtest.h>
+#include "id_generator.h"
+#include <chrono>
+#include <mutex>
+#include <regex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+TEST(IdGeneratorTest, FormatsUuidV7) {
+  std::regex uuid_v7(R"([0-9a-f]{8}-[0-9a-f]{4}-7[0-9a-f]{3}-[89ab][0-9a-f]{3}-[0-9a-f]{12})");
+  id_generator generator;
+  for (int i = 0; i < 100; i++) {
+    EXPECT_TRUE(std::regex_match(generator.next(), uuid_v7));
+  }
+  EXPECT_TRUE(std::regex_match(id_generator::generate(), uuid_v7));
+}
+
+TEST(IdGeneratorTest, EncodesCurrentTime) {
+  std::uint64_t before = std::chrono::duration_cast<std::chrono::milliseconds>(
+      std::chrono::system_clock::now().time_since_epoch()).count();
+  std::string id = id_generator().next();
+  std::uint64_t ms = std::stoull(id.substr(0, 8) + id.substr(9, 4), nullptr, 16);
+  EXPECT_GE(ms, before);
+  EXPECT_LE(ms, before + 1000);
+}
+
+TEST(IdGeneratorTest, StrictlyIncreasing) {
+  // Far more IDs than fit in one millisecond's counter.
+  id_generator generator;
+  std::string previous = generator.next();
+  for (int i = 0; i < 100000; i++) {
+    std::string id = generator.next();
+    ASSERT_LT(previous, id);
+    previous = id;
+  }
+}
+
+TEST(IdGeneratorTest, UniqueAcrossThreads) {
+  const int threads = 8;
+  const int per_thread = 10000;
+  std::mutex ids_mutex;
+  std::set<std::string> ids;
+  std::vector<std::thread> workers;
+  for (int t = 0; t < threads; t++) {
+    workers.emplace_back([&]() {
+      std::vector<std::string> mine;
+      for (int i = 0; i < per_thread; i++) {
+        mine.push_back(id_generator::generate());
+      }
+      std::lock_guard<std::mutex> lock(ids_mutex);
+      ids.insert(mine.begin(), mine.end());
+    });
+  }
+  for (auto& worker : workers) {
+    worker.join();
+  }
+  EXPECT_EQ(ids.size(), threads * per_thread);
+}
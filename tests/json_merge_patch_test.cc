@@ -0,0 +1,61 @@
+#include <gtest/gtest.h>
+#include "json_merge_patch.h"
+#include <string>
+#include <vector>
+
+std::string patched(const std::string& target, const std::string& patch) {
+  std::string out;
+  EXPECT_TRUE(json_merge_patch::apply(target, patch, out)) << target << " + " << patch;
+  return out;
+}
+
+TEST(JsonMergePatchTest, Rfc7396Examples) {
+  // Appendix A of RFC 7396, with the expected results minified.
+  struct example {
+    std::string target, patch, result;
+  };
+  std::vector<example> examples = {
+    {"{\"a\":\"b\"}", "{\"a\":\"c\"}", "{\"a\":\"c\"}"},
+    {"{\"a\":\"b\"}", "{\"b\":\"c\"}", "{\"a\":\"b\",\"b\":\"c\"}"},
+    {"{\"a\":\"b\"}", "{\"a\":null}", "{}"},
+    {"{\"a\":\"b\",\"b\":\"c\"}", "{\"a\":null}", "{\"b\":\"c\"}"},
+    {"{\"a\":[\"b\"]}", "{\"a\":\"c\"}", "{\"a\":\"c\"}"},
+    {"{\"a\":\"c\"}", "{\"a\":[\"b\"]}", "{\"a\":[\"b\"]}"},
+    {"{\"a\": {\"b\": \"c\"}}", "{\"a\": {\"b\": \"d\", \"c\": null}}", "{\"a\":{\"b\":\"d\"}}"},
+    {"{\"a\": [{\"b\":\"c\"}]}", "{\"a\": [1]}", "{\"a\":[1]}"},
+    {"[\"a\",\"b\"]", "[\"c\",\"d\"]", "[\"c\",\"d\"]"},
+    {"{\"a\":\"b\"}", "[\"c\"]", "[\"c\"]"},
+    {"{\"a\":\"foo\"}", "null", "null"},
+    {"{\"a\":\"foo\"}", "\"bar\"", "\"bar\""},
+    {"{\"e\":null}", "{\"a\":1}", "{\"e\":null,\"a\":1}"},
+    {"[1,2]", "{\"a\":\"b\",\"c\":null}", "{\"a\":\"b\"}"},
+    {"{}", "{\"a\":{\"bb\":{\"ccc\":null}}}", "{\"a\":{\"bb\":{}}}"},
+  };
+  for (const auto& e : examples) {
+    EXPECT_EQ(patched(e.target, e.patch), e.result) << e.target << " + " << e.patch;
+  }
+}
+
+TEST(JsonMergePatchTest, KeepsUntouchedValuesAsWritten) {
+  EXPECT_EQ(patched("{\n  \"title\": \"Dune\",\n  \"tags\": [ \"sf\", \"classic\" ],\n  \"pages\": 412\n}\n",
+                    "{\"pages\": 896}"),
+            "{\"title\":\"Dune\",\"tags\":[ \"sf\", \"classic\" ],\"pages\":896}");
+}
+
+TEST(JsonMergePatchTest, MatchesEscapedNames) {
+  EXPECT_EQ(patched("{\"caf\\u00e9\": 1, \"a\\\"b\": 2}", "{\"caf\xc3\xa9\": null, \"a\\u0022b\": 3}"),
+            "{\"a\\\"b\":3}");
+}
+
+TEST(JsonMergePatchTest, StringsWithBracketsAndCommas) {
+  EXPECT_EQ(patched("{\"a\": \"} , {\", \"b\": [\"]\", {\"c\": \"[\"}]}", "{\"d\": true}"),
+            "{\"a\":\"} , {\",\"b\":[\"]\", {\"c\": \"[\"}],\"d\":true}");
+}
+
+TEST(JsonMergePatchTest, RejectsMalformedInput) {
+  std::string out;
+  EXPECT_FALSE(json_merge_patch::apply("{\"a\": 1", "{}", out));
+  EXPECT_FALSE(json_merge_patch::apply("{}", "{\"a\" 1}", out));
+  EXPECT_FALSE(json_merge_patch::apply("{} {}", "{}", out));
+  EXPECT_FALSE(json_merge_patch::apply("", "{}", out));
+}
@@ -0,0 +1,101 @@
+#include <gtest/gtest.h>
+#include "json_validator.h"
+#include <string>
+#include <vector>
+
+TEST(JsonValidatorTest, AcceptsValidDocuments) {
+  std::vector<std::string> valid = {
+    "{}", "[]", "0", "-0.5e+10", "1E3", "\"text\"", "true", "false", "null",
+    " {\"a\": [1, 2.5, -3e-2, true, false, null, {\"b\": \"c\"}], \"d\": {}} \n",
+    "[[[]], [{}], \"\"]",
+    "\"escapes \\\" \\\\ \\/ \\b \\f \\n \\r \\t \\u00e9\"",
+    "\"caf\xc3\xa9 \xe2\x82\xac \xf0\x9f\x98\x80\"",
+    "{\"brand\": \"Nike\", \"model\": \"Air Max\", \"size\": 10}",
+  };
+  for (const auto& text : valid) {
+    std::string error;
+    EXPECT_TRUE(json_validator::validate(text, &error)) << text << ": " << error;
+  }
+}
+
+TEST(JsonValidatorTest, RejectsInvalidDocuments) {
+  std::vector<std::string> invalid = {
+    "", " ", "{", "}", "[1,]", "{\"a\":}", "{\"a\" 1}", "{a: 1}", "{\"a\": 1,}", "[1 2]",
+    "01", "1.", ".5", "-", "1e", "+1", "tru", "nul", "True", "NaN",
+    "\"unterminated", "\"bad \\x escape\"", "\"bad \\u12g4\"", "\"tab\tinside\"",
+    "\"\xc3\"", "\"\xc0\xaf\"", "\"\xed\xa0\x80\"", "\"\xf5\x80\x80\x80\"", "\"\x80\"",
+    "{} {}", "[] x", std::string("\"nul\0\"", 6),
+  };
+  for (const auto& text : invalid) {
+    EXPECT_FALSE(json_validator::validate(text)) << text;
+  }
+}
+
+TEST(JsonValidatorTest, ReportsOffset) {
+  std::string error;
+  EXPECT_FALSE(json_validator::validate("{\"a\": [1, 2,]}", &error));
+  EXPECT_EQ(error, "unexpected character at offset 12");
+}
+
+TEST(JsonValidatorTest, LimitsDepth) {
+  std::string deep(json_validator::max_depth, '[');
+  deep += std::string(json_validator::max_depth, ']');
+  EXPECT_TRUE(json_validator::validate(deep));
+  std::string deeper = "[" + deep + "]";
+  std::string error;
+  EXPECT_FALSE(json_validator::validate(deeper, &error));
+  EXPECT_EQ(error.rfind("nesting too deep", 0), 0);
+}
+
+TEST(JsonValidatorTest, LongStringsAcrossBlocks) {
+  // Special characters land at every offset within the 16-byte blocks.
+  for (size_t prefix = 0; prefix < 40; prefix++) {
+    std::string plain(prefix, 'x');
+    EXPECT_TRUE(json_validator::validate("\"" + plain + "\\n" + plain + "\xc3\xa9" + plain + "\"")) << prefix;
+    EXPECT_FALSE(json_validator::validate("\"" + plain + "\x01" + plain + "\"")) << prefix;
+    EXPECT_FALSE(json_validator::validate("\"" + plain)) << prefix;
+    EXPECT_TRUE(json_validator::validate(std::string(prefix, ' ') + "[" + std::string(prefix, '\n') + "1]")) << prefix;
+  }
+}
+
+TEST(JsonValidatorTest, Minifies) {
+  std::string out;
+  ASSERT_TRUE(json_validator::minify(" {\n  \"a b\" : [ 1 , \"x \\\" y\" ,\ttrue ],\r\n  \"c\": {} \n}\n", out));
+  EXPECT_EQ(out, "{\"a b\":[1,\"x \\\" y\",true],\"c\":{}}");
+  EXPECT_FALSE(json_validator::minify("[1,", out));
+}
+
+TEST(JsonValidatorTest, Unescapes) {
+  std::string out;
+  ASSERT_TRUE(json_validator::unescape("\"a\\\"b\\\\c\\/d\\n\\u00e9\\ud83d\\ude00\"", out));
+  EXPECT_EQ(out, "a\"b\\c/d\n\xc3\xa9\xf0\x9f\x98\x80");
+  out.clear();
+  EXPECT_FALSE(json_validator::unescape("\"unterminated\\\"", out));
+  EXPECT_FALSE(json_validator::unescape("\"bad \\x escape\"", out));
+  EXPECT_FALSE(json_validator::unescape("\"\\u12\"", out));
+  EXPECT_FALSE(json_validator::unescape("bare", out));
+}
+
+TEST(JsonValidatorTest, SkipsStringsAndSpace) {
+  std::string json = std::string(40, ' ') + "\t\n\"" + std::string(20, 'a') + "\\\"" + std::string(20, 'b') + "\" : 1";
+  size_t i = 0;
+  json_validator::skip_space(json, i);
+  EXPECT_EQ(i, 42u);
+  bool escaped = false;
+  ASSERT_TRUE(json_validator::skip_string(json, i, escaped));
+  EXPECT_TRUE(escaped);
+  EXPECT_EQ(json.substr(i), " : 1");
+  json_validator::skip_space(json, i);
+  EXPECT_EQ(json[i], ':');
+
+  // A short string, and one that is never closed.
+  std::string plain = "\"short\",";
+  i = 0;
+  escaped = false;
+  ASSERT_TRUE(json_validator::skip_string(plain, i, escaped));
+  EXPECT_FALSE(escaped);
+  EXPECT_EQ(i, 7u);
+  std::string open = "\"" + std::string(30, 'x') + "\\\"";
+  i = 0;
+  EXPECT_FALSE(json_validator::skip_string(open, i, escaped));
+}
@@ -0,0 +1,353 @@
+#include <gtest/gtest.h>
+#include "log_store.h"
+#include "log_file_io.h"
+#include "config_parser.h"
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+class LogStoreTest : public ::testing::Test {
+protected:
+  std::filesystem::path root = std::filesystem::temp_directory_path() / "log_store_test";
+
+  void SetUp() override {
+    std::filesystem::remove_all(root);
+  }
+
+  void TearDown() override {
+    std::filesystem::remove_all(root);
+  }
+
+  std::unique_ptr<log_store> open(size_t segment_size = 64 << 20) {
+    log_store::options opts;
+    opts.segment_size = segment_size;
+    opts.background_compaction = false;
+    return std::make_unique<log_store>(root.string(), opts);
+  }
+
+  std::vector<std::filesystem::path> segments() {
+    std::vector<std::filesystem::path> paths;
+    for (const auto& entry : std::filesystem::directory_iterator(root)) {
+      paths.push_back(entry.path());
+    }
+    std::sort(paths.begin(), paths.end());
+    return paths;
+  }
+};
+
+TEST_F(LogStoreTest, PutGetRemove) {
+  auto store = open();
+  std::string value;
+  EXPECT_FALSE(store->get("shoes/1", value));
+  ASSERT_TRUE(store->put("shoes/1", "{\"a\": 1}"));
+  ASSERT_TRUE(store->get("shoes/1", value));
+  EXPECT_EQ(value, "{\"a\": 1}");
+  ASSERT_TRUE(store->put("shoes/1", "{\"a\": 2}"));
+  ASSERT_TRUE(store->get("shoes/1", value));
+  EXPECT_EQ(value, "{\"a\": 2}");
+  EXPECT_EQ(store->size(), 1);
+
+  EXPECT_TRUE(store->remove("shoes/1"));
+  EXPECT_FALSE(store->remove("shoes/1"));
+  EXPECT_FALSE(store->contains("shoes/1"));
+  EXPECT_EQ(store->size(), 0);
+}
+
+TEST_F(LogStoreTest, ListsChildren) {
+  auto store = open();
+  store->put("shoes/1", "a");
+  store->put("shoes/2", "b");
+  store->put("books/1", "c");
+  std::vector<std::string> names;
+  ASSERT_TRUE(store->list("shoes", names));
+  EXPECT_EQ(names, (std::vector<std::string>{"1", "2"}));
+
+  store->remove("shoes/1");
+  names.clear();
+  ASSERT_TRUE(store->list("shoes", names));
+  EXPECT_EQ(names, std::vector<std::string>{"2"});
+
+  names.clear();
+  EXPECT_FALSE(store->list("hats", names));
+}
+
+TEST_F(LogStoreTest, RecoversAfterReopen) {
+  {
+    auto store = open();
+    store->put("shoes/1", "one");
+    store->put("shoes/2", "two");
+    store->put("shoes/1", "uno");
+    store->remove("shoes/2");
+  }
+  auto store = open();
+  std::string value;
+  ASSERT_TRUE(store->get("shoes/1", value));
+  EXPECT_EQ(value, "uno");
+  EXPECT_FALSE(store->contains("shoes/2"));
+  EXPECT_EQ(store->size(), 1);
+}
+
+TEST_F(LogStoreTest, TruncatesTornTail) {
+  {
+    auto store = open();
+    store->put("shoes/1", "one");
+    store->put("shoes/2", "two");
+  }
+  std::filesystem::path segment = segments().back();
+  std::filesystem::resize_file(segment, std::filesystem::file_size(segment) - 2);
+
+  auto store = open();
+  std::string value;
+  ASSERT_TRUE(store->get("shoes/1", value));
+  EXPECT_EQ(value, "one");
+  EXPECT_FALSE(store->contains("shoes/2"));
+
+  // New appends land on a record boundary and survive another reopen.
+  store->put("shoes/3", "three");
+  store.reset();
+  store = open();
+  ASSERT_TRUE(store->get("shoes/3", value));
+  EXPECT_EQ(value, "three");
+}
+
+TEST_F(LogStoreTest, RollsSegments) {
+  auto store = open(256);
+  for (int i = 0; i < 100; i++) {
+    store->put("k/" + std::to_string(i), std::string(50, 'x'));
+  }
+  EXPECT_GT(store->segment_count(), 10);
+  std::string value;
+  ASSERT_TRUE(store->get("k/0", value));
+  ASSERT_TRUE(store->get("k/99", value));
+}
+
+TEST_F(LogStoreTest, CompactionDropsDeadRecords) {
+  auto store = open(1024);
+  for (int round = 0; round < 10; round++) {
+    for (int i = 0; i < 20; i++) {
+      store->put("k/" + std::to_string(i), "value " + std::to_string(round));
+    }
+  }
+  for (int i = 10; i < 20; i++) {
+    store->remove("k/" + std::to_string(i));
+  }
+  std::uint64_t before = store->total_bytes();
+  ASSERT_TRUE(store->compact());
+  EXPECT_LT(store->total_bytes(), before / 5);
+  EXPECT_EQ(store->size(), 10);
+
+  std::string value;
+  for (int i = 0; i < 10; i++) {
+    ASSERT_TRUE(store->get("k/" + std::to_string(i), value));
+    EXPECT_EQ(value, "value 9");
+  }
+
+  // Writes after compaction are newer than the compacted copies on recovery.
+  store->put("k/0", "latest");
+  store->remove("k/1");
+  store.reset();
+  store = open(1024);
+  ASSERT_TRUE(store->get("k/0", value));
+  EXPECT_EQ(value, "latest");
+  EXPECT_FALSE(store->contains("k/1"));
+  EXPECT_FALSE(store->contains("k/15"));
+  EXPECT_EQ(store->size(), 9);
+}
+
+TEST_F(LogStoreTest, CompactionKeepsNoEmptySegments) {
+  auto store = open(1024);
+  ASSERT_TRUE(store->compact());
+  EXPECT_EQ(store->segment_count(), 1);
+
+  store->put("k/0", "value");
+  ASSERT_TRUE(store->compact());
+  size_t segments = store->segment_count();
+  // Nothing has been written since, so there is nothing more to compact.
+  ASSERT_TRUE(store->compact());
+  ASSERT_TRUE(store->compact());
+  EXPECT_EQ(store->segment_count(), segments);
+  std::string value;
+  ASSERT_TRUE(store->get("k/0", value));
+  EXPECT_EQ(value, "value");
+}
+
+TEST_F(LogStoreTest, RecoveryFinishesInterruptedCompaction) {
+  std::vector<std::filesystem::path> before;
+  {
+    auto store = open(128);
+    for (int i = 0; i < 10; i++) {
+      store->put("k/" + std::to_string(i), std::string(40, 'a'));
+    }
+    store->remove("k/0");
+    before = segments();
+    // Keep copies of the old segments to simulate a crash before they were deleted.
+    for (const auto& path : before) {
+      std::filesystem::copy_file(path, path.string() + ".bak");
+    }
+    ASSERT_TRUE(store->compact());
+  }
+  for (const auto& path : before) {
+    if (!std::filesystem::exists(path)) {
+      std::filesystem::rename(path.string() + ".bak", path);
+    } else {
+      std::filesystem::remove(path.string() + ".bak");
+    }
+  }
+
+  auto store = open(128);
+  EXPECT_FALSE(store->contains("k/0"));
+  EXPECT_EQ(store->size(), 9);
+  for (const auto& path : before) {
+    if (path != before.back()) {
+      EXPECT_FALSE(std::filesystem::exists(path)) << path;
+    }
+  }
+}
+
+TEST_F(LogStoreTest, ConcurrentWritersAndCompaction) {
+  log_store::options opts;
+  opts.segment_size = 4096;
+  opts.background_compaction = false;
+  log_store store(root.string(), opts);
+
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 4; t++) {
+    threads.emplace_back([&store, t]() {
+      for (int i = 0; i < 500; i++) {
+        store.put("t" + std::to_string(t) + "/" + std::to_string(i % 50), std::to_string(i));
+      }
+    });
+  }
+  threads.emplace_back([&store]() {
+    for (int i = 0; i < 10; i++) {
+      store.compact();
+    }
+  });
+  for (auto& thread : threads) {
+    thread.join();
+  }
+
+  std::string value;
+  for (int t = 0; t < 4; t++) {
+    for (int i = 0; i < 50; i++) {
+      ASSERT_TRUE(store.get("t" + std::to_string(t) + "/" + std::to_string(i), value));
+      EXPECT_EQ(value, std::to_string(450 + i));
+    }
+  }
+}
+
+TEST_F(LogStoreTest, VersionFollowsLatestRecord) {
+  auto store = open(1024);
+  std::uint64_t first, second, compacted;
+  EXPECT_FALSE(store->version("k/0", first));
+  ASSERT_TRUE(store->put("k/0", "same"));
+  ASSERT_TRUE(store->version("k/0", first));
+  ASSERT_TRUE(store->put("k/0", "same"));
+  ASSERT_TRUE(store->version("k/0", second));
+  EXPECT_NE(first, second);
+
+  // Compaction and recovery keep the version.
+  for (int i = 1; i < 50; i++) {
+    store->put("k/" + std::to_string(i), std::string(50, 'x'));
+  }
+  ASSERT_TRUE(store->compact());
+  ASSERT_TRUE(store->version("k/0", compacted));
+  EXPECT_EQ(compacted, second);
+  store.reset();
+  store = open(1024);
+  ASSERT_TRUE(store->version("k/0", compacted));
+  EXPECT_EQ(compacted, second);
+
+  store->remove("k/0");
+  EXPECT_FALSE(store->version("k/0", compacted));
+}
+
+TEST_F(LogStoreTest, FileInterface) {
+  auto store = std::make_shared<log_store>(root.string());
+  log_file_io io(store, "./data");
+
+  EXPECT_FALSE(io.exists("./data/shoes/1"));
+  ASSERT_TRUE(io.open("./data/shoes/1", std::ios::out | std::ios::trunc));
+  ASSERT_TRUE(io.write("{\"a\": "));
+  ASSERT_TRUE(io.write("1}"));
+  // The pieces are stored as one record once the file is closed.
+  EXPECT_FALSE(io.exists("./data/shoes/1"));
+  ASSERT_TRUE(io.close());
+  EXPECT_TRUE(io.exists("./data/shoes/1"));
+  EXPECT_TRUE(io.open("./data/shoes/1", std::ios::in));
+  EXPECT_FALSE(io.open("./data/shoes/2", std::ios::in));
+
+  std::string content;
+  ASSERT_TRUE(io.read("./data/shoes/1", content));
+  EXPECT_EQ(content, "{\"a\": 1}");
+  std::vector<std::string> ids;
+  ASSERT_TRUE(io.list_directories("./data/shoes", ids));
+  EXPECT_EQ(ids, std::vector<std::string>{"1"});
+
+  EXPECT_FALSE(io.read("./elsewhere/shoes/1", content));
+  std::string tag;
+  ASSERT_TRUE(io.version("./data/shoes/1", tag));
+  EXPECT_FALSE(io.version("./data/shoes/2", tag));
+  EXPECT_TRUE(io.delete_file("./data/shoes/1"));
+  EXPECT_FALSE(io.delete_file("./data/shoes/1"));
+}
+
+TEST_F(LogStoreTest, WriteBatch) {
+  {
+    auto store = open();
+    ASSERT_TRUE(store->put("shoes/1", "one"));
+    std::vector<log_store::write_op> ops = {
+      {"shoes/2", "two"},
+      {"shoes/1", "", true},
+      {"shoes/9", "", true},  // never existed
+      {"shoes/3", "three"},
+      {"shoes/3", "", true},  // put earlier in the batch
+      {"shoes/1", "", true},  // already removed in the batch
+    };
+    std::vector<bool> results;
+    ASSERT_TRUE(store->write_batch(ops, results));
+    EXPECT_EQ(results, (std::vector<bool>{true, true, false, true, true, false}));
+    std::string value;
+    ASSERT_TRUE(store->get("shoes/2", value));
+    EXPECT_EQ(value, "two");
+    EXPECT_FALSE(store->contains("shoes/1"));
+    EXPECT_FALSE(store->contains("shoes/3"));
+  }
+  auto store = open();
+  std::vector<std::string> names;
+  ASSERT_TRUE(store->list("shoes", names));
+  EXPECT_EQ(names, std::vector<std::string>{"2"});
+}
+
+TEST_F(LogStoreTest, FileInterfaceWriteBatch) {
+  auto store = std::make_shared<log_store>(root.string());
+  log_file_io io(store, root.string());
+  std::vector<i_file_io::batch_op> ops = {
+    {(root / "shoes" / "1").string(), "one"},
+    {(root / "shoes" / "2").string(), "two"},
+    {(root / ".." / "outside").string(), "no"},
+  };
+  std::vector<bool> results;
+  io.write_batch(ops, results);
+  EXPECT_EQ(results, (std::vector<bool>{true, true, false}));
+  std::string value;
+  ASSERT_TRUE(io.read((root / "shoes" / "2").string(), value));
+  EXPECT_EQ(value, "two");
+}
+
+TEST_F(LogStoreTest, LoadConfig) {
+  HandlerConfig config = {"crud_handler", "/api", root.string()};
+  config.directives["storage"] = {"log"};
+  EXPECT_TRUE(log_file_io::load_config({config}));
+  EXPECT_NE(log_store::get_shared(root.string()), nullptr);
+  EXPECT_EQ(log_store::get_shared(root.string()), log_store::get_shared(root.string()));
+
+  config.directives["storage"] = {"file"};
+  EXPECT_TRUE(log_file_io::load_config({config}));
+  config.directives["storage"] = {"tape"};
+  EXPECT_FALSE(log_file_io::load_config({config}));
+}
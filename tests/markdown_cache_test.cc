@@ -0,0 +1,125 @@
+#include <gtest/gtest.h>
+#include "markdown_cache.h"
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+class MarkdownCacheTest : public ::testing::Test {
+protected:
+  markdown_cache cache;
+  int render_calls = 0;
+
+  std::function<std::string()> renderer(const std::string& html) {
+    return [this, html]() {
+      render_calls++;
+      return html;
+    };
+  }
+};
+
+TEST_F(MarkdownCacheTest, RepeatedGetRendersOnce) {
+  for (int i = 0; i < 100; i++) {
+    EXPECT_EQ(*cache.get("/static/doc.md", 1, 10, renderer("<h1>A</h1>\n")), "<h1>A</h1>\n");
+  }
+  EXPECT_EQ(render_calls, 1);
+  EXPECT_EQ(cache.renders(), 1);
+  EXPECT_EQ(cache.hits(), 99);
+}
+
+TEST_F(MarkdownCacheTest, ChangedMtimeRerenders) {
+  cache.get("/static/doc.md", 1, 10, renderer("old"));
+  EXPECT_EQ(*cache.get("/static/doc.md", 2, 10, renderer("new")), "new");
+  EXPECT_EQ(*cache.get("/static/doc.md", 2, 10, renderer("unused")), "new");
+  EXPECT_EQ(render_calls, 2);
+}
+
+TEST_F(MarkdownCacheTest, ChangedSizeRerenders) {
+  cache.get("/static/doc.md", 1, 10, renderer("old"));
+  EXPECT_EQ(*cache.get("/static/doc.md", 1, 11, renderer("new")), "new");
+  EXPECT_EQ(render_calls, 2);
+}
+
+TEST_F(MarkdownCacheTest, PathsAreCachedSeparately) {
+  EXPECT_EQ(*cache.get("/static/a.md", 1, 10, renderer("a")), "a");
+  EXPECT_EQ(*cache.get("/static/b.md", 1, 10, renderer("b")), "b");
+  EXPECT_EQ(*cache.get("/static/a.md", 1, 10, renderer("unused")), "a");
+  EXPECT_EQ(render_calls, 2);
+}
+
+TEST_F(MarkdownCacheTest, FailedRenderIsRetried) {
+  EXPECT_THROW(cache.get("/static/doc.md", 1, 10, []() -> std::string { throw std::runtime_error("read failed"); }),
+               std::runtime_error);
+  EXPECT_EQ(*cache.get("/static/doc.md", 1, 10, renderer("ok")), "ok");
+  EXPECT_EQ(render_calls, 1);
+}
+
+TEST_F(MarkdownCacheTest, ConcurrentMissesRenderOnce) {
+  std::atomic<int> slow_renders{0};
+  auto slow_render = [&slow_renders]() {
+    slow_renders++;
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    return std::string("<p>slow</p>\n");
+  };
+
+  std::vector<std::thread> threads;
+  std::atomic<int> matches{0};
+  for (int i = 0; i < 8; i++) {
+    threads.emplace_back([&]() {
+      if (*cache.get("/static/slow.md", 1, 10, slow_render) == "<p>slow</p>\n") {
+        matches++;
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  EXPECT_EQ(slow_renders, 1);
+  EXPECT_EQ(matches, 8);
+}
+
+TEST(MarkdownCacheBoundTest, EvictsLeastRecentlyUsed) {
+  // Room for two renders of "html" under a five-byte path.
+  markdown_cache cache(2 * (4 + 5));
+  int render_calls = 0;
+  auto render = [&render_calls]() {
+    render_calls++;
+    return std::string("html");
+  };
+  cache.get("/a.md", 1, 1, render);
+  cache.get("/b.md", 1, 1, render);
+  cache.get("/a.md", 1, 1, render);
+  // b is the least recently used, so c takes its place.
+  cache.get("/c.md", 1, 1, render);
+  EXPECT_EQ(render_calls, 3);
+  EXPECT_EQ(cache.used(), 18u);
+  cache.get("/a.md", 1, 1, render);
+  cache.get("/c.md", 1, 1, render);
+  EXPECT_EQ(render_calls, 3);
+  cache.get("/b.md", 1, 1, render);
+  EXPECT_EQ(render_calls, 4);
+}
+
+TEST(MarkdownCacheBoundTest, BoundsBytes) {
+  markdown_cache cache(100);
+  int render_calls = 0;
+  auto render = [&render_calls](size_t bytes) {
+    return [&render_calls, bytes]() {
+      render_calls++;
+      return std::string(bytes, 'x');
+    };
+  };
+  cache.get("/small.md", 1, 1, render(10));
+  // A render larger than the whole budget is served but not kept.
+  EXPECT_EQ(cache.get("/large.md", 1, 1, render(200))->size(), 200u);
+  EXPECT_LE(cache.used(), 100u);
+  cache.get("/large.md", 1, 1, render(200));
+  EXPECT_EQ(render_calls, 3);
+
+  // A changed document replaces its stale render rather than adding to it.
+  cache.get("/small.md", 2, 1, render(20));
+  EXPECT_EQ(cache.used(), 20u + 9u);
+  cache.clear();
+  EXPECT_EQ(cache.used(), 0u);
+}
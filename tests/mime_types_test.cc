@@ -0,0 +1,98 @@
+#include <gtest/gtest.h>
+#include "mime_types.h"
+#include "config_parser.h"
+#include <string>
+
+class MimeTypesTest : public ::testing::Test {
+protected:
+  mime_types types;
+};
+
+TEST_F(MimeTypesTest, BuiltinTypes) {
+  EXPECT_EQ(types.lookup("html"), "text/html");
+  EXPECT_EQ(types.lookup("jpg"), "image/jpeg");
+  EXPECT_EQ(types.lookup("jpeg"), "image/jpeg");
+  EXPECT_EQ(types.lookup("txt"), "text/plain");
+  EXPECT_EQ(types.lookup("zip"), "application/zip");
+  EXPECT_EQ(types.lookup("css"), "text/css");
+  EXPECT_EQ(types.lookup("js"), "application/javascript");
+  EXPECT_EQ(types.lookup("json"), "application/json");
+  EXPECT_EQ(types.lookup("svg"), "image/svg+xml");
+  EXPECT_EQ(types.lookup("woff2"), "font/woff2");
+  EXPECT_EQ(types.lookup("wasm"), "application/wasm");
+  EXPECT_EQ(types.lookup("mp4"), "video/mp4");
+  EXPECT_EQ(types.lookup("docx"), "application/vnd.openxmlformats-officedocument.wordprocessingml.document");
+}
+
+TEST_F(MimeTypesTest, BuiltinTableHasNoDuplicates) {
+  EXPECT_EQ(types.size(), mime_types::builtin_size());
+  EXPECT_GT(types.size(), 200);
+}
+
+TEST_F(MimeTypesTest, CaseInsensitive) {
+  EXPECT_EQ(types.lookup("HTML"), "text/html");
+  EXPECT_EQ(types.lookup("Jpg"), "image/jpeg");
+}
+
+TEST_F(MimeTypesTest, UnknownExtension) {
+  EXPECT_EQ(types.lookup(""), "application/octet-stream");
+  EXPECT_EQ(types.lookup("nope"), "application/octet-stream");
+  EXPECT_EQ(types.lookup("htmlx"), "application/octet-stream");
+}
+
+TEST_F(MimeTypesTest, AddOverridesExisting) {
+  types.add("text/x-custom", "TXT");
+  EXPECT_EQ(types.lookup("txt"), "text/x-custom");
+  EXPECT_EQ(types.size(), mime_types::builtin_size());
+}
+
+TEST_F(MimeTypesTest, ClearAndGrow) {
+  types.clear();
+  EXPECT_EQ(types.lookup("html"), "application/octet-stream");
+  for (int i = 0; i < 1000; i++) {
+    types.add("application/x-" + std::to_string(i), "ext" + std::to_string(i));
+  }
+  EXPECT_EQ(types.size(), 1000);
+  EXPECT_EQ(types.lookup("ext0"), "application/x-0");
+  EXPECT_EQ(types.lookup("ext999"), "application/x-999");
+}
+
+TEST_F(MimeTypesTest, LoadConfigTypesBlock) {
+  NginxConfigParser parser;
+  NginxConfig config;
+  ASSERT_TRUE(parser.Parse("test_configs/config_with_types", &config));
+  ASSERT_TRUE(types.load_config(config));
+  EXPECT_EQ(types.size(), 5);
+  EXPECT_EQ(types.lookup("htm"), "text/html");
+  EXPECT_EQ(types.lookup("custom"), "application/x-custom");
+  // The types block replaces the defaults, and default_type applies to the rest.
+  EXPECT_EQ(types.lookup("zip"), "text/plain");
+}
+
+TEST_F(MimeTypesTest, LoadConfigWithoutTypesKeepsDefaults) {
+  NginxConfigParser parser;
+  NginxConfig config;
+  ASSERT_TRUE(parser.Parse("test_configs/example_config", &config));
+  ASSERT_TRUE(types.load_config(config));
+  EXPECT_EQ(types.size(), mime_types::builtin_size());
+}
+
+TEST_F(MimeTypesTest, LoadNginxFile) {
+  types.clear();
+  ASSERT_TRUE(types.load_file("test_configs/mime.types.nginx"));
+  EXPECT_EQ(types.size(), 5);
+  EXPECT_EQ(types.lookup("css"), "text/css");
+  EXPECT_EQ(types.lookup("woff2"), "font/woff2");
+}
+
+TEST_F(MimeTypesTest, LoadApacheFile) {
+  types.clear();
+  ASSERT_TRUE(types.load_file("test_configs/mime.types.apache"));
+  EXPECT_EQ(types.size(), 5);
+  EXPECT_EQ(types.lookup("htm"), "text/html");
+  EXPECT_EQ(types.lookup("flac"), "audio/flac");
+}
+
+TEST_F(MimeTypesTest, LoadMissingFile) {
+  EXPECT_FALSE(types.load_file("test_configs/does_not_exist"));
+}
@@ -0,0 +1,151 @@
+#include <gtest/gtest.h>
+#include "open_file_cache.h"
+#include "config_parser.h"
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <thread>
+
+class OpenFileCacheTest : public ::testing::Test {
+protected:
+  std::filesystem::path root = std::filesystem::temp_directory_path() / "open_file_cache_test";
+  open_file_cache cache;
+
+  void SetUp() override {
+    std::filesystem::remove_all(root);
+    std::filesystem::create_directories(root / "dir");
+    write("a.txt", "STUFF\n");
+  }
+
+  void TearDown() override {
+    std::filesystem::remove_all(root);
+  }
+
+  void write(const std::string& name, const std::string& content) {
+    std::ofstream file(root / name, std::ios::trunc);
+    file << content;
+  }
+
+  std::string path(const std::string& name) {
+    return (root / name).string();
+  }
+};
+
+TEST_F(OpenFileCacheTest, DisabledOpensEveryTime) {
+  auto first = cache.open(path("a.txt"));
+  auto second = cache.open(path("a.txt"));
+  ASSERT_TRUE(first->exists);
+  EXPECT_NE(first, second);
+  EXPECT_EQ(cache.size(), 0);
+  EXPECT_EQ(cache.hits(), 0);
+}
+
+TEST_F(OpenFileCacheTest, ReadsFile) {
+  auto file = cache.open(path("a.txt"));
+  std::string content;
+  ASSERT_TRUE(file->read(content));
+  EXPECT_EQ(content, "STUFF\n");
+  EXPECT_EQ(file->size, 6);
+  EXPECT_FALSE(file->is_directory);
+}
+
+TEST_F(OpenFileCacheTest, Directory) {
+  auto file = cache.open(path("dir"));
+  EXPECT_TRUE(file->exists);
+  EXPECT_TRUE(file->is_directory);
+  EXPECT_EQ(file->fd, -1);
+}
+
+TEST_F(OpenFileCacheTest, CachesOpenFiles) {
+  cache.configure(10, std::chrono::seconds(60), std::chrono::seconds(60), true);
+  auto first = cache.open(path("a.txt"));
+  auto second = cache.open(path("a.txt"));
+  EXPECT_EQ(first, second);
+  EXPECT_EQ(cache.hits(), 1);
+  EXPECT_EQ(cache.misses(), 1);
+
+  // The cached descriptor can still be read after repeated lookups.
+  std::string content;
+  ASSERT_TRUE(second->read(content));
+  EXPECT_EQ(content, "STUFF\n");
+}
+
+TEST_F(OpenFileCacheTest, CachesNegativeLookups) {
+  cache.configure(10, std::chrono::seconds(60), std::chrono::seconds(60), true);
+  auto missing = cache.open(path("missing.txt"));
+  EXPECT_FALSE(missing->exists);
+  EXPECT_EQ(missing->error, ENOENT);
+
+  // Created after the miss, but the negative entry is still valid.
+  write("missing.txt", "now here");
+  EXPECT_FALSE(cache.open(path("missing.txt"))->exists);
+  EXPECT_EQ(cache.hits(), 1);
+}
+
+TEST_F(OpenFileCacheTest, ErrorsOff) {
+  cache.configure(10, std::chrono::seconds(60), std::chrono::seconds(60), false);
+  EXPECT_FALSE(cache.open(path("missing.txt"))->exists);
+  write("missing.txt", "now here");
+  EXPECT_TRUE(cache.open(path("missing.txt"))->exists);
+}
+
+TEST_F(OpenFileCacheTest, RevalidatesAfterValidPeriod) {
+  cache.configure(10, std::chrono::seconds(60), std::chrono::milliseconds(0), true);
+  auto first = cache.open(path("a.txt"));
+  // Unchanged file: revalidation keeps the same descriptor.
+  auto second = cache.open(path("a.txt"));
+  EXPECT_EQ(first, second);
+
+  write("a.txt", "CHANGED STUFF\n");
+  auto third = cache.open(path("a.txt"));
+  EXPECT_NE(first, third);
+  std::string content;
+  ASSERT_TRUE(third->read(content));
+  EXPECT_EQ(content, "CHANGED STUFF\n");
+}
+
+TEST_F(OpenFileCacheTest, EvictsLeastRecentlyUsed) {
+  cache.configure(2, std::chrono::seconds(60), std::chrono::seconds(60), true);
+  write("b.txt", "b");
+  write("c.txt", "c");
+  auto a = cache.open(path("a.txt"));
+  cache.open(path("b.txt"));
+  cache.open(path("a.txt"));
+  cache.open(path("c.txt"));
+  EXPECT_EQ(cache.size(), 2);
+  EXPECT_EQ(cache.open(path("a.txt")), a);
+
+  // Evicted files stay readable for requests still holding them.
+  std::string content;
+  ASSERT_TRUE(a->read(content));
+}
+
+TEST_F(OpenFileCacheTest, EvictsInactive) {
+  cache.configure(10, std::chrono::milliseconds(10), std::chrono::seconds(60), true);
+  write("b.txt", "b");
+  cache.open(path("a.txt"));
+  std::this_thread::sleep_for(std::chrono::milliseconds(20));
+  cache.open(path("b.txt"));
+  EXPECT_EQ(cache.size(), 1);
+}
+
+TEST_F(OpenFileCacheTest, LoadConfig) {
+  NginxConfigParser parser;
+  NginxConfig config;
+  std::istringstream input("open_file_cache max=2 inactive=20s;\nopen_file_cache_valid 30s;\nopen_file_cache_errors off;\n");
+  ASSERT_TRUE(parser.Parse(&input, &config));
+  ASSERT_TRUE(cache.load_config(config));
+  cache.open(path("a.txt"));
+  cache.open(path("missing.txt"));
+  EXPECT_EQ(cache.size(), 1);
+}
+
+TEST_F(OpenFileCacheTest, LoadConfigMalformed) {
+  NginxConfigParser parser;
+  NginxConfig config;
+  std::istringstream input("open_file_cache max=lots;\n");
+  ASSERT_TRUE(parser.Parse(&input, &config));
+  EXPECT_FALSE(cache.load_config(config));
+}
@@ -0,0 +1,115 @@
+#include <gtest/gtest.h>
+#include "peer_client.h"
+#include <boost/asio.hpp>
+#include <boost/beast/core.hpp>
+#include <boost/beast/http.hpp>
+#include <atomic>
+#include <string>
+#include <thread>
+
+using boost::asio::ip::tcp;
+
+// A node answering each request with its target, or with a body of
+// `size` bytes for /large?size=. It closes each connection after
+// `requests_per_connection` requests.
+class PeerClientTest : public ::testing::Test {
+protected:
+  boost::asio::io_context io;
+  tcp::acceptor acceptor{io, tcp::endpoint(boost::asio::ip::make_address("127.0.0.1"), 0)};
+  std::string node = "127.0.0.1:" + std::to_string(acceptor.local_endpoint().port());
+  std::atomic<int> accepted{0};
+  int requests_per_connection = 100;
+  std::thread serving;
+
+  void serve(int connections) {
+    serving = std::thread([this, connections]() {
+      for (int i = 0; i < connections; i++) {
+        tcp::socket socket(io);
+        boost::beast::error_code ec;
+        acceptor.accept(socket, ec);
+        if (ec) {
+          return;
+        }
+        accepted++;
+        boost::beast::flat_buffer buffer;
+        for (int answered = 0; answered < requests_per_connection; answered++) {
+          http::request<http::string_body> request;
+          http::read(socket, buffer, request, ec);
+          if (ec) {
+            break;
+          }
+          http::response<http::string_body> response{http::status::ok, 11};
+          std::string target(request.target());
+          response.body() = target.rfind("/large?size=", 0) == 0 ? std::string(std::stoul(target.substr(12)), 'x') : target;
+          response.keep_alive(request.keep_alive());
+          response.prepare_payload();
+          http::write(socket, response, ec);
+        }
+      }
+    });
+  }
+
+  void TearDown() override {
+    if (serving.joinable()) {
+      serving.join();
+    }
+  }
+};
+
+TEST_F(PeerClientTest, ReusesConnections) {
+  serve(1);
+  peer_client client(std::chrono::seconds(5), 1024, 4);
+  http::response<http::string_body> response;
+  ASSERT_TRUE(client.exchange(node, http::request<http::string_body>{http::verb::get, "/first", 11}, response));
+  EXPECT_EQ(response.body(), "/first");
+  ASSERT_TRUE(client.exchange(node, http::request<http::string_body>{http::verb::get, "/second", 11}, response));
+  EXPECT_EQ(response.body(), "/second");
+  EXPECT_EQ(accepted, 1);
+}
+
+TEST_F(PeerClientTest, RetriesClosedConnection) {
+  requests_per_connection = 1;
+  serve(2);
+  peer_client client(std::chrono::seconds(5), 1024, 4);
+  http::response<http::string_body> response;
+  ASSERT_TRUE(client.exchange(node, http::request<http::string_body>{http::verb::get, "/first", 11}, response));
+  // The node has closed the idle connection, so this goes out on a new one.
+  ASSERT_TRUE(client.exchange(node, http::request<http::string_body>{http::verb::get, "/second", 11}, response));
+  EXPECT_EQ(response.body(), "/second");
+  EXPECT_EQ(accepted, 2);
+}
+
+TEST_F(PeerClientTest, LimitsResponseBody) {
+  serve(2);
+  peer_client client(std::chrono::seconds(5), 1024, 4);
+  http::response<http::string_body> response;
+  ASSERT_TRUE(client.exchange(node, http::request<http::string_body>{http::verb::get, "/large?size=1024", 11}, response));
+  EXPECT_EQ(response.body().size(), 1024u);
+  EXPECT_FALSE(client.exchange(node, http::request<http::string_body>{http::verb::get, "/large?size=1025", 11}, response));
+  // The connection is dropped, and the next request gets a new one.
+  ASSERT_TRUE(client.exchange(node, http::request<http::string_body>{http::verb::get, "/after", 11}, response));
+  EXPECT_EQ(response.body(), "/after");
+  EXPECT_EQ(accepted, 2);
+}
+
+TEST_F(PeerClientTest, UnreachableNode) {
+  std::string closed = node;
+  acceptor.close();
+  peer_client client(std::chrono::seconds(5), 1024, 4);
+  http::response<http::string_body> response;
+  EXPECT_FALSE(client.exchange(closed, http::request<http::string_body>{http::verb::get, "/", 11}, response));
+  EXPECT_FALSE(client.exchange("no-port", http::request<http::string_body>{http::verb::get, "/", 11}, response));
+}
+
+TEST(PeerClientSplitTest, SplitsNodes) {
+  std::string host, port;
+  EXPECT_TRUE(peer_client::split_node("127.0.0.1:8080", host, port));
+  EXPECT_EQ(host, "127.0.0.1");
+  EXPECT_EQ(port, "8080");
+  EXPECT_FALSE(peer_client::split_node("127.0.0.1", host, port));
+  EXPECT_FALSE(peer_client::split_node(":8080", host, port));
+  EXPECT_FALSE(peer_client::split_node("127.0.0.1:", host, port));
+  EXPECT_FALSE(peer_client::split_node("127.0.0.1:80a", host, port));
+  EXPECT_FALSE(peer_client::split_node("127.0.0.1:0", host, port));
+  EXPECT_FALSE(peer_client::split_node("127.0.0.1:65536", host, port));
+}
@@ -0,0 +1,246 @@
+#include <gtest/gtest.h>
+#include "crud_handler.h"
+#include "replication_follower.h"
+#include "server.h"
+#include <boost/asio.hpp>
+#include <boost/beast/core.hpp>
+#include <boost/beast/http.hpp>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+using boost::asio::ip::tcp;
+
+namespace {
+
+unsigned short free_port() {
+  boost::asio::io_context io;
+  tcp::acceptor acceptor(io, tcp::endpoint(boost::asio::ip::make_address("127.0.0.1"), 0));
+  return acceptor.local_endpoint().port();
+}
+
+std::string node(unsigned short port) {
+  return "127.0.0.1:" + std::to_string(port);
+}
+
+http::response<http::string_body> send(unsigned short port, http::verb method, const std::string& target,
+                                       const std::string& body = "") {
+  boost::asio::io_context io;
+  tcp::socket socket(io);
+  socket.connect(tcp::endpoint(boost::asio::ip::make_address("127.0.0.1"), port));
+  http::request<http::string_body> request{method, target, 11};
+  request.set(http::field::host, node(port));
+  if (!body.empty()) {
+    request.set(http::field::content_type, "application/json");
+    request.body() = body;
+  }
+  request.prepare_payload();
+  http::write(socket, request);
+  boost::beast::flat_buffer buffer;
+  http::response<http::string_body> response;
+  http::read(socket, buffer, response);
+  return response;
+}
+
+// Waits up to ten seconds for done.
+bool eventually(const std::function<bool()>& done) {
+  auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+  while (!done()) {
+    if (std::chrono::steady_clock::now() > deadline) {
+      return false;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+  }
+  return true;
+}
+
+}
+
+// Runs a leader and a follower in this process, each a server on a port
+// and io_context of its own, so the leader can be stopped on its own.
+class ReplicationFollowerTest : public ::testing::Test {
+protected:
+  struct instance {
+    boost::asio::io_context io;
+    std::unique_ptr<server> listening;
+    std::vector<std::thread> threads;
+  };
+
+  unsigned short leader_port = free_port();
+  unsigned short follower_port = free_port();
+  instance leader;
+  instance follower;
+  std::filesystem::path base = std::filesystem::temp_directory_path() / "replication_follower_test";
+  HandlerConfig leader_config{"crud_handler", "/api", (base / "leader").string(), {{"replication", {"leader"}}}};
+  HandlerConfig follower_config{"crud_handler", "/api", (base / "follower").string(),
+                                {{"replication", {"follower", node(leader_port)}}, {"replication_max_lag", {"2"}}}};
+
+  void SetUp() override {
+    std::filesystem::remove_all(base);
+  }
+
+  void TearDown() override {
+    stop(leader);
+    stop(follower);
+    // A long poll still waiting on the leader answers within a poll's wait.
+    std::this_thread::sleep_for(replication_follower::poll_wait + std::chrono::milliseconds(200));
+    std::filesystem::remove_all(base);
+  }
+
+  void start(instance& running, const HandlerConfig& config, unsigned short port) {
+    std::vector<HandlerConfig> handlers = {config};
+    running.listening = std::make_unique<server>(running.io, port, handlers);
+    for (int i = 0; i < 2; i++) {
+      running.threads.emplace_back([&running]() { running.io.run(); });
+    }
+  }
+
+  void stop(instance& running) {
+    running.io.stop();
+    for (auto& thread : running.threads) {
+      thread.join();
+    }
+    running.threads.clear();
+  }
+
+  bool follower_has(const std::string& target, http::status status, const std::string& body = "") {
+    return eventually([&]() {
+      http::response<http::string_body> found = send(follower_port, http::verb::get, target);
+      return found.result() == status && (body.empty() || found.body() == body);
+    });
+  }
+};
+
+TEST_F(ReplicationFollowerTest, FollowsLeader) {
+  start(leader, leader_config, leader_port);
+  std::string created = send(leader_port, http::verb::post, "/api/Books", "{\"n\": 1}").body();
+  std::string first = created.substr(created.find(": \"") + 3, 36);
+  // Left over from before; the leader has no such entity.
+  std::filesystem::create_directories(base / "follower" / "Books");
+  std::ofstream(base / "follower" / "Books" / "stale") << "{}";
+
+  ASSERT_TRUE(replication_follower::load_config({leader_config, follower_config}));
+  ASSERT_TRUE(crud_handler::load_config({leader_config, follower_config}));
+  start(follower, follower_config, follower_port);
+
+  // The follower starts with a copy of the leader.
+  EXPECT_TRUE(follower_has("/api/Books/" + first, http::status::ok, "{\"n\": 1}"));
+  EXPECT_TRUE(follower_has("/api/Books/stale", http::status::not_found));
+  http::response<http::string_body> found = send(follower_port, http::verb::get, "/api/Books/" + first);
+  EXPECT_LE(std::stoul(std::string(found[replication_follower::lag_header])), 2000u);
+
+  // Then takes every write the leader makes.
+  EXPECT_EQ(send(leader_port, http::verb::put, "/api/Books/second", "{\"n\": 2}").result(), http::status::created);
+  EXPECT_EQ(send(leader_port, http::verb::put, "/api/Books/" + first, "{\"n\": 3}").result(), http::status::no_content);
+  EXPECT_TRUE(follower_has("/api/Books/second", http::status::ok, "{\"n\": 2}"));
+  EXPECT_TRUE(follower_has("/api/Books/" + first, http::status::ok, "{\"n\": 3}"));
+  EXPECT_EQ(send(leader_port, http::verb::delete_, "/api/Books/second").result(), http::status::no_content);
+  EXPECT_TRUE(follower_has("/api/Books/second", http::status::not_found));
+  EXPECT_TRUE(follower_has("/api/Books", http::status::ok, "[\"" + first + "\"]"));
+
+  // Writes go to the leader only.
+  http::response<http::string_body> refused = send(follower_port, http::verb::put, "/api/Books/third", "{}");
+  EXPECT_EQ(refused.result(), http::status::forbidden);
+  EXPECT_EQ(refused.body(), "Read-only replica of " + node(leader_port) + "; send writes to the leader");
+  EXPECT_NE(send(follower_port, http::verb::get, "/api/_replication").body().find("\"role\": \"follower\""), std::string::npos);
+
+  // Once it cannot hear from the leader for longer than its bound, the
+  // follower stops answering reads.
+  stop(leader);
+  EXPECT_TRUE(follower_has("/api/Books/" + first, http::status::service_unavailable));
+}
+
+TEST_F(ReplicationFollowerTest, LeaderServesItsLog) {
+  std::shared_ptr<replication_log> log = replication_log::get_shared(leader_config.root);
+  start(leader, leader_config, leader_port);
+  std::uint64_t start_sequence = log->last_sequence();
+  EXPECT_EQ(send(leader_port, http::verb::put, "/api/Books/a", "{}").result(), http::status::created);
+  EXPECT_EQ(send(leader_port, http::verb::delete_, "/api/Books/a").result(), http::status::no_content);
+
+  http::response<http::string_body> read = send(leader_port, http::verb::get,
+                                                "/api/_replication?since=" + std::to_string(start_sequence) + "&limit=1");
+  EXPECT_EQ(read.result(), http::status::ok);
+  EXPECT_EQ(read["X-Replication-More"], "true");
+  std::vector<replication_log::entry> entries;
+  ASSERT_TRUE(replication_log::parse(read.body(), entries));
+  ASSERT_EQ(entries.size(), 1u);
+  EXPECT_EQ(entries[0].key, "Books/a");
+  EXPECT_EQ(entries[0].data, "{}");
+
+  // A poll with nothing new waits, and answers with the next write.
+  std::string since = std::to_string(log->last_sequence());
+  std::thread writer([this]() {
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    send(leader_port, http::verb::put, "/api/Books/b", "{}");
+  });
+  auto asked = std::chrono::steady_clock::now();
+  read = send(leader_port, http::verb::get, "/api/_replication?since=" + since + "&wait=5");
+  writer.join();
+  EXPECT_GE(std::chrono::steady_clock::now() - asked, std::chrono::milliseconds(150));
+  entries.clear();
+  ASSERT_TRUE(replication_log::parse(read.body(), entries));
+  ASSERT_EQ(entries.size(), 1u);
+  EXPECT_EQ(entries[0].key, "Books/b");
+  EXPECT_EQ(read["X-Replication-More"], "false");
+
+  EXPECT_EQ(send(leader_port, http::verb::get, "/api/_replication?since=1").result(), http::status::gone);
+  EXPECT_EQ(send(leader_port, http::verb::get, "/api/_replication?limit=0").result(), http::status::bad_request);
+  read = send(leader_port, http::verb::get, "/api/_replication?snapshot");
+  entries.clear();
+  ASSERT_TRUE(replication_log::parse(read.body(), entries));
+  ASSERT_EQ(entries.size(), 1u);
+  EXPECT_EQ(entries[0].key, "Books/b");
+  EXPECT_EQ(read["X-Replication-More"], "false");
+
+  // The copy comes in pages, in key order, each addressed by the cursor the
+  // previous one ends with.
+  EXPECT_EQ(send(leader_port, http::verb::put, "/api/Books/c&d", "{}").result(), http::status::created);
+  EXPECT_EQ(send(leader_port, http::verb::put, "/api/Authors/x", "{}").result(), http::status::created);
+  std::vector<std::string> keys;
+  std::string target = "/api/_replication?snapshot&limit=1";
+  for (int page = 0; page < 3; page++) {
+    read = send(leader_port, http::verb::get, target);
+    ASSERT_EQ(read.result(), http::status::ok);
+    entries.clear();
+    ASSERT_TRUE(replication_log::parse(read.body(), entries));
+    ASSERT_EQ(entries.size(), 1u);
+    keys.push_back(entries[0].key);
+    EXPECT_EQ(read["X-Replication-More"], page < 2 ? "true" : "false");
+    target = "/api/_replication?snapshot&limit=1&cursor=" + std::string(read["X-Replication-Cursor"]);
+  }
+  EXPECT_EQ(keys, (std::vector<std::string>{"Authors/x", "Books/b", "Books/c&d"}));
+}
+
+TEST(ReplicationFollowerConfigTest, LoadsConfig) {
+  auto replicated = [](const std::vector<std::string>& role, const std::vector<std::string>& max_lag) {
+    HandlerConfig handler{"crud_handler", "/api", "./replica_config", {{"replication", role}}};
+    if (!max_lag.empty()) {
+      handler.directives["replication_max_lag"] = max_lag;
+    }
+    return replication_follower::load_config({handler});
+  };
+  EXPECT_FALSE(replicated({"primary"}, {}));
+  EXPECT_FALSE(replicated({"follower"}, {}));
+  EXPECT_FALSE(replicated({"follower", "127.0.0.1"}, {}));
+  EXPECT_FALSE(replicated({"follower", "127.0.0.1:8080"}, {"0"}));
+  EXPECT_FALSE(replicated({"follower", "127.0.0.1:8080"}, {"soon"}));
+  EXPECT_EQ(replication_follower::get_shared("./replica_config"), nullptr);
+
+  HandlerConfig log_storage{"crud_handler", "/api", "./replica_config", {{"replication", {"leader"}}, {"storage", {"log"}}}};
+  EXPECT_FALSE(replication_follower::load_config({log_storage}));
+  EXPECT_TRUE(replicated({"leader"}, {}));
+  EXPECT_EQ(replication_follower::get_shared("./replica_config"), nullptr);
+
+  EXPECT_TRUE(replicated({"follower", "127.0.0.1:8080"}, {"5"}));
+  std::shared_ptr<replication_follower> follower = replication_follower::get_shared("./replica_config");
+  ASSERT_NE(follower, nullptr);
+  EXPECT_EQ(follower->leader(), "127.0.0.1:8080");
+  EXPECT_EQ(follower->max_lag(), std::chrono::seconds(5));
+  EXPECT_EQ(follower->lag(), std::chrono::milliseconds::max());
+  EXPECT_FALSE(follower->current());
+}
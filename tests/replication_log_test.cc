@@ -0,0 +1,115 @@
+#include <gtest/gtest.h>
+#include "replication_log.h"
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <thread>
+#include <vector>
+
+class ReplicationLogTest : public ::testing::Test {
+protected:
+  replication_log log = replication_log(64, 2);
+
+  std::vector<std::string> keys_since(std::uint64_t since, size_t limit, std::uint64_t& next, bool& more) {
+    std::vector<replication_log::entry> entries;
+    EXPECT_TRUE(log.since(since, limit, entries, next, more));
+    std::vector<std::string> keys;
+    for (const auto& written : entries) {
+      keys.push_back(written.key + (written.deleted ? "-" : "=" + written.data));
+    }
+    return keys;
+  }
+};
+
+TEST_F(ReplicationLogTest, ReportsWritesInOrder) {
+  std::uint64_t start = log.last_sequence();
+  log.record("Shoes/a", "1", false);
+  log.record("Hats/b", "2", false);
+  log.record("Shoes/a", "ignored", true);
+
+  std::uint64_t next = 0;
+  bool more = true;
+  EXPECT_EQ(keys_since(start, 0, next, more), (std::vector<std::string>{"Shoes/a=1", "Hats/b=2", "Shoes/a-"}));
+  EXPECT_FALSE(more);
+  EXPECT_EQ(next, log.last_sequence());
+  EXPECT_GT(next, start);
+  EXPECT_TRUE(keys_since(next, 0, next, more).empty());
+
+  EXPECT_EQ(keys_since(start, 2, next, more), (std::vector<std::string>{"Shoes/a=1", "Hats/b=2"}));
+  EXPECT_TRUE(more);
+  EXPECT_EQ(keys_since(next, 2, next, more), (std::vector<std::string>{"Shoes/a-"}));
+  EXPECT_FALSE(more);
+}
+
+TEST_F(ReplicationLogTest, DropsOldestPastItsSize) {
+  std::string data(18, 'x');
+  std::uint64_t start = log.last_sequence();
+  log.record("S/a", data, false);
+  std::uint64_t after_first = log.last_sequence();
+  log.record("S/b", data, false);
+  log.record("S/c", data, false);
+  // 63 bytes so far; the fourth write pushes the first out.
+  std::uint64_t next;
+  bool more;
+  EXPECT_EQ(keys_since(start, 0, next, more).size(), 3u);
+  log.record("S/d", data, false);
+
+  std::vector<replication_log::entry> entries;
+  EXPECT_FALSE(log.since(start, 0, entries, next, more));
+  EXPECT_EQ(keys_since(after_first, 0, next, more), (std::vector<std::string>{"S/b=" + data, "S/c=" + data, "S/d=" + data}));
+
+  // A write larger than the whole log is still kept.
+  std::uint64_t before_large = log.last_sequence();
+  log.record("S/e", std::string(100, 'x'), false);
+  EXPECT_EQ(keys_since(before_large, 0, next, more).size(), 1u);
+  EXPECT_FALSE(log.since(after_first, 0, entries, next, more));
+}
+
+TEST_F(ReplicationLogTest, WatchersWakeOnWriteOrDeadline) {
+  std::uint64_t start = log.last_sequence();
+  std::atomic<int> woken{0};
+  auto far = std::chrono::steady_clock::now() + std::chrono::seconds(30);
+  EXPECT_TRUE(log.watch(start, far, [&woken]() { woken++; }));
+  EXPECT_TRUE(log.watch(start, std::chrono::steady_clock::now() + std::chrono::milliseconds(50), [&woken]() { woken += 10; }));
+  // Only two may wait at once.
+  EXPECT_FALSE(log.watch(start, far, []() {}));
+
+  std::this_thread::sleep_for(std::chrono::milliseconds(300));
+  EXPECT_EQ(woken, 10);
+  log.record("Shoes/a", "1", false);
+  EXPECT_EQ(woken, 11);
+
+  // Runs right away when there already is a write.
+  EXPECT_TRUE(log.watch(start, far, [&woken]() { woken += 100; }));
+  EXPECT_EQ(woken, 111);
+}
+
+TEST(ReplicationLogFormatTest, SerializesAndParses) {
+  std::vector<replication_log::entry> written = {
+    {7, "Shoes/a", "{\"name\": \"a\"}\n{\"line\": 2}", false},
+    {8, "Shoes/with space", "", true},
+    {9, "Shoes/empty", "", false},
+  };
+  std::string body;
+  for (const auto& entry : written) {
+    replication_log::serialize(entry, body);
+  }
+  EXPECT_EQ(body.substr(0, body.find('\n')), "7 25 Shoes/a");
+
+  std::vector<replication_log::entry> read;
+  ASSERT_TRUE(replication_log::parse(body, read));
+  ASSERT_EQ(read.size(), written.size());
+  for (size_t i = 0; i < read.size(); i++) {
+    EXPECT_EQ(read[i].sequence, written[i].sequence);
+    EXPECT_EQ(read[i].key, written[i].key);
+    EXPECT_EQ(read[i].data, written[i].data);
+    EXPECT_EQ(read[i].deleted, written[i].deleted);
+  }
+
+  read.clear();
+  EXPECT_TRUE(replication_log::parse("", read));
+  EXPECT_FALSE(replication_log::parse("7 99 Shoes/a\n{}", read));
+  EXPECT_FALSE(replication_log::parse("x 2 Shoes/a\n{}", read));
+  EXPECT_FALSE(replication_log::parse("7 2 Shoes/a", read));
+}
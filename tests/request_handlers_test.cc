@@ -8,9 +8,23 @@
 #include <sleep_handler.h>
 #include <health_handler.h>
 #include <markdown_handler.h>
+#include <static_preloader.h>
+#include <content_cache.h>
+#include <asset_bundle.h>
+#include <markdown_cache.h>
+#include <entity_index.h>
+#include <field_index.h>
+#include <change_feed.h>
+#include <expiry_wheel.h>
+#include <compressed_file_io.h>
+#include <caching_file_io.h>
+#include <async_file_io.h>
+#include <snapshot_file_io.h>
+#include <tar_archive.h>
 #include <boost/beast/http.hpp>
 #include <boost/lexical_cast.hpp>
 #include "i_file_io.h"
+#include "file_io.h"
 #include <ios>
 #include <memory>
 #include <regex>
@@ -19,6 +33,11 @@
 #include <vector>
 #include <algorithm>
 #include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <future>
+#include <mutex>
+#include <thread>
 
 namespace http = boost::beast::http;
 
@@ -69,8 +88,9 @@ public:
     return false;
   }
 
-  void close() override { 
+  bool close() override { 
     current_file = "";
+    return true;
   }
 
   bool delete_file(const std::string& filepath) override{
@@ -125,6 +145,28 @@ public:
   }
 };
 
+// fake_file_io whose reads wait for gate, once one is set.
+class gated_file_io : public fake_file_io {
+public:
+  std::shared_future<void> gate;
+
+  bool read(const std::string& filepath, std::string& content) override {
+    if (gate.valid()) {
+      gate.wait();
+    }
+    return fake_file_io::read(filepath, content);
+  }
+};
+
+// Fails to store anything written, as a backend that stores on close can.
+class unstorable_file_io : public fake_file_io {
+public:
+  bool close() override {
+    fake_file_io::close();
+    return false;
+  }
+};
+
 class EchoHandlerTest : public testing::Test {
 protected:
   echo_handler handler;
@@ -295,6 +337,134 @@ TEST_F(StaticHandlerTest, Markdown) {
   ASSERT_EQ(responseMarkdownBadParameter, badRequest);
 }
 
+TEST_F(StaticHandlerTest, PreloadedLocationSendsEtag) {
+  static_handler cached_handler = static_handler("/usr/src/projects/new-grad-ten-years-experience", true);
+
+  std::string request0 = "GET /static/Test2.txt HTTP/1.1\r\n\r\n";
+  http::request_parser<http::string_body> parser0;
+  boost::beast::error_code ec0;
+  parser0.put(boost::asio::buffer(request0), ec0);
+  http::request<http::string_body> parsedRequest0 = parser0.release();
+
+  http::response<http::string_body> response = cached_handler.handle_request(parsedRequest0);
+  ASSERT_EQ(response.result(), http::status::ok);
+  ASSERT_EQ(response.body(), "STUFF\n");
+  std::string etag = std::string(response[http::field::etag]);
+  ASSERT_EQ(etag, content_cache::make_etag("STUFF\n"));
+
+  std::string request1 = "GET /static/Test2.txt HTTP/1.1\r\nIf-None-Match: " + etag + "\r\n\r\n";
+  http::request_parser<http::string_body> parser1;
+  boost::beast::error_code ec1;
+  parser1.put(boost::asio::buffer(request1), ec1);
+  http::request<http::string_body> parsedRequest1 = parser1.release();
+
+  http::response<http::string_body> notModified = cached_handler.handle_request(parsedRequest1);
+  ASSERT_EQ(notModified.result(), http::status::not_modified);
+  ASSERT_EQ(notModified.body(), "");
+
+  // Locations without preload do not send ETags.
+  ASSERT_EQ(handler.handle_request(parsedRequest1).count(http::field::etag), 0);
+}
+
+TEST(StaticBundleTest, ServesFromBundle) {
+  std::string bundle_path = (std::filesystem::temp_directory_path() / "static_bundle_test.bundle").string();
+  asset_bundle_writer writer;
+  writer.add("/static/a.txt", "text/plain", "STUFF\n", 1);
+  writer.add("/static/big.css", "text/css", std::string(4096, 'c'), 1);
+  ASSERT_TRUE(writer.write(bundle_path));
+  static_handler bundle_handler = static_handler(asset_bundle::get_shared(bundle_path));
+
+  auto get = [&bundle_handler](const std::string& request) {
+    http::request_parser<http::string_body> parser;
+    boost::beast::error_code ec;
+    parser.put(boost::asio::buffer(request), ec);
+    return bundle_handler.handle_request(parser.release());
+  };
+
+  http::response<http::string_body> text = get("GET /static/a.txt HTTP/1.1\r\nAccept-Encoding: gzip\r\n\r\n");
+  ASSERT_EQ(text.result(), http::status::ok);
+  ASSERT_EQ(text.body(), "STUFF\n");
+  ASSERT_EQ(text[http::field::content_type], "text/plain");
+  ASSERT_EQ(text[http::field::etag], content_cache::make_etag("STUFF\n"));
+  ASSERT_EQ(text.count(http::field::content_encoding), 0);
+
+  http::response<http::string_body> plain = get("GET /static/big.css HTTP/1.1\r\n\r\n");
+  ASSERT_EQ(plain.body(), std::string(4096, 'c'));
+  ASSERT_EQ(plain[http::field::vary], "Accept-Encoding");
+  ASSERT_EQ(plain.count(http::field::content_encoding), 0);
+
+  http::response<http::string_body> gzipped = get("GET /static/big.css HTTP/1.1\r\nAccept-Encoding: deflate, gzip\r\n\r\n");
+  ASSERT_EQ(gzipped[http::field::content_encoding], "gzip");
+  ASSERT_LT(gzipped.body().size(), 4096);
+  ASSERT_NE(gzipped[http::field::etag], plain[http::field::etag]);
+
+  http::response<http::string_body> refused = get("GET /static/big.css HTTP/1.1\r\nAccept-Encoding: gzip;q=0\r\n\r\n");
+  ASSERT_EQ(refused.count(http::field::content_encoding), 0);
+
+  std::string etag = std::string(plain[http::field::etag]);
+  http::response<http::string_body> notModified = get("GET /static/big.css HTTP/1.1\r\nIf-None-Match: " + etag + "\r\n\r\n");
+  ASSERT_EQ(notModified.result(), http::status::not_modified);
+  ASSERT_EQ(notModified.body(), "");
+
+  http::response<http::string_body> missing = get("GET /static/missing.txt HTTP/1.1\r\n\r\n");
+  ASSERT_EQ(missing.result(), http::status::not_found);
+  ASSERT_EQ(missing.body(), "File not found");
+
+  std::filesystem::remove(bundle_path);
+}
+
+TEST(StaticPreloaderTest, LoadsFilesWithinBudget) {
+  std::filesystem::path root = std::filesystem::temp_directory_path() / "static_preloader_test";
+  std::filesystem::remove_all(root);
+  std::filesystem::create_directories(root / "static" / "nested");
+  std::ofstream(root / "static" / "a.txt") << "AAAA";
+  std::ofstream(root / "static" / "nested" / "b.md") << "# B";
+  std::ofstream(root / "static" / "nested" / "c.txt") << std::string(64, 'c');
+
+  content_cache::get_global_cache()->clear();
+  content_cache::get_global_cache()->set_budget(1 << 20);
+  size_t renders = markdown_cache::get_global_cache()->renders();
+
+  static_preloader preloader(root.string(), 16, 2);
+  preloader.run();
+
+  EXPECT_EQ(preloader.files_loaded(), 2);
+  EXPECT_EQ(preloader.bytes_loaded(), 7);
+  EXPECT_EQ(preloader.markdown_rendered(), 1);
+  EXPECT_EQ(markdown_cache::get_global_cache()->renders(), renders + 1);
+  EXPECT_EQ(content_cache::get_global_cache()->used(), 7);
+
+  // Entries are keyed the way static_handler builds paths: root + target.
+  static_handler cached_handler = static_handler(root.string(), true);
+  std::string request = "GET /static/a.txt HTTP/1.1\r\n\r\n";
+  http::request_parser<http::string_body> parser;
+  boost::beast::error_code ec;
+  parser.put(boost::asio::buffer(request), ec);
+  http::response<http::string_body> response = cached_handler.handle_request(parser.release());
+  EXPECT_EQ(response.body(), "AAAA");
+  EXPECT_EQ(content_cache::get_global_cache()->used(), 7);
+
+  // A root spelled with a trailing slash still finds the preloaded render.
+  static_handler slashed_handler = static_handler(root.string() + "/", true);
+  request = "GET /static/nested/b.md HTTP/1.1\r\n\r\n";
+  http::request_parser<http::string_body> markdown_parser;
+  markdown_parser.put(boost::asio::buffer(request), ec);
+  response = slashed_handler.handle_request(markdown_parser.release());
+  EXPECT_EQ(response.result(), http::status::ok);
+  EXPECT_EQ(markdown_cache::get_global_cache()->renders(), renders + 1);
+  EXPECT_EQ(content_cache::get_global_cache()->used(), 7);
+
+  content_cache::get_global_cache()->clear();
+  content_cache::get_global_cache()->set_budget(0);
+  std::filesystem::remove_all(root);
+}
+
+TEST(StaticPreloaderTest, RejectsMalformedBudget) {
+  HandlerConfig config = {"static_handler", "/static", "/tmp"};
+  config.directives["preload"] = {"lots"};
+  EXPECT_FALSE(static_preloader::start({config}));
+}
+
 TEST_F(StaticHandlerTest, DoesNotExist) {
   std::string fileNotFound = "HTTP/1.1 404 Not Found\r\nContent-Length: 14\r\n\r\nFile not found";
 
@@ -338,7 +508,7 @@ TEST_F(CrudHandlerTest, HandleRequestPostSuccess) {
   size_t content_length_value = std::stoul(content_length);
   ASSERT_EQ(content_length_value, res_body.size());
 
-  std::regex uuid_regex(R"(\{"id": "\b[0-9a-fA-F]{8}-[0-9a-fA-F]{4}-[1-5][0-9a-fA-F]{3}-[89abAB][0-9a-fA-F]{3}-[0-9a-fA-F]{12}\b"\})");
+  std::regex uuid_regex(R"(\{"id": "\b[0-9a-fA-F]{8}-[0-9a-fA-F]{4}-7[0-9a-fA-F]{3}-[89abAB][0-9a-fA-F]{3}-[0-9a-fA-F]{12}\b"\})");
   EXPECT_TRUE(std::regex_match(res_body, uuid_regex));
 }
 
@@ -542,6 +712,780 @@ TEST_F(CrudHandlerTest, HandleRequestGetListSuccess) {
   
 }
 
+TEST_F(CrudHandlerTest, HandleRequestGetListCreationOrder) {
+  // Directory iteration order is arbitrary; IDs sort by creation time.
+  std::filesystem::path root = std::filesystem::temp_directory_path() / "crud_list_order_test";
+  std::filesystem::remove_all(root);
+  crud_handler files_handler(root.string(), std::make_shared<file_io>());
+
+  std::vector<std::string> ids;
+  for (int i = 0; i < 20; i++) {
+    http::request<http::string_body> req_post;
+    req_post.method(http::verb::post);
+    req_post.target("/api/Shoes");
+    req_post.version(11);
+    req_post.set(http::field::content_type, "application/json");
+    req_post.body() = "{\"size\": " + std::to_string(i) + "}";
+    req_post.prepare_payload();
+    std::string res_body = files_handler.handle_request(req_post).body();
+    ids.push_back(res_body.substr(8, res_body.size() - 10));
+  }
+
+  http::request<http::string_body> req_get;
+  req_get.method(http::verb::get);
+  req_get.target("/api/Shoes");
+  req_get.version(11);
+  http::response<http::string_body> res_get = files_handler.handle_request(req_get);
+
+  std::string expected = "[";
+  for (size_t i = 0; i < ids.size(); i++) {
+    expected += (i ? ",\"" : "\"") + ids[i] + "\"";
+  }
+  expected += "]";
+  EXPECT_EQ(res_get.result(), http::status::ok);
+  EXPECT_EQ(res_get.body(), expected);
+  std::filesystem::remove_all(root);
+}
+
+TEST_F(CrudHandlerTest, HandleRequestGetListPaginated) {
+  for (int i = 0; i < 5; i++) {
+    http::request<http::string_body> req_put;
+    req_put.method(http::verb::put);
+    req_put.target("/api/Shoes/" + std::to_string(i));
+    req_put.version(11);
+    req_put.set(http::field::content_type, "application/json");
+    req_put.body() = "{\"size\": 10}";
+    req_put.prepare_payload();
+    handler.handle_request(req_put);
+  }
+
+  http::request<http::string_body> req_get;
+  req_get.method(http::verb::get);
+  req_get.version(11);
+
+  req_get.target("/api/Shoes?limit=2");
+  http::response<http::string_body> res_get = handler.handle_request(req_get);
+  EXPECT_EQ(res_get.result(), http::status::ok);
+  EXPECT_EQ(res_get.body(), "[\"0\",\"1\"]");
+  EXPECT_EQ(res_get[http::field::link], "</api/Shoes?limit=2&cursor=1>; rel=\"next\"");
+
+  // Entities created and deleted between pages do not disturb the cursor.
+  http::request<http::string_body> req_delete;
+  req_delete.method(http::verb::delete_);
+  req_delete.target("/api/Shoes/2");
+  req_delete.version(11);
+  handler.handle_request(req_delete);
+
+  req_get.target("/api/Shoes?limit=2&cursor=1");
+  res_get = handler.handle_request(req_get);
+  EXPECT_EQ(res_get.body(), "[\"3\",\"4\"]");
+  EXPECT_EQ(res_get.find(http::field::link), res_get.end());
+
+  req_get.target("/api/Shoes?cursor=3");
+  res_get = handler.handle_request(req_get);
+  EXPECT_EQ(res_get.body(), "[\"4\"]");
+  // The link escapes what the ID and entity path hold.
+  for (std::string id : {"a&b", "a c"}) {
+    http::request<http::string_body> req_put;
+    req_put.method(http::verb::put);
+    req_put.target("/api/Odd Shoes/" + id);
+    req_put.version(11);
+    req_put.set(http::field::content_type, "application/json");
+    req_put.body() = "{}";
+    req_put.prepare_payload();
+    EXPECT_EQ(handler.handle_request(req_put).result(), http::status::created);
+  }
+  req_get.target("/api/Odd Shoes?limit=1");
+  res_get = handler.handle_request(req_get);
+  EXPECT_EQ(res_get.body(), "[\"a c\"]");
+  EXPECT_EQ(res_get[http::field::link], "</api/Odd%20Shoes?limit=1&cursor=a%20c>; rel=\"next\"");
+  req_get.target("/api/Odd Shoes?limit=1&cursor=a%20c");
+  EXPECT_EQ(handler.handle_request(req_get).body(), "[\"a&b\"]");
+}
+
+TEST_F(CrudHandlerTest, HandleRequestGetListInvalidLimit) {
+  http::request<http::string_body> req_get;
+  req_get.method(http::verb::get);
+  req_get.version(11);
+  for (std::string limit : {"0", "abc", "-1", "10001"}) {
+    req_get.target("/api/Shoes?limit=" + limit);
+    EXPECT_EQ(handler.handle_request(req_get).result(), http::status::bad_request) << limit;
+  }
+}
+
+http::request<http::string_body> make_bulk_request(const std::string& target, const std::string& body) {
+  http::request<http::string_body> req;
+  req.method(http::verb::post);
+  req.target(target);
+  req.version(11);
+  req.set(http::field::content_type, "application/x-ndjson");
+  req.body() = body;
+  req.prepare_payload();
+  return req;
+}
+
+TEST_F(CrudHandlerTest, HandleRequestBulk) {
+  std::string bulk =
+    "{\"update\": {\"id\": \"1\"}}\n"
+    "{\"size\": 1}\n"
+    "{\"create\": {}}\n"
+    "{\"size\": 2}\n"
+    "\n"
+    "{\"update\": {\"id\": \"1\"}}\r\n"
+    "{\"size\": 3}\r\n"
+    "{\"delete\": {\"id\": \"1\"}}\n"
+    "{\"delete\": {\"id\": \"missing\"}}\n"
+    "{\"update\": {\"id\": \"../escape\"}}\n"
+    "{\"size\": 4}\n";
+  http::response<http::string_body> res = handler.handle_request(make_bulk_request("/api/Shoes/_bulk", bulk));
+  EXPECT_EQ(res.result(), http::status::ok);
+  EXPECT_EQ(res[http::field::content_type], "application/x-ndjson");
+
+  std::vector<std::string> lines;
+  std::istringstream stream(res.body());
+  for (std::string line; std::getline(stream, line);) {
+    lines.push_back(line);
+  }
+  ASSERT_EQ(lines.size(), 6);
+  EXPECT_EQ(lines[0], "{\"op\": \"update\", \"id\": \"1\", \"status\": 201}");
+  std::regex created(R"(\{"op": "create", "id": "[0-9a-f-]{36}", "status": 201\})");
+  EXPECT_TRUE(std::regex_match(lines[1], created));
+  EXPECT_EQ(lines[2], "{\"op\": \"update\", \"id\": \"1\", \"status\": 200}");
+  EXPECT_EQ(lines[3], "{\"op\": \"delete\", \"id\": \"1\", \"status\": 204}");
+  EXPECT_EQ(lines[4], "{\"op\": \"delete\", \"id\": \"missing\", \"status\": 404}");
+  EXPECT_EQ(lines[5], "{\"op\": \"update\", \"id\": \"../escape\", \"status\": 400, \"error\": \"Invalid id\"}");
+
+  http::request<http::string_body> req_get;
+  req_get.method(http::verb::get);
+  req_get.target("/api/Shoes/" + lines[1].substr(24, 36));
+  req_get.version(11);
+  res = handler.handle_request(req_get);
+  EXPECT_EQ(res.result(), http::status::ok);
+  EXPECT_EQ(res.body(), "{\"size\": 2}");
+}
+
+TEST_F(CrudHandlerTest, HandleRequestBulkMalformed) {
+  http::response<http::string_body> res = handler.handle_request(make_bulk_request("/api/Shoes/_bulk", "{\"create\": {}}\n{}\n{\"upsert\": {}}\n"));
+  EXPECT_EQ(res.result(), http::status::bad_request);
+  EXPECT_EQ(res.body(), "Malformed bulk action on line 3");
+
+  res = handler.handle_request(make_bulk_request("/api/Shoes/_bulk", "{\"create\": {}}\n"));
+  EXPECT_EQ(res.result(), http::status::bad_request);
+
+  http::request<http::string_body> req = make_bulk_request("/api/Shoes/_bulk", "{\"create\": {}}\n{}\n");
+  req.set(http::field::content_type, "application/json");
+  EXPECT_EQ(handler.handle_request(req).result(), http::status::unsupported_media_type);
+
+  EXPECT_EQ(handler.handle_request(make_bulk_request("/api/_bulk", "{}\n")).result(), http::status::bad_request);
+}
+
+TEST_F(CrudHandlerTest, HandleRequestImportAndMultiGet) {
+  std::string import;
+  for (int i = 0; i < 2500; i++) {
+    import += "{\"size\": " + std::to_string(i) + "}\n";
+  }
+  http::response<http::string_body> res = handler.handle_request(make_bulk_request("/api/Shoes/_import", import));
+  EXPECT_EQ(res.result(), http::status::ok);
+  EXPECT_EQ(std::count(res.body().begin(), res.body().end(), '\n'), 2500);
+  EXPECT_EQ(res.body().find("\"status\": 500"), std::string::npos);
+
+  std::string first_id = res.body().substr(res.body().find("\"id\": \"") + 7, 36);
+  http::request<http::string_body> req_get;
+  req_get.method(http::verb::get);
+  req_get.target("/api/Shoes?ids=" + first_id + ",missing,..");
+  req_get.version(11);
+  res = handler.handle_request(req_get);
+  EXPECT_EQ(res.result(), http::status::ok);
+  EXPECT_EQ(res.body(),
+            "{\"id\": \"" + first_id + "\", \"status\": 200, \"data\": {\"size\": 0}}\n"
+            "{\"id\": \"missing\", \"status\": 404}\n"
+            "{\"id\": \"..\", \"status\": 400}\n");
+}
+
+TEST_F(CrudHandlerTest, HandleRequestInvalidJson) {
+  http::request<http::string_body> req;
+  req.method(http::verb::post);
+  req.target("/api/Shoes");
+  req.version(11);
+  req.set(http::field::content_type, "application/json");
+  req.body() = "{\"brand\": \"Nike\",}";
+  req.prepare_payload();
+  http::response<http::string_body> res = handler.handle_request(req);
+  EXPECT_EQ(res.result(), http::status::bad_request);
+  EXPECT_EQ(res.body(), "Invalid JSON: expected string key at offset 17");
+
+  req.method(http::verb::put);
+  req.target("/api/Shoes/1");
+  res = handler.handle_request(req);
+  EXPECT_EQ(res.result(), http::status::bad_request);
+
+  // Nothing reached storage.
+  EXPECT_FALSE(file_io_ptr->exists("./root/Shoes/1"));
+  EXPECT_FALSE(file_io_ptr->exists("./root/Shoes"));
+
+  res = handler.handle_request(make_bulk_request("/api/Shoes/_import", "{\"size\": 1}\n{\"size\": }\n"));
+  EXPECT_NE(res.body().find("\"status\": 201"), std::string::npos);
+  EXPECT_NE(res.body().find("\"status\": 400, \"error\": \"Invalid JSON: unexpected character at offset 9\""), std::string::npos);
+}
+
+TEST_F(CrudHandlerTest, HandleRequestMinifiesJson) {
+  crud_handler minifying("./root", file_io_ptr, std::make_shared<entity_index>(), true);
+  http::request<http::string_body> req;
+  req.method(http::verb::put);
+  req.target("/api/Shoes/1");
+  req.version(11);
+  req.set(http::field::content_type, "application/json");
+  req.body() = "{\n  \"brand\" : \"Nike Air\",\n  \"sizes\" : [ 9, 10 ]\n}\n";
+  req.prepare_payload();
+  EXPECT_EQ(minifying.handle_request(req).result(), http::status::created);
+
+  std::string stored;
+  ASSERT_TRUE(file_io_ptr->read("./root/Shoes/1", stored));
+  EXPECT_EQ(stored, "{\"brand\":\"Nike Air\",\"sizes\":[9,10]}");
+}
+
+TEST_F(CrudHandlerTest, HandleRequestGetFiltered) {
+  crud_handler indexed("./root", file_io_ptr, std::make_shared<entity_index>(), false,
+                       std::make_shared<field_index>("./root", std::vector<std::string>{"Books:author", "Books:year"}));
+  std::vector<std::string> bodies = {"{\"author\": \"Le Guin\", \"year\": 1969}",
+                                     "{\"author\": \"Banks\", \"year\": 1987}",
+                                     "{\"author\": \"Le Guin\", \"year\": 1974}",
+                                     "{\"author\": \"Le Guin\", \"year\": 1969}"};
+  for (size_t i = 0; i < bodies.size(); i++) {
+    http::request<http::string_body> req_put;
+    req_put.method(http::verb::put);
+    req_put.target("/api/Books/" + std::to_string(i));
+    req_put.version(11);
+    req_put.set(http::field::content_type, "application/json");
+    req_put.body() = bodies[i];
+    req_put.prepare_payload();
+    indexed.handle_request(req_put);
+  }
+
+  http::request<http::string_body> req_get;
+  req_get.method(http::verb::get);
+  req_get.version(11);
+  req_get.target("/api/Books?author=Le%20Guin");
+  http::response<http::string_body> res_get = indexed.handle_request(req_get);
+  EXPECT_EQ(res_get.result(), http::status::ok);
+  EXPECT_EQ(res_get.body(), "[\"0\",\"2\",\"3\"]");
+
+  req_get.target("/api/Books?author=Le+Guin&year=1969&limit=1");
+  res_get = indexed.handle_request(req_get);
+  EXPECT_EQ(res_get.body(), "[\"0\"]");
+  EXPECT_EQ(res_get[http::field::link], "</api/Books?author=Le%20Guin&year=1969&limit=1&cursor=0>; rel=\"next\"");
+  req_get.target("/api/Books?author=Le%20Guin&year=1969&limit=1&cursor=0");
+  res_get = indexed.handle_request(req_get);
+  EXPECT_EQ(res_get.body(), "[\"3\"]");
+  EXPECT_EQ(res_get.find(http::field::link), res_get.end());
+
+  // Writes and deletes keep the index current.
+  http::request<http::string_body> req_delete;
+  req_delete.method(http::verb::delete_);
+  req_delete.target("/api/Books/0");
+  req_delete.version(11);
+  indexed.handle_request(req_delete);
+  indexed.handle_request(make_bulk_request("/api/Books/_bulk",
+                                           "{\"update\": {\"id\": \"1\"}}\n{\"author\": \"Le Guin\"}\n"));
+  req_get.target("/api/Books?author=Le%20Guin");
+  EXPECT_EQ(indexed.handle_request(req_get).body(), "[\"1\",\"2\",\"3\"]");
+  req_get.target("/api/Books?author=Banks");
+  EXPECT_EQ(indexed.handle_request(req_get).body(), "[]");
+
+  req_get.target("/api/Books?title=Excession");
+  res_get = indexed.handle_request(req_get);
+  EXPECT_EQ(res_get.result(), http::status::bad_request);
+  EXPECT_EQ(res_get.body(), "Field title is not indexed");
+  // Even when another filter already matches nothing.
+  req_get.target("/api/Books?author=Nobody&colour=red");
+  res_get = indexed.handle_request(req_get);
+  EXPECT_EQ(res_get.result(), http::status::bad_request);
+  EXPECT_EQ(res_get.body(), "Field colour is not indexed");
+}
+
+TEST_F(CrudHandlerTest, HandleRequestAggregate) {
+  crud_handler indexed("./root", file_io_ptr, std::make_shared<entity_index>(), false,
+                       std::make_shared<field_index>("./root", std::vector<std::string>{"Products:brand"}));
+  // Enough products for the scan to be split between threads.
+  for (int i = 0; i < 300; i++) {
+    http::request<http::string_body> req_put;
+    req_put.method(http::verb::put);
+    req_put.target("/api/Products/" + std::to_string(i));
+    req_put.version(11);
+    req_put.set(http::field::content_type, "application/json");
+    req_put.body() = "{\"brand\": \"" + std::string(i % 3 == 0 ? "Acme" : "Bolt") + "\", \"price\": " +
+                     (i == 299 ? "\"n/a\"" : std::to_string(i) + ".5") + "}";
+    req_put.prepare_payload();
+    indexed.handle_request(req_put);
+  }
+
+  http::request<http::string_body> req_get;
+  req_get.method(http::verb::get);
+  req_get.version(11);
+  req_get.target("/api/Products/_aggregate?op=count");
+  http::response<http::string_body> res_get = indexed.handle_request(req_get);
+  EXPECT_EQ(res_get.result(), http::status::ok);
+  EXPECT_EQ(res_get[http::field::content_type], "application/json");
+  EXPECT_EQ(res_get.body(), "{\"count\": 300}");
+
+  // The product priced "n/a" is not a number, so it is left out.
+  req_get.target("/api/Products/_aggregate?op=sum&field=price");
+  EXPECT_EQ(indexed.handle_request(req_get).body(), "{\"count\": 299, \"sum\": 44700.5}");
+  req_get.target("/api/Products/_aggregate?op=max&field=price&group_by=brand");
+  EXPECT_EQ(indexed.handle_request(req_get).body(),
+            "{\"groups\": {\"Acme\": {\"count\": 100, \"max\": 297.5}, \"Bolt\": {\"count\": 199, \"max\": 298.5}}}");
+
+  // Other parameters filter on indexed fields, as in a listing.
+  req_get.target("/api/Products/_aggregate?op=avg&field=price&brand=Acme");
+  EXPECT_EQ(indexed.handle_request(req_get).body(), "{\"count\": 100, \"avg\": 149}");
+  req_get.target("/api/Products/_aggregate?op=min&field=price&brand=Nobody");
+  EXPECT_EQ(indexed.handle_request(req_get).body(), "{\"count\": 0, \"min\": null}");
+
+  req_get.target("/api/Products/_aggregate?op=sum");
+  res_get = indexed.handle_request(req_get);
+  EXPECT_EQ(res_get.result(), http::status::bad_request);
+  EXPECT_EQ(res_get.body(), "op=sum needs a field");
+  req_get.target("/api/Products/_aggregate?op=count&color=red");
+  res_get = indexed.handle_request(req_get);
+  EXPECT_EQ(res_get.result(), http::status::bad_request);
+  EXPECT_EQ(res_get.body(), "Field color is not indexed");
+}
+
+TEST_F(CrudHandlerTest, HandleRequestETagPreconditions) {
+  std::filesystem::path root = std::filesystem::temp_directory_path() / "crud_etag_test";
+  std::filesystem::remove_all(root);
+  crud_handler files_handler(root.string(), std::make_shared<file_io>());
+
+  auto request = [](http::verb method, const std::string& body) {
+    http::request<http::string_body> req;
+    req.method(method);
+    req.target("/api/Shoes/1");
+    req.version(11);
+    if (!body.empty()) {
+      req.set(http::field::content_type, "application/json");
+      req.body() = body;
+    }
+    req.prepare_payload();
+    return req;
+  };
+
+  http::response<http::string_body> res = files_handler.handle_request(request(http::verb::put, "{\"size\": 9}"));
+  ASSERT_EQ(res.result(), http::status::created);
+  std::string created = std::string(res[http::field::etag]);
+  ASSERT_FALSE(created.empty());
+
+  // GET returns the same tag, and If-None-Match with it skips the body.
+  http::request<http::string_body> req_get = request(http::verb::get, "");
+  res = files_handler.handle_request(req_get);
+  EXPECT_EQ(res[http::field::etag], created);
+  EXPECT_EQ(res.body(), "{\"size\": 9}");
+  req_get.set(http::field::if_none_match, "\"other\", W/" + created);
+  res = files_handler.handle_request(req_get);
+  EXPECT_EQ(res.result(), http::status::not_modified);
+  EXPECT_EQ(res.body(), "");
+  EXPECT_EQ(res[http::field::etag], created);
+
+  // PUT with the current tag succeeds and moves the tag on.
+  http::request<http::string_body> req_put = request(http::verb::put, "{\"size\": 10}");
+  req_put.set(http::field::if_match, created);
+  res = files_handler.handle_request(req_put);
+  EXPECT_EQ(res.result(), http::status::no_content);
+  std::string updated = std::string(res[http::field::etag]);
+  EXPECT_NE(updated, created);
+
+  // A second PUT from the same stale copy is rejected instead of lost.
+  res = files_handler.handle_request(req_put);
+  EXPECT_EQ(res.result(), http::status::precondition_failed);
+  req_put.set(http::field::if_match, "W/" + updated);
+  EXPECT_EQ(files_handler.handle_request(req_put).result(), http::status::precondition_failed);
+  req_put.erase(http::field::if_match);
+  req_put.set(http::field::if_none_match, "*");
+  EXPECT_EQ(files_handler.handle_request(req_put).result(), http::status::precondition_failed);
+  req_get.set(http::field::if_none_match, created);
+  EXPECT_EQ(files_handler.handle_request(req_get).result(), http::status::ok);
+
+  // A same-size rewrite straight after still gets a new tag.
+  http::request<http::string_body> req_same_size = request(http::verb::put, "{\"size\": 11}");
+  req_same_size.set(http::field::if_match, updated);
+  res = files_handler.handle_request(req_same_size);
+  EXPECT_EQ(res.result(), http::status::no_content);
+  std::string rewritten = std::string(res[http::field::etag]);
+  EXPECT_NE(rewritten, updated);
+  EXPECT_EQ(files_handler.handle_request(req_same_size).result(), http::status::precondition_failed);
+
+  http::request<http::string_body> req_delete = request(http::verb::delete_, "");
+  req_delete.set(http::field::if_match, updated);
+  EXPECT_EQ(files_handler.handle_request(req_delete).result(), http::status::precondition_failed);
+  req_delete.set(http::field::if_match, rewritten);
+  EXPECT_EQ(files_handler.handle_request(req_delete).result(), http::status::no_content);
+  EXPECT_EQ(files_handler.handle_request(req_delete).result(), http::status::precondition_failed);
+  std::filesystem::remove_all(root);
+}
+
+TEST_F(CrudHandlerTest, HandleRequestETagWithoutVersions) {
+  // A backend without version metadata sends no ETags and fails If-Match
+  // on a specific tag, but * still only requires the entity to exist.
+  http::request<http::string_body> req;
+  req.method(http::verb::put);
+  req.target("/api/Shoes/1");
+  req.version(11);
+  req.set(http::field::content_type, "application/json");
+  req.body() = "{\"size\": 9}";
+  req.prepare_payload();
+  http::response<http::string_body> res = handler.handle_request(req);
+  EXPECT_EQ(res.result(), http::status::created);
+  EXPECT_EQ(res.find(http::field::etag), res.end());
+
+  req.set(http::field::if_match, "\"abc\"");
+  EXPECT_EQ(handler.handle_request(req).result(), http::status::precondition_failed);
+  req.set(http::field::if_match, "*");
+  EXPECT_EQ(handler.handle_request(req).result(), http::status::no_content);
+}
+
+http::request<http::string_body> make_patch_request(const std::string& target, const std::string& body) {
+  http::request<http::string_body> req;
+  req.method(http::verb::patch);
+  req.target(target);
+  req.version(11);
+  req.set(http::field::content_type, "application/merge-patch+json");
+  req.body() = body;
+  req.prepare_payload();
+  return req;
+}
+
+TEST_F(CrudHandlerTest, HandleRequestPatch) {
+  file_io_ptr->open("./root/Books/1", std::ios::out);
+  file_io_ptr->write("{\"title\": \"Dune\", \"author\": {\"first\": \"Frank\", \"last\": \"Herbert\"}, \"draft\": true}");
+  file_io_ptr->close();
+
+  http::response<http::string_body> res = handler.handle_request(
+      make_patch_request("/api/Books/1", "{\"author\": {\"first\": \"F.\"}, \"draft\": null, \"pages\": 412}"));
+  EXPECT_EQ(res.result(), http::status::no_content);
+  std::string stored;
+  ASSERT_TRUE(file_io_ptr->read("./root/Books/1", stored));
+  EXPECT_EQ(stored, "{\"title\":\"Dune\",\"author\":{\"first\":\"F.\",\"last\":\"Herbert\"},\"pages\":412}");
+
+  EXPECT_EQ(handler.handle_request(make_patch_request("/api/Books/2", "{\"a\": 1}")).result(), http::status::not_found);
+  EXPECT_EQ(handler.handle_request(make_patch_request("/api/Books", "{\"a\": 1}")).result(), http::status::bad_request);
+  res = handler.handle_request(make_patch_request("/api/Books/1", "{\"a\": }"));
+  EXPECT_EQ(res.result(), http::status::bad_request);
+  EXPECT_EQ(res.body(), "Invalid JSON: unexpected character at offset 6");
+  http::request<http::string_body> req = make_patch_request("/api/Books/1", "{\"a\": 1}");
+  req.set(http::field::content_type, "application/json");
+  EXPECT_EQ(handler.handle_request(req).result(), http::status::unsupported_media_type);
+  req = make_patch_request("/api/Books/1", "{\"a\": 1}");
+  req.set(http::field::if_match, "\"stale\"");
+  EXPECT_EQ(handler.handle_request(req).result(), http::status::precondition_failed);
+  ASSERT_TRUE(file_io_ptr->read("./root/Books/1", stored));
+  EXPECT_EQ(stored.find("\"a\""), std::string::npos);
+}
+
+TEST_F(CrudHandlerTest, HandleRequestConcurrentPatches) {
+  // Patches of different fields from many threads must all land.
+  std::filesystem::path root = std::filesystem::temp_directory_path() / "crud_patch_test";
+  std::filesystem::remove_all(root);
+  std::filesystem::create_directories(root / "Counters");
+  std::ofstream(root / "Counters" / "1") << "{}";
+
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 8; t++) {
+    threads.emplace_back([&root, t]() {
+      crud_handler files_handler(root.string(), std::make_shared<file_io>());
+      for (int i = 0; i < 10; i++) {
+        std::string field = "\"f" + std::to_string(t * 10 + i) + "\"";
+        files_handler.handle_request(make_patch_request("/api/Counters/1", "{" + field + ": " + std::to_string(i) + "}"));
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  std::string stored;
+  ASSERT_TRUE(file_io().read((root / "Counters" / "1").string(), stored));
+  EXPECT_EQ(std::count(stored.begin(), stored.end(), ':'), 80);
+  std::filesystem::remove_all(root);
+}
+
+http::request<http::string_body> make_get_request(const std::string& target) {
+  http::request<http::string_body> req;
+  req.method(http::verb::get);
+  req.target(target);
+  req.version(11);
+  return req;
+}
+
+TEST_F(CrudHandlerTest, HandleRequestChanges) {
+  http::response<http::string_body> res = handler.handle_request(make_get_request("/api/Shoes/_changes"));
+  ASSERT_EQ(res.result(), http::status::ok);
+  std::smatch match;
+  std::string body = res.body();
+  ASSERT_TRUE(std::regex_match(body, match, std::regex(R"(\{"changes": \[\], "last_seq": (\d+)\})")));
+  std::string since = match[1];
+
+  http::request<http::string_body> req_put;
+  req_put.method(http::verb::put);
+  req_put.target("/api/Shoes/1");
+  req_put.version(11);
+  req_put.set(http::field::content_type, "application/json");
+  req_put.body() = "{\"size\": 9}";
+  req_put.prepare_payload();
+  handler.handle_request(req_put);
+  handler.handle_request(make_patch_request("/api/Shoes/1", "{\"size\": 10}"));
+  handler.handle_request(make_bulk_request("/api/Shoes/_bulk", "{\"update\": {\"id\": \"2\"}}\n{}\n"));
+  http::request<http::string_body> req_delete;
+  req_delete.method(http::verb::delete_);
+  req_delete.target("/api/Shoes/1");
+  req_delete.version(11);
+  handler.handle_request(req_delete);
+  handler.handle_request(req_delete);  // nothing deleted, nothing recorded
+
+  res = handler.handle_request(make_get_request("/api/Shoes/_changes?since=" + since));
+  body = res.body();
+  std::regex change(R"re(\{"seq": \d+, "id": "(\w+)", "deleted": (true|false)\})re");
+  std::vector<std::string> changes;
+  for (auto it = std::sregex_iterator(body.begin(), body.end(), change); it != std::sregex_iterator(); ++it) {
+    changes.push_back((*it)[1].str() + ((*it)[2] == "true" ? "-" : "+"));
+  }
+  EXPECT_EQ(changes, (std::vector<std::string>{"1+", "1+", "2+", "1-"}));
+
+  res = handler.handle_request(make_get_request("/api/Shoes/_changes?since=" + since + "&limit=3"));
+  body = res.body();
+  ASSERT_TRUE(std::regex_search(body, match, std::regex(R"("last_seq": (\d+))")));
+  res = handler.handle_request(make_get_request("/api/Shoes/_changes?since=" + match[1].str()));
+  EXPECT_NE(res.body().find("\"id\": \"1\", \"deleted\": true"), std::string::npos);
+  EXPECT_EQ(res.body().find("\"id\": \"2\""), std::string::npos);
+
+  EXPECT_EQ(handler.handle_request(make_get_request("/api/Shoes/_changes?since=1")).result(), http::status::gone);
+  EXPECT_EQ(handler.handle_request(make_get_request("/api/Shoes/_changes?since=abc")).result(), http::status::bad_request);
+  EXPECT_EQ(handler.handle_request(make_get_request("/api/Shoes/_changes?limit=0")).result(), http::status::bad_request);
+}
+
+TEST_F(CrudHandlerTest, HandleRequestChangesLongPoll) {
+  auto feed = std::make_shared<change_feed>();
+  crud_handler watching("./root", file_io_ptr, std::make_shared<entity_index>(), false, nullptr, feed);
+  std::string body = watching.handle_request(make_get_request("/api/Shoes/_changes")).body();
+  std::string since = body.substr(body.rfind(' ') + 1, body.size() - body.rfind(' ') - 2);
+
+  // Requests that can be answered now are left to handle_request.
+  auto ignore = [](http::response<http::string_body>) {};
+  EXPECT_FALSE(watching.handle_request_async(make_get_request("/api/Shoes/_changes?since=" + since), ignore));
+  EXPECT_FALSE(watching.handle_request_async(make_get_request("/api/Shoes/_changes?wait=5"), ignore));
+  EXPECT_FALSE(watching.handle_request_async(make_get_request("/api/Shoes/1?wait=5"), ignore));
+  EXPECT_FALSE(watching.handle_request_async(make_get_request("/api/Shoes/_changes?since=x&wait=5"), ignore));
+
+  std::promise<http::response<http::string_body>> answered;
+  ASSERT_TRUE(watching.handle_request_async(make_get_request("/api/Shoes/_changes?since=" + since + "&wait=30"),
+                                            [&answered](http::response<http::string_body> res) { answered.set_value(res); }));
+  EXPECT_EQ(feed->watchers(), 1);
+
+  // A write through another handler wakes the watcher.
+  std::thread writer([this, feed]() {
+    crud_handler other("./root", file_io_ptr, std::make_shared<entity_index>(), false, nullptr, feed);
+    http::request<http::string_body> req_put;
+    req_put.method(http::verb::put);
+    req_put.target("/api/Shoes/7");
+    req_put.version(11);
+    req_put.set(http::field::content_type, "application/json");
+    req_put.body() = "{\"size\": 9}";
+    req_put.prepare_payload();
+    other.handle_request(req_put);
+  });
+  auto result = answered.get_future();
+  ASSERT_EQ(result.wait_for(std::chrono::seconds(10)), std::future_status::ready);
+  writer.join();
+  http::response<http::string_body> res = result.get();
+  EXPECT_EQ(res.result(), http::status::ok);
+  EXPECT_NE(res.body().find("\"id\": \"7\", \"deleted\": false"), std::string::npos);
+}
+
+http::request<http::string_body> make_put_request(const std::string& target, const std::string& body, const std::string& ttl = "") {
+  http::request<http::string_body> req;
+  req.method(http::verb::put);
+  req.target(target);
+  req.version(11);
+  req.set(http::field::content_type, "application/json");
+  if (!ttl.empty()) {
+    req.set("X-TTL", ttl);
+  }
+  req.body() = body;
+  req.prepare_payload();
+  return req;
+}
+
+TEST_F(CrudHandlerTest, HandleRequestStoreFailure) {
+  crud_handler failing("./root", std::make_shared<unstorable_file_io>(), std::make_shared<entity_index>());
+  EXPECT_EQ(failing.handle_request(make_put_request("/api/Shoes/1", "{}")).result(), http::status::internal_server_error);
+}
+
+TEST_F(CrudHandlerTest, HandleRequestTtl) {
+  auto expiry = std::make_shared<expiry_wheel>("", std::chrono::milliseconds(10));
+  crud_handler expiring("./root", file_io_ptr, std::make_shared<entity_index>(), false, nullptr, nullptr, expiry, 3600);
+  auto now = expiry_wheel::clock::now();
+
+  // The location default applies unless X-TTL overrides it; 0 never expires.
+  EXPECT_EQ(expiring.handle_request(make_put_request("/api/Shoes/1", "{}")).result(), http::status::created);
+  EXPECT_FALSE(expiry->expired("./root/Shoes/1", now + std::chrono::seconds(3599)));
+  EXPECT_TRUE(expiry->expired("./root/Shoes/1", now + std::chrono::seconds(3601)));
+  EXPECT_EQ(expiring.handle_request(make_put_request("/api/Shoes/1", "{}", "60")).result(), http::status::no_content);
+  EXPECT_TRUE(expiry->expired("./root/Shoes/1", now + std::chrono::seconds(61)));
+  EXPECT_EQ(expiring.handle_request(make_put_request("/api/Shoes/1", "{}", "0")).result(), http::status::no_content);
+  EXPECT_EQ(expiry->size(), 0);
+  EXPECT_EQ(expiring.handle_request(make_put_request("/api/Shoes/1", "{}", "-1")).result(), http::status::bad_request);
+  EXPECT_EQ(expiring.handle_request(make_put_request("/api/Shoes/1", "{}", "soon")).result(), http::status::bad_request);
+  EXPECT_EQ(expiring.handle_request(make_bulk_request("/api/Shoes/_import", "{}\n{}\n")).result(), http::status::ok);
+  EXPECT_EQ(expiry->size(), 2);
+
+  // Past its deadline an entity is gone, even before it is reaped.
+  expiry->set("./root/Shoes/1", now - std::chrono::seconds(1));
+  EXPECT_EQ(expiring.handle_request(make_get_request("/api/Shoes/1")).result(), http::status::not_found);
+  std::string listing = expiring.handle_request(make_get_request("/api/Shoes")).body();
+  EXPECT_EQ(listing.find("\"1\""), std::string::npos);
+  EXPECT_EQ(std::count(listing.begin(), listing.end(), ','), 1);
+  EXPECT_EQ(expiring.handle_request(make_get_request("/api/Shoes?ids=1")).body(), "{\"id\": \"1\", \"status\": 404}\n");
+  EXPECT_EQ(expiring.handle_request(make_patch_request("/api/Shoes/1", "{}")).result(), http::status::not_found);
+  EXPECT_EQ(expiring.handle_request(make_put_request("/api/Shoes/1", "{}", "0")).result(), http::status::created);
+  EXPECT_EQ(expiring.handle_request(make_get_request("/api/Shoes/1")).result(), http::status::ok);
+
+  std::promise<void> reaped;
+  expiry->start([&expiring, &reaped](const std::string& path, expiry_wheel& wheel) {
+    expiring.expire_entity(path, wheel);
+    reaped.set_value();
+  });
+  expiry->set("./root/Shoes/1", now - std::chrono::seconds(2));
+  ASSERT_EQ(reaped.get_future().wait_for(std::chrono::seconds(5)), std::future_status::ready);
+  EXPECT_FALSE(file_io_ptr->exists("./root/Shoes/1"));
+  EXPECT_EQ(expiring.handle_request(make_get_request("/api/Shoes")).body().find("\"1\""), std::string::npos);
+}
+
+TEST_F(CrudHandlerTest, HandleRequestHiddenPaths) {
+  // The expiry journal and write-ahead log live under the root.
+  EXPECT_EQ(handler.handle_request(make_get_request("/api/.ttl/expiry.log")).result(), http::status::bad_request);
+  EXPECT_EQ(handler.handle_request(make_put_request("/api/.ttl/expiry.log", "{}")).result(), http::status::bad_request);
+  EXPECT_EQ(handler.handle_request(make_put_request("/api/Shoes/.1", "{}")).result(), http::status::bad_request);
+  EXPECT_EQ(handler.handle_request(make_get_request("/api/.wal")).result(), http::status::bad_request);
+  EXPECT_FALSE(file_io_ptr->exists("./root/.ttl/expiry.log"));
+  EXPECT_EQ(handler.handle_request(make_put_request("/api/Shoes/1.x", "{}")).result(), http::status::created);
+}
+
+TEST_F(CrudHandlerTest, HandleRequestCompressed) {
+  auto compressed = std::make_shared<compressed_file_io>(file_io_ptr, "./root");
+  crud_handler compressing("./root", compressed);
+  std::string entity = "{\"brand\": \"Acme\", \"tags\": [\"a\", \"a\", \"a\", \"a\", \"a\", \"a\"]}";
+  EXPECT_EQ(compressing.handle_request(make_put_request("/api/Shoes/1", entity)).result(), http::status::created);
+  std::string stored;
+  ASSERT_TRUE(file_io_ptr->read("./root/Shoes/1", stored));
+  EXPECT_EQ(stored.substr(0, 2), "\x1f\x8b");
+
+  http::request<http::string_body> req = make_get_request("/api/Shoes/1");
+  http::response<http::string_body> res = compressing.handle_request(req);
+  EXPECT_EQ(res.body(), entity);
+  EXPECT_EQ(res.count(http::field::content_encoding), 0);
+  EXPECT_EQ(res[http::field::vary], "Accept-Encoding");
+
+  // A client that takes gzip gets the stored bytes.
+  req.set(http::field::accept_encoding, "br, gzip");
+  res = compressing.handle_request(req);
+  EXPECT_EQ(res[http::field::content_encoding], "gzip");
+  EXPECT_EQ(res.body(), stored);
+
+  // Everything else sees the plain entity.
+  EXPECT_EQ(compressing.handle_request(make_get_request("/api/Shoes?ids=1")).body(),
+            "{\"id\": \"1\", \"status\": 200, \"data\": " + entity + "}\n");
+  EXPECT_EQ(compressing.handle_request(make_patch_request("/api/Shoes/1", "{\"tags\": null}")).result(), http::status::no_content);
+  EXPECT_EQ(compressing.handle_request(make_get_request("/api/Shoes/1")).body(), "{\"brand\":\"Acme\"}");
+}
+
+TEST_F(CrudHandlerTest, HandleRequestBackup) {
+  std::filesystem::path root = std::filesystem::temp_directory_path() / "crud_backup_test";
+  std::filesystem::remove_all(root);
+  HandlerConfig config{"crud_handler", "/api", root.string(), {{"backup", {"on"}}}};
+  ASSERT_TRUE(snapshot_file_io::load_config({config}));
+  std::shared_ptr<i_file_io> storage = snapshot_file_io::wrap(config, std::make_shared<file_io>());
+  crud_handler backed_up(root.string(), storage);
+  EXPECT_EQ(backed_up.handle_request(make_put_request("/api/Shoes/1", "{\"size\": 9}")).result(), http::status::created);
+  EXPECT_EQ(backed_up.handle_request(make_put_request("/api/Hats/2", "{\"size\": 7}")).result(), http::status::created);
+
+  std::promise<http::response<http::string_body>> answered;
+  ASSERT_TRUE(backed_up.handle_request_async(make_get_request("/api/_backup"),
+                                             [&answered](http::response<http::string_body> res) { answered.set_value(res); }));
+  std::future<http::response<http::string_body>> future = answered.get_future();
+  ASSERT_EQ(future.wait_for(std::chrono::seconds(10)), std::future_status::ready);
+  http::response<http::string_body> res = future.get();
+  EXPECT_EQ(res.result(), http::status::ok);
+  EXPECT_EQ(res["X-Backup-Files"], "2");
+  std::ifstream spooled{std::string(res[request_handler::spooled_body_header]), std::ios::binary};
+  std::stringstream tar;
+  tar << spooled.rdbuf();
+  std::map<std::string, std::string> files;
+  EXPECT_TRUE(tar_archive::extract(tar.str(), [&files](const std::string& name, const std::string& content) {
+    files[name] = content;
+    return true;
+  }));
+  EXPECT_EQ(files, (std::map<std::string, std::string>{{"Hats/2", "{\"size\": 7}"}, {"Shoes/1", "{\"size\": 9}"}}));
+
+  // Without `backup on;` the request is left to handle_request.
+  EXPECT_FALSE(handler.handle_request_async(make_get_request("/api/_backup"), [](http::response<http::string_body>) {}));
+  std::filesystem::remove_all(root);
+}
+
+TEST_F(CrudHandlerTest, HandleRequestAggregateAsync) {
+  auto storage = std::make_shared<gated_file_io>();
+  auto scanning = std::make_unique<crud_handler>("./root", storage, std::make_shared<entity_index>());
+  EXPECT_EQ(scanning->handle_request(make_put_request("/api/Shoes/1", "{\"size\": 9}")).result(), http::status::created);
+  EXPECT_EQ(scanning->handle_request(make_put_request("/api/Shoes/2", "{\"size\": 7}")).result(), http::status::created);
+
+  // The scan runs on a scan thread, after the handler that took it is gone.
+  std::promise<void> opened;
+  storage->gate = opened.get_future().share();
+  std::vector<std::future<http::response<http::string_body>>> answers;
+  std::mutex answered_mutex;
+  std::vector<std::promise<http::response<http::string_body>>> answered(crud_handler::max_pending_scans + 1);
+  for (size_t i = 0; i < answered.size(); i++) {
+    answers.push_back(answered[i].get_future());
+    ASSERT_TRUE(scanning->handle_request_async(make_get_request("/api/Shoes/_aggregate?op=sum&field=size"),
+                                               [&answered, &answered_mutex, i](http::response<http::string_body> res) {
+                                                 std::lock_guard<std::mutex> lock(answered_mutex);
+                                                 answered[i].set_value(res);
+                                               }));
+  }
+  scanning.reset();
+
+  // Past max_pending_scans, scans are refused until the others finish.
+  ASSERT_EQ(answers.back().wait_for(std::chrono::seconds(10)), std::future_status::ready);
+  http::response<http::string_body> refused = answers.back().get();
+  EXPECT_EQ(refused.result(), http::status::service_unavailable);
+  EXPECT_EQ(refused[http::field::retry_after], "1");
+
+  opened.set_value();
+  for (size_t i = 0; i + 1 < answers.size(); i++) {
+    ASSERT_EQ(answers[i].wait_for(std::chrono::seconds(10)), std::future_status::ready);
+    http::response<http::string_body> res = answers[i].get();
+    EXPECT_EQ(res.result(), http::status::ok);
+    EXPECT_EQ(res.body(), "{\"count\": 2, \"sum\": 16}");
+  }
+}
+
+TEST_F(CrudHandlerTest, HandleRequestCached) {
+  auto cache = std::make_shared<caching_file_io::cache>(1 << 20);
+  crud_handler caching("./root", std::make_shared<caching_file_io>(file_io_ptr, cache));
+  EXPECT_EQ(caching.handle_request(make_put_request("/api/Shoes/1", "{\"size\": 9}")).result(), http::status::created);
+  EXPECT_EQ(caching.handle_request(make_get_request("/api/Shoes/1")).body(), "{\"size\": 9}");
+  size_t hits = cache->hits();
+  EXPECT_EQ(caching.handle_request(make_get_request("/api/Shoes/1")).body(), "{\"size\": 9}");
+  EXPECT_GT(cache->hits(), hits);
+
+  // Writes through the handler are seen by the next read.
+  EXPECT_EQ(caching.handle_request(make_put_request("/api/Shoes/1", "{\"size\": 10}")).result(), http::status::no_content);
+  EXPECT_EQ(caching.handle_request(make_get_request("/api/Shoes/1")).body(), "{\"size\": 10}");
+  EXPECT_EQ(caching.handle_request(make_patch_request("/api/Shoes/1", "{\"size\": 11}")).result(), http::status::no_content);
+  EXPECT_EQ(caching.handle_request(make_get_request("/api/Shoes/1")).body(), "{\"size\":11}");
+
+  http::request<http::string_body> req_delete = make_get_request("/api/Shoes/1");
+  req_delete.method(http::verb::delete_);
+  EXPECT_EQ(caching.handle_request(req_delete).result(), http::status::no_content);
+  EXPECT_EQ(caching.handle_request(make_get_request("/api/Shoes/1")).result(), http::status::not_found);
+}
+
 TEST_F(CrudHandlerTest, HandleRequestPutCreationSuccess) {
   // Create PUT Request
   http::request<http::string_body> req;
@@ -779,6 +1723,24 @@ TEST_F(HealthHandlerTest, HealthTest) {
   ASSERT_EQ(response.body(), "OK");
 }
 
+TEST_F(HealthHandlerTest, WarmingUp) {
+  std::string validRequest = "GET /health HTTP/1.1\r\n\r\n";
+  http::request_parser<http::string_body> parser;
+  boost::beast::error_code ec;
+  parser.put(boost::asio::buffer(validRequest), ec);
+  http::request<http::string_body> parsedRequest = parser.release();
+
+  health_handler::begin_warmup();
+  http::response<http::string_body> warming = handler.handle_request(parsedRequest);
+  health_handler::end_warmup();
+  http::response<http::string_body> ready = handler.handle_request(parsedRequest);
+
+  ASSERT_EQ(warming.result(), http::status::service_unavailable);
+  ASSERT_EQ(warming.body(), "WARMING UP");
+  ASSERT_EQ(ready.result(), http::status::ok);
+  ASSERT_TRUE(health_handler::ready());
+}
+
 TEST_F(MarkdownHandlerTest, CreateMarkdownFileSuccess) {
   http::request<http::string_body> req;
   req.method(http::verb::post);
@@ -800,10 +1762,63 @@ TEST_F(MarkdownHandlerTest, CreateMarkdownFileSuccess) {
   size_t content_length_value = std::stoul(content_length);
   ASSERT_EQ(content_length_value, res_body.size());
 
-  std::regex uuid_regex(R"(\{"id": "\b[0-9a-fA-F]{8}-[0-9a-fA-F]{4}-[1-5][0-9a-fA-F]{3}-[89abAB][0-9a-fA-F]{3}-[0-9a-fA-F]{12}\b"\})");
+  std::regex uuid_regex(R"(\{"id": "\b[0-9a-fA-F]{8}-[0-9a-fA-F]{4}-7[0-9a-fA-F]{3}-[89abAB][0-9a-fA-F]{3}-[0-9a-fA-F]{12}\b"\})");
   EXPECT_TRUE(std::regex_match(res_body, uuid_regex));
 }
 
+TEST_F(MarkdownHandlerTest, HandleRequestAsync) {
+  std::filesystem::path root = std::filesystem::temp_directory_path() / "markdown_async_test";
+  std::filesystem::remove_all(root);
+  boost::asio::io_context io;
+  auto work = boost::asio::make_work_guard(io);
+  markdown_handler async_handler(root.string(), std::make_shared<file_io>(), async_file_io::create(io));
+  auto send = [&](http::verb method, const std::string& target, const std::string& body) {
+    http::request<http::string_body> req;
+    req.method(method);
+    req.target(target);
+    req.version(11);
+    req.set(http::field::content_type, "text/markdown");
+    req.body() = body;
+    req.prepare_payload();
+    std::shared_ptr<http::response<http::string_body>> res;
+    EXPECT_TRUE(async_handler.handle_request_async(req, [&res](http::response<http::string_body> response) {
+      res = std::make_shared<http::response<http::string_body>>(std::move(response));
+    }));
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+    while (!res && std::chrono::steady_clock::now() < deadline) {
+      io.run_for(std::chrono::milliseconds(10));
+    }
+    return res ? *res : http::response<http::string_body>();
+  };
+
+  http::response<http::string_body> res = send(http::verb::put, "/markdown/Docs/1", "# One");
+  EXPECT_EQ(res.result(), http::status::created);
+  EXPECT_EQ(res.body(), "{\"id\": \"1\"}");
+  EXPECT_EQ(send(http::verb::put, "/markdown/Docs/1", "# Uno").result(), http::status::no_content);
+  res = send(http::verb::post, "/markdown/Docs", "# Two");
+  EXPECT_EQ(res.result(), http::status::created);
+
+  res = send(http::verb::get, "/markdown/Docs/1?raw=true", "");
+  EXPECT_EQ(res.result(), http::status::ok);
+  EXPECT_EQ(res[http::field::content_type], "text/markdown");
+  EXPECT_EQ(res.body(), "# Uno");
+  res = send(http::verb::get, "/markdown/Docs", "");
+  EXPECT_NE(res.body().find("\"1\""), std::string::npos);
+  EXPECT_EQ(std::count(res.body().begin(), res.body().end(), ','), 1);
+
+  EXPECT_EQ(send(http::verb::delete_, "/markdown/Docs/1", "").result(), http::status::no_content);
+  EXPECT_EQ(send(http::verb::get, "/markdown/Docs/1?raw=true", "").result(), http::status::not_found);
+
+  // Requests that fail validation are left to handle_request.
+  http::request<http::string_body> req;
+  req.method(http::verb::put);
+  req.target("/markdown/Docs");
+  req.set(http::field::content_type, "text/markdown");
+  EXPECT_FALSE(async_handler.handle_request_async(req, [](http::response<http::string_body>) {}));
+  EXPECT_FALSE(handler.handle_request_async(req, [](http::response<http::string_body>) {}));
+  std::filesystem::remove_all(root);
+}
+
 TEST_F(MarkdownHandlerTest, HandleRequestUnsupportedMethod) {
   http::request<http::string_body> req;
   req.method(http::verb::head);
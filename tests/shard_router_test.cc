@@ -0,0 +1,316 @@
+#include <gtest/gtest.h>
+#include "crud_handler.h"
+#include "expiry_wheel.h"
+#include "server.h"
+#include "shard_router.h"
+#include <boost/asio.hpp>
+#include <boost/beast/core.hpp>
+#include <boost/beast/http.hpp>
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+using boost::asio::ip::tcp;
+
+namespace {
+
+unsigned short free_port() {
+  boost::asio::io_context io;
+  tcp::acceptor acceptor(io, tcp::endpoint(boost::asio::ip::make_address("127.0.0.1"), 0));
+  return acceptor.local_endpoint().port();
+}
+
+std::string node(unsigned short port) {
+  return "127.0.0.1:" + std::to_string(port);
+}
+
+http::response<http::string_body> send(unsigned short port, http::verb method, const std::string& target,
+                                       const std::string& body = "") {
+  boost::asio::io_context io;
+  tcp::socket socket(io);
+  socket.connect(tcp::endpoint(boost::asio::ip::make_address("127.0.0.1"), port));
+  http::request<http::string_body> request{method, target, 11};
+  request.set(http::field::host, node(port));
+  if (!body.empty()) {
+    request.set(http::field::content_type, "application/json");
+    request.body() = body;
+  }
+  request.prepare_payload();
+  http::write(socket, request);
+  boost::beast::flat_buffer buffer;
+  http::response<http::string_body> response;
+  http::read(socket, buffer, response);
+  return response;
+}
+
+// IDs of a listing body such as ["a","b"].
+std::vector<std::string> listed(const std::string& body) {
+  std::vector<std::string> ids;
+  for (size_t open = body.find('"'); open != std::string::npos; open = body.find('"', body.find('"', open + 1) + 1)) {
+    ids.push_back(body.substr(open + 1, body.find('"', open + 1) - open - 1));
+  }
+  return ids;
+}
+
+}
+
+// Runs whole nodes in this process, each a server with a sharded /api
+// location on a port of its own.
+class ShardRouterTest : public ::testing::Test {
+protected:
+  std::unique_ptr<boost::asio::io_context> io;
+  std::vector<std::unique_ptr<server>> servers;
+  std::vector<std::thread> threads;
+  std::filesystem::path base = std::filesystem::temp_directory_path() / "shard_router_test";
+
+  void SetUp() override {
+    std::filesystem::remove_all(base);
+    io = std::make_unique<boost::asio::io_context>();
+  }
+
+  void TearDown() override {
+    stop();
+    std::filesystem::remove_all(base);
+  }
+
+  HandlerConfig config(const std::string& name, unsigned short self, const std::vector<std::string>& nodes) {
+    return {"crud_handler", "/api", (base / name).string(), {{"shard_nodes", nodes}, {"shard_self", {node(self)}}}};
+  }
+
+  void start(const HandlerConfig& node_config, unsigned short port) {
+    std::vector<HandlerConfig> handlers = {node_config};
+    servers.push_back(std::make_unique<server>(*io, port, handlers));
+  }
+
+  void run() {
+    for (int i = 0; i < 4; i++) {
+      threads.emplace_back([this]() { io->run(); });
+    }
+  }
+
+  // Stops every node, so the ports can be listened on again.
+  void stop() {
+    io->stop();
+    for (auto& thread : threads) {
+      thread.join();
+    }
+    threads.clear();
+    servers.clear();
+    io = std::make_unique<boost::asio::io_context>();
+  }
+
+  std::vector<std::string> stored(const std::string& name) {
+    std::vector<std::string> ids;
+    std::error_code error;
+    for (std::filesystem::directory_iterator it(base / name / "Books", error), end; !error && it != end; it.increment(error)) {
+      ids.push_back(it->path().filename().string());
+    }
+    std::sort(ids.begin(), ids.end());
+    return ids;
+  }
+
+  std::vector<std::string> create(unsigned short port, int count) {
+    std::vector<std::string> ids;
+    for (int i = 0; i < count; i++) {
+      http::response<http::string_body> created = send(port, http::verb::post, "/api/Books", "{\"n\": " + std::to_string(i) + "}");
+      EXPECT_EQ(created.result(), http::status::created);
+      std::string body = created.body();
+      ids.push_back(body.substr(body.find(": \"") + 3, body.rfind('"') - body.find(": \"") - 3));
+    }
+    return ids;
+  }
+};
+
+TEST_F(ShardRouterTest, ForwardsToOwner) {
+  unsigned short a = free_port();
+  unsigned short b = free_port();
+  HandlerConfig config_a = config("forward_a", a, {node(a), node(b)});
+  HandlerConfig config_b = config("forward_b", b, {node(a), node(b)});
+  ASSERT_TRUE(shard_router::load_config({config_a, config_b}));
+  ASSERT_TRUE(crud_handler::load_config({config_a, config_b}));
+  start(config_a, a);
+  start(config_b, b);
+  run();
+
+  // Created through one node, stored on whichever owns each ID.
+  std::vector<std::string> ids = create(a, 20);
+  std::shared_ptr<shard_router> router = shard_router::get_shared(config_a.root);
+  std::vector<std::string> on_a;
+  std::vector<std::string> on_b;
+  for (const auto& id : ids) {
+    (router->owner("Books/" + id) == node(a) ? on_a : on_b).push_back(id);
+  }
+  std::sort(on_a.begin(), on_a.end());
+  std::sort(on_b.begin(), on_b.end());
+  EXPECT_EQ(stored("forward_a"), on_a);
+  EXPECT_EQ(stored("forward_b"), on_b);
+  EXPECT_FALSE(on_a.empty());
+  EXPECT_FALSE(on_b.empty());
+
+  for (size_t i = 0; i < ids.size(); i++) {
+    http::response<http::string_body> found = send(b, http::verb::get, "/api/Books/" + ids[i]);
+    EXPECT_EQ(found.result(), http::status::ok);
+    EXPECT_EQ(found.body(), "{\"n\": " + std::to_string(i) + "}");
+  }
+
+  // Listings gather every node's IDs, a page at a time across the cluster.
+  std::sort(ids.begin(), ids.end());
+  EXPECT_EQ(listed(send(b, http::verb::get, "/api/Books").body()), ids);
+  std::vector<std::string> paged;
+  std::string target = "/api/Books?limit=7";
+  for (int pages = 0; !target.empty() && pages < 10; pages++) {
+    http::response<http::string_body> page = send(a, http::verb::get, target);
+    std::vector<std::string> page_ids = listed(page.body());
+    EXPECT_LE(page_ids.size(), 7u);
+    paged.insert(paged.end(), page_ids.begin(), page_ids.end());
+    std::string link(page[http::field::link]);
+    target = link.empty() ? "" : link.substr(1, link.find('>') - 1);
+  }
+  EXPECT_EQ(paged, ids);
+
+  for (const auto& id : on_b) {
+    EXPECT_EQ(send(a, http::verb::delete_, "/api/Books/" + id).result(), http::status::no_content);
+    EXPECT_EQ(send(b, http::verb::get, "/api/Books/" + id).result(), http::status::not_found);
+  }
+  EXPECT_TRUE(stored("forward_b").empty());
+  EXPECT_EQ(stored("forward_a"), on_a);
+}
+
+TEST_F(ShardRouterTest, HandsOffToJoiningNode) {
+  unsigned short a = free_port();
+  unsigned short b = free_port();
+  unsigned short c = free_port();
+  HandlerConfig before_a = config("join_a", a, {node(a), node(b)});
+  HandlerConfig before_b = config("join_b", b, {node(a), node(b)});
+  ASSERT_TRUE(shard_router::load_config({before_a, before_b}));
+  start(before_a, a);
+  start(before_b, b);
+  run();
+  std::vector<std::string> ids = create(a, 40);
+  std::sort(ids.begin(), ids.end());
+  stop();
+
+  // c joins: a and b come back with the same data and the longer list.
+  std::filesystem::copy(base / "join_a", base / "joined_a", std::filesystem::copy_options::recursive);
+  std::filesystem::copy(base / "join_b", base / "joined_b", std::filesystem::copy_options::recursive);
+  std::vector<std::string> nodes = {node(a), node(b), node(c)};
+  HandlerConfig after_a = config("joined_a", a, nodes);
+  HandlerConfig after_b = config("joined_b", b, nodes);
+  HandlerConfig after_c = config("joined_c", c, nodes);
+  ASSERT_TRUE(shard_router::load_config({after_a, after_b, after_c}));
+  start(after_a, a);
+  start(after_b, b);
+  start(after_c, c);
+  run();
+
+  std::shared_ptr<shard_router> router = shard_router::get_shared(after_c.root);
+  std::vector<std::string> on_c;
+  for (const auto& id : ids) {
+    if (router->owner("Books/" + id) == node(c)) {
+      on_c.push_back(id);
+    }
+  }
+  ASSERT_FALSE(on_c.empty());
+  EXPECT_TRUE(stored("joined_c").empty());
+
+  // Before anything has moved, c fetches what it is asked for from the
+  // entity's previous owner.
+  EXPECT_EQ(send(a, http::verb::get, "/api/Books/" + on_c[0]).result(), http::status::ok);
+  EXPECT_EQ(stored("joined_c"), std::vector<std::string>{on_c[0]});
+
+  // An entity that expires keeps its deadline when it moves.
+  ASSERT_GE(on_c.size(), 2u);
+  std::string expiring = on_c.back();
+  std::string holder = std::filesystem::exists(base / "joined_a" / "Books" / expiring) ? "joined_a" : "joined_b";
+  auto deadline_at = expiry_wheel::clock::now() + std::chrono::hours(1);
+  expiry_wheel::get_shared((base / holder).string())->set((base / holder / "Books" / expiring).string(), deadline_at);
+
+  // Then each node hands off what it no longer owns, in the background.
+  EXPECT_TRUE(router->taking_over());
+  ASSERT_TRUE(crud_handler::load_config({after_a, after_b, after_c}));
+  auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+  auto moved = [&]() {
+    return stored("joined_c") == on_c && stored("joined_a").size() + stored("joined_b").size() + on_c.size() == ids.size();
+  };
+  while (!moved() && std::chrono::steady_clock::now() < deadline) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+  }
+  EXPECT_EQ(stored("joined_c"), on_c);
+  EXPECT_EQ(stored("joined_a").size() + stored("joined_b").size() + on_c.size(), ids.size());
+  EXPECT_EQ(listed(send(b, http::verb::get, "/api/Books").body()), ids);
+  for (const auto& id : ids) {
+    EXPECT_EQ(send(c, http::verb::get, "/api/Books/" + id).result(), http::status::ok);
+  }
+  expiry_wheel::clock::time_point moved_deadline;
+  ASSERT_TRUE(expiry_wheel::get_shared(after_c.root)->deadline((base / "joined_c" / "Books" / expiring).string(), moved_deadline));
+  EXPECT_LE(moved_deadline, deadline_at + std::chrono::seconds(1));
+  EXPECT_GT(moved_deadline, deadline_at - std::chrono::seconds(30));
+
+  // Once every node reports it has handed off, missing entities are no
+  // longer looked for on their previous owner.
+  deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+  while (router->taking_over() && std::chrono::steady_clock::now() < deadline) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+  }
+  EXPECT_FALSE(router->taking_over());
+  http::response<http::string_body> status = send(c, http::verb::get, shard_router::status_target);
+  EXPECT_EQ(status.result(), http::status::ok);
+  EXPECT_NE(status.body().find("\"handed_off\": true"), std::string::npos);
+  EXPECT_NE(status.body().find("\"taking_over\": false"), std::string::npos);
+}
+
+TEST_F(ShardRouterTest, UnavailableNode) {
+  unsigned short a = free_port();
+  unsigned short down = free_port();
+  HandlerConfig config_a = config("down_a", a, {node(a), node(down)});
+  ASSERT_TRUE(shard_router::load_config({config_a}));
+  start(config_a, a);
+  run();
+
+  int unavailable = 0;
+  for (int i = 0; i < 20; i++) {
+    http::response<http::string_body> created = send(a, http::verb::post, "/api/Books", "{}");
+    if (created.result() == http::status::bad_gateway) {
+      EXPECT_EQ(created.body(), "Shard " + node(down) + " is unavailable");
+      unavailable++;
+    } else {
+      EXPECT_EQ(created.result(), http::status::created);
+    }
+  }
+  EXPECT_GT(unavailable, 0);
+  EXPECT_EQ(send(a, http::verb::get, "/api/Books").result(), http::status::bad_gateway);
+}
+
+TEST(ShardRouterConfigTest, LoadsConfig) {
+  auto sharded = [](const std::vector<std::string>& nodes, const std::vector<std::string>& self) {
+    HandlerConfig handler{"crud_handler", "/api", "./shard_config", {{"shard_nodes", nodes}}};
+    if (!self.empty()) {
+      handler.directives["shard_self"] = self;
+    }
+    return shard_router::load_config({handler});
+  };
+  EXPECT_FALSE(sharded({"127.0.0.1:8080", "127.0.0.1:8081"}, {}));
+  EXPECT_FALSE(sharded({"127.0.0.1:8080", "127.0.0.1:8081"}, {"127.0.0.1:8082"}));
+  EXPECT_FALSE(sharded({"127.0.0.1:8080", "127.0.0.1"}, {"127.0.0.1:8080"}));
+  EXPECT_FALSE(sharded({"127.0.0.1:8080", "127.0.0.1:99999"}, {"127.0.0.1:8080"}));
+  EXPECT_EQ(shard_router::get_shared("./shard_config"), nullptr);
+
+  HandlerConfig log{"crud_handler", "/api", "./shard_log",
+                    {{"shard_nodes", {"127.0.0.1:8080", "127.0.0.1:8081"}}, {"shard_self", {"127.0.0.1:8080"}}, {"storage", {"log"}}}};
+  EXPECT_FALSE(shard_router::load_config({log}));
+  EXPECT_EQ(shard_router::get_shared("./shard_log"), nullptr);
+
+  HandlerConfig plain{"crud_handler", "/api", "./plain", {}};
+  EXPECT_TRUE(shard_router::load_config({plain}));
+  EXPECT_EQ(shard_router::get_shared("./plain"), nullptr);
+
+  EXPECT_TRUE(sharded({"127.0.0.1:8080", "localhost:8081"}, {"127.0.0.1:8080"}));
+  std::shared_ptr<shard_router> router = shard_router::get_shared("./shard_config");
+  ASSERT_NE(router, nullptr);
+  EXPECT_EQ(router->self(), "127.0.0.1:8080");
+  EXPECT_EQ(router->peers(), std::vector<std::string>{"localhost:8081"});
+}
@@ -0,0 +1,229 @@
+#include <gtest/gtest.h>
+#include "snapshot_file_io.h"
+#include "config_parser.h"
+#include "file_io.h"
+#include "tar_archive.h"
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <future>
+#include <map>
+#include <sstream>
+#include <memory>
+#include <string>
+#include <vector>
+
+class SnapshotFileIoTest : public ::testing::Test {
+protected:
+  std::filesystem::path root = std::filesystem::temp_directory_path() / "snapshot_file_io_test";
+  std::shared_ptr<file_io> plain = std::make_shared<file_io>();
+  std::shared_ptr<snapshot_file_io::snapshot> state = std::make_shared<snapshot_file_io::snapshot>((root / "data").string());
+  std::shared_ptr<snapshot_file_io> files = std::make_shared<snapshot_file_io>(plain, state);
+
+  void SetUp() override {
+    std::filesystem::remove_all(root);
+    std::filesystem::create_directories(root / "data" / "Shoes");
+  }
+
+  void TearDown() override {
+    std::filesystem::remove_all(root);
+  }
+
+  std::string path(const std::string& id) {
+    return (root / "data" / "Shoes" / id).string();
+  }
+
+  void write(i_file_io& storage, const std::string& id, const std::string& data) {
+    ASSERT_TRUE(storage.open(path(id), std::ios::out | std::ios::trunc));
+    ASSERT_TRUE(storage.write(data));
+    storage.close();
+  }
+
+  std::string slurp(const std::string& path) {
+    std::ifstream in(path, std::ios::binary);
+    std::ostringstream contents;
+    contents << in.rdbuf();
+    return contents.str();
+  }
+
+  // Archives the open snapshot through storage and returns the archive.
+  std::string archive(snapshot_file_io::snapshot& snapshot, i_file_io& storage, size_t& count) {
+    std::string tar_path = (root / "archive.tar").string();
+    EXPECT_TRUE(snapshot.archive(storage, tar_path, count));
+    return slurp(tar_path);
+  }
+
+  std::map<std::string, std::string> unpack(const std::string& archive) {
+    std::map<std::string, std::string> unpacked;
+    EXPECT_TRUE(tar_archive::extract(archive, [&](const std::string& name, const std::string& content) {
+      unpacked[name] = content;
+      return true;
+    }));
+    return unpacked;
+  }
+};
+
+TEST_F(SnapshotFileIoTest, ArchivesEveryFile) {
+  write(*files, "1", "one");
+  write(*files, "2", "two");
+  std::filesystem::create_directories(root / "data" / ".wal");
+  std::ofstream(root / "data" / ".wal" / "log") << "hidden";
+  std::ofstream(root / "data" / "Shoes" / ".3.tmp") << "hidden";
+
+  ASSERT_TRUE(state->begin());
+  size_t count;
+  std::string tar = archive(*state, *files, count);
+  EXPECT_EQ(count, 2u);
+  EXPECT_EQ(unpack(tar), (std::map<std::string, std::string>{{"Shoes/1", "one"}, {"Shoes/2", "two"}}));
+  EXPECT_EQ(state->preserved(), 0u);
+}
+
+TEST_F(SnapshotFileIoTest, KeepsThePointInTime) {
+  write(*files, "1", "one");
+  write(*files, "2", "two");
+  write(*files, "3", "three");
+
+  ASSERT_TRUE(state->begin());
+  EXPECT_FALSE(state->begin());
+  write(*files, "1", "changed");
+  write(*files, "1", "changed again");
+  EXPECT_TRUE(files->delete_file(path("2")));
+  write(*files, "4", "created");
+  std::vector<bool> results;
+  files->write_batch({{path("3"), "batched"}}, results);
+  EXPECT_EQ(results, std::vector<bool>{true});
+  EXPECT_EQ(state->preserved(), 4u);
+
+  size_t count;
+  std::string tar = archive(*state, *files, count);
+  EXPECT_EQ(count, 3u);
+  EXPECT_EQ(unpack(tar), (std::map<std::string, std::string>{{"Shoes/1", "one"}, {"Shoes/2", "two"}, {"Shoes/3", "three"}}));
+
+  // The files themselves moved on, and the next backup sees them as they are.
+  std::string content;
+  ASSERT_TRUE(files->read(path("1"), content));
+  EXPECT_EQ(content, "changed again");
+  ASSERT_TRUE(state->begin());
+  tar = archive(*state, *files, count);
+  EXPECT_EQ(unpack(tar), (std::map<std::string, std::string>{
+                             {"Shoes/1", "changed again"}, {"Shoes/3", "batched"}, {"Shoes/4", "created"}}));
+}
+
+TEST_F(SnapshotFileIoTest, SpillsSavedCopiesPastTheLimit) {
+  auto small = std::make_shared<snapshot_file_io::snapshot>((root / "data").string(), 8);
+  snapshot_file_io spilling(plain, small);
+  write(spilling, "1", "four");
+  write(spilling, "2", "more than eight");
+  write(spilling, "3", "five!");
+
+  ASSERT_TRUE(small->begin());
+  write(spilling, "1", "changed");
+  write(spilling, "2", "changed");
+  write(spilling, "3", "changed");
+  EXPECT_EQ(small->preserved(), 3u);
+  // "four" fits in memory; the other two do not fit beside it.
+  EXPECT_EQ(small->spilled(), 2u);
+
+  size_t count;
+  std::string tar = archive(*small, spilling, count);
+  EXPECT_EQ(unpack(tar), (std::map<std::string, std::string>{
+                             {"Shoes/1", "four"}, {"Shoes/2", "more than eight"}, {"Shoes/3", "five!"}}));
+  // The spill files go with the snapshot.
+  EXPECT_TRUE(std::filesystem::is_empty(small->directory()));
+}
+
+TEST_F(SnapshotFileIoTest, SavesNothingOutsideABackup) {
+  write(*files, "1", "one");
+  EXPECT_TRUE(files->delete_file(path("1")));
+  EXPECT_EQ(state->preserved(), 0u);
+  EXPECT_FALSE(files->exists(path("1")));
+}
+
+TEST_F(SnapshotFileIoTest, RestoresArchives) {
+  write(*plain, "1", "one");
+  write(*plain, "2", "two");
+  ASSERT_TRUE(state->begin());
+  size_t count;
+  std::string tar = archive(*state, *plain, count);
+  std::ofstream(root / "backup.tar", std::ios::binary) << tar;
+
+  ASSERT_TRUE(snapshot_file_io::restore((root / "backup.tar").string(), (root / "restored").string(), *plain, count));
+  EXPECT_EQ(count, 2u);
+  std::string content;
+  ASSERT_TRUE(plain->read((root / "restored" / "Shoes" / "2").string(), content));
+  EXPECT_EQ(content, "two");
+
+  EXPECT_FALSE(snapshot_file_io::restore((root / "missing.tar").string(), (root / "restored").string(), *plain, count));
+  std::ofstream(root / "cut.tar", std::ios::binary) << tar.substr(0, 700);
+  EXPECT_FALSE(snapshot_file_io::restore((root / "cut.tar").string(), (root / "restored").string(), *plain, count));
+}
+
+TEST_F(SnapshotFileIoTest, LoadsConfig) {
+  write(*plain, "1", "one");
+  ASSERT_TRUE(state->begin());
+  size_t count;
+  std::string tar = archive(*state, *plain, count);
+  std::ofstream(root / "backup.tar", std::ios::binary) << tar;
+  std::string archive = (root / "backup.tar").string();
+
+  HandlerConfig crud{"crud_handler", "/api", (root / "crud").string(), {{"backup", {"on"}}, {"restore_from", {archive}}}};
+  HandlerConfig markdown{"markdown_handler", "/markdown", (root / "markdown").string(), {{"backup", {"off"}}}};
+  ASSERT_TRUE(snapshot_file_io::load_config({crud, markdown}));
+  EXPECT_NE(snapshot_file_io::get_shared(crud.root), nullptr);
+  EXPECT_EQ(snapshot_file_io::get_shared(markdown.root), nullptr);
+  EXPECT_NE(std::dynamic_pointer_cast<snapshot_file_io>(snapshot_file_io::wrap(crud, plain)), nullptr);
+  EXPECT_EQ(snapshot_file_io::wrap(markdown, plain), plain);
+  std::string content;
+  ASSERT_TRUE(plain->read((root / "crud" / "Shoes" / "1").string(), content));
+  EXPECT_EQ(content, "one");
+
+  // A location that already has data is left alone.
+  write(*plain, "1", "newer");
+  HandlerConfig existing{"crud_handler", "/api", (root / "data").string(), {{"restore_from", {archive}}}};
+  EXPECT_TRUE(snapshot_file_io::load_config({existing}));
+  ASSERT_TRUE(plain->read(path("1"), content));
+  EXPECT_EQ(content, "newer");
+
+  HandlerConfig unknown{"crud_handler", "/api", (root / "a").string(), {{"backup", {"daily"}}}};
+  HandlerConfig log{"crud_handler", "/api", (root / "b").string(), {{"backup", {"on"}}, {"storage", {"log"}}}};
+  HandlerConfig async{"markdown_handler", "/markdown", (root / "c").string(), {{"backup", {"on"}}, {"async_io", {"on"}}}};
+  HandlerConfig unreadable{"crud_handler", "/api", (root / "d").string(), {{"restore_from", {(root / "missing.tar").string()}}}};
+  EXPECT_FALSE(snapshot_file_io::load_config({unknown}));
+  EXPECT_FALSE(snapshot_file_io::load_config({log}));
+  EXPECT_FALSE(snapshot_file_io::load_config({async}));
+  EXPECT_FALSE(snapshot_file_io::load_config({unreadable}));
+}
+
+TEST_F(SnapshotFileIoTest, AnswersBackups) {
+  HandlerConfig config{"crud_handler", "/api", (root / "data").string(), {{"backup", {"on"}}}};
+  ASSERT_TRUE(snapshot_file_io::load_config({config}));
+  std::shared_ptr<i_file_io> storage = snapshot_file_io::wrap(config, plain);
+  write(*storage, "1", "one");
+
+  std::promise<http::response<http::string_body>> answered;
+  ASSERT_TRUE(snapshot_file_io::answer_backup(config.root, storage, [&](http::response<http::string_body> response) {
+    answered.set_value(std::move(response));
+  }));
+  std::future<http::response<http::string_body>> future = answered.get_future();
+  ASSERT_EQ(future.wait_for(std::chrono::seconds(10)), std::future_status::ready);
+  http::response<http::string_body> response = future.get();
+  EXPECT_EQ(response.result(), http::status::ok);
+  EXPECT_EQ(response[http::field::content_type], "application/x-tar");
+  EXPECT_EQ(response["X-Backup-Files"], "1");
+  // The archive is spooled to a hidden file for the session to stream.
+  std::string spooled = std::string(response[request_handler::spooled_body_header]);
+  EXPECT_EQ(std::filesystem::path(spooled).parent_path(), root / "data" / ".backup");
+  EXPECT_TRUE(response.body().empty());
+  EXPECT_EQ(unpack(slurp(spooled)), (std::map<std::string, std::string>{{"Shoes/1", "one"}}));
+
+  // One backup of a location at a time.
+  std::shared_ptr<snapshot_file_io::snapshot> shared = snapshot_file_io::get_shared(config.root);
+  ASSERT_TRUE(shared->begin());
+  ASSERT_TRUE(snapshot_file_io::answer_backup(config.root, storage, [&](http::response<http::string_body> response) {
+    EXPECT_EQ(response.result(), http::status::conflict);
+  }));
+  size_t count;
+  archive(*shared, *storage, count);
+
+  EXPECT_FALSE(snapshot_file_io::answer_backup((root / "elsewhere").string(), storage, [](http::response<http::string_body>) {}));
+}
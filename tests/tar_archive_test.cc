@@ -0,0 +1,105 @@
+#include <gtest/gtest.h>
+#include "tar_archive.h"
+#include <cstdio>
+#include <map>
+#include <string>
+
+namespace {
+
+std::map<std::string, std::string> unpack(const std::string& archive, bool& ok) {
+  std::map<std::string, std::string> files;
+  ok = tar_archive::extract(archive, [&](const std::string& name, const std::string& content) {
+    files[name] = content;
+    return true;
+  });
+  return files;
+}
+
+}
+
+TEST(TarArchiveTest, RoundTripsFiles) {
+  std::string archive;
+  ASSERT_TRUE(tar_archive::append("Shoes/1", "{\"size\": 9}", 1700000000, archive));
+  ASSERT_TRUE(tar_archive::append("Shoes/empty", "", 1700000000, archive));
+  ASSERT_TRUE(tar_archive::append("Hats/2", std::string(1000, 'h'), 1700000000, archive));
+  tar_archive::finish(archive);
+  EXPECT_EQ(archive.size() % 512, 0u);
+
+  bool ok;
+  std::map<std::string, std::string> files = unpack(archive, ok);
+  EXPECT_TRUE(ok);
+  EXPECT_EQ(files, (std::map<std::string, std::string>{
+                       {"Shoes/1", "{\"size\": 9}"}, {"Shoes/empty", ""}, {"Hats/2", std::string(1000, 'h')}}));
+}
+
+TEST(TarArchiveTest, WritesUstarHeaders) {
+  std::string archive;
+  ASSERT_TRUE(tar_archive::append("Shoes/1", "abc", 8, archive));
+  EXPECT_EQ(archive.substr(0, 8), std::string("Shoes/1\0", 8));
+  EXPECT_EQ(archive.substr(124, 12), std::string("00000000003\0", 12));
+  EXPECT_EQ(archive.substr(136, 12), std::string("00000000010\0", 12));
+  EXPECT_EQ(archive[156], '0');
+  EXPECT_EQ(archive.substr(257, 8), std::string("ustar\0" "00", 8));
+  EXPECT_EQ(archive.substr(512, 3), "abc");
+}
+
+TEST(TarArchiveTest, SplitsLongNames) {
+  std::string name = std::string(120, 'd') + "/" + std::string(90, 'f');
+  std::string archive;
+  ASSERT_TRUE(tar_archive::append(name, "x", 0, archive));
+  tar_archive::finish(archive);
+  bool ok;
+  std::map<std::string, std::string> files = unpack(archive, ok);
+  EXPECT_TRUE(ok);
+  EXPECT_EQ(files, (std::map<std::string, std::string>{{name, "x"}}));
+
+  EXPECT_FALSE(tar_archive::append(std::string(101, 'f'), "x", 0, archive));
+  EXPECT_FALSE(tar_archive::append(std::string(200, 'd') + "/f", "x", 0, archive));
+}
+
+TEST(TarArchiveTest, RefusesUnsafeNames) {
+  std::string archive;
+  EXPECT_FALSE(tar_archive::append("", "x", 0, archive));
+  EXPECT_FALSE(tar_archive::append("/etc/passwd", "x", 0, archive));
+  EXPECT_FALSE(tar_archive::append("Shoes/../../escape", "x", 0, archive));
+  EXPECT_TRUE(archive.empty());
+  EXPECT_TRUE(tar_archive::safe_name("Shoes/1"));
+  EXPECT_TRUE(tar_archive::safe_name("Shoes/..1"));
+}
+
+TEST(TarArchiveTest, RejectsDamagedArchives) {
+  std::string archive;
+  ASSERT_TRUE(tar_archive::append("Shoes/1", "abc", 0, archive));
+  tar_archive::finish(archive);
+  bool ok;
+
+  std::string corrupted = archive;
+  corrupted[3] = 'X';
+  unpack(corrupted, ok);
+  EXPECT_FALSE(ok);
+
+  unpack(archive.substr(0, 512), ok);
+  EXPECT_FALSE(ok);
+
+  EXPECT_FALSE(tar_archive::extract(archive, [](const std::string&, const std::string&) { return false; }));
+}
+
+TEST(TarArchiveTest, SkipsOtherEntries) {
+  std::string archive;
+  ASSERT_TRUE(tar_archive::append("Shoes/", "", 0, archive));
+  // Turn it into a directory entry, and fix up the checksum.
+  archive[156] = '5';
+  unsigned sum = 0;
+  for (size_t i = 0; i < 512; i++) {
+    sum += i >= 148 && i < 156 ? ' ' : static_cast<unsigned char>(archive[i]);
+  }
+  std::snprintf(&archive[148], 8, "%06o", sum);
+  archive[155] = ' ';
+  ASSERT_TRUE(tar_archive::append("Shoes/1", "abc", 0, archive));
+  tar_archive::finish(archive);
+
+  bool ok;
+  std::map<std::string, std::string> files = unpack(archive, ok);
+  EXPECT_TRUE(ok);
+  EXPECT_EQ(files, (std::map<std::string, std::string>{{"Shoes/1", "abc"}}));
+}
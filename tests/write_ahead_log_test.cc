@@ -0,0 +1,238 @@
+#include <gtest/gtest.h>
+#include "write_ahead_log.h"
+#include "durable_file_io.h"
+#include "config_parser.h"
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+class WriteAheadLogTest : public ::testing::Test {
+protected:
+  std::filesystem::path root = std::filesystem::temp_directory_path() / "write_ahead_log_test";
+  std::string log_path = (root / "wal.log").string();
+
+  void SetUp() override {
+    std::filesystem::remove_all(root);
+    std::filesystem::create_directories(root);
+  }
+
+  void TearDown() override {
+    std::filesystem::remove_all(root);
+  }
+
+  std::vector<std::string> replay(write_ahead_log& wal) {
+    std::vector<std::string> records;
+    EXPECT_TRUE(wal.replay([&records](const std::string& payload) { records.push_back(payload); }));
+    return records;
+  }
+
+  std::string contents(const std::filesystem::path& path) {
+    std::ifstream file(path);
+    std::stringstream buffer;
+    buffer << file.rdbuf();
+    return buffer.str();
+  }
+};
+
+TEST_F(WriteAheadLogTest, CommitsAndReplays) {
+  {
+    write_ahead_log wal(log_path);
+    int applied = 0;
+    ASSERT_TRUE(wal.commit("first", [&applied]() { applied++; return true; }));
+    ASSERT_TRUE(wal.commit("second", [&applied]() { applied++; return true; }));
+    EXPECT_EQ(applied, 2);
+    EXPECT_EQ(wal.commits(), 2);
+    EXPECT_EQ(wal.fsyncs(), 2);
+  }
+  write_ahead_log wal(log_path);
+  EXPECT_EQ(replay(wal), (std::vector<std::string>{"first", "second"}));
+}
+
+TEST_F(WriteAheadLogTest, ApplyFailureIsReported) {
+  write_ahead_log wal(log_path);
+  EXPECT_FALSE(wal.commit("record", []() { return false; }));
+}
+
+TEST_F(WriteAheadLogTest, TornTailIsDropped) {
+  {
+    write_ahead_log wal(log_path);
+    wal.commit("first", []() { return true; });
+    wal.commit("second", []() { return true; });
+  }
+  std::filesystem::resize_file(log_path, std::filesystem::file_size(log_path) - 3);
+  {
+    write_ahead_log wal(log_path);
+    EXPECT_EQ(replay(wal), std::vector<std::string>{"first"});
+    wal.commit("third", []() { return true; });
+  }
+  write_ahead_log wal(log_path);
+  EXPECT_EQ(replay(wal), (std::vector<std::string>{"first", "third"}));
+}
+
+TEST_F(WriteAheadLogTest, CheckpointEmptiesLog) {
+  write_ahead_log wal(log_path);
+  wal.commit("record", []() { return true; });
+  EXPECT_GT(wal.size(), 0);
+
+  EXPECT_FALSE(wal.checkpoint([]() { return false; }));
+  EXPECT_GT(wal.size(), 0);
+
+  bool flushed = false;
+  EXPECT_TRUE(wal.checkpoint([&flushed]() { flushed = true; return true; }));
+  EXPECT_TRUE(flushed);
+  EXPECT_EQ(wal.size(), 0);
+  EXPECT_TRUE(replay(wal).empty());
+}
+
+TEST_F(WriteAheadLogTest, AutomaticCheckpoint) {
+  write_ahead_log wal(log_path);
+  int flushes = 0;
+  wal.set_checkpoint(100, [&flushes]() { flushes++; return true; });
+  for (int i = 0; i < 20; i++) {
+    wal.commit(std::string(20, 'x'), []() { return true; });
+  }
+  EXPECT_GT(flushes, 0);
+  EXPECT_LT(wal.size(), 100);
+}
+
+TEST_F(WriteAheadLogTest, ReportsMetricsUntilDestroyed) {
+  auto start = std::chrono::steady_clock::now();
+  {
+    write_ahead_log wal(log_path);
+    wal.report_metrics(std::chrono::milliseconds(5));
+    // Already reporting, so this starts no second thread.
+    wal.report_metrics(std::chrono::hours(1));
+    ASSERT_TRUE(wal.commit("a", []() { return true; }));
+    std::this_thread::sleep_for(std::chrono::milliseconds(30));
+    EXPECT_EQ(wal.commits(), 1u);
+  }
+  // The reporter wakes to stop rather than waiting out its interval.
+  EXPECT_LT(std::chrono::steady_clock::now() - start, std::chrono::seconds(5));
+
+  write_ahead_log idle(log_path);
+  idle.report_metrics(std::chrono::hours(1));
+}
+
+TEST_F(WriteAheadLogTest, GroupCommitBatchesConcurrentWriters) {
+  write_ahead_log wal(log_path);
+  const int threads = 8;
+  const int per_thread = 50;
+  std::vector<std::thread> writers;
+  for (int t = 0; t < threads; t++) {
+    writers.emplace_back([&wal, t]() {
+      for (int i = 0; i < per_thread; i++) {
+        ASSERT_TRUE(wal.commit(std::to_string(t) + ":" + std::to_string(i), []() { return true; }));
+      }
+    });
+  }
+  for (auto& writer : writers) {
+    writer.join();
+  }
+
+  EXPECT_EQ(wal.commits(), threads * per_thread);
+  EXPECT_LE(wal.fsyncs(), wal.commits());
+  EXPECT_EQ(wal.batch_sizes().count(), wal.fsyncs());
+  EXPECT_EQ(wal.commit_latency_us().count(), wal.commits());
+  EXPECT_EQ(replay(wal).size(), threads * per_thread);
+}
+
+TEST(Log2HistogramTest, Percentiles) {
+  log2_histogram histogram;
+  EXPECT_EQ(histogram.percentile(50), 0);
+  for (int i = 1; i <= 100; i++) {
+    histogram.record(i);
+  }
+  EXPECT_EQ(histogram.count(), 100);
+  EXPECT_EQ(histogram.max(), 100);
+  EXPECT_EQ(histogram.percentile(50), 63);
+  EXPECT_EQ(histogram.percentile(99), 100);
+  EXPECT_EQ(histogram.summary(), "count=100 p50=63 p90=100 p99=100 max=100");
+}
+
+TEST_F(WriteAheadLogTest, DurableFileWritesAndDeletes) {
+  std::string data = (root / "data").string();
+  auto wal = durable_file_io::get_shared_log(data);
+  ASSERT_NE(wal, nullptr);
+  durable_file_io io(wal, data);
+
+  std::string path = (root / "data" / "shoes" / "1").string();
+  io.create_directories((root / "data" / "shoes").string());
+  ASSERT_TRUE(io.open(path, std::ios::out | std::ios::trunc));
+  ASSERT_TRUE(io.write("{\"a\": 1}"));
+  io.close();
+  EXPECT_EQ(contents(path), "{\"a\": 1}");
+
+  ASSERT_TRUE(io.open(path, std::ios::out | std::ios::trunc));
+  ASSERT_TRUE(io.write("{\"a\": 2}"));
+  io.close();
+  EXPECT_EQ(contents(path), "{\"a\": 2}");
+
+  // Temporary files never show up next to entities.
+  std::vector<std::string> ids;
+  ASSERT_TRUE(io.list_directories((root / "data" / "shoes").string(), ids));
+  EXPECT_EQ(ids, std::vector<std::string>{"1"});
+
+  EXPECT_TRUE(io.delete_file(path));
+  EXPECT_FALSE(io.exists(path));
+  EXPECT_FALSE(io.delete_file(path));
+}
+
+TEST_F(WriteAheadLogTest, DurableFileRecoversLoggedWrites) {
+  std::string data = (root / "recover").string();
+  std::filesystem::create_directories(std::filesystem::path(data) / ".wal");
+  {
+    // Simulate a crash after the log write but before the rename.
+    write_ahead_log wal((std::filesystem::path(data) / ".wal" / "wal.log").string());
+    std::string path = (std::filesystem::path(data) / "shoes" / "7").string();
+    std::string payload = std::string("P") + std::string(4, '\0') + path + "{\"b\": 7}";
+    std::uint32_t length = path.size();
+    std::memcpy(&payload[1], &length, 4);
+    ASSERT_TRUE(wal.commit(payload, []() { return true; }));
+  }
+
+  auto wal = durable_file_io::get_shared_log(data);
+  ASSERT_NE(wal, nullptr);
+  EXPECT_EQ(contents(std::filesystem::path(data) / "shoes" / "7"), "{\"b\": 7}");
+  EXPECT_EQ(wal->size(), 0);
+}
+
+TEST_F(WriteAheadLogTest, DurableFileWriteBatch) {
+  std::string data = (root / "batch").string();
+  auto wal = durable_file_io::get_shared_log(data);
+  ASSERT_NE(wal, nullptr);
+  durable_file_io io(wal, data);
+  std::filesystem::path shoes = std::filesystem::path(data) / "shoes";
+
+  std::vector<i_file_io::batch_op> ops = {
+    {(shoes / "1").string(), "one"},
+    {(shoes / "2").string(), "two"},
+    {(shoes / "3").string(), "", true},  // does not exist
+    {(shoes / "1").string(), "", true},
+  };
+  std::vector<bool> results;
+  std::uint64_t fsyncs = wal->fsyncs();
+  io.write_batch(ops, results);
+  EXPECT_EQ(results, (std::vector<bool>{true, true, false, true}));
+  EXPECT_EQ(wal->fsyncs(), fsyncs + 1);
+  EXPECT_FALSE(io.exists((shoes / "1").string()));
+  EXPECT_EQ(contents(shoes / "2"), "two");
+}
+
+TEST_F(WriteAheadLogTest, LoadConfig) {
+  HandlerConfig config = {"crud_handler", "/api", (root / "config").string()};
+  config.directives["durable"] = {"on"};
+  EXPECT_TRUE(durable_file_io::load_config({config}));
+  config.directives["durable"] = {"off"};
+  EXPECT_TRUE(durable_file_io::load_config({config}));
+  config.directives["durable"] = {"maybe"};
+  EXPECT_FALSE(durable_file_io::load_config({config}));
+  config.directives["durable"] = {"on"};
+  config.directives["storage"] = {"log"};
+  EXPECT_FALSE(durable_file_io::load_config({config}));
+}